@@ -10,16 +10,30 @@
 #include "stdlib.h"
 #include "ac_app.h"
 #include "sm_alarm.h"
+#include "alarm_rules.h"
+#include "history.h"
 #include "SIM800L.h"
 #include "stm32_lib_usart.h"
 #include "parser.h"
 #include "timsys.h"
+#include "supervisor.h"
+#include "restart.h"
+#include "msgpool.h"
+#include "libfmt.h"
+#include "telemetry.h"
 
 #define MAX_SCHEDULER 			32  	// Si possono schedulare un massimo di 32 comandi consecutivi
 #define MAX_PHONEBOOK_ENTRY 	3   	// NON CAMBIARE !!! IN CASO CONTRARIO MODIFICARE IL COMANDO => [AT_READ_PHONEBOOK] = "AT+CPBR=1,3\n",
-#define AT_DELAY                200 	// [msec] attesa dopo il completamento di un comando AT
 #define GSM_STARTING_DELAY      1000
 
+#define AT_ARG_NUM				0x01	// il comando contiene gsm.at_num
+#define AT_ARG_STR				0x02	// il comando contiene gsm.at_str, dopo at_num e il separatore
+
+#define AT_FRAGMENT(s)			(s), (sizeof(s) - 1)	// frammento costante e la sua lunghezza, calcolata in compilazione
+#define AT_FIXED(s)				{ AT_FRAGMENT(s), 0, AT_FRAGMENT(""), AT_FRAGMENT("") }
+#define AT_ARGS(p, a, m, s)		{ AT_FRAGMENT(p), (a), AT_FRAGMENT(m), AT_FRAGMENT(s) }
+#define AT_NONE					{ NULL, 0, 0, NULL, 0, NULL, 0 }		// comando dello scheduler, non inviato al modem
+
 typedef enum {
 
 	AT_WRITE_PHONEBOOK_ENTRY = 0,
@@ -57,6 +71,9 @@ typedef enum {
 	AT_COPS,
 	AT_CSQ,
 	AT_SMSDEL,
+	AT_REPORT_SMS,
+	AT_IPR,
+	AT_IFC,
     AT_MAX_ID,
 
 } ATCommand_ID_TypeDef;
@@ -73,6 +90,38 @@ typedef struct {
 
 } ATCommandData_TypeDef;
 
+/**
+ * @struct
+ * @brief comando AT: prefisso, [at_num], separatore, [at_str], suffisso. I frammenti sono costanti con la lunghezza
+ *        calcolata in compilazione, gli argomenti sono quelli del comando corrente
+ *
+ */
+typedef struct {
+
+	const char *prefix;
+	uint8_t     prefix_len;
+	uint8_t     args;			// AT_ARG_NUM | AT_ARG_STR
+	const char *sep;
+	uint8_t     sep_len;
+	const char *suffix;
+	uint8_t     suffix_len;
+
+} ATCommand_TypeDef;
+
+/**
+ * @enum
+ * @brief fase del collegamento seriale col modulo in GSM_WAITING_FOR_READY
+ *
+ */
+typedef enum {
+
+	LINK_SYNC = 0,	// AT alla velocità corrente fino alla risposta, poi le altre velocità (autobaud del modulo)
+	LINK_READY,		// sincronizzato: attesa di SMS Ready
+	LINK_SET,		// AT+IPR inviato alla velocità corrente: attesa di OK
+	LINK_VERIFY,	// huart1 riprogrammata: AT alla nuova velocità
+
+} GSMLink_TypeDef;
+
 /**
  * @struct
  * @brief
@@ -85,6 +134,7 @@ typedef struct {
 	char    clipnumber[MAX_NUM_LENGTH];
 
 	uint8_t signal;		// gsm signal strength
+	uint8_t configured;	// coda di inizializzazione completata
 	uint8_t call_entry;	// phonebook entry of outgoing call
     uint8_t ring;
     uint8_t battCharge;
@@ -94,9 +144,11 @@ typedef struct {
 	int8_t fifo_items;  // scheduler items
 	int8_t fifo_head;
 
-	SMS_TypeDef sms[MAX_PHONEBOOK_ENTRY];
+	SMS_TypeDef *tx;      // SMS in trasmissione: blocco del pool di proprietà della trasmissione
+	char        *tx_line; // prossima linea dell'SMS da inviare al prompt
 
-	char at_cmd[MAX_AT_LENGTH];
+	uint32_t at_num;					// argomenti del comando corrente (command), copiati all'invio:
+	char    at_str[MAX_NUM_LENGTH];		// nessun buffer condiviso tra comandi diversi
 
 	ATCommandData_TypeDef  scheduler[MAX_SCHEDULER];
 
@@ -104,6 +156,16 @@ typedef struct {
 
 	ATCommand_ID_TypeDef   command; // last at command id sent
 
+	GSMLink_TypeDef link;			// fase del collegamento durante GSM_WAITING_FOR_READY
+	uint8_t  link_tries;			// AT senza risposta alla velocità corrente
+	uint8_t  link_rate;				// prossima velocità della tabella da provare
+	uint8_t  link_pending;			// comando inviato, in attesa della risposta
+	uint8_t  link_ready;			// SMS Ready ricevuto
+	uint8_t  link_failed;			// negoziazione fallita: resta alla velocità sincronizzata fino al prossimo avvio
+	uint32_t link_time;				// invio dell'ultimo comando
+	uint32_t baud;					// velocità a cui il modulo risponde, 0 se non nota
+	uint32_t baud_prev;				// velocità precedente AT+IPR, per il ripiego
+
 	GSMStatus_TypeDef      status;
 
 } GSM_TypeDef;
@@ -112,48 +174,59 @@ typedef struct {
 
 static char ctrlz = 0x1A;
 
-static char sms[MAX_SMS_LENGTH + 1];
-
-static char *atcommands[AT_MAX_ID] = {
-
-	[AT_WRITE_PHONEBOOK_ENTRY] = NULL,
-	[AT_DEL_PHONEBOOK_ENTRY	 ] = NULL,
-	[AT_READ_PHONEBOOK 		 ] = "AT+CPBR=1,3\n",
-	[AT_CALL_PHONEBOOK_ENTRY ] = NULL,
-	[AT_CALL_PHONENUMBER     ] = NULL,
-	[AT_SMS_READ_ENTRY		 ] = NULL,
-	[AT_SMS_DEL_ENTRY    	 ] = NULL,
-	[AT_SMS     			 ] = NULL,
-	[AT_SMS_GET_PARAMS		 ] = NULL,
-	[AT_HANG_UP 			 ] = "ATH\n",
-	[AT_ANSWER 			     ] = "ATA\n",
-	[AT_DTMF_ENABLE			 ] = "AT+DDET=1\n",
-	[AT_SMS_TEXT_MODE	     ] = "AT+CMGF=1\n",
-	[AT_DTMF_SHARP	         ] = "AT+VTS=\"#\"\n",
-	[AT_DTMF_STAR            ] = "AT+VTS=\"*,*,*\"\n",
-	[AT_DTMF_DURATION        ] = "AT+VTD=10\n",
-	[AT_CLIP                 ] = "AT+CLIP=1\n",
-	[AT_CBC                  ] = "AT+CBC\n",
-	[AT_NOECHO               ] = "ATE0\n",
-	[AT_CGATT                ] = "AT+CGATT=0\n",
-	[AT_MORING				 ] = "AT+MORING=0\n",  	// OUTGOING CALLS UNSOLICITED RING/CONNECTED MESSAGE
-	[AT_CALM				 ] = "AT+CALM=1\n",    	// ALARM SOUND OFF
-	[AT_MUT					 ] = "AT+CMUT=1\n",    	// MUTE ON (NON FUNZIONA)
-	[AT_CRSL				 ] = "AT+CRSL=0\n",     // RING LEVEL TO 0
-	[AT_LVL					 ] = "AT+CLVL=0\n",   	// LOUDSPEAKER SOUND LEVEL TO 0
-	[AT_CMIC0     			 ] = "AT+CMIC=0,0\n",   // LOUDSPEAKER SOUND LEVEL TO 0
-	[AT_CMIC1     			 ] = "AT+CMIC=1,0\n",   // LOUDSPEAKER SOUND LEVEL TO 0
-	[AT_CMIC2     			 ] = "AT+CMIC=2,0\n",   // LOUDSPEAKER SOUND LEVEL TO 0
-	[AT_CMIC3    			 ] = "AT+CMIC=3,0\n",   // LOUDSPEAKER SOUND LEVEL TO 0
-	[AT_AT    	     		 ] = "AT\n",            // LOUDSPEAKER SOUND LEVEL TO 0
-	[AT_WELCOME_SMS          ] = NULL,
-	[AT_IMEI                 ] = "AT+CGSN\n",
-	[AT_COPS                 ] = "AT+COPS?\n",
-	[AT_CSQ                  ] = "AT+CSQ\n",
-	[AT_SMSDEL               ] = "AT+CMGD=1,4\n",
+_Static_assert(sizeof(SMS_TypeDef) <= MSGPOOL_BLOCK_SIZE, "SMS_TypeDef non entra in un blocco del pool dei messaggi");
+
+static const ATCommand_TypeDef atcommands[AT_MAX_ID] = {
+
+	[AT_WRITE_PHONEBOOK_ENTRY] = AT_ARGS("AT+CPBW=", AT_ARG_NUM | AT_ARG_STR, ",\"", "\"\n"),  // AT+CPBW=<entry>,"<number>"
+	[AT_DEL_PHONEBOOK_ENTRY	 ] = AT_ARGS("AT+CPBW=", AT_ARG_NUM, "", "\n"),                    // AT+CPBW=<entry>
+	[AT_READ_PHONEBOOK 		 ] = AT_FIXED("AT+CPBR=1,3\n"),
+	[AT_CALL_PHONEBOOK_ENTRY ] = AT_ARGS("atd", AT_ARG_STR, "", ";\n"),                        // atd<number>;
+	[AT_CALL_PHONENUMBER     ] = AT_NONE,
+	[AT_SMS_READ_ENTRY		 ] = AT_NONE,
+	[AT_SMS_DEL_ENTRY    	 ] = AT_NONE,
+	[AT_SMS     			 ] = AT_ARGS("AT+CMGS=\"", AT_ARG_STR, "", "\"\r\n"),               // AT+CMGS="<number>"
+	[AT_SMS_GET_PARAMS		 ] = AT_NONE,
+	[AT_HANG_UP 			 ] = AT_FIXED("ATH\n"),
+	[AT_ANSWER 			     ] = AT_FIXED("ATA\n"),
+	[AT_DTMF_ENABLE			 ] = AT_FIXED("AT+DDET=1\n"),
+	[AT_SMS_TEXT_MODE	     ] = AT_FIXED("AT+CMGF=1\n"),
+	[AT_DTMF_SHARP	         ] = AT_FIXED("AT+VTS=\"#\"\n"),
+	[AT_DTMF_STAR            ] = AT_FIXED("AT+VTS=\"*,*,*\"\n"),
+	[AT_DTMF_DURATION        ] = AT_FIXED("AT+VTD=10\n"),
+	[AT_CLIP                 ] = AT_FIXED("AT+CLIP=1\n"),
+	[AT_CBC                  ] = AT_FIXED("AT+CBC\n"),
+	[AT_NOECHO               ] = AT_FIXED("ATE0\n"),
+	[AT_CGATT                ] = AT_FIXED("AT+CGATT=0\n"),
+	[AT_MORING				 ] = AT_FIXED("AT+MORING=0\n"),  	// OUTGOING CALLS UNSOLICITED RING/CONNECTED MESSAGE
+	[AT_CALM				 ] = AT_FIXED("AT+CALM=1\n"),    	// ALARM SOUND OFF
+	[AT_MUT					 ] = AT_FIXED("AT+CMUT=1\n"),    	// MUTE ON (NON FUNZIONA)
+	[AT_CRSL				 ] = AT_FIXED("AT+CRSL=0\n"),     // RING LEVEL TO 0
+	[AT_LVL					 ] = AT_FIXED("AT+CLVL=0\n"),   	// LOUDSPEAKER SOUND LEVEL TO 0
+	[AT_CMIC0     			 ] = AT_FIXED("AT+CMIC=0,0\n"),   // LOUDSPEAKER SOUND LEVEL TO 0
+	[AT_CMIC1     			 ] = AT_FIXED("AT+CMIC=1,0\n"),   // LOUDSPEAKER SOUND LEVEL TO 0
+	[AT_CMIC2     			 ] = AT_FIXED("AT+CMIC=2,0\n"),   // LOUDSPEAKER SOUND LEVEL TO 0
+	[AT_CMIC3    			 ] = AT_FIXED("AT+CMIC=3,0\n"),   // LOUDSPEAKER SOUND LEVEL TO 0
+	[AT_AT    	     		 ] = AT_FIXED("AT\n"),            // LOUDSPEAKER SOUND LEVEL TO 0
+	[AT_WELCOME_SMS          ] = AT_NONE,
+	[AT_IMEI                 ] = AT_FIXED("AT+CGSN\n"),
+	[AT_COPS                 ] = AT_FIXED("AT+COPS?\n"),
+	[AT_CSQ                  ] = AT_FIXED("AT+CSQ\n"),
+	[AT_SMSDEL               ] = AT_FIXED("AT+CMGD=1,4\n"),
+	[AT_REPORT_SMS           ] = AT_NONE,
+	[AT_IFC                  ] = AT_FIXED("AT+IFC=2,2\n"),  // RTS/CTS: il modulo rispetta RTS e pilota CTS
+	[AT_IPR                  ] = AT_ARGS("AT+IPR=", AT_ARG_NUM, "", ";&W\n"),  // AT+IPR=<baud>;&W: velocità fissa, salvata nel modulo
+
+};
 
+static const uint32_t linkrates[] = { // velocità provate in sincronizzazione, a partire dalla più probabile
+	GSM_BAUD_NEGOTIATE ? GSM_BAUD_TARGET : GSM_BAUD_DEFAULT, GSM_BAUD_DEFAULT, 57600, 38400, 19200
 };
 
+#define LINK_RATES (sizeof(linkrates) / sizeof(linkrates[0]))
+
+static TimSys_Task_TypeDef gsm_task; // task dello scheduler: periodico e segnalato dalla ricezione dal modem
+
 static GSM_TypeDef gsm = {.fifo_items = 0, .fifo_head = 0, .status = GSM_WAITING_FOR_READY, .call_entry = 0, .ring = 0, };
 
 /**
@@ -284,13 +357,113 @@ static int8_t SIM800L_Scheduler_Pop(ATCommandData_TypeDef *item)
 }
 
 /**
- * @fn void SIM800L_Init(void)
- * @brief
+ * @fn void SIM800L_Scheduler_Flush(void)
+ * @brief svuota lo scheduler rilasciando gli SMS in coda
+ *
+ */
+static void SIM800L_Scheduler_Flush(void)
+{
+	ATCommandData_TypeDef item;
+
+	while (SIM800L_Scheduler_Pop(&item))
+	{
+		if (item.id == AT_SMS || item.id == AT_SMS_GET_PARAMS || item.id == AT_REPORT_SMS)
+		{
+			MsgPool_Free(item.data);
+		}
+	}
+}
+
+/**
+ * @fn SMS_TypeDef SMS_Alloc*(const char*)
+ * @brief prende dal pool dei messaggi un SMS vuoto indirizzato a num
  *
+ * @param num numero del destinatario
+ * @return SMS, NULL se il pool è esaurito (l'SMS non viene inviato)
  */
-void SIM800L_Init(void)
+static SMS_TypeDef *SMS_Alloc(const char *num)
+{
+	SMS_TypeDef *sms = MsgPool_Alloc(MSG_SMS_BUILD);
+
+	if (sms)
+	{
+		memset(sms, 0, sizeof(*sms));
+
+		strncpy(sms->num, num, MAX_NUM_LENGTH - 1);
+	}
+
+	return sms;
+}
+
+/**
+ * @fn void ReleaseTx(void)
+ * @brief fine della trasmissione dell'SMS: rilascia il blocco al pool
+ *
+ */
+static void ReleaseTx(void)
+{
+	MsgPool_Free(gsm.tx);
+
+	gsm.tx      = NULL;
+	gsm.tx_line = NULL;
+}
+
+/**
+ * @fn const char CallerNumber*(void)
+ * @brief numero dell'interlocutore della chiamata in corso: il chiamante per una chiamata entrante, la voce della
+ *        rubrica chiamata per una chiamata uscente
+ */
+static const char *CallerNumber(void)
+{
+	if (gsm.status == GSM_CALL_ANSWERED)
+	{
+		return SIM800L_GetClipNumber();
+	}
+
+	return (gsm.call_entry >= PHONE_1 && gsm.call_entry < PHONE_MAX) ? gsm.phonebook[gsm.call_entry - 1].number : "";
+}
+
+/**
+ * @fn void SetLinkRate(uint32_t)
+ * @brief riprogramma huart1 alla velocità indicata e scarta la linea parziale ricevuta alla velocità precedente
+ *
+ * @param baud
+ */
+static void SetLinkRate(uint32_t baud)
+{
+	gsm.baud = baud;
+
+	if (USART_BaudRate(USART_1) != baud)
+	{
+		USART_SetBaudRate(USART_1, baud);
+
+		ParserInterface()->Clear(PARSER_1);
+	}
+}
+
+/**
+ * @fn void NextLinkRate(void)
+ * @brief passa alla velocità successiva della tabella
+ *
+ */
+static void NextLinkRate(void)
+{
+	SetLinkRate(linkrates[gsm.link_rate]);
+
+	gsm.link_rate = (gsm.link_rate + 1) % LINK_RATES;
+}
+
+/**
+ * @fn void Startup(void)
+ * @brief schedula i comandi di inizializzazione del modulo e attende il messaggio di modulo pronto
+ *
+ */
+static void Startup(void)
 {
 	ATCommand_ID_TypeDef init[] = {
+#if USART1_RTS_CTS
+		AT_IFC,
+#endif
 		AT_CLIP,
 		AT_SMS_TEXT_MODE,
 		AT_DTMF_ENABLE,
@@ -318,6 +491,19 @@ void SIM800L_Init(void)
 
 	memset(&gsm.phonebook,0,sizeof(gsm.phonebook)); // reset phonebook list
 
+	gsm.configured = 0;
+
+	gsm.link         = LINK_SYNC; // sincronizza alla velocità dell'ultima risposta, altrimenti prova la tabella
+	gsm.link_tries   = 0;
+	gsm.link_rate    = 0;
+	gsm.link_pending = 0;
+	gsm.link_ready   = 0;
+
+	if (!gsm.baud)
+	{
+		NextLinkRate();
+	}
+
 	command.data = NULL;
 
 	uint8_t items = sizeof(init)/sizeof(init[0]);
@@ -332,6 +518,179 @@ void SIM800L_Init(void)
 	gsm.status = GSM_WAITING_FOR_READY;
 }
 
+/**
+ * @fn void WarmStart(const GSMWarmState_TypeDef*)
+ * @brief riavvio a caldo: il modulo è rimasto acceso e configurato. Ripristina rubrica e dati del modulo e ne
+ *        verifica soltanto la risposta; se non risponde il supervisore lo reinizializza (SIM800L_Recover).
+ *
+ * @param warm stato salvato prima del reset
+ */
+static void WarmStart(const GSMWarmState_TypeDef *warm)
+{
+	ATCommandData_TypeDef command = {.data = NULL};
+
+	memcpy(gsm.phonebook, warm->phonebook, sizeof(gsm.phonebook));
+
+	strncpy(gsm.imei, warm->imei, sizeof(gsm.imei) - 1);
+	strncpy(gsm.operator, warm->operator, sizeof(gsm.operator) - 1);
+
+	gsm.signal     = warm->signal;
+	gsm.configured = 1;
+
+	if (warm->baud)
+	{
+		SetLinkRate(warm->baud); // il modulo è rimasto alla velocità negoziata
+	}
+
+	if (warm->status == GSM_CALL_IN_PROGRESS || warm->status == GSM_CALL_ANSWERED) // chiamata interrotta dal reset
+	{
+		command.id = AT_HANG_UP;
+
+		SIM800L_Scheduler_Push(&command);
+	}
+
+	command.id = AT_AT; // health check
+
+	SIM800L_Scheduler_Push(&command);
+
+	command.id = AT_CSQ;
+
+	SIM800L_Scheduler_Push(&command);
+
+	gsm.status = GSM_IDLE;
+}
+
+/**
+ * @fn void SIM800L_Init(const GSMWarmState_TypeDef*)
+ * @brief
+ *
+ * @param warm stato salvato prima del reset se il modem è rimasto configurato (riavvio a caldo), altrimenti NULL
+ */
+void SIM800L_Init(const GSMWarmState_TypeDef *warm)
+{
+	if (warm)
+	{
+		WarmStart(warm);
+	}
+	else
+	{
+		Startup();
+	}
+
+	TimSys_TaskRegister(&gsm_task, "gsm", SIM800L_SM_Exec);
+	TimSys_TaskStart(&gsm_task, 0, GSM_TASK_PERIOD);
+
+	Supervisor_Watch(SV_GSM, SUPERVISOR_GSM_DEADLINE, SIM800L_Recover);
+	Supervisor_CheckIn(SV_GSM);
+}
+
+/**
+ * @fn void SIM800L_Recover(void)
+ * @brief recupero del modem senza riavviare la MCU, chiamato dal supervisore quando il modem non risponde entro la
+ *        scadenza: reset hardware del modulo, svuotamento dei comandi schedulati e nuova inizializzazione
+ *
+ */
+void SIM800L_Recover(void)
+{
+	TimSys_LoopTag("gsm:recover");
+
+	HAL_GPIO_WritePin(GPIOB, GPIO_PIN_5, GPIO_PIN_RESET); // reset del modulo
+
+	HAL_Delay(GSM_RESET_PULSE);
+
+	HAL_GPIO_WritePin(GPIOB, GPIO_PIN_5, GPIO_PIN_SET);
+
+	SIM800L_Scheduler_Flush();
+
+	ReleaseTx();
+
+	gsm.ring = 0;
+
+	ParserInterface()->Clear(PARSER_1);
+
+	Startup();
+}
+
+/**
+ * @fn void SIM800L_Suspend(uint8_t)
+ * @brief sospende la macchina a stati mentre il modem è collegato direttamente alla console (bridge DMA): task e
+ *        supervisione fermi, stato, comandi schedulati e stato del parser conservati per la ripresa
+ *
+ * @param suspend 1 sospende, 0 riprende
+ */
+void SIM800L_Suspend(uint8_t suspend)
+{
+	if (suspend)
+	{
+		TimSys_TaskStop(&gsm_task);
+
+		Supervisor_Idle(SV_GSM);
+	}
+	else
+	{
+		Supervisor_CheckIn(SV_GSM);
+
+		TimSys_TaskStart(&gsm_task, 0, GSM_TASK_PERIOD);
+	}
+}
+
+/**
+ * @fn void SIM800L_SaveState(GSMWarmState_TypeDef*)
+ * @brief stato del modem da conservare per il riavvio a caldo
+ *
+ * @param state
+ */
+void SIM800L_SaveState(GSMWarmState_TypeDef *state)
+{
+	state->configured = gsm.configured;
+	state->status     = gsm.status;
+	state->signal     = gsm.signal;
+	state->baud       = gsm.baud;
+
+	memcpy(state->imei, gsm.imei, sizeof(state->imei));
+	memcpy(state->operator, gsm.operator, sizeof(state->operator));
+	memcpy(state->phonebook, gsm.phonebook, sizeof(state->phonebook));
+}
+
+/**
+ * @fn TimSys_Task_TypeDef SIM800L_Task*(void)
+ * @brief task dello scheduler che esegue la macchina a stati del modem
+ *
+ * @return
+ */
+TimSys_Task_TypeDef *SIM800L_Task(void)
+{
+	return &gsm_task;
+}
+
+/**
+ * @fn char SIM800L_StatusReport*(char*, uint16_t)
+ * @brief riepilogo dello stato del modem per la console
+ *
+ * @param mess buffer di destinazione (160 caratteri per il riepilogo completo)
+ * @param size dimensione del buffer
+ * @return mess
+ */
+char *SIM800L_StatusReport(char *mess, uint16_t size)
+{
+	static const char *names[] = {
+		[GSM_WAITING_FOR_READY] = "avvio",
+		[GSM_WAITING_FOR_IDLE]  = "configurazione",
+		[GSM_IDLE]              = "pronto",
+		[GSM_SEND_AT_COMMAND]   = "invio comando",
+		[GSM_WAITING_FOR_REPLY] = "attesa risposta",
+		[GSM_CALL_IN_PROGRESS]  = "chiamata",
+		[GSM_CALL_ANSWERED]     = "chiamata in corso",
+		[GSM_ERROR]             = "errore",
+	};
+
+	Fmt_Snprintf(mess, size, "Modem: %s, %lu baud, segnale %u, operatore %s, IMEI %s, batteria %u%% %0.2fV, comandi in coda %d%s\r\n",
+	             names[gsm.status], (unsigned long) gsm.baud, gsm.signal, gsm.operator[0] ? gsm.operator : "-", gsm.imei[0] ? gsm.imei : "-",
+	             gsm.battCharge, gsm.vbatt, gsm.fifo_items, gsm_task.armed ? "" : ", sospeso");
+
+	return mess;
+}
+
 /**
  * @fn void SIM800L_SentClipNumber(char*)
  * @brief
@@ -369,6 +728,59 @@ void SIM800L_SendATCommand(ATCommand_ID_TypeDef id)
 	gsm.status  = GSM_SEND_AT_COMMAND;
 }
 
+/**
+ * @fn void SendATCommandArgs(ATCommand_ID_TypeDef, uint8_t, const char*)
+ * @brief come SIM800L_SendATCommand, con gli argomenti del comando. Gli argomenti sono copiati: restano associati
+ *        al comando fino all'invio anche se il buffer del chiamante cambia
+ *
+ * @param id
+ * @param num argomento numerico (AT_ARG_NUM)
+ * @param str argomento stringa (AT_ARG_STR), NULL se assente
+ */
+static void SendATCommandArgs(ATCommand_ID_TypeDef id, uint32_t num, const char *str)
+{
+	gsm.at_num = num;
+
+	strncpy(gsm.at_str, str ? str : "", sizeof(gsm.at_str) - 1);
+
+	gsm.at_str[sizeof(gsm.at_str) - 1] = '\0';
+
+	SIM800L_SendATCommand(id);
+}
+
+/**
+ * @fn void WriteATCommand(ATCommand_ID_TypeDef)
+ * @brief accoda il comando al ring di trasmissione del modem: frammenti costanti di lunghezza nota e gli argomenti
+ *        del comando corrente, senza formattazione e senza strlen sui frammenti
+ *
+ * @param id
+ */
+static void WriteATCommand(ATCommand_ID_TypeDef id)
+{
+	const ATCommand_TypeDef *at = atcommands + id;
+
+	if (!at->prefix)
+	{
+		return; // comando dello scheduler
+	}
+
+	USART_TxFifoPushBuffer(USART_1, at->prefix, at->prefix_len);
+
+	if (at->args & AT_ARG_NUM)
+	{
+		USART_TxFifoPushUInt(USART_1, gsm.at_num);
+	}
+
+	USART_TxFifoPushBuffer(USART_1, at->sep, at->sep_len);
+
+	if (at->args & AT_ARG_STR)
+	{
+		USART_TxFifoPushString(USART_1, gsm.at_str);
+	}
+
+	USART_TxFifoPushBuffer(USART_1, at->suffix, at->suffix_len);
+}
+
 /**
  * @fn void SIM800L_HangUp(void)
  * @brief Invia il comando AT di HANGUP direttamente sulla seriale. Lo stato della macchina a stati non viene modificato. Rimane nello stato corrente.
@@ -379,7 +791,7 @@ void SIM800L_HangUp(void)
 {
 	gsm.command = AT_HANG_UP;
 
-	USART_Write(USART_1, atcommands[AT_HANG_UP], 0);
+	WriteATCommand(AT_HANG_UP);
 }
 
 /**
@@ -400,11 +812,7 @@ void SIM800L_Answer(void)
  */
 void SIMM800L_AddPhonebookEntry(PhonebookEntry_TypeDef *number)
 {
-	atcommands[AT_WRITE_PHONEBOOK_ENTRY] = gsm.at_cmd;
-
-	sprintf(atcommands[AT_WRITE_PHONEBOOK_ENTRY],"AT+CPBW=%d,\"%s\"\n", number->entry, number->number);
-
-	SIM800L_SendATCommand(AT_WRITE_PHONEBOOK_ENTRY);
+	SendATCommandArgs(AT_WRITE_PHONEBOOK_ENTRY, number->entry, number->number);
 }
 
 /**
@@ -417,15 +825,11 @@ void SIMM800L_DelPhonebookEntry(PhonebookIdEntry_TypeDef entry)
 {
 	if (entry > 0 && entry < PHONE_MAX)
 	{
-		atcommands[AT_DEL_PHONEBOOK_ENTRY] = gsm.at_cmd;
-
 		memset(gsm.phonebook[entry-1].number,0,sizeof(gsm.phonebook[entry-1].number));
 
 		gsm.phonebook[entry-1].entry = 0;
 
-		sprintf(atcommands[AT_DEL_PHONEBOOK_ENTRY],"AT+CPBW=%d\n", entry);
-
-		SIM800L_SendATCommand(AT_DEL_PHONEBOOK_ENTRY);
+		SendATCommandArgs(AT_DEL_PHONEBOOK_ENTRY, entry, NULL);
 	}
 }
 
@@ -445,11 +849,7 @@ uint8_t SIMM800L_CallPhonebookEntry(PhonebookIdEntry_TypeDef entry)
 
 			if (strlen(gsm.phonebook[entry-1].number))
 			{
-				sprintf(gsm.at_cmd,"atd%s;\n",gsm.phonebook[entry-1].number);
-
-				atcommands[AT_CALL_PHONEBOOK_ENTRY] = gsm.at_cmd;
-
-				SIM800L_SendATCommand(AT_CALL_PHONEBOOK_ENTRY);
+				SendATCommandArgs(AT_CALL_PHONEBOOK_ENTRY, entry, gsm.phonebook[entry-1].number);
 			}
 
 			return 1; // restituisce successo anche se non c'è il numero
@@ -511,9 +911,26 @@ uint8_t SIMM800L_Schedule_DelPhonebookEntry(PhonebookIdEntry_TypeDef entry)
  */
 void SIM800L_Schedule_Call_Phonebook_Entries(void)
 {
-	// gsm.call_entry = 0; // Alarm call entry
+	SIM800L_Schedule_Call_Phonebook_From(PHONE_1);
+}
 
-	for (uint8_t n = PHONE_1; n < PHONE_MAX; n++)
+/**
+ * @fn void SIM800L_Schedule_Call_Phonebook_From(PhonebookIdEntry_TypeDef)
+ * @brief schedula la sequenza di chiamate dalla voce indicata all'ultima della rubrica, ad esempio per riprendere
+ *        una notifica interrotta da un riavvio
+ *
+ * @param first prima voce chiamata
+ */
+void SIM800L_Schedule_Call_Phonebook_From(PhonebookIdEntry_TypeDef first)
+{
+	if (first < PHONE_1 || first >= PHONE_MAX)
+	{
+		first = PHONE_1;
+	}
+
+	gsm.call_entry = first - 1; // nessuna chiamata della sequenza ancora eseguita
+
+	for (uint8_t n = first; n < PHONE_MAX; n++)
 	{
 		gsm.phonebook[n-1].entry = n;
 
@@ -545,21 +962,26 @@ void SIM800L_Schedule_Call_Phonebook_Entries(void)
 
 /**
  * @fn void SIMM800L_Schedule_SMS(SMS_TypeDef*)
- * @brief
+ * @brief schedula l'invio di un SMS composto. L'SMS è un blocco del pool dei messaggi: la proprietà passa allo
+ *        scheduler, che lo rilascia dopo l'invio o se non può accodarlo.
  *
  * @param sms
  */
 void SIMM800L_Schedule_SMS(SMS_TypeDef *sms)
 {
-	if (strlen(sms->num) < 16 && strlen(sms->mess) < MAX_SMS_LENGTH)
+	if (sms && strlen(sms->num) < 16 && strlen(sms->mess) < MAX_SMS_LENGTH - 1)
 	{
-		// strcpy(gsm.sms[0].mess, mess);  // Assembla il messaggio
-		// strcpy(gsm.sms[0].num , num );	 // Copia il numero
+		MsgPool_Handoff(sms, MSG_SMS_QUEUED);
 
-		ATCommandData_TypeDef command = {.id = AT_SMS, .data = (void *) &gsm.sms};
+		ATCommandData_TypeDef command = {.id = AT_SMS, .data = (void *) sms};
 
-		SIM800L_Scheduler_Push(&command); // schedule
+		if (SIM800L_Scheduler_Push(&command)) // schedule
+		{
+			return;
+		}
 	}
+
+	MsgPool_Free(sms);
 }
 
 
@@ -585,20 +1007,52 @@ void SIMM800L_Schedule_SMS(SMS_TypeDef *sms)
 
 /**
  * @fn void SIMM800L_Schedule_SMS_Get_Params(SMS_TypeDef*)
- * @brief
+ * @brief schedula l'SMS dei parametri correnti, composto all'invio. Come SIMM800L_Schedule_SMS prende la proprietà
+ *        del blocco.
  *
  * @param sms
  */
 void SIMM800L_Schedule_SMS_Get_Params(SMS_TypeDef *sms)
 {
-	if (strlen(sms->num) < MAX_NUM_LENGTH)
+	if (sms && strlen(sms->num) < MAX_NUM_LENGTH)
 	{
 		memset(sms->mess, 0, sizeof(sms->mess));  // cancella l'ultima stringa inviata
 
+		MsgPool_Handoff(sms, MSG_SMS_QUEUED);
+
 		ATCommandData_TypeDef command = {.id = AT_SMS_GET_PARAMS, .data = (void *) sms};
 
-		SIM800L_Scheduler_Push(&command); // schedule
+		if (SIM800L_Scheduler_Push(&command)) // schedule
+		{
+			return;
+		}
+	}
+
+	MsgPool_Free(sms);
+}
+
+/**
+ * @fn void SIMM800L_Schedule_SMS_Report(SMS_TypeDef*)
+ * @brief schedula l'invio di un rapporto al primo numero della rubrica. Il numero è letto all'invio, dopo la
+ *        lettura della rubrica dell'inizializzazione. Come SIMM800L_Schedule_SMS prende la proprietà del blocco.
+ *
+ * @param sms blocco del pool con il testo del rapporto
+ */
+void SIMM800L_Schedule_SMS_Report(SMS_TypeDef *sms)
+{
+	if (sms && strlen(sms->mess) < MAX_SMS_LENGTH - 1)
+	{
+		MsgPool_Handoff(sms, MSG_SMS_QUEUED);
+
+		ATCommandData_TypeDef command = {.id = AT_REPORT_SMS, .data = (void *) sms};
+
+		if (SIM800L_Scheduler_Push(&command)) // schedule
+		{
+			return;
+		}
 	}
+
+	MsgPool_Free(sms);
 }
 
 /**
@@ -611,26 +1065,35 @@ void SIMM800L_Schedule_SMS_Get_Params(SMS_TypeDef *sms)
  */
 int8_t SIMM800L_SMS(SMS_TypeDef *psms)
 {
-	static char at_cmd[MAX_AT_LENGTH];
 
 	if (gsm.status != GSM_IDLE)
 	{
+		MsgPool_Free(psms);
+
 		return -1; // command refused
 	}
 
-	if (strlen(psms->num) < 16 && strlen(psms->mess) < MAX_SMS_LENGTH)
+	uint16_t len = strlen(psms->mess);
+
+	if (strlen(psms->num) < 16 && len < MAX_SMS_LENGTH - 1)
 	{
-		sprintf(sms, "%s%c", psms->mess, ctrlz); 			  // aggiunge il carattere terminatore al messaggio e salva i dati nella struttura apposita
+		ReleaseTx();
+
+		psms->mess[len++] = ctrlz; 			  				  // aggiunge il carattere terminatore al messaggio
+		psms->mess[len]   = '\0';
 
-		sprintf(at_cmd,"%s\"%s\"\r\n","AT+CMGS=",psms->num);  // assembla la stringa di comando
+		gsm.tx      = psms;
+		gsm.tx_line = psms->mess;
 
-		atcommands[AT_SMS] = at_cmd;   			   	          // set command string pointer
+		MsgPool_Handoff(psms, MSG_SMS_TX);					  // il blocco è rilasciato alla risposta del modem
 
-		SIM800L_SendATCommand(AT_SMS);
+		SendATCommandArgs(AT_SMS, 0, psms->num);
 
 		return 1;
 	}
 
+	MsgPool_Free(psms);
+
 	return 0; // data overflow
 }
 
@@ -643,19 +1106,27 @@ int8_t SIMM800L_SMS(SMS_TypeDef *psms)
  */
 char * SetParamsMsg(char *mess)
 {
-	sprintf(mess, "SCD TESYS-MA %s %s\r\n\r\n"
+	char history[128];
+	char loop[64];
+
+	Fmt_Snprintf(mess, MAX_SMS_LENGTH - 1, "SCD TESYS-MA %s %s\r\n\r\n"
 			      "Terminale: %s\r\n"
 			      "Operatore: %s\r\n"
 			      "Segnale: %d%s \r\n"
 			      "Batteria: %d%s, %0.1fV\r\n"
 			      "Temperatura: %0.1f gradi\r\n"
   			      "Soglia: %0.1f gradi\r\n"
+			      "Tendenza: %0.2f gradi/min\r\n"
+			      "Campionamento: %lus, %lu/ora\r\n"
+			      "%s"
+			      "%s"
 				  "Allarme: %s\r\n"
 			      "Auto Reset Allarme: %s\r\n"
 				  "Num 1: %s\r\n"
 				  "Num 2: %s\r\n"
 				  "Num 3: %s\r\n\r\n"
 				  "Digita #* per il menu comandi.\r\n", App_Version(), App_BuildDate(), gsm.imei, gsm.operator, gsm.signal, "%", gsm.battCharge, "%", gsm.vbatt, GetTemp(), GetTempThreshold(),
+				                                        Rules_Slope(), (unsigned long) SamplingInterval() / 1000, (unsigned long) SamplesPerHour(), History_Report(history, sizeof(history)), TimSys_LoopReport(loop, sizeof(loop)),
 				                                        AlarmStatus() == ALARM_ON ? "Abilitato" : "Disabilitato", AlarmAutoEnable() ? "Si" : "No",
 						                                gsm.phonebook[0].number, gsm.phonebook[1].number, gsm.phonebook[2].number);
 	return mess;
@@ -663,14 +1134,175 @@ char * SetParamsMsg(char *mess)
 
 /**
  * @fn void DelayAndResetWD(void)
- * @brief attende e reimposta il watchdog
+ * @brief attende e segnala l'attività del modem al supervisore (watchdog del task gsm)
  *
  */
 void DelayAndResetWD(void)
 {
+	TimSys_LoopTag("gsm:AT delay");
+
 	HAL_Delay(AT_DELAY);
 
-	WatchdogRefresh();   // se ha ricevuto una risposta reimposta il watchdog
+	Supervisor_CheckIn(SV_GSM);   // se ha ricevuto una risposta riarma la scadenza del task gsm
+}
+
+/**
+ * @fn void LinkCommand(ATCommand_ID_TypeDef, uint32_t)
+ * @brief invia un comando della negoziazione del collegamento e ne avvia l'attesa della risposta
+ *
+ * @param id
+ * @param num argomento numerico (AT_ARG_NUM)
+ */
+static void LinkCommand(ATCommand_ID_TypeDef id, uint32_t num)
+{
+	gsm.command      = id;
+	gsm.at_num       = num;
+	gsm.link_pending = 1;
+	gsm.link_time    = HAL_GetTick();
+
+	WriteATCommand(id);
+}
+
+/**
+ * @fn void LinkDone(void)
+ * @brief collegamento stabilito e modulo pronto: avvia lo scheduler dei comandi
+ *
+ */
+static void LinkDone(void)
+{
+	gsm.status = GSM_IDLE; // go to to idle. Se non va in idle entro il timeout del watchdog, intervinviene il watchdog e riavvia.
+
+	USART_Printf(USART_2, "\r\nModem: %lu baud%s\r\n", (unsigned long) gsm.baud, gsm.link_failed ? " (negoziazione fallita)" : "");
+
+	Supervisor_CheckIn(SV_GSM);
+
+	TimSys_LoopTag("gsm:start delay");
+
+	HAL_Delay(GSM_STARTING_DELAY);
+}
+
+/**
+ * @fn void LinkExec(ATCommand_Reply_TypeDef)
+ * @brief GSM_WAITING_FOR_READY: sincronizzazione col modulo, attesa di SMS Ready e negoziazione della velocità.
+ *
+ *        LINK_SYNC:   AT alla velocità corrente; dopo GSM_BAUD_SYNC_TRIES tentativi senza risposta passa alla velocità
+ *                     successiva della tabella (il modulo di fabbrica riconosce la velocità dall'AT, quello negoziato
+ *                     risponde solo alla velocità salvata)
+ *        LINK_READY:  attesa di SMS Ready, poi AT+IPR=GSM_BAUD_TARGET;&W se la velocità è diversa
+ *        LINK_SET:    all'OK (inviato dal modulo alla velocità precedente) riprogramma huart1
+ *        LINK_VERIFY: AT alla nuova velocità; senza risposta torna alla velocità precedente e risincronizza
+ *
+ *        Il supervisore reinizializza il modem se non si arriva in IDLE entro SUPERVISOR_GSM_DEADLINE.
+ *
+ * @param atreply risposta analizzata dal parser
+ */
+static void LinkExec(ATCommand_Reply_TypeDef atreply)
+{
+	uint8_t ok      = (atreply == ATR_OK);
+	uint8_t timeout = gsm.link_pending && (HAL_GetTick() - gsm.link_time >= GSM_LINK_TIMEOUT);
+
+	if (atreply == ATR_READY)
+	{
+		gsm.link_ready = 1;
+	}
+
+	if (ok)
+	{
+		gsm.link_pending = 0;
+	}
+
+	switch (gsm.link)
+	{
+		case LINK_SYNC:
+
+			if (ok)
+			{
+				gsm.link_tries = 0;
+				gsm.link       = LINK_READY;
+			}
+			else
+			if (timeout || !gsm.link_pending)
+			{
+				if (timeout && ++gsm.link_tries >= GSM_BAUD_SYNC_TRIES) // nessuna risposta: prova la velocità successiva
+				{
+					gsm.link_tries = 0;
+
+					NextLinkRate();
+				}
+
+				LinkCommand(AT_AT, 0); // continua ad inviare AT finchè non vi è risposta
+			}
+
+		break;
+
+		case LINK_READY:
+
+			if (!gsm.link_ready)
+			{
+				break;
+			}
+
+			if (GSM_BAUD_NEGOTIATE && gsm.baud != GSM_BAUD_TARGET && !gsm.link_failed)
+			{
+				gsm.link = LINK_SET;
+
+				LinkCommand(AT_IPR, GSM_BAUD_TARGET);
+			}
+			else
+			{
+				LinkDone();
+			}
+
+		break;
+
+		case LINK_SET:
+
+			if (ok)
+			{
+				gsm.baud_prev = gsm.baud;
+				gsm.link      = LINK_VERIFY;
+
+				SetLinkRate(GSM_BAUD_TARGET);
+
+				LinkCommand(AT_AT, 0);
+			}
+			else
+			if (timeout || atreply == ATR_ERROR) // velocità non supportata: resta a quella corrente
+			{
+				gsm.link_failed  = 1;
+				gsm.link_pending = 0;
+
+				LinkDone();
+			}
+
+		break;
+
+		case LINK_VERIFY:
+
+			if (ok)
+			{
+				LinkDone(); // velocità negoziata e salvata nel modulo
+			}
+			else
+			if (timeout)
+			{
+				if (++gsm.link_tries < GSM_BAUD_SYNC_TRIES)
+				{
+					LinkCommand(AT_AT, 0);
+				}
+				else // ripiego: torna alla velocità precedente e risincronizza
+				{
+					gsm.link_failed  = 1;
+					gsm.link_tries   = 0;
+					gsm.link_pending = 0;
+					gsm.link         = LINK_SYNC;
+
+					SetLinkRate(gsm.baud_prev);
+				}
+			}
+
+		break;
+	}
 }
 
 /**
@@ -682,22 +1314,31 @@ void SIM800L_SM_Exec(void)
 {
     static uint32_t time;
     static uint8_t  inactivity_counter = 0;
+    static GSMStatus_TypeDef traced = GSM_WAITING_FOR_READY; // ultimo stato trasmesso dalla telemetria
     // static uint8_t  prompt = 1;
-    static char *   psms = sms;
+
+	PROF_BEGIN(PROF_GSM_SM);
 
 	ATCommand_Reply_TypeDef atreply = ParserInterface()->MsgAnalyze(PARSER_1); // Analize message received on fifo of parser 1 (GSM RX Message Fifo)
 
+	if (atreply && atreply != ATR_NONE)
+	{
+		Telemetry_Parser(atreply, gsm.status);
+	}
+
+	USART_RxFlowUpdate(USART_1); // fifo svuotata dal parser: riavvia la ricezione fermata da RTS
+
 	switch (gsm.status)
 	{
 		case GSM_SEND_AT_COMMAND:
 
-			USART_Write(USART_1, atcommands[gsm.command], 0);
+			WriteATCommand(gsm.command);
 
 			gsm.status = GSM_WAITING_FOR_REPLY;
 
 			time = HAL_GetTick();
 
-			WatchdogRefresh();   // reimposta il watchdog, se non riceve risposta in tempo utile, intervien il watchdog
+			Supervisor_CheckIn(SV_GSM);   // riarma la scadenza: se non riceve risposta in tempo utile, il supervisore reinizializza il modem
 
 		break;
 
@@ -737,6 +1378,8 @@ void SIM800L_SM_Exec(void)
 					}
 					else
 					{
+						TimSys_LoopTag("gsm:COPS retry");
+
 						HAL_Delay(1000);
 
 						SIM800L_SendATCommand(AT_COPS);
@@ -788,22 +1431,24 @@ void SIM800L_SM_Exec(void)
 								prompt = 0;
 							}*/
 
-							char *line = strstr(psms,"\r\n"); // prende il puntatore alla linea successiva
+							if (!gsm.tx_line)
+							{
+								break;
+							}
+
+							char *line = strstr(gsm.tx_line,"\r\n"); // prende il puntatore alla linea successiva
 
 							if (line) // se c'è una linea successiva
 							{
-								line[0] = '\0'; // termina la stringa precedente
-								line[1] = '\0'; //
-
 								line +=2; // avanza il puntatore alla linea successiva
 
-								USART_Printf(USART_1, "%s\r\n", psms);   // send the current sms line
+								USART_TxFifoPushBuffer(USART_1, gsm.tx_line, line - gsm.tx_line); // send the current sms line, CRLF compreso
 
-								psms = line; 				     // imposta il puntatore alla linea successiva
+								gsm.tx_line = line; 				     // imposta il puntatore alla linea successiva
 							}
 							else
 							{
-								USART_Write(USART_1, psms, 0);     // send the sms line
+								USART_TxFifoPushString(USART_1, gsm.tx_line); // send the last sms line, with ctrl-z
 							}
 						}
 						break;
@@ -812,7 +1457,7 @@ void SIM800L_SM_Exec(void)
 						break;
 					}
 
-					WatchdogRefresh();
+					Supervisor_CheckIn(SV_GSM);
 
 				break;
 
@@ -840,17 +1485,23 @@ void SIM800L_SM_Exec(void)
 						case AT_DEL_PHONEBOOK_ENTRY:
 						case AT_WRITE_PHONEBOOK_ENTRY:
 
-							SetParamsMsg(gsm.sms[0].mess);
+						{
+							SMS_TypeDef *sms = SMS_Alloc(SIM800L_GetClipNumber()); // solo il chiamante può aggiungere o eliminare un numero
 
-							strcpy(gsm.sms[0].num, SIM800L_GetClipNumber()); // solo il chiamante può aggiungere o eliminare un numero
+							if (sms)
+							{
+								SetParamsMsg(sms->mess);
 
-							SIMM800L_Schedule_SMS(gsm.sms);
+								SIMM800L_Schedule_SMS(sms);
+							}
+						}
+						// no break
 
 						case AT_SMS:
 
 							// prompt = 1;
 
-							psms = sms;
+							ReleaseTx();
 
 						default:
 
@@ -871,6 +1522,11 @@ void SIM800L_SM_Exec(void)
 
 					// prompt = 1;
 
+					if (gsm.command == AT_SMS) // SMS non inviato
+					{
+						ReleaseTx();
+					}
+
 					gsm.status = GSM_IDLE; // waiting for new command, or manage unsolicted message
 
 					DelayAndResetWD();	   // se ha ricevuto una risposta reimposta il watchdog
@@ -901,7 +1557,7 @@ void SIM800L_SM_Exec(void)
 				    break;
 				}
 
-				WatchdogRefresh();
+				Supervisor_CheckIn(SV_GSM);
 			}
 
 			// Controlla la risposta. Il watchdog viene reimpostato solo se viene rilevata una risposta conosciuta.
@@ -915,7 +1571,7 @@ void SIM800L_SM_Exec(void)
 
 					HAL_Delay(2000);
 
-					HAL_NVIC_SystemReset();
+					Restart_SystemReset(RESTART_REMOTE); // riavvio a caldo: il modem resta configurato
 
 				break;
 
@@ -926,7 +1582,7 @@ void SIM800L_SM_Exec(void)
 
 					inactivity_counter = 0; // importante lasciare: in caso di chamata entrante assicura che il contatore sia azzerato
 
-					WatchdogRefresh();
+					Supervisor_CheckIn(SV_GSM);
 
 				break;
 
@@ -981,26 +1637,11 @@ void SIM800L_SM_Exec(void)
 
 						case AT_READ_PHONEBOOK:      // Lettura rubrica eseguita
 						{
-							uint8_t idx;
-
-							if (gsm.status == GSM_CALL_ANSWERED)
-							{
-								idx = 0;
-
-								strcpy(gsm.sms[0].num, SIM800L_GetClipNumber());    // invia il mssaggio al numero entrante
-							}
-							else
-							{
-								idx = gsm.call_entry - 1;
-
-								strcpy(gsm.sms[idx].num, gsm.phonebook[idx].number); // invia il messaggio al numero uscente
-							}
-
-							SIMM800L_Schedule_SMS_Get_Params(&gsm.sms[idx]);
+							SIMM800L_Schedule_SMS_Get_Params(SMS_Alloc(CallerNumber())); // invia il messaggio al numero entrante o uscente
 
 							gsm.command = AT_DTMF_SHARP;
 
-							USART_Write(USART_1, atcommands[AT_DTMF_SHARP], 0); // Invia il tono di risposta
+							WriteATCommand(AT_DTMF_SHARP); // Invia il tono di risposta
 						}
 						break;
 
@@ -1020,7 +1661,7 @@ void SIM800L_SM_Exec(void)
 
 					gsm.command = AT_READ_PHONEBOOK;
 
-					USART_Write(USART_1, atcommands[AT_READ_PHONEBOOK], 0); // legge la rubrica in modalità immediata ed attende 'OK'
+					WriteATCommand(AT_READ_PHONEBOOK); // legge la rubrica in modalità immediata ed attende 'OK'
 
 					time = HAL_GetTick();
 
@@ -1034,7 +1675,7 @@ void SIM800L_SM_Exec(void)
 
 					gsm.command = AT_DTMF_STAR;
 
-					USART_Write(USART_1, atcommands[AT_DTMF_STAR], 0);
+					WriteATCommand(AT_DTMF_STAR);
 
 					time = HAL_GetTick();
 
@@ -1048,7 +1689,7 @@ void SIM800L_SM_Exec(void)
 
 					gsm.command = AT_DTMF_SHARP;
 
-					USART_Write(USART_1, atcommands[AT_DTMF_SHARP], 0);
+					WriteATCommand(AT_DTMF_SHARP);
 
 					time = HAL_GetTick();
 
@@ -1060,22 +1701,11 @@ void SIM800L_SM_Exec(void)
 				{
 					DelayAndResetWD();
 
-					uint8_t idx;
+					SMS_TypeDef *sms = SMS_Alloc(CallerNumber()); // invia il messaggio al numero entrante o uscente
 
-					if (gsm.status == GSM_CALL_ANSWERED)
+					if (sms)
 					{
-						idx = 0;
-
-						strcpy(gsm.sms[0].num, SIM800L_GetClipNumber());    // invia il mssaggio al numero entrante
-					}
-					else
-					{
-						idx = gsm.call_entry - 1;
-
-						strcpy(gsm.sms[idx].num, gsm.phonebook[idx].number); // invia il messaggio al numero uscente
-					}
-
-					sprintf(gsm.sms[idx].mess,"\r\nSCD TESYS-MA %s %s\r\n\r\n"
+						Fmt_Snprintf(sms->mess, MAX_SMS_LENGTH - 1, "\r\nSCD TESYS-MA %s %s\r\n\r\n"
 												    "#*  Aiuto\r\n"          							// 10
 												    "### Alarme OFF\r\n"    							// 16
 												    "##* Alarme ON\r\n"    								// 15
@@ -1086,11 +1716,12 @@ void SIM800L_SM_Exec(void)
 												    "#X## Elimina numero X:[1-3]\r\n"                   // 29
 												    "*X*Num** Modifica numero X:[1-3]\r\n", App_Version(), App_BuildDate());            // 34
 
-					SIMM800L_Schedule_SMS(&gsm.sms[idx]); // schedula l'invio degli SMS
+						SIMM800L_Schedule_SMS(sms); // schedula l'invio degli SMS
+					}
 
 					gsm.command = AT_DTMF_SHARP;
 
-					USART_Write(USART_1, atcommands[AT_DTMF_SHARP], 0);  // invia il tono di risposta in modalità immediata, ed attende OK. Se non viene ricevuto interviene il watchdog
+					WriteATCommand(AT_DTMF_SHARP);  // invia il tono di risposta in modalità immediata, ed attende OK. Se non viene ricevuto interviene il watchdog
 
 					time = HAL_GetTick();
 
@@ -1133,9 +1764,7 @@ void SIM800L_SM_Exec(void)
 
 						// prompt = 1;
 
-						psms = sms;
-
-						SIMM800L_SMS((SMS_TypeDef *) sch_command.data);
+						SIMM800L_SMS((SMS_TypeDef *) sch_command.data); // la proprietà del blocco passa alla trasmissione
 
 					break;
 
@@ -1155,11 +1784,26 @@ void SIM800L_SM_Exec(void)
 
 					break;
 
-					case AT_WELCOME_SMS:
+					case AT_WELCOME_SMS: // ultimo comando della coda di inizializzazione
 
-						strcpy(gsm.sms[0].num, gsm.phonebook[0].number);
+						gsm.configured = 1;
 
-						SIMM800L_Schedule_SMS_Get_Params(gsm.sms);
+						SIMM800L_Schedule_SMS_Get_Params(SMS_Alloc(gsm.phonebook[0].number));
+
+					break;
+
+					case AT_REPORT_SMS: // rapporto al primo numero della rubrica, letta dall'inizializzazione
+
+						if (strlen(gsm.phonebook[0].number))
+						{
+							strncpy(((SMS_TypeDef *) sch_command.data)->num, gsm.phonebook[0].number, MAX_NUM_LENGTH - 1);
+
+							SIMM800L_SMS((SMS_TypeDef *) sch_command.data);
+						}
+						else
+						{
+							MsgPool_Free(sch_command.data); // nessun destinatario
+						}
 
 					break;
 
@@ -1211,7 +1855,7 @@ void SIM800L_SM_Exec(void)
 						}
 						else
 						{
-							WatchdogRefresh();
+							Supervisor_CheckIn(SV_GSM);
 						}
 
 					break;
@@ -1234,55 +1878,23 @@ void SIM800L_SM_Exec(void)
 		break;
 
 		case GSM_WAITING_FOR_READY:
-		{
-			static uint8_t  waiting = 0;
-			static uint32_t time    = 0;
-
-			switch (atreply)
-			{
-				case ATR_READY:
 
-					gsm.status = GSM_IDLE; // go to to idle. Se non va in idle entro il timeout del watchdog, intervinviene il watchdog e riavvia.
+			LinkExec(atreply);
 
-					WatchdogRefresh();
-
-					HAL_Delay(GSM_STARTING_DELAY);
-
-				break;
-
-				case ATR_OK:
-
-					if (waiting < 2)
-					{
-						waiting = 2; // OK found
-					}
-
-				break;
-
-				default:
-
-					 if (waiting == 0)
-					 {
-						 USART_Write(USART_1, atcommands[AT_AT], 0);
-
-						 time = HAL_GetTick() + 1000;
-
-						 waiting = 1;
-					 }
-					 else
-					 if (HAL_GetTick() > time && waiting == 1)
-					 {
-						 waiting = 0; // continua ad inviare AT finchè non vi è risposta. Il watchdog dovrebbe intervenire entro 30 sec.) per riavviare
-					 }
-
-				break;
-			}
-		}
 		break;
 
 		default:
 		break;
 	}
+
+	if (gsm.status != traced) // transizioni anche fuori dalla macchina a stati (Startup, Recover), rilevate qui
+	{
+		Telemetry_Gsm(traced, gsm.status, gsm.command);
+
+		traced = gsm.status;
+	}
+
+	PROF_END(PROF_GSM_SM);
 }
 
 /**
@@ -1310,7 +1922,7 @@ void print_status(void)
 			[GSM_ERROR]             = "ERROR" ,
 		};
 
-		sprintf(mess,"\r\nGSM Status: %s\r\n",status[GSM_Status()]);
+		Fmt_Snprintf(mess, sizeof(mess), "\r\nGSM Status: %s\r\n", status[GSM_Status()]);
 
 		USART_Write(USART_2, mess, 0);
 	}
@@ -11,16 +11,32 @@
 #include "iwdg.h"
 #include "usart.h"
 #include "stm32_lib_usart.h"
+#include "usart_callback.h"
 #include "ac_app.h"
 #include "parser.h"
 #include "sm_alarm.h"
+#include "history.h"
+#include "datalog.h"
+#include "timsys.h"
+#include "power.h"
+#include "clock.h"
+#include "supervisor.h"
+#include "restart.h"
+#include "fault.h"
+#include "msgpool.h"
+#include "libfmt.h"
+#include "sm_adc.h"
 #include "SIM800L.h"
+#include "console.h"
+#include "telemetry.h"
 
 // Local functions -----------------------------------------------------------------------------------------------------------------------
 
 static char *version = AC_VERSION; // AC_VERSION È UNA DEFINE CHE PUNTA AD UNA VARIABILE DI AMBIENTE STRINGA, DEFINITA NELLE PROPRIETÀ DEL PROGETTO
 static char build_date[11];
 
+static TimSys_Task_TypeDef bridge_task;
+
 /**
  * @fn void App_Init(void)
  * @brief
@@ -28,34 +44,103 @@ static char build_date[11];
  */
 static void App_Init(void)
 {
-	HAL_GPIO_WritePin(GPIOB, GPIO_PIN_5, GPIO_PIN_RESET);   // leave to reset (OFF) SIM800L Module
+	TimSys_Init();
+
+	Clock_SetProfile(CLOCK_PERFORMANCE);
 
 	USART_Init();
 
-	USART_SetHandle(USART_1, &huart1);
-	USART_SetHandle(USART_2, &huart2);
+	USART_SetHandle(USART_1, &huart1, &USART1_Callbacks);
+	USART_SetHandle(USART_2, &huart2, &USART2_Callbacks);
 
 	USART_Start(USART_1);
 	USART_Start(USART_2);
 
-	sprintf(build_date,"20%d-%02d-%02d", AC_VERSION_YEAR, AC_VERSION_MONTH, AC_VERSION_DAY);
+	Fmt_Snprintf(build_date, sizeof(build_date), "20%d-%02d-%02d", AC_VERSION_YEAR, AC_VERSION_MONTH, AC_VERSION_DAY);
 
 	USART_Printf(USART_2, "\r\n\r\nSCD TESYS-MA %s - %s\r\n", version, build_date);
-	USART_Printf(USART_2, "\r\nTemperature computing...\r\n");
 
-	// delay the starting to avoid false starting due to power spark instability that can can cause the flash memory writing error on calling SetTempThreshold() function
+	Fault_Init(); // causa del reset e contatori
+
+	Supervisor_Init(); // primo task registrato: priorità massima
+
+	Restart_Init(); // avvio a caldo dopo un reset dell'IWDG o software
+
+	if (!Restart_Warm())
+	{
+		HAL_GPIO_WritePin(GPIOB, GPIO_PIN_5, GPIO_PIN_RESET);   // leave to reset (OFF) SIM800L Module
+
+		// delay the starting to avoid false starting due to power spark instability that can can cause the flash memory writing error on calling SetTempThreshold() function
 
-	HAL_Delay(5000);
+		HAL_Delay(5000);
+	}
+	else
+	if (!Restart_Modem()) // il modem va reinizializzato
+	{
+		HAL_GPIO_WritePin(GPIOB, GPIO_PIN_5, GPIO_PIN_RESET);
+
+		HAL_Delay(GSM_RESET_PULSE);
+	}
 
-	HAL_GPIO_WritePin(GPIOB, GPIO_PIN_5, GPIO_PIN_SET);   // start SIM800L
+	HAL_GPIO_WritePin(GPIOB, GPIO_PIN_5, GPIO_PIN_SET);   // start SIM800L (all'avvio a caldo è già acceso)
 
-	WatchdogRefresh();
+	Supervisor_Kick(); // lo scheduler non è ancora in esecuzione
 
-	SM_Alarm_Init();
+	SM_Alarm_Init(Restart_Alarm());
+
+	DataLog_Init();
+
+	DataLog_Event(DL_BOOT, RCC->CSR >> 24); // flag della causa di reset
 
 	ParserInit();
 
-	SIM800L_Init();
+	SIM800L_Init(Restart_Modem());
+
+	if (Restart_Warm())
+	{
+		USART_Printf(USART_2, "\r\nRiavvio a caldo: %s, modem %s\r\n", Restart_CauseName(Restart_Cause()), Restart_Modem() ? "configurato" : "reinizializzato");
+	}
+
+	const SupervisorReset_TypeDef *wdg = Supervisor_LastReset(); // dopo la registrazione dei task
+
+	if (wdg->valid)
+	{
+		USART_Printf(USART_2, "\r\nReset watchdog: task in ritardo %s, in esecuzione %s\r\n", wdg->starved ? wdg->starved : "-", wdg->running ? wdg->running : "-");
+
+		DataLog_Event(DL_WATCHDOG, (wdg->id < SV_TASKS) ? wdg->id + 1 : 0);
+	}
+
+	FaultReset_TypeDef reset = Fault_LastReset();
+
+	if (reset != FAULT_RESET_POWER)
+	{
+		SMS_TypeDef *report = MsgPool_Alloc(MSG_SMS_BUILD); // rapporto composto direttamente nell'SMS
+
+		if (report)
+		{
+			memset(report, 0, sizeof(*report));
+
+			USART_Printf(USART_2, "\r\n%s", Fault_Report(report->mess, FAULT_REPORT_LENGTH));
+
+			if (FAULT_REPORT_SMS && (reset == FAULT_RESET_WATCHDOG || reset == FAULT_RESET_HARDFAULT || reset == FAULT_RESET_ERROR))
+			{
+				SIMM800L_Schedule_SMS_Report(report); // la proprietà passa allo scheduler del modem
+			}
+			else
+			{
+				MsgPool_Free(report);
+			}
+		}
+
+		if (Fault_Captured())
+		{
+			DataLog_Event(DL_FAULT, (int32_t) Fault_Captured()->pc);
+		}
+	}
+
+	__HAL_RCC_CLEAR_RESET_FLAGS();
+
+	Power_Init();
 
 	float temp = *(float*) DATA_CFG_ADDRESS;
 
@@ -64,25 +149,164 @@ static void App_Init(void)
 		SetTempThreshold(*(float*) DATA_CFG_ADDRESS);
 	}
 
-	SetTemp(ReadTemperature()); // waiting for temperature reading
+	USART_Printf(USART_2, "\r\nThreshold  : %0.1f °C\r\n", GetTempThreshold()); // la prima lettura è acquisita dal loop principale
+
+	Console_Init();
+
+	Telemetry_Init();
+}
+
+/**
+ * @fn void DataLog_Task(void)
+ * @brief task del datalogger: le cancellazioni della flash sono eseguite solo a sistema inattivo
+ *
+ */
+static void DataLog_Task(void)
+{
+	DataLog_Exec(GSM_Status() == GSM_IDLE && AlarmSMStatus() == AS_IDLE);
+}
+
+/**
+ * @fn void Report_Task(void)
+ * @brief task del riepilogo periodico della storia sulla console
+ *
+ */
+static void Report_Task(void)
+{
+	char report[160];
+
+	PowerStats_TypeDef power;
+
+	// scrittura bloccante: report è riutilizzato subito
+	USART_Printf(USART_2, "\r\n%s", History_Report(report, sizeof(report)));
+
+	USART_Printf(USART_2, "%s", TimSys_LoopReport(report, sizeof(report)));
+
+	USART_Printf(USART_2, "%s", MsgPool_Report(report, sizeof(report)));
+
+	USART_Printf(USART_2, "%s", USART_StatsReport(USART_1, report, sizeof(report)));
+
+	USART_Printf(USART_2, "%s", USART_StatsReport(USART_2, report, sizeof(report)));
+
+	Power_Stats(&power);
+
+	USART_Printf(USART_2, "Duty cycle: %0.1f %%, corrente stimata: %0.2f mA, risvegli: %lu, clock: %s\r\n", power.duty, power.current, (unsigned long) power.wakeups, Clock_ProfileName(Clock_Profile()));
+}
+
+/**
+ * @fn uint8_t SystemIdle(void)
+ * @brief sistema inattivo: modem e allarme a riposo, nessun campionamento in corso
+ *
+ */
+static uint8_t SystemIdle(void)
+{
+	return GSM_Status() == GSM_IDLE && AlarmSMStatus() == AS_IDLE && ADCInterface()->isStopped();
+}
+
+/**
+ * @fn void Clock_Task(void)
+ * @brief task del profilo di clock: profilo a basso consumo dopo CLOCK_IDLE_TIME di inattività, profilo ad alte
+ *        prestazioni appena il sistema torna attivo
+ *
+ */
+static void Clock_Task(void)
+{
+	static uint32_t busy_tick = 0;
+
+	if (!SystemIdle())
+	{
+		busy_tick = HAL_GetTick();
+
+		Clock_SetProfile(CLOCK_PERFORMANCE);
+	}
+	else if (HAL_GetTick() - busy_tick >= CLOCK_IDLE_TIME)
+	{
+		Clock_SetProfile(CLOCK_LOW_POWER);
+	}
+}
+
+/**
+ * @fn uint8_t StopAllowed(void)
+ * @brief lo Stop mode ferma i clock delle periferiche: ammesso solo con il sistema inattivo, le UART senza
+ *        trasmissioni in corso e l'ADC fermo (né in campionamento né in watch)
+ *
+ */
+static uint8_t StopAllowed(void)
+{
+	return SystemIdle()
+	    && huart1.gState == HAL_UART_STATE_READY
+	    && huart2.gState == HAL_UART_STATE_READY
+	    && !USART_Bridged(USART_1)
+	    && !ADCInterface()->isWatching();
+}
+
+/**
+ * @fn void Bridge_Task(void)
+ * @brief task del bridge DMA console <-> modem, eseguito su richiesta (App_Bridge): attiva o disattiva il bridge.
+ *        Durante il bridge la macchina a stati del modem è sospesa: si attiva solo col modem in IDLE e senza allarmi
+ *        da notificare, così nessuna risposta attesa dal parser passa al terminale e nessuna chiamata resta ferma.
+ */
+static void Bridge_Task(void)
+{
+	if (App_BridgeStop())
+	{
+		USART_Printf(USART_2, "\r\nBridge modem terminato\r\n");
+	}
+	else
+	if (GSM_Status() != GSM_IDLE)
+	{
+		USART_Printf(USART_2, "\r\nBridge modem non disponibile: modem occupato\r\n");
+	}
+	else
+	if (AlarmSMStatus() != AS_IDLE)
+	{
+		USART_Printf(USART_2, "\r\nBridge modem non disponibile: allarme in notifica\r\n");
+	}
+	else
+	{
+		SIM800L_Suspend(1);
+
+		USART_Printf(USART_2, "\r\nBridge modem attivo, CTRL+B per uscire\r\n");
 
-	USART_Printf(USART_2, "\r\nTemperature: %0.1f °C\r\nThreshold  : %0.1f °C\r\n", GetTemp(), GetTempThreshold());
+		if (!USART_BridgeStart(USART_1, USART_2))
+		{
+			SIM800L_Suspend(0);
+
+			USART_Printf(USART_2, "Bridge modem non disponibile\r\n");
+		}
+	}
 }
 
 // Exported functions -----------------------------------------------------------------------------------------------------------------------
 
 /**
- * @fn void WatchDogRefresh(void)
- * @brief
+ * @fn uint8_t App_BridgeStop(void)
+ * @brief termina il bridge DMA console <-> modem, se attivo, e riprende la macchina a stati del modem
  *
+ * @return 1 se il bridge era attivo
  */
-void WatchdogRefresh(void)
+uint8_t App_BridgeStop(void)
 {
-  #ifdef WATCHDOG
+	if (!USART_Bridged(USART_1))
+	{
+		return 0;
+	}
 
-	HAL_IWDG_Refresh(&hiwdg);
+	USART_BridgeStop();
 
-  #endif
+	SIM800L_Suspend(0);
+
+	return 1;
+}
+
+/**
+ * @fn void App_Bridge(void)
+ * @brief richiede l'attivazione o la disattivazione del bridge DMA console <-> modem (ISR safe)
+ *
+ */
+void App_Bridge(void)
+{
+	TimSys_TaskSignal(&bridge_task);
 }
 
 /**
@@ -92,13 +316,29 @@ void WatchdogRefresh(void)
  */
 void App_Start(void)
 {
-	App_Init();
+	static TimSys_Task_TypeDef datalog_task;
+	static TimSys_Task_TypeDef report_task;
+	static TimSys_Task_TypeDef clock_task;
+
+	App_Init(); // i moduli registrano i propri task (adc, alarm, gsm)
+
+	TimSys_TaskRegister(&datalog_task, "datalog", DataLog_Task);
+	TimSys_TaskStart(&datalog_task, 1000, 1000);
+
+	TimSys_TaskRegister(&report_task, "report", Report_Task);
+	TimSys_TaskStart(&report_task, HISTORY_REPORT_TIME, HISTORY_REPORT_TIME);
+
+	TimSys_TaskRegister(&clock_task, "clock", Clock_Task);
+	TimSys_TaskStart(&clock_task, 1000, 1000);
+
+	TimSys_TaskRegister(&bridge_task, "bridge", Bridge_Task); // eseguito solo su richiesta (App_Bridge)
 
 	while (1)
 	{
-		SIM800L_SM_Exec();
-
-		SM_Alarm_Exec();
+		if (!TimSys_Run()) // esegue solo i task pronti
+		{
+			Power_Idle(StopAllowed()); // nessun task pronto: dorme fino alla prossima scadenza
+		}
 	}
 }
 
@@ -0,0 +1,277 @@
+/**
+ * @file alarm_rules.c - https://github.com/SC-Develop/tesysma
+ *
+ * @author Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/SC-Develop/
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ *
+ * Regole di allarme valutate dopo ogni campionamento della temperatura:
+ *
+ * - soglia bassa e soglia alta, ciascuna con la propria isteresi di rientro
+ * - allarme predittivo: la pendenza dT/dt è stimata con la regressione ai minimi quadrati sugli ultimi
+ *   RULES_HISTORY_SIZE campioni; se il tempo stimato per raggiungere una soglia è inferiore all'orizzonte
+ *   configurato la regola predittiva si attiva prima che la soglia sia effettivamente superata.
+ *
+ * La regressione è ricalcolata sulla finestra a ogni campione, con ascisse e temperature centrate sulle loro medie:
+ * la finestra è breve e i float restano precisi qualunque sia l'istante assoluto o il passo di campionamento.
+ * Somme aggiornate in modo incrementale accumulerebbero invece l'errore di arrotondamento a ogni campione.
+ */
+
+#include "limits.h"
+#include "alarm_rules.h"
+
+/**
+ * @struct
+ * @brief storia dei campioni e stato delle regole
+ *
+ */
+typedef struct {
+
+	uint32_t tick[RULES_HISTORY_SIZE];	// istante di ciascun campione [msec]
+	float    temp[RULES_HISTORY_SIZE];	// temperatura di ciascun campione [°C]
+	uint8_t  head;						// posizione del campione più vecchio
+	uint8_t  count;						// campioni presenti
+
+	float    slope;						// pendenza [°C/s]
+	uint32_t crossing;					// tempo stimato per il raggiungimento della soglia più vicina [s]
+	uint8_t  active;					// regole attive (AlarmRule_TypeDef)
+
+} AlarmRules_TypeDef;
+
+// Variables ------------------------------------------------------------------------------------------------------------------------------
+
+static AlarmRules_TypeDef rules = {
+	.crossing = UINT_MAX,
+};
+
+// - Local functions ----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @fn float Abscissa(uint8_t)
+ * @brief ascissa del campione: secondi trascorsi dal campione più vecchio della finestra
+ *
+ * @param i posizione nella finestra, 0 il campione più vecchio
+ */
+static float Abscissa(uint8_t i)
+{
+	uint8_t idx = (rules.head + i) % RULES_HISTORY_SIZE;
+
+	return (rules.tick[idx] - rules.tick[rules.head]) / 1000.0f;
+}
+
+/**
+ * @fn float Ordinate(uint8_t)
+ * @brief temperatura del campione
+ *
+ * @param i posizione nella finestra, 0 il campione più vecchio
+ */
+static float Ordinate(uint8_t i)
+{
+	return rules.temp[(rules.head + i) % RULES_HISTORY_SIZE];
+}
+
+/**
+ * @fn void AddSample(float, uint32_t)
+ * @brief aggiunge un campione alla storia, rimuovendo il più vecchio se la storia è piena
+ */
+static void AddSample(float temp, uint32_t tick)
+{
+	if (rules.count == RULES_HISTORY_SIZE) // rimuove il campione più vecchio
+	{
+		rules.head = (rules.head + 1) % RULES_HISTORY_SIZE;
+		rules.count--;
+	}
+
+	uint8_t idx = (rules.head + rules.count) % RULES_HISTORY_SIZE;
+
+	rules.tick[idx] = tick;
+	rules.temp[idx] = temp;
+	rules.count++;
+}
+
+/**
+ * @fn float Slope(void)
+ * @brief pendenza della retta di regressione ai minimi quadrati
+ *
+ * @return [°C/s], 0 se i campioni non sono sufficienti
+ */
+static float Slope(void)
+{
+	if (rules.count < RULES_MIN_SAMPLES)
+	{
+		return 0;
+	}
+
+	float mx = 0, my = 0;
+
+	for (uint8_t i = 0; i < rules.count; i++)
+	{
+		mx += Abscissa(i);
+		my += Ordinate(i);
+	}
+
+	mx /= rules.count;
+	my /= rules.count;
+
+	float sxx = 0, sxy = 0; // somme degli scarti dalle medie
+
+	for (uint8_t i = 0; i < rules.count; i++)
+	{
+		float dx = Abscissa(i) - mx;
+
+		sxx += dx * dx;
+		sxy += dx * (Ordinate(i) - my);
+	}
+
+	if (sxx < 1e-6f)
+	{
+		return 0;
+	}
+
+	return sxy / sxx;
+}
+
+/**
+ * @fn uint32_t CrossingTime(float, float)
+ * @brief tempo stimato per raggiungere la soglia con la pendenza corrente
+ *
+ * @param temp      temperatura attuale
+ * @param threshold soglia
+ * @return [s], UINT_MAX se la temperatura non si sta avvicinando alla soglia
+ */
+static uint32_t CrossingTime(float temp, float threshold)
+{
+	float distance = threshold - temp;
+
+	if (rules.slope == 0 || distance * rules.slope <= 0) // pendenza nulla o in allontanamento dalla soglia
+	{
+		return UINT_MAX;
+	}
+
+	float t = distance / rules.slope;
+
+	return (t < (float) UINT_MAX) ? (uint32_t) t : UINT_MAX;
+}
+
+/**
+ * @fn void Latch(uint8_t, uint8_t, uint8_t)
+ * @brief attiva la regola se la condizione di intervento è vera, la disattiva se la condizione di rientro è vera
+ */
+static void Latch(uint8_t rule, uint8_t set, uint8_t clear)
+{
+	if (set)
+	{
+		rules.active |= rule;
+	}
+	else if (clear)
+	{
+		rules.active &= ~rule;
+	}
+}
+
+// - Exported functions -------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @fn uint8_t Rules_Exec(const AlarmRulesConfig_TypeDef*, float, uint32_t)
+ * @brief valuta le regole di allarme sul nuovo campione di temperatura
+ *
+ * Le regole di soglia si attivano al superamento della soglia e rientrano solo oltre l'isteresi. Le regole
+ * predittive si attivano quando il tempo stimato di raggiungimento della soglia è inferiore all'orizzonte e
+ * rientrano quando supera il doppio dell'orizzonte o quando la temperatura non si avvicina più alla soglia.
+ *
+ * @param cfg   configurazione delle regole
+ * @param temp  temperatura campionata [°C]
+ * @param tick  istante del campionamento [msec]
+ * @return maschera delle regole attive (AlarmRule_TypeDef)
+ */
+uint8_t Rules_Exec(const AlarmRulesConfig_TypeDef *cfg, float temp, uint32_t tick)
+{
+	AddSample(temp, tick);
+
+	rules.slope = Slope();
+
+	// soglia bassa
+	Latch(RULE_LOW, temp < cfg->low, temp > cfg->low + cfg->low_hyst);
+
+	uint32_t t_low  = CrossingTime(temp, cfg->low);
+	uint32_t t_high = UINT_MAX;
+
+	// soglia alta
+	if (cfg->high_enabled)
+	{
+		Latch(RULE_HIGH, temp > cfg->high, temp < cfg->high - cfg->high_hyst);
+
+		t_high = CrossingTime(temp, cfg->high);
+	}
+	else
+	{
+		rules.active &= ~(RULE_HIGH | RULE_PREDICT_HIGH);
+	}
+
+	rules.crossing = (t_low < t_high) ? t_low : t_high;
+
+	// previsione
+	if (cfg->horizon)
+	{
+		uint32_t reset = (cfg->horizon < UINT_MAX / 2) ? 2 * cfg->horizon : UINT_MAX;
+
+		Latch(RULE_PREDICT_LOW, !(rules.active & RULE_LOW) && t_low < cfg->horizon, (rules.active & RULE_LOW) || t_low > reset);
+
+		if (cfg->high_enabled)
+		{
+			Latch(RULE_PREDICT_HIGH, !(rules.active & RULE_HIGH) && t_high < cfg->horizon, (rules.active & RULE_HIGH) || t_high > reset);
+		}
+	}
+	else
+	{
+		rules.active &= ~(RULE_PREDICT_LOW | RULE_PREDICT_HIGH);
+	}
+
+	return rules.active;
+}
+
+/**
+ * @fn uint8_t Rules_Active(void)
+ * @brief regole attive dopo l'ultima valutazione
+ *
+ * @return maschera AlarmRule_TypeDef
+ */
+uint8_t Rules_Active(void)
+{
+	return rules.active;
+}
+
+/**
+ * @fn float Rules_Slope(void)
+ * @brief pendenza stimata della temperatura
+ *
+ * @return [°C/min]
+ */
+float Rules_Slope(void)
+{
+	return rules.slope * 60;
+}
+
+/**
+ * @fn uint32_t Rules_CrossingTime(void)
+ * @brief tempo stimato per raggiungere la soglia più vicina
+ *
+ * @return [s], UINT_MAX se la temperatura non si avvicina ad alcuna soglia
+ */
+uint32_t Rules_CrossingTime(void)
+{
+	return rules.crossing;
+}
+
+/**
+ * @fn void Rules_Reset(void)
+ * @brief azzera la storia e lo stato delle regole
+ */
+void Rules_Reset(void)
+{
+	rules.head     = 0;
+	rules.count    = 0;
+	rules.slope    = 0;
+	rules.active   = RULE_NONE;
+	rules.crossing = UINT_MAX;
+}
@@ -0,0 +1,236 @@
+/**
+ * @file clock.c - https://github.com/SC-Develop/tesysma
+ *
+ * @author Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/SC-Develop/
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ *
+ * Profili di clock selezionabili a run-time:
+ *
+ * - CLOCK_PERFORMANCE: PLL da HSE (25 MHz / M 25 * N 200 / P 2) = 100 MHz, APB1 e APB2 a 50 MHz, 3 wait state della
+ *   flash (2.7 - 3.6 V), prefetch, cache istruzioni e dati
+ * - CLOCK_DEFAULT: HSE a 25 MHz senza PLL, come SystemClock_Config
+ * - CLOCK_LOW_POWER: HSE / 4 = 6.25 MHz per l'idle; è il clock minimo per cui l'errore del baud rate a 115200 resta
+ *   sotto l'1% (BRR 3.375)
+ *
+ * Ad ogni cambio di profilo HAL_RCC_ClockConfig riprogramma il SysTick; i baud rate delle UART sono ricalcolati
+ * dal clock del bus (BRR) e il prescaler dell'ADC è scelto perché il clock dell'ADC non superi CLOCK_ADC_FREQ,
+ * il clock per cui sono dimensionati i tempi di campionamento di sm_adc.
+ * Con l'ADC acceso (watch) il nuovo prescaler è applicato dalla successiva HAL_ADC_Init di sm_adc, al prossimo
+ * campionamento.
+ */
+
+#include "usart.h"
+#include "adc.h"
+#include "timsys.h"
+#include "clock.h"
+
+/**
+ * @struct
+ * @brief configurazione del profilo
+ *
+ */
+typedef struct {
+	const char *name;
+	uint8_t     pll;			// SYSCLK da PLL, altrimenti da HSE
+	uint32_t    ahb;			// prescaler AHB (HCLK)
+	uint32_t    apb1;			// prescaler APB1 (USART2), max 50 MHz
+	uint32_t    apb2;			// prescaler APB2 (USART1, ADC)
+	uint32_t    latency;		// wait state della flash
+	uint8_t     prefetch;
+	uint32_t    run_current;	// corrente stimata in run [uA]
+	uint32_t    sleep_current;	// corrente stimata in Sleep [uA]
+} ClockProfileCfg_TypeDef;
+
+// Variables ------------------------------------------------------------------------------------------------------------------------------
+
+static const ClockProfileCfg_TypeDef profiles[CLOCK_PROFILES] = {
+	[CLOCK_PERFORMANCE] = { .name = "performance", .pll = 1, .ahb = RCC_SYSCLK_DIV1, .apb1 = RCC_HCLK_DIV2, .apb2 = RCC_HCLK_DIV2, .latency = FLASH_LATENCY_3, .prefetch = 1, .run_current = 14000, .sleep_current = 5500 },
+	[CLOCK_DEFAULT]     = { .name = "default",     .pll = 0, .ahb = RCC_SYSCLK_DIV1, .apb1 = RCC_HCLK_DIV1, .apb2 = RCC_HCLK_DIV1, .latency = FLASH_LATENCY_0, .prefetch = 0, .run_current = 6000,  .sleep_current = 2500 },
+	[CLOCK_LOW_POWER]   = { .name = "low power",   .pll = 0, .ahb = RCC_SYSCLK_DIV4, .apb1 = RCC_HCLK_DIV1, .apb2 = RCC_HCLK_DIV1, .latency = FLASH_LATENCY_0, .prefetch = 0, .run_current = 2500,  .sleep_current = 1200 },
+};
+
+static ClockProfile_TypeDef current = CLOCK_DEFAULT;
+
+// - Local functions ----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @fn uint32_t AdcPrescaler(uint32_t)
+ * @brief prescaler minimo dell'ADC per cui il clock dell'ADC non supera CLOCK_ADC_FREQ
+ *
+ * @param pclk2 clock di APB2 [Hz]
+ */
+static uint32_t AdcPrescaler(uint32_t pclk2)
+{
+	if (pclk2 <= 2 * CLOCK_ADC_FREQ) return ADC_CLOCK_SYNC_PCLK_DIV2;
+	if (pclk2 <= 4 * CLOCK_ADC_FREQ) return ADC_CLOCK_SYNC_PCLK_DIV4;
+	if (pclk2 <= 6 * CLOCK_ADC_FREQ) return ADC_CLOCK_SYNC_PCLK_DIV6;
+
+	return ADC_CLOCK_SYNC_PCLK_DIV8;
+}
+
+/**
+ * @fn void Apply(ClockProfile_TypeDef)
+ * @brief programma oscillatori, PLL, bus e flash del profilo e ricalcola i clock delle periferiche
+ */
+static void Apply(ClockProfile_TypeDef profile)
+{
+	const ClockProfileCfg_TypeDef *cfg = &profiles[profile];
+
+	RCC_OscInitTypeDef RCC_OscInitStruct = {0};
+	RCC_ClkInitTypeDef RCC_ClkInitStruct = {0};
+
+	RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_HSE;
+	RCC_OscInitStruct.HSEState       = RCC_HSE_ON;
+
+	if (cfg->pll)
+	{
+		RCC_OscInitStruct.PLL.PLLState  = RCC_PLL_ON;
+		RCC_OscInitStruct.PLL.PLLSource = RCC_PLLSOURCE_HSE;
+		RCC_OscInitStruct.PLL.PLLM      = 25;	// 1 MHz all'ingresso del VCO
+		RCC_OscInitStruct.PLL.PLLN      = 200;	// VCO a 200 MHz
+		RCC_OscInitStruct.PLL.PLLP      = RCC_PLLP_DIV2;
+		RCC_OscInitStruct.PLL.PLLQ      = 4;
+	}
+	else
+	{
+		RCC_OscInitStruct.PLL.PLLState  = RCC_PLL_NONE;
+	}
+
+	if (HAL_RCC_OscConfig(&RCC_OscInitStruct) != HAL_OK)
+	{
+		Error_Handler();
+	}
+
+	if (cfg->prefetch)
+	{
+		__HAL_FLASH_PREFETCH_BUFFER_ENABLE();
+	}
+
+	__HAL_FLASH_INSTRUCTION_CACHE_ENABLE();
+	__HAL_FLASH_DATA_CACHE_ENABLE();
+
+	RCC_ClkInitStruct.ClockType      = RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_SYSCLK | RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2;
+	RCC_ClkInitStruct.SYSCLKSource   = cfg->pll ? RCC_SYSCLKSOURCE_PLLCLK : RCC_SYSCLKSOURCE_HSE;
+	RCC_ClkInitStruct.AHBCLKDivider  = cfg->ahb;
+	RCC_ClkInitStruct.APB1CLKDivider = cfg->apb1;
+	RCC_ClkInitStruct.APB2CLKDivider = cfg->apb2;
+
+	// HAL_RCC_ClockConfig aumenta i wait state prima di alzare il clock e li riduce dopo averlo abbassato,
+	// e riprogramma il SysTick con il nuovo HCLK
+
+	TimSys_MicrosSync(); // chiude l'intervallo al clock precedente
+
+	if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, cfg->latency) != HAL_OK)
+	{
+		Error_Handler();
+	}
+
+	TimSys_MicrosSync(); // fattore di conversione del nuovo clock
+
+	if (!cfg->prefetch)
+	{
+		__HAL_FLASH_PREFETCH_BUFFER_DISABLE(); // a 0 wait state il prefetch consuma senza vantaggi
+	}
+
+	if (!cfg->pll && (RCC->CR & RCC_CR_PLLON)) // PLL non più in uso
+	{
+		RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_NONE;
+		RCC_OscInitStruct.PLL.PLLState   = RCC_PLL_OFF;
+
+		HAL_RCC_OscConfig(&RCC_OscInitStruct);
+	}
+
+	// baud rate: USART1 su APB2, USART2 su APB1
+
+	huart1.Instance->BRR = UART_BRR_SAMPLING16(HAL_RCC_GetPCLK2Freq(), huart1.Init.BaudRate);
+	huart2.Instance->BRR = UART_BRR_SAMPLING16(HAL_RCC_GetPCLK1Freq(), huart2.Init.BaudRate);
+
+	// prescaler dell'ADC: applicato subito ad ADC spento, altrimenti dalla prossima HAL_ADC_Init
+
+	hadc1.Init.ClockPrescaler = AdcPrescaler(HAL_RCC_GetPCLK2Freq());
+
+	if (!(hadc1.Instance->CR2 & ADC_CR2_ADON))
+	{
+		MODIFY_REG(ADC1_COMMON->CCR, ADC_CCR_ADCPRE, hadc1.Init.ClockPrescaler);
+	}
+
+	current = profile;
+}
+
+// - Exported functions -------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @fn uint8_t Clock_SetProfile(ClockProfile_TypeDef)
+ * @brief seleziona il profilo di clock. Il cambio non è eseguito con una trasmissione UART in corso: un byte in
+ *        ricezione durante il cambio può essere perso.
+ *
+ * @param profile
+ * @return 0 se il cambio non è possibile ora (UART occupate)
+ */
+uint8_t Clock_SetProfile(ClockProfile_TypeDef profile)
+{
+	if (profile >= CLOCK_PROFILES)
+	{
+		return 0;
+	}
+
+	if (profile == current)
+	{
+		return 1;
+	}
+
+	if (huart1.gState != HAL_UART_STATE_READY || huart2.gState != HAL_UART_STATE_READY)
+	{
+		return 0;
+	}
+
+	Apply(profile);
+
+	return 1;
+}
+
+/**
+ * @fn ClockProfile_TypeDef Clock_Profile(void)
+ * @brief profilo corrente
+ */
+ClockProfile_TypeDef Clock_Profile(void)
+{
+	return current;
+}
+
+/**
+ * @fn void Clock_Resume(void)
+ * @brief ripristina il profilo corrente all'uscita dallo Stop mode (il clock di sistema è HSI, HSE e PLL spenti)
+ */
+void Clock_Resume(void)
+{
+	Apply(current);
+}
+
+/**
+ * @fn const char Clock_ProfileName*(ClockProfile_TypeDef)
+ * @brief nome del profilo, per la console
+ */
+const char *Clock_ProfileName(ClockProfile_TypeDef profile)
+{
+	return (profile < CLOCK_PROFILES) ? profiles[profile].name : "?";
+}
+
+/**
+ * @fn uint32_t Clock_RunCurrent(void)
+ * @brief corrente stimata in run con il profilo corrente [uA]
+ */
+uint32_t Clock_RunCurrent(void)
+{
+	return profiles[current].run_current;
+}
+
+/**
+ * @fn uint32_t Clock_SleepCurrent(void)
+ * @brief corrente stimata in Sleep con il profilo corrente [uA]
+ */
+uint32_t Clock_SleepCurrent(void)
+{
+	return profiles[current].sleep_current;
+}
@@ -0,0 +1,1169 @@
+/**
+ * @file   console.c - https://github.com/SC-Develop/tesysma
+ *
+ * @author Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/SC-Develop/
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ *
+ * Console di manutenzione sul terminale seriale (USART2), sul parser dei comandi di libparser (PARSER_2).
+ *
+ * I comandi sono eseguiti dal task della console, segnalato dalla ricezione di un carattere. Gli elenchi (GET,
+ * STATS, PROFILE, HISTORY, MODEM, HELP, TELEMETRY) sono scritti una riga alla volta solo quando la riga entra nella coda di
+ * trasmissione: il task non attende mai lo svuotamento della coda, si riprogramma dopo CONSOLE_DUMP_DELAY. Un nuovo
+ * comando interrompe l'elenco in corso.
+ */
+
+#include <ctype.h>
+#include <string.h>
+#include "console.h"
+#include "libparser.h"
+#include "libfmt.h"
+#include "stm32_lib_usart.h"
+#include "sm_alarm.h"
+#include "history.h"
+#include "datalog.h"
+#include "msgpool.h"
+#include "power.h"
+#include "SIM800L.h"
+#include "telemetry.h"
+
+// Defines ----------------------------------------------------------------------------------------------------------------------------------
+
+#define NTC_FIELDS			7			// righe di GET NTCn: EQ, BETA, A, B, D, RC, RREF
+#define MANTISSA_DIGITS		7			// cifre significative dei coefficienti A, B, D (precisione dei float)
+#define MANTISSA_SCALE		1000000UL	// 10^(MANTISSA_DIGITS - 1)
+
+// Types definition ---------------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @enum
+ * @brief comandi della console, indici della tabella dei comandi del parser
+ *
+ */
+typedef enum {
+	CMD_GET = 0,
+	CMD_SET,
+	CMD_STATS,
+	CMD_PROFILE,
+	CMD_HISTORY,
+	CMD_MODEM,
+	CMD_HELP,
+	CMD_TELEMETRY,
+	CMD_NULL,
+	CMD_MAX
+} ConsoleCmd_TypeDef;
+
+/**
+ * @brief riga n di un elenco nel buffer line
+ * @return 0 se l'elenco è terminato
+ */
+typedef uint8_t (*ConsolePage)(uint16_t n, char *line, uint16_t size);
+
+/**
+ * @struct
+ * @brief parametro impostabile con SET e letto con GET: ciascuna riga della lettura, "NOME valore" o
+ *        "NOME CAMPO valore", può essere reinviata come argomento di SET
+ *
+ */
+typedef struct {
+	const char *name;
+	void      (*get)(char *line, uint16_t size, uint8_t index, uint8_t n);
+	uint8_t   (*set)(char *args, uint8_t index);
+	uint8_t     index;		// NTC o voce della rubrica
+	uint8_t     lines;		// righe della lettura, n da 0 a lines - 1
+} Param_TypeDef;
+
+// - Local Function Prototypes ------------------------------------------------------------------------------- /
+
+static uint8_t Exec(char *args, uint8_t cmd_index);
+static uint8_t Echo(ParserResult_TypeDef result, char ch);
+
+static void    GetThreshold(char *line, uint16_t size, uint8_t index, uint8_t n);
+static uint8_t SetThreshold(char *args, uint8_t index);
+static void    GetHigh(char *line, uint16_t size, uint8_t index, uint8_t n);
+static uint8_t SetHigh(char *args, uint8_t index);
+static void    GetAlarm(char *line, uint16_t size, uint8_t index, uint8_t n);
+static uint8_t SetAlarm(char *args, uint8_t index);
+static void    GetAutoEnable(char *line, uint16_t size, uint8_t index, uint8_t n);
+static uint8_t SetAutoEnable(char *args, uint8_t index);
+static void    GetNtc(char *line, uint16_t size, uint8_t index, uint8_t n);
+static uint8_t SetNtc(char *args, uint8_t index);
+static void    GetContact(char *line, uint16_t size, uint8_t index, uint8_t n);
+static uint8_t SetContact(char *args, uint8_t index);
+
+// - Local variables ----------------------------------------------------------------------------------------- /
+
+static Commands_TypeDef commands[CMD_MAX] = {
+	[CMD_GET]       = {"GET"       , NULL, Exec, Echo,},
+	[CMD_SET]       = {"SET"       , NULL, Exec, Echo,},
+	[CMD_STATS]     = {"STATS"     , NULL, Exec, Echo,},
+	[CMD_PROFILE]   = {"PROFILE"   , NULL, Exec, Echo,},
+	[CMD_HISTORY]   = {"HISTORY"   , NULL, Exec, Echo,},
+	[CMD_MODEM]     = {"MODEM"     , NULL, Exec, Echo,},
+	[CMD_HELP]      = {"HELP"      , NULL, Exec, Echo,},
+	[CMD_TELEMETRY] = {"TELEMETRY" , NULL, Exec, Echo,},
+	[CMD_NULL]      = {NULL        , NULL, NULL, NULL,},
+};
+
+static const Param_TypeDef params[] = {
+	{ "THRESHOLD",  GetThreshold,  SetThreshold,  0,       1          },
+	{ "HIGH",       GetHigh,       SetHigh,       0,       1          },
+	{ "ALARM",      GetAlarm,      SetAlarm,      0,       1          },
+	{ "AUTOENABLE", GetAutoEnable, SetAutoEnable, 0,       1          },
+	{ "NTC1",       GetNtc,        SetNtc,        NTC1,    NTC_FIELDS },
+	{ "NTC2",       GetNtc,        SetNtc,        NTC2,    NTC_FIELDS },
+	{ "CONTACT1",   GetContact,    SetContact,    PHONE_1, 1          },
+	{ "CONTACT2",   GetContact,    SetContact,    PHONE_2, 1          },
+	{ "CONTACT3",   GetContact,    SetContact,    PHONE_3, 1          },
+};
+
+#define PARAMS (sizeof(params) / sizeof(params[0]))
+
+static const char *help[] = {
+	"GET [nome]              parametri: THRESHOLD HIGH ALARM AUTOENABLE NTC1 NTC2 CONTACT1..3\r\n",
+	"SET THRESHOLD t         soglia di allarme [gradi], salvata in flash\r\n",
+	"SET HIGH t|OFF          soglia alta [gradi]\r\n",
+	"SET ALARM ON|OFF        allarme attivo\r\n",
+	"SET AUTOENABLE 0|1      riattivazione automatica dell'allarme\r\n",
+	"SET NTCn A|B|D|BETA|RC|RREF v, SET NTCn EQ BETA|ABD   parametri del termistore (non salvati)\r\n",
+	"SET CONTACTn [numero]   voce della rubrica del modem, senza numero la cancella\r\n",
+	"STATS [RESET]           statistiche delle porte, del loop, dei messaggi, del consumo e temperature delle sonde\r\n",
+	"PROFILE [RESET]         profiling e tempi dei task (anche CTRL+P)\r\n",
+	"HISTORY [n]             statistiche della storia e ultimi n campioni\r\n",
+	"MODEM [MONITOR ON|OFF]  stato del modem, eco sul terminale dei caratteri ricevuti dal modem (CTRL+B: bridge diretto)\r\n",
+	"TELEMETRY [ON|OFF|m]    telemetria binaria COBS: tutti i tipi, spenta o maschera m (1 ADC 2 TEMP 4 GSM 8 PARSER 16 PROFILE)\r\n",
+};
+
+#define HELP_LINES (sizeof(help) / sizeof(help[0]))
+
+static TimSys_Task_TypeDef console_task; // segnalato dalla ricezione dal terminale, riprogrammato durante un elenco
+
+static volatile uint8_t profile_request; // CTRL+P ricevuto dalla ISR
+
+static volatile uint8_t modem_monitor; // MODEM MONITOR ON: eco dei caratteri del modem, letto dalla ISR di USART1
+
+static struct {
+	ConsolePage page;						// elenco in corso, NULL se nessuno
+	uint16_t    n;							// prossima riga
+	uint16_t    end;						// righe dell'elenco al più
+	uint16_t    len;						// riga pronta in line in attesa di spazio nella coda di trasmissione
+	char        line[CONSOLE_LINE_LENGTH];
+} dump;
+
+// - Local Functions ----------------------------------------------------------------------------------------- /
+
+/**
+ * @fn char Token*(char**)
+ * @brief estrae la prossima parola separata da spazi dagli argomenti, terminandola
+ *
+ * @param s argomenti, avanzati oltre la parola
+ * @return NULL se non ci sono altre parole
+ */
+static char *Token(char **s)
+{
+	char *t = *s;
+
+	while (*t == SPACE)
+	{
+		t++;
+	}
+
+	if (*t == NULLCH)
+	{
+		*s = t;
+
+		return NULL;
+	}
+
+	char *e = t;
+
+	while (*e && *e != SPACE)
+	{
+		e++;
+	}
+
+	if (*e)
+	{
+		*e++ = NULLCH;
+	}
+
+	*s = e;
+
+	return t;
+}
+
+/**
+ * @fn uint8_t ParseNumber(const char*, double*)
+ * @brief numero decimale con segno ed esponente opzionali (es. -12.5, 7.9E-4): niente strtod, come atoi in parser.c
+ *
+ * @param s parola da convertire, tutta
+ * @param value
+ * @return 0 se la parola non è un numero
+ */
+static uint8_t ParseNumber(const char *s, double *value)
+{
+	double  v      = 0;
+	double  scale  = 1;
+	uint8_t digits = 0;
+	uint8_t minus  = (*s == '-');
+
+	if (*s == '-' || *s == '+')
+	{
+		s++;
+	}
+
+	for (; isdigit((uint8_t) *s); s++, digits++)
+	{
+		v = v * 10 + (*s - '0');
+	}
+
+	if (*s == '.')
+	{
+		for (s++; isdigit((uint8_t) *s); s++, digits++)
+		{
+			v      = v * 10 + (*s - '0');
+			scale /= 10;
+		}
+	}
+
+	if (!digits)
+	{
+		return 0;
+	}
+
+	if (*s == 'E')
+	{
+		uint8_t  negative = (*++s == '-');
+		uint16_t exp      = 0;
+
+		if (*s == '-' || *s == '+')
+		{
+			s++;
+		}
+
+		if (!isdigit((uint8_t) *s))
+		{
+			return 0;
+		}
+
+		for (; isdigit((uint8_t) *s) && exp <= 38; s++)
+		{
+			exp = exp * 10 + (*s - '0');
+		}
+
+		if (exp > 38) // fuori dal campo dei float
+		{
+			return 0;
+		}
+
+		while (exp--)
+		{
+			scale = negative ? scale / 10 : scale * 10;
+		}
+	}
+
+	if (*s)
+	{
+		return 0;
+	}
+
+	*value = (minus ? -v : v) * scale;
+
+	return 1;
+}
+
+/**
+ * @fn uint32_t Mantissa(double, int8_t*)
+ * @brief scompone il valore assoluto di value in mantissa ed esponente decimale, per stampare i coefficienti dei
+ *        termistori con libfmt (%f al più FMT_FLOAT_MAX_PRECISION cifre decimali): la mantissa è un intero di
+ *        MANTISSA_DIGITS cifre, riletto da ParseNumber senza perdita di precisione
+ *
+ * @param value
+ * @param exp esponente della prima cifra
+ * @return mantissa in [10^(MANTISSA_DIGITS-1), 10^MANTISSA_DIGITS), 0 se value è nullo
+ */
+static uint32_t Mantissa(double value, int8_t *exp)
+{
+	double a = (value < 0) ? -value : value;
+
+	*exp = 0;
+
+	if (a == 0)
+	{
+		return 0;
+	}
+
+	for (; a >= 10; (*exp)++)
+	{
+		a /= 10;
+	}
+
+	for (; a < 1; (*exp)--)
+	{
+		a *= 10;
+	}
+
+	uint32_t m = a * MANTISSA_SCALE + 0.5;
+
+	if (m >= 10 * MANTISSA_SCALE) // arrotondamento a 10.000000
+	{
+		m = MANTISSA_SCALE;
+		(*exp)++;
+	}
+
+	return m;
+}
+
+/**
+ * @fn Param_TypeDef FindParam*(const char*)
+ * @brief
+ *
+ * @param name
+ * @return NULL se il parametro non esiste
+ */
+static const Param_TypeDef *FindParam(const char *name)
+{
+	for (uint8_t i = 0; i < PARAMS; i++)
+	{
+		if (strcmp(name, params[i].name) == 0)
+		{
+			return params + i;
+		}
+	}
+
+	return NULL;
+}
+
+// - Parametri ----------------------------------------------------------------------------------------------- /
+
+static void GetThreshold(char *line, uint16_t size, uint8_t index, uint8_t n)
+{
+	Fmt_Snprintf(line, size, "THRESHOLD %0.1f\r\n", GetTempThreshold());
+}
+
+static uint8_t SetThreshold(char *args, uint8_t index)
+{
+	double t;
+
+	char *value = Token(&args);
+
+	if (!value || Token(&args) || !ParseNumber(value, &t) || t <= -50 || t > 100) // campo accettato all'avvio (App_Init)
+	{
+		return 0;
+	}
+
+	SetTempThreshold(t);
+
+	return 1;
+}
+
+static void GetHigh(char *line, uint16_t size, uint8_t index, uint8_t n)
+{
+	if (HighThresholdEnabled())
+	{
+		Fmt_Snprintf(line, size, "HIGH %0.1f\r\n", GetHighThreshold());
+	}
+	else
+	{
+		Fmt_Snprintf(line, size, "HIGH OFF\r\n");
+	}
+}
+
+static uint8_t SetHigh(char *args, uint8_t index)
+{
+	double t;
+
+	char *value = Token(&args);
+
+	if (!value || Token(&args))
+	{
+		return 0;
+	}
+
+	if (strcmp(value, "OFF") == 0)
+	{
+		SetHighThreshold(GetHighThreshold(), 0);
+
+		return 1;
+	}
+
+	if (!ParseNumber(value, &t) || t <= -50 || t > 100)
+	{
+		return 0;
+	}
+
+	SetHighThreshold(t, 1);
+
+	return 1;
+}
+
+static void GetAlarm(char *line, uint16_t size, uint8_t index, uint8_t n)
+{
+	Fmt_Snprintf(line, size, "ALARM %s\r\n", (AlarmStatus() == ALARM_ON) ? "ON" : "OFF");
+}
+
+static uint8_t SetAlarm(char *args, uint8_t index)
+{
+	char *value = Token(&args);
+
+	if (!value || Token(&args))
+	{
+		return 0;
+	}
+
+	if (strcmp(value, "ON") == 0)
+	{
+		EnableAlarm(ALARM_ON);
+	}
+	else
+	if (strcmp(value, "OFF") == 0)
+	{
+		EnableAlarm(ALARM_OFF);
+	}
+	else
+	{
+		return 0;
+	}
+
+	return 1;
+}
+
+static void GetAutoEnable(char *line, uint16_t size, uint8_t index, uint8_t n)
+{
+	Fmt_Snprintf(line, size, "AUTOENABLE %u\r\n", AlarmAutoEnable());
+}
+
+static uint8_t SetAutoEnable(char *args, uint8_t index)
+{
+	char *value = Token(&args);
+
+	if (!value || Token(&args) || (strcmp(value, "0") && strcmp(value, "1")))
+	{
+		return 0;
+	}
+
+	SetAlarmAutoEnable(value[0] == '1');
+
+	return 1;
+}
+
+static void GetNtc(char *line, uint16_t size, uint8_t index, uint8_t n)
+{
+	struct NTC ntc = NTC_Get(index);
+
+	switch (n)
+	{
+		case 0:
+			Fmt_Snprintf(line, size, "NTC%u EQ %s\r\n", index + 1, ntc.betaEnabled ? "BETA" : "ABD");
+		break;
+
+		case 1:
+			Fmt_Snprintf(line, size, "NTC%u BETA %0.3f\r\n", index + 1, (float) ntc.Beta);
+		break;
+
+		case 2:
+		case 3:
+		case 4:
+		{
+			static const char name[] = { 'A', 'B', 'D' };
+
+			double   value = (n == 2) ? ntc.A : (n == 3) ? ntc.B : ntc.D;
+			int8_t   exp;
+			uint32_t m     = Mantissa(value, &exp);
+
+			Fmt_Snprintf(line, size, "NTC%u %c %s%lu.%0*luE%d\r\n", index + 1, name[n - 2], (value < 0) ? "-" : "",
+			             (unsigned long) (m / MANTISSA_SCALE), MANTISSA_DIGITS - 1, (unsigned long) (m % MANTISSA_SCALE), exp);
+		}
+		break;
+
+		case 5:
+			Fmt_Snprintf(line, size, "NTC%u RC %lu\r\n", index + 1, (unsigned long) ntc.Rc);
+		break;
+
+		default:
+			Fmt_Snprintf(line, size, "NTC%u RREF %lu\r\n", index + 1, (unsigned long) ntc.Rref);
+		break;
+	}
+}
+
+static uint8_t SetNtc(char *args, uint8_t index)
+{
+	double v;
+
+	char *field = Token(&args);
+	char *value = Token(&args);
+
+	if (!field || !value || Token(&args))
+	{
+		return 0;
+	}
+
+	if (strcmp(field, "EQ") == 0)
+	{
+		if (strcmp(value, "BETA") && strcmp(value, "ABD"))
+		{
+			return 0;
+		}
+
+		NTC_EnableBetaEq(index, value[0] == 'B');
+
+		return 1;
+	}
+
+	if (!ParseNumber(value, &v))
+	{
+		return 0;
+	}
+
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq(); // la conversione dell'ADC legge i parametri dall'interrupt
+
+	struct NTC ntc = NTC_Get(index);
+
+	uint8_t ok = 1;
+
+	if      (strcmp(field, "A") == 0)               ntc.A    = v;
+	else if (strcmp(field, "B") == 0)               ntc.B    = v;
+	else if (strcmp(field, "D") == 0)               ntc.D    = v;
+	else if (strcmp(field, "BETA") == 0 && v > 0)   ntc.Beta = v;
+	else if (strcmp(field, "RC") == 0 && v >= 1)    ntc.Rc   = v;
+	else if (strcmp(field, "RREF") == 0 && v >= 1)  ntc.Rref = v;
+	else                                            ok       = 0;
+
+	if (ok)
+	{
+		NTC_Set(index, &ntc);
+	}
+
+	__set_PRIMASK(primask);
+
+	return ok;
+}
+
+static void GetContact(char *line, uint16_t size, uint8_t index, uint8_t n)
+{
+	const char *number = GetPhonebook()[index - 1].number;
+
+	Fmt_Snprintf(line, size, "CONTACT%u %s\r\n", index, number);
+}
+
+static uint8_t SetContact(char *args, uint8_t index)
+{
+	char *number = Token(&args);
+
+	if (Token(&args))
+	{
+		return 0;
+	}
+
+	if (!number) // senza numero: cancella la voce
+	{
+		SetPhonebookEntry("", index);
+
+		return SIMM800L_Schedule_DelPhonebookEntry(index);
+	}
+
+	uint8_t len = strlen(number);
+
+	if (len >= MAX_NUM_LENGTH)
+	{
+		return 0;
+	}
+
+	for (uint8_t i = (number[0] == '+'); i < len; i++)
+	{
+		if (!isdigit((uint8_t) number[i]))
+		{
+			return 0;
+		}
+	}
+
+	return SIMM800L_Schedule_AddPhonebookEntry(number, index); // scritta nel modem dallo scheduler del modem
+}
+
+// - Elenchi ------------------------------------------------------------------------------------------------- /
+
+/**
+ * @fn uint8_t ParamsPage(uint16_t, char*, uint16_t)
+ * @brief GET: le righe dei parametri, in ordine
+ */
+static uint8_t ParamsPage(uint16_t n, char *line, uint16_t size)
+{
+	for (uint8_t i = 0; i < PARAMS; n -= params[i++].lines)
+	{
+		if (n < params[i].lines)
+		{
+			params[i].get(line, size, params[i].index, n);
+
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @fn uint16_t ParamsFirstLine(const Param_TypeDef*)
+ * @brief riga di ParamsPage da cui inizia la lettura del parametro
+ */
+static uint16_t ParamsFirstLine(const Param_TypeDef *param)
+{
+	uint16_t n = 0;
+
+	for (const Param_TypeDef *p = params; p < param; p++)
+	{
+		n += p->lines;
+	}
+
+	return n;
+}
+
+/**
+ * @fn uint8_t StatsPage(uint16_t, char*, uint16_t)
+ * @brief STATS: porte, loop principale, pool dei messaggi, consumo e datalogger
+ */
+static uint8_t StatsPage(uint16_t n, char *line, uint16_t size)
+{
+	switch (n)
+	{
+		case 0:
+			USART_StatsReport(USART_1, line, size);
+		break;
+
+		case 1:
+			USART_StatsReport(USART_2, line, size);
+		break;
+
+		case 2:
+			TimSys_LoopReport(line, size);
+		break;
+
+		case 3:
+			MsgPool_Report(line, size);
+		break;
+
+		case 4:
+		{
+			PowerStats_TypeDef power;
+
+			Power_Stats(&power);
+
+			Fmt_Snprintf(line, size, "Duty cycle: %0.1f %%, corrente stimata: %0.2f mA, risvegli: %lu\r\n", power.duty, power.current, (unsigned long) power.wakeups);
+		}
+		break;
+
+		case 5:
+			Fmt_Snprintf(line, size, "Datalog: %lu byte usati, %lu record scartati\r\n", (unsigned long) DataLog_Used(), (unsigned long) DataLog_Dropped());
+		break;
+
+		case 6:
+			Fmt_Snprintf(line, size, "Sonde: NTC1 %0.1f gradi, NTC2 %0.1f gradi, MCU %0.1f gradi\r\n", GetNtcTemp(NTC1), GetNtcTemp(NTC2), GetMcuTemp());
+		break;
+
+		default:
+			return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * @fn uint8_t ProfilePage(uint16_t, char*, uint16_t)
+ * @brief PROFILE: sonde di profiling, tempi dei task e del loop principale
+ */
+static uint8_t ProfilePage(uint16_t n, char *line, uint16_t size)
+{
+	if (n == 0)
+	{
+		Fmt_Snprintf(line, size, "Profiling (usec, istogramma <1 <2 <4 ... >=%u):\r\n", 1U << (TIMSYS_PROF_BUCKETS - 2));
+
+		return 1;
+	}
+
+	n--;
+
+	if (n < PROF_PROBES)
+	{
+		TimSys_ProfReport(n, line, size);
+
+		return 1;
+	}
+
+	n -= PROF_PROBES;
+
+	if (n < TimSys_TaskCount())
+	{
+		TimSys_Task_TypeDef *task = TimSys_Task(n);
+
+		Fmt_Snprintf(line, size, "task %-8s runs=%lu med/max=%lu/%lu us\r\n", task->name, (unsigned long) task->runs,
+		             (unsigned long) (task->runs ? task->run_time / task->runs : 0), (unsigned long) task->max_time);
+
+		return 1;
+	}
+
+	n -= TimSys_TaskCount();
+
+	const TimSys_LoopStats_TypeDef *loop = TimSys_LoopStats();
+
+	if (n == 0)
+	{
+		uint32_t i = loop->iterations ? loop->iterations : 1;
+
+		Fmt_Snprintf(line, size, "loop n=%lu med/max=%lu/%lu us, ritardo med/max=%lu/%lu us, >%u ms: %lu\r\n",
+		             (unsigned long) loop->iterations, (unsigned long) (loop->sum / i), (unsigned long) loop->max,
+		             (unsigned long) (loop->latency_sum / i), (unsigned long) loop->latency_max, TIMSYS_LOOP_BUDGET, (unsigned long) loop->over_budget);
+
+		return 1;
+	}
+
+	if (n == 1)
+	{
+		FmtSink_TypeDef out;
+
+		Fmt_SpanSink(&out, line, size);
+
+		Fmt_Print(&out, "loop istogramma:");
+
+		for (uint8_t i = 0; i < TIMSYS_LOOP_BUCKETS; i++)
+		{
+			Fmt_Print(&out, " %lu", (unsigned long) loop->hist[i]);
+		}
+
+		Fmt_Print(&out, "\r\n");
+
+		return 1;
+	}
+
+	n -= 2;
+
+	if (n < TIMSYS_LOOP_WORST && loop->worst[n].tag)
+	{
+		Fmt_Snprintf(line, size, "peggiore %u: %lu us, %s, t=%lu s\r\n", n + 1, (unsigned long) loop->worst[n].time,
+		             loop->worst[n].tag, (unsigned long) (loop->worst[n].tick / 1000));
+
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * @fn uint8_t HistoryPage(uint16_t, char*, uint16_t)
+ * @brief HISTORY: statistiche delle finestre, poi i campioni dal più recente
+ */
+static uint8_t HistoryPage(uint16_t n, char *line, uint16_t size)
+{
+	if (n == 0)
+	{
+		History_Report(line, size);
+
+		return 1;
+	}
+
+	float    temp;
+	uint32_t tick;
+
+	if (!History_Get(n - 1, &temp, &tick))
+	{
+		return 0;
+	}
+
+	Fmt_Snprintf(line, size, "%3u: %0.1f gradi, %lu s fa\r\n", n, temp, (unsigned long) ((HAL_GetTick() - tick) / 1000));
+
+	return 1;
+}
+
+/**
+ * @fn uint8_t ModemPage(uint16_t, char*, uint16_t)
+ * @brief MODEM: stato del modem
+ */
+static uint8_t ModemPage(uint16_t n, char *line, uint16_t size)
+{
+	if (n)
+	{
+		return 0;
+	}
+
+	SIM800L_StatusReport(line, size);
+
+	return 1;
+}
+
+/**
+ * @fn uint8_t TelemetryPage(uint16_t, char*, uint16_t)
+ * @brief TELEMETRY: tipi trasmessi e contatori delle trame
+ */
+static uint8_t TelemetryPage(uint16_t n, char *line, uint16_t size)
+{
+	if (n)
+	{
+		return 0;
+	}
+
+	Telemetry_Report(line, size);
+
+	return 1;
+}
+
+/**
+ * @fn uint8_t HelpPage(uint16_t, char*, uint16_t)
+ * @brief HELP: elenco dei comandi
+ */
+static uint8_t HelpPage(uint16_t n, char *line, uint16_t size)
+{
+	if (n >= HELP_LINES)
+	{
+		return 0;
+	}
+
+	Fmt_Snprintf(line, size, "%s", help[n]);
+
+	return 1;
+}
+
+/**
+ * @fn void DumpStart(ConsolePage, uint16_t, uint16_t)
+ * @brief avvia un elenco dalla riga first, al più count righe: l'elenco in corso è interrotto
+ *
+ */
+static void DumpStart(ConsolePage page, uint16_t first, uint16_t count)
+{
+	dump.page = page;
+	dump.n    = first;
+	dump.end  = first + count;
+	dump.len  = 0;
+
+	USART_Write(USART_2, "\r\n", 0);
+}
+
+/**
+ * @fn void Dump(void)
+ * @brief scrive le righe dell'elenco in corso finché entrano nella coda di trasmissione, senza attendere: con la
+ *        coda piena riprogramma il task, alla fine dell'elenco stampa il prompt
+ *
+ */
+static void Dump(void)
+{
+	while (dump.page)
+	{
+		if (!dump.len)
+		{
+			if (dump.n >= dump.end || !dump.page(dump.n, dump.line, sizeof(dump.line)))
+			{
+				dump.page = NULL;
+
+				USART_Write(USART_2, CONSOLE_PROMPT, 0);
+
+				return;
+			}
+
+			dump.n++;
+			dump.len = strlen(dump.line);
+
+			continue;
+		}
+
+		if (USART_TxFree(USART_2) < dump.len)
+		{
+			TimSys_TaskStart(&console_task, CONSOLE_DUMP_DELAY, 0);
+
+			return;
+		}
+
+		USART_Write(USART_2, dump.line, 0);
+
+		dump.len = 0;
+	}
+}
+
+/**
+ * @fn uint8_t Exec(char*, uint8_t)
+ * @brief esecuzione di un comando riconosciuto dal parser
+ *
+ * @param args argomenti dopo il nome del comando
+ * @param cmd_index
+ * @return PR_OK, PR_ERROR o PR_IGNORED se il comando produce un elenco (il prompt è stampato alla fine)
+ */
+static uint8_t Exec(char *args, uint8_t cmd_index)
+{
+	if (*args && *args != SPACE) // il nome del comando continua: comando sconosciuto
+	{
+		return PR_ERROR;
+	}
+
+	char *arg = Token(&args);
+
+	switch (cmd_index)
+	{
+		case CMD_GET:
+		{
+			if (!arg)
+			{
+				DumpStart(ParamsPage, 0, UINT16_MAX);
+
+				return PR_IGNORED;
+			}
+
+			const Param_TypeDef *param = FindParam(arg);
+
+			if (!param || Token(&args))
+			{
+				return PR_ERROR;
+			}
+
+			DumpStart(ParamsPage, ParamsFirstLine(param), param->lines);
+
+			return PR_IGNORED;
+		}
+		break;
+
+		case CMD_SET:
+		{
+			const Param_TypeDef *param = arg ? FindParam(arg) : NULL;
+
+			return (param && param->set(args, param->index)) ? PR_OK : PR_ERROR;
+		}
+		break;
+
+		case CMD_STATS:
+		case CMD_PROFILE:
+
+			if (arg)
+			{
+				if (strcmp(arg, "RESET") || Token(&args))
+				{
+					return PR_ERROR;
+				}
+
+				if (cmd_index == CMD_STATS)
+				{
+					USART_StatsReset(USART_1);
+					USART_StatsReset(USART_2);
+				}
+				else
+				{
+					TimSys_ProfReset();
+					TimSys_LoopReset();
+				}
+
+				return PR_OK;
+			}
+
+			DumpStart((cmd_index == CMD_STATS) ? StatsPage : ProfilePage, 0, UINT16_MAX);
+
+			return PR_IGNORED;
+
+		break;
+
+		case CMD_HISTORY:
+		{
+			double count = 0;
+
+			if (arg && (Token(&args) || !ParseNumber(arg, &count) || count < 0 || count > CONSOLE_HISTORY_MAX))
+			{
+				return PR_ERROR;
+			}
+
+			DumpStart(HistoryPage, 0, 1 + (uint16_t) count);
+
+			return PR_IGNORED;
+		}
+		break;
+
+		case CMD_MODEM:
+
+			if (arg)
+			{
+				char *state = Token(&args);
+
+				if (strcmp(arg, "MONITOR") || !state || Token(&args))
+				{
+					return PR_ERROR;
+				}
+
+				if (strcmp(state, "ON") == 0)
+				{
+					modem_monitor = 1;
+				}
+				else
+				if (strcmp(state, "OFF") == 0)
+				{
+					modem_monitor = 0;
+				}
+				else
+				{
+					return PR_ERROR;
+				}
+
+				return PR_OK;
+			}
+
+			DumpStart(ModemPage, 0, UINT16_MAX);
+
+			return PR_IGNORED;
+
+		break;
+
+		case CMD_HELP:
+
+			if (arg)
+			{
+				return PR_ERROR;
+			}
+
+			DumpStart(HelpPage, 0, UINT16_MAX);
+
+			return PR_IGNORED;
+
+		break;
+
+		case CMD_TELEMETRY:
+		{
+			double mask;
+
+			if (!arg)
+			{
+				DumpStart(TelemetryPage, 0, UINT16_MAX);
+
+				return PR_IGNORED;
+			}
+
+			if (Token(&args))
+			{
+				return PR_ERROR;
+			}
+
+			if (strcmp(arg, "ON") == 0)
+			{
+				mask = TM_MASK_ALL;
+			}
+			else
+			if (strcmp(arg, "OFF") == 0)
+			{
+				mask = 0;
+			}
+			else
+			if (!ParseNumber(arg, &mask) || mask < 0 || mask > TM_MASK_ALL)
+			{
+				return PR_ERROR;
+			}
+
+			Telemetry_SetMask(mask);
+
+			return PR_OK;
+		}
+		break;
+	}
+
+	return PR_ERROR;
+}
+
+/**
+ * @fn uint8_t Echo(ParserResult_TypeDef, char)
+ * @brief eco dei caratteri ricevuti e risposta ai comandi
+ *
+ */
+static uint8_t Echo(ParserResult_TypeDef result, char ch)
+{
+	switch (result)
+	{
+		case PR_ECHO:
+			USART_WriteChar(USART_2, ch);
+		break;
+
+		case PR_BACKSPACE:
+			USART_Write(USART_2, "\b \b", 0);
+		break;
+
+		case PR_PROMPT:
+			USART_Write(USART_2, "\r\n" CONSOLE_PROMPT, 0);
+		break;
+
+		case PR_OK:
+			USART_Write(USART_2, "\r\nOK\r\n" CONSOLE_PROMPT, 0);
+		break;
+
+		case PR_ERROR:
+			USART_Write(USART_2, "\r\nComando non valido, HELP per l'elenco dei comandi\r\n" CONSOLE_PROMPT, 0);
+		break;
+
+		case PR_OVERFLOW:
+			USART_Write(USART_2, "\r\nComando troppo lungo\r\n" CONSOLE_PROMPT, 0);
+		break;
+
+		default:
+		break;
+	}
+
+	return result;
+}
+
+/**
+ * @fn void Console_Exec(void)
+ * @brief task della console: analizza i caratteri ricevuti e prosegue l'elenco in corso
+ *
+ */
+static void Console_Exec(void)
+{
+	if (profile_request)
+	{
+		profile_request = 0;
+
+		DumpStart(ProfilePage, 0, UINT16_MAX);
+	}
+
+	ParserInterface()->CmdAnalyze(PARSER_2);
+
+	Dump();
+}
+
+// - Exported Functions -------------------------------------------------------------------------------------- /
+
+/**
+ * @fn void Console_Init(void)
+ * @brief inizializza il parser dei comandi del terminale e registra il task della console
+ *
+ */
+void Console_Init(void)
+{
+	ParserInterface()->Init(PARSER_2, USART_RxFifo(USART_2), "", commands);
+
+	TimSys_TaskRegister(&console_task, "console", Console_Exec); // eseguito su ricezione (USART2_RxCplt)
+
+	USART_Printf(USART_2, "\r\nConsole: HELP per l'elenco dei comandi\r\n" CONSOLE_PROMPT);
+}
+
+/**
+ * @fn void Console_ProfileDump(void)
+ * @brief richiede l'elenco delle statistiche di profiling (ISR safe)
+ *
+ */
+void Console_ProfileDump(void)
+{
+	profile_request = 1;
+
+	TimSys_TaskSignal(&console_task);
+}
+
+/**
+ * @fn uint8_t Console_ModemMonitor(void)
+ * @brief eco sul terminale dei caratteri ricevuti dal modem, attivato con MODEM MONITOR ON (ISR safe)
+ *
+ * @return 1 se attivo
+ */
+uint8_t Console_ModemMonitor(void)
+{
+	return modem_monitor;
+}
+
+/**
+ * @fn TimSys_Task_TypeDef Console_Task*(void)
+ * @brief task dello scheduler della console, da segnalare alla ricezione di un carattere dal terminale
+ *
+ * @return
+ */
+TimSys_Task_TypeDef *Console_Task(void)
+{
+	return &console_task;
+}
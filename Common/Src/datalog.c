@@ -0,0 +1,737 @@
+/**
+ * @file datalog.c - https://github.com/SC-Develop/tesysma
+ *
+ * @author Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/SC-Develop/
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ *
+ * Log persistente in flash delle letture e degli eventi, nei settori liberi successivi a DATA_CFG_ADDRESS.
+ *
+ * Formato:
+ *
+ * - ogni settore inizia con un'intestazione { seq, base_time, magic }: il magic è programmato per ultimo, per cui
+ *   un'intestazione interrotta da una mancanza di alimentazione non è valida. Il settore attivo è quello valido con
+ *   la sequenza più alta, l'altro contiene i record più vecchi.
+ * - i record sono di lunghezza variabile: [len][type][varint dt][varint zigzag arg][crc8]. dt è il tempo in
+ *   secondi dal record precedente, arg delle letture è la differenza in centesimi di grado dalla lettura
+ *   precedente. Il primo record di ogni settore è relativo all'intestazione, così ogni settore è decodificabile
+ *   da solo. len è programmato per primo: un record interrotto ha len valido e crc errato, viene saltato.
+ *
+ * Il tempo del log è in secondi e prosegue da un avvio all'altro dall'ultimo record registrato (in assenza di RTC
+ * il tempo passato a dispositivo spento non è contato).
+ *
+ * L'indice temporale in RAM, costruito all'avvio, contiene ogni DATALOG_INDEX_STEP byte la posizione di un record
+ * e lo stato del decodificatore in quel punto: la lettura di un intervallo di tempo parte dal punto dell'indice più
+ * vicino senza scandire l'intero log.
+ *
+ * La cancellazione di un settore (1-2 sec. durante i quali la CPU, eseguendo dalla stessa flash, resta in attesa) non
+ * avviene mai durante la scrittura di un record: è anticipata quando il settore attivo supera DATALOG_ERASE_WATERMARK
+ * ed eseguita da DataLog_Exec solo quando il sistema è inattivo. Se il settore successivo non è ancora cancellato
+ * quando quello attivo è pieno, i record vengono scartati e contati, senza bloccare il loop principale.
+ */
+
+#include "stddef.h"
+#include "math.h"
+#include "timsys.h"
+#include "datalog.h"
+
+#define DATALOG_MAGIC		0x474F4C44	// "DLOG"
+#define DATALOG_MAX_RECORD	16			// lunghezza massima di un record [byte]
+#define DATALOG_INDEX_SIZE	(DATALOG_SECTOR_SIZE / DATALOG_INDEX_STEP)
+#define DATALOG_NONE		0xFF
+
+/**
+ * @struct
+ * @brief intestazione del settore
+ *
+ */
+typedef struct {
+	uint32_t seq;		// sequenza di utilizzo dei settori
+	uint32_t base_time;	// tempo del log all'apertura del settore [s]
+	uint32_t magic;		// programmato per ultimo
+} DataLogHeader_TypeDef;
+
+/**
+ * @struct
+ * @brief punto dell'indice temporale: stato del decodificatore prima del record all'offset dato
+ *
+ */
+typedef struct {
+	uint32_t offset;
+	uint32_t time;
+	int32_t  temp;
+} DataLogIndex_TypeDef;
+
+/**
+ * @struct
+ * @brief stato in RAM di un settore
+ *
+ */
+typedef struct {
+	uint8_t  valid;		// intestazione valida
+	uint8_t  blank;		// cancellato e pronto per una nuova intestazione
+	uint32_t seq;
+	uint32_t used;		// offset della prima posizione libera
+	uint32_t time;		// stato del decodificatore alla fine del settore
+	int32_t  temp;
+
+	DataLogIndex_TypeDef index[DATALOG_INDEX_SIZE];
+	uint16_t             index_count;
+} DataLogSector_TypeDef;
+
+// Variables ------------------------------------------------------------------------------------------------------------------------------
+
+static struct {
+	DataLogSector_TypeDef sector[DATALOG_SECTORS];
+	uint8_t               active;		// settore attivo (DATALOG_NONE se nessuno)
+	uint8_t               erase;		// settore da cancellare (DATALOG_NONE se nessuno)
+	uint32_t              time_base;	// tempo del log [s] al tick tick_base
+	uint32_t              tick_base;
+	uint32_t              reading_tick;	// istante dell'ultima lettura registrata
+	uint8_t               reading_logged;
+	uint32_t              dropped;		// record scartati
+} dlog = {
+	.active = DATALOG_NONE,
+	.erase  = DATALOG_NONE,
+};
+
+// - Local functions ----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @fn uint8_t* SectorAddress(uint8_t)
+ * @brief indirizzo in flash del settore
+ */
+static const uint8_t *SectorAddress(uint8_t s)
+{
+	return (const uint8_t *) (DATALOG_ADDRESS + s * DATALOG_SECTOR_SIZE);
+}
+
+/**
+ * @fn uint8_t Crc8(const uint8_t*, uint8_t)
+ * @brief CRC-8 (polinomio 0x07)
+ */
+static uint8_t Crc8(const uint8_t *data, uint8_t len)
+{
+	uint8_t crc = 0;
+
+	while (len--)
+	{
+		crc ^= *data++;
+
+		for (uint8_t b = 0; b < 8; b++)
+		{
+			crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+		}
+	}
+
+	return crc;
+}
+
+/**
+ * @fn uint8_t PutVarint(uint8_t*, uint32_t)
+ * @brief codifica varint (7 bit per byte, bit 7 = continua)
+ *
+ * @return byte scritti
+ */
+static uint8_t PutVarint(uint8_t *p, uint32_t v)
+{
+	uint8_t n = 0;
+
+	do
+	{
+		p[n++] = (v & 0x7F) | ((v > 0x7F) ? 0x80 : 0);
+		v >>= 7;
+	}
+	while (v);
+
+	return n;
+}
+
+/**
+ * @fn uint8_t GetVarint(const uint8_t*, const uint8_t*, uint32_t*)
+ * @brief decodifica varint
+ *
+ * @return byte letti, 0 se il varint supera la fine del record
+ */
+static uint8_t GetVarint(const uint8_t *p, const uint8_t *end, uint32_t *v)
+{
+	uint8_t n = 0;
+
+	*v = 0;
+
+	while (p + n < end && n < 5)
+	{
+		*v |= (uint32_t) (p[n] & 0x7F) << (7 * n);
+
+		if (!(p[n++] & 0x80))
+		{
+			return n;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @fn uint32_t ZigZag(int32_t)
+ * @brief codifica zigzag: i valori con segno piccoli in modulo diventano varint corti
+ */
+static uint32_t ZigZag(int32_t v)
+{
+	return ((uint32_t) v << 1) ^ (uint32_t) (v >> 31);
+}
+
+static int32_t UnZigZag(uint32_t v)
+{
+	return (int32_t) (v >> 1) ^ -(int32_t) (v & 1);
+}
+
+/**
+ * @fn int32_t Decode(const uint8_t*, uint32_t, DataLogRecord_TypeDef*, uint32_t*, int32_t*)
+ * @brief decodifica il record alla posizione data e aggiorna lo stato del decodificatore
+ *
+ * @param p      inizio del record
+ * @param avail  byte disponibili fino alla fine del settore
+ * @param rec    record decodificato (valido solo se il valore di ritorno è positivo e rec->type != 0)
+ * @param time   stato del decodificatore: tempo del record precedente
+ * @param temp   stato del decodificatore: lettura precedente
+ * @return lunghezza del record, 0 alla fine del log, -1 se il settore è corrotto
+ */
+static int32_t Decode(const uint8_t *p, uint32_t avail, DataLogRecord_TypeDef *rec, uint32_t *time, int32_t *temp)
+{
+	uint8_t len = p[0];
+
+	rec->type = 0;
+
+	if (len == 0xFF) // flash cancellata: fine del log
+	{
+		return 0;
+	}
+
+	if (len < 4 || len > DATALOG_MAX_RECORD || len + 1u > avail)
+	{
+		return -1;
+	}
+
+	const uint8_t *body = p + 1;
+	const uint8_t *end  = body + len - 1; // il crc è l'ultimo byte
+
+	if (Crc8(body, len - 1) != *end) // record interrotto da una mancanza di alimentazione: viene saltato
+	{
+		return len + 1;
+	}
+
+	uint32_t dt, arg;
+	uint8_t  n = 1;
+	uint8_t  m;
+
+	if (!(m = GetVarint(body + n, end, &dt)))
+	{
+		return len + 1;
+	}
+
+	n += m;
+
+	if (!(m = GetVarint(body + n, end, &arg)))
+	{
+		return len + 1;
+	}
+
+	*time += dt;
+
+	rec->type = body[0];
+	rec->time = *time;
+	rec->arg  = UnZigZag(arg);
+
+	if (rec->type == DL_READING)
+	{
+		*temp   += rec->arg;
+		rec->arg = *temp;
+	}
+
+	return len + 1;
+}
+
+/**
+ * @fn void AddIndex(DataLogSector_TypeDef*, uint32_t)
+ * @brief aggiunge un punto all'indice temporale se l'ultimo dista almeno DATALOG_INDEX_STEP
+ */
+static void AddIndex(DataLogSector_TypeDef *s, uint32_t offset)
+{
+	if (s->index_count && (offset - s->index[s->index_count - 1].offset) < DATALOG_INDEX_STEP)
+	{
+		return;
+	}
+
+	if (s->index_count < DATALOG_INDEX_SIZE)
+	{
+		s->index[s->index_count].offset = offset;
+		s->index[s->index_count].time   = s->time;
+		s->index[s->index_count].temp   = s->temp;
+		s->index_count++;
+	}
+}
+
+/**
+ * @fn void Scan(uint8_t)
+ * @brief legge l'intestazione del settore, ne scandisce i record e costruisce l'indice temporale
+ */
+static void Scan(uint8_t i)
+{
+	DataLogSector_TypeDef       *s = dlog.sector + i;
+	const DataLogHeader_TypeDef *h = (const DataLogHeader_TypeDef *) SectorAddress(i);
+
+	s->valid       = (h->magic == DATALOG_MAGIC);
+	s->blank       = 0;
+	s->index_count = 0;
+
+	if (!s->valid)
+	{
+		return;
+	}
+
+	s->seq  = h->seq;
+	s->time = h->base_time;
+	s->temp = 0;
+	s->used = sizeof(DataLogHeader_TypeDef);
+
+	while (s->used < DATALOG_SECTOR_SIZE)
+	{
+		DataLogRecord_TypeDef rec;
+
+		AddIndex(s, s->used);
+
+		int32_t n = Decode(SectorAddress(i) + s->used, DATALOG_SECTOR_SIZE - s->used, &rec, &s->time, &s->temp);
+
+		if (n == 0)
+		{
+			break;
+		}
+
+		if (n < 0) // dati non interpretabili: il settore è considerato pieno
+		{
+			s->used = DATALOG_SECTOR_SIZE;
+			break;
+		}
+
+		s->used += n;
+	}
+}
+
+/**
+ * @fn uint8_t Program(uint32_t, const uint8_t*, uint32_t)
+ * @brief programma i byte in flash
+ */
+static uint8_t Program(uint32_t address, const uint8_t *data, uint32_t len)
+{
+	uint8_t ok = 1;
+
+	HAL_FLASH_Unlock();
+
+	for (uint32_t n = 0; n < len && ok; n++)
+	{
+		ok = (HAL_FLASH_Program(FLASH_TYPEPROGRAM_BYTE, address + n, data[n]) == HAL_OK);
+	}
+
+	HAL_FLASH_Lock();
+
+	return ok;
+}
+
+/**
+ * @fn uint8_t OpenSector(uint8_t, uint32_t)
+ * @brief scrive l'intestazione nel settore cancellato e lo rende attivo
+ */
+static uint8_t OpenSector(uint8_t i, uint32_t seq)
+{
+	DataLogSector_TypeDef *s = dlog.sector + i;
+	uint32_t               address = (uint32_t) SectorAddress(i);
+	uint8_t                ok;
+
+	if (!s->blank)
+	{
+		return 0;
+	}
+
+	uint32_t time = DataLog_Time();
+
+	HAL_FLASH_Unlock();
+
+	ok =       (HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, address + offsetof(DataLogHeader_TypeDef, seq),       seq)  == HAL_OK);
+	ok = ok && (HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, address + offsetof(DataLogHeader_TypeDef, base_time), time) == HAL_OK);
+	ok = ok && (HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, address + offsetof(DataLogHeader_TypeDef, magic), DATALOG_MAGIC) == HAL_OK);
+
+	HAL_FLASH_Lock();
+
+	s->blank = 0;
+
+	if (!ok)
+	{
+		dlog.erase = i; // intestazione incompleta: il settore va cancellato di nuovo
+
+		return 0;
+	}
+
+	s->valid       = 1;
+	s->seq         = seq;
+	s->time        = time;
+	s->temp        = 0;
+	s->used        = sizeof(DataLogHeader_TypeDef);
+	s->index_count = 0;
+
+	dlog.active = i;
+
+	return 1;
+}
+
+/**
+ * @fn uint8_t Rotate(void)
+ * @brief passa al settore successivo, che deve essere già stato cancellato
+ */
+static uint8_t Rotate(void)
+{
+	uint8_t next = (dlog.active + 1) % DATALOG_SECTORS;
+
+	if (OpenSector(next, dlog.sector[dlog.active].seq + 1))
+	{
+		return 1;
+	}
+
+	if (!dlog.sector[next].blank)
+	{
+		dlog.erase = next; // cancellazione non ancora eseguita: i record sono scartati fino al prossimo periodo di inattività
+	}
+
+	return 0;
+}
+
+/**
+ * @fn uint8_t Append(DataLogType_TypeDef, int32_t)
+ * @brief codifica e accoda un record al settore attivo
+ */
+static uint8_t Append(DataLogType_TypeDef type, int32_t arg)
+{
+	uint8_t buf[DATALOG_MAX_RECORD + 1];
+
+	if (dlog.active == DATALOG_NONE)
+	{
+		dlog.dropped++;
+		return 0;
+	}
+
+	uint32_t time = DataLog_Time();
+
+	for (uint8_t retry = 0; retry < 2; retry++)
+	{
+		DataLogSector_TypeDef *s = dlog.sector + dlog.active;
+
+		int32_t  value = (type == DL_READING) ? arg - s->temp : arg;
+		uint32_t dt    = (time > s->time) ? time - s->time : 0;
+		uint8_t  n     = 1;
+
+		buf[n++] = type;
+		n       += PutVarint(buf + n, dt);
+		n       += PutVarint(buf + n, ZigZag(value));
+		buf[n]   = Crc8(buf + 1, n - 1);
+		buf[0]   = n; // lunghezza dopo il byte len, crc compreso
+		n       += 1;
+
+		if (s->used + n > DATALOG_SECTOR_SIZE)
+		{
+			if (!Rotate())
+			{
+				break;
+			}
+
+			continue; // il record è ricodificato rispetto all'intestazione del nuovo settore
+		}
+
+		uint32_t address = (uint32_t) SectorAddress(dlog.active) + s->used;
+
+		AddIndex(s, s->used);
+
+		if (!Program(address, buf, 1) || !Program(address + 1, buf + 1, n - 1)) // len per primo
+		{
+			s->used = DATALOG_SECTOR_SIZE; // settore non più scrivibile: il prossimo record ruota
+			break;
+		}
+
+		s->used += n;
+		s->time += dt;
+
+		if (type == DL_READING)
+		{
+			s->temp = arg;
+		}
+
+		if (s->used > DATALOG_ERASE_WATERMARK)
+		{
+			uint8_t next = (dlog.active + 1) % DATALOG_SECTORS;
+
+			if (!dlog.sector[next].blank)
+			{
+				dlog.erase = next; // cancellazione anticipata del settore più vecchio
+			}
+		}
+
+		return 1;
+	}
+
+	dlog.dropped++;
+
+	return 0;
+}
+
+// - Exported functions -------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @fn void DataLog_Init(void)
+ * @brief monta il log: scandisce i settori, ricostruisce l'indice e riprende il tempo del log dall'ultimo record
+ */
+void DataLog_Init(void)
+{
+	uint32_t time = 0;
+
+	dlog.active = DATALOG_NONE;
+	dlog.erase  = DATALOG_NONE;
+
+	for (uint8_t i = 0; i < DATALOG_SECTORS; i++)
+	{
+		Scan(i);
+
+		if (!dlog.sector[i].valid)
+		{
+			continue;
+		}
+
+		if (dlog.active == DATALOG_NONE || dlog.sector[i].seq > dlog.sector[dlog.active].seq)
+		{
+			dlog.active = i;
+		}
+
+		if (dlog.sector[i].time > time)
+		{
+			time = dlog.sector[i].time;
+		}
+	}
+
+	dlog.time_base = time;
+	dlog.tick_base = HAL_GetTick();
+
+	if (dlog.active == DATALOG_NONE) // log vuoto o mai inizializzato
+	{
+		dlog.erase = 0;
+	}
+	else if (dlog.sector[dlog.active].used > DATALOG_ERASE_WATERMARK)
+	{
+		dlog.erase = (dlog.active + 1) % DATALOG_SECTORS;
+	}
+}
+
+/**
+ * @fn void DataLog_Exec(uint8_t)
+ * @brief esegue la cancellazione pendente solo se il sistema è inattivo
+ *
+ * @param idle  1 se nessuna attività in corso (modem libero, nessuna notifica)
+ */
+void DataLog_Exec(uint8_t idle)
+{
+	if (dlog.erase == DATALOG_NONE || !idle)
+	{
+		return;
+	}
+
+	uint8_t i = dlog.erase;
+
+	FLASH_EraseInitTypeDef EraseInit = {
+		.TypeErase    = FLASH_TYPEERASE_SECTORS,
+		.Banks        = FLASH_BANK_1,
+		.VoltageRange = FLASH_VOLTAGE_RANGE_3,
+		.Sector       = DATALOG_FIRST_SECTOR + i,
+		.NbSectors    = 1};
+
+	uint32_t SectorError;
+
+	HAL_FLASH_Unlock(); // la cancellazione del settore dura 1 - 2 s: entro la scadenza dei task supervisionati
+
+	HAL_StatusTypeDef status = HAL_FLASHEx_Erase(&EraseInit, &SectorError);
+
+	HAL_FLASH_Lock();
+
+	if (status != HAL_OK)
+	{
+		return; // nuovo tentativo al prossimo periodo di inattività
+	}
+
+	dlog.erase = DATALOG_NONE;
+
+	dlog.sector[i].valid       = 0;
+	dlog.sector[i].blank       = 1;
+	dlog.sector[i].index_count = 0;
+
+	if (dlog.active == DATALOG_NONE)
+	{
+		OpenSector(i, 1);
+	}
+	else if (dlog.active == i) // non dovrebbe accadere: il settore attivo non è mai cancellato
+	{
+		dlog.active = DATALOG_NONE;
+		OpenSector(i, dlog.sector[(i + 1) % DATALOG_SECTORS].seq + 1);
+	}
+}
+
+/**
+ * @fn uint8_t DataLog_Reading(float)
+ * @brief registra la lettura della temperatura, al massimo una ogni DATALOG_READING_TIME
+ *
+ * @param temp [°C]
+ * @return 1 se registrata
+ */
+uint8_t DataLog_Reading(float temp)
+{
+	if (dlog.reading_logged && TimSys_TimeElapsed(dlog.reading_tick) < DATALOG_READING_TIME)
+	{
+		return 0;
+	}
+
+	dlog.reading_tick   = HAL_GetTick();
+	dlog.reading_logged = 1;
+
+	return Append(DL_READING, (int32_t) roundf(temp * 100));
+}
+
+/**
+ * @fn uint8_t DataLog_Event(DataLogType_TypeDef, int32_t)
+ * @brief registra un evento
+ *
+ * @param type
+ * @param arg
+ * @return 1 se registrato
+ */
+uint8_t DataLog_Event(DataLogType_TypeDef type, int32_t arg)
+{
+	return Append(type, arg);
+}
+
+/**
+ * @fn uint32_t DataLog_Read(uint32_t, uint32_t, DataLog_Callback)
+ * @brief legge i record nell'intervallo di tempo [from, to], dal più vecchio. La decodifica di ciascun settore
+ *        parte dal punto dell'indice temporale che precede from.
+ *
+ * @param from      [s]
+ * @param to        [s]
+ * @param callback  chiamata per ogni record dell'intervallo
+ * @return numero di record letti
+ */
+uint32_t DataLog_Read(uint32_t from, uint32_t to, DataLog_Callback callback)
+{
+	uint32_t count = 0;
+	uint8_t  order[DATALOG_SECTORS];
+	uint8_t  n = 0;
+
+	for (uint8_t i = 0; i < DATALOG_SECTORS; i++) // settori validi in ordine di sequenza
+	{
+		if (!dlog.sector[i].valid)
+		{
+			continue;
+		}
+
+		uint8_t j = n++;
+
+		while (j > 0 && dlog.sector[order[j - 1]].seq > dlog.sector[i].seq)
+		{
+			order[j] = order[j - 1];
+			j--;
+		}
+
+		order[j] = i;
+	}
+
+	for (uint8_t k = 0; k < n; k++)
+	{
+		DataLogSector_TypeDef *s = dlog.sector + order[k];
+
+		if (s->index_count == 0 || s->time < from) // settore vuoto o interamente precedente all'intervallo
+		{
+			continue;
+		}
+
+		uint16_t lo = 0, hi = s->index_count - 1; // ultimo punto dell'indice con tempo <= from
+
+		while (lo < hi)
+		{
+			uint16_t mid = (lo + hi + 1) / 2;
+
+			if (s->index[mid].time <= from) lo = mid;
+			else                            hi = mid - 1;
+		}
+
+		uint32_t offset = s->index[lo].offset;
+		uint32_t time   = s->index[lo].time;
+		int32_t  temp   = s->index[lo].temp;
+
+		while (offset < s->used)
+		{
+			DataLogRecord_TypeDef rec;
+
+			int32_t len = Decode(SectorAddress(order[k]) + offset, DATALOG_SECTOR_SIZE - offset, &rec, &time, &temp);
+
+			if (len <= 0)
+			{
+				break;
+			}
+
+			offset += len;
+
+			if (rec.type == 0 || rec.time < from)
+			{
+				continue;
+			}
+
+			if (rec.time > to)
+			{
+				return count;
+			}
+
+			callback(&rec);
+
+			count++;
+		}
+	}
+
+	return count;
+}
+
+/**
+ * @fn uint32_t DataLog_Time(void)
+ * @brief tempo del log
+ *
+ * @return [s]
+ */
+uint32_t DataLog_Time(void)
+{
+	uint32_t elapsed = (HAL_GetTick() - dlog.tick_base) / 1000;
+
+	dlog.time_base += elapsed;
+	dlog.tick_base += elapsed * 1000;
+
+	return dlog.time_base;
+}
+
+/**
+ * @fn uint32_t DataLog_Used(void)
+ * @brief byte occupati nel settore attivo
+ */
+uint32_t DataLog_Used(void)
+{
+	return (dlog.active == DATALOG_NONE) ? 0 : dlog.sector[dlog.active].used;
+}
+
+/**
+ * @fn uint32_t DataLog_Dropped(void)
+ * @brief record scartati (log non disponibile o settore successivo non ancora cancellato)
+ */
+uint32_t DataLog_Dropped(void)
+{
+	return dlog.dropped;
+}
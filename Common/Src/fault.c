@@ -0,0 +1,308 @@
+/**
+ * @file fault.c - https://github.com/SC-Develop/tesysma
+ *
+ * @author Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/SC-Develop/
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ *
+ * Cattura dei guasti attraverso il reset.
+ *
+ * HardFault_Handler passa a Fault_HardFault lo stack frame dell'eccezione; Error_Handler (main.c) chiama
+ * Fault_Error con l'indirizzo del chiamante. Entrambi salvano nella RAM no-init i registri, i registri di stato dei
+ * fault (CFSR, HFSR, BFAR, MMFAR), lo stato del modem e dell'allarme, il task in esecuzione e le ultime durate delle
+ * sonde di profiling, quindi riavviano subito la MCU invece di attendere l'IWDG. Lo stato salvato per il riavvio a
+ * caldo è scartato: il firmware riparte a freddo, senza riprendere lo stato che potrebbe aver causato il guasto.
+ *
+ * HardFault_Handler è definito qui e non in stm32f4xx_it.c (generazione disabilitata in Tesys-ME.ioc): è naked,
+ * senza prologo, per leggere MSP/PSP così come li ha lasciati l'eccezione, e contiene solo assembly.
+ *
+ * Al successivo avvio Fault_Init classifica la causa del reset e aggiorna i contatori per causa, conservati
+ * attraverso i reset e azzerati solo all'accensione. Fault_Report compone il rapporto per la console e per l'SMS.
+ * Nessun costo nel percorso normale: le sonde registrano già l'ultima durata.
+ */
+
+#include "string.h"
+#include "libfmt.h"
+#include "timsys.h"
+#include "sm_alarm.h"
+#include "SIM800L.h"
+#include "restart.h"
+#include "fault.h"
+
+/**
+ * @struct
+ * @brief record conservato nella RAM no-init attraverso il reset
+ *
+ */
+typedef struct {
+	uint32_t             magic;
+	uint32_t             resets[FAULT_RESET_CAUSES];	// reset per causa dall'accensione
+	uint8_t              pending;						// FAULT_RESET_HARDFAULT o FAULT_RESET_ERROR se capture è valido
+	FaultCapture_TypeDef capture;
+} FaultRecord_TypeDef;
+
+// Variables ------------------------------------------------------------------------------------------------------------------------------
+
+extern uint32_t _estack; // fine della RAM (linker script)
+
+static const char *names[FAULT_RESET_CAUSES] = {
+	[FAULT_RESET_POWER]     = "accensione",
+	[FAULT_RESET_PIN]       = "pin",
+	[FAULT_RESET_WATCHDOG]  = "watchdog",
+	[FAULT_RESET_SOFTWARE]  = "software",
+	[FAULT_RESET_HARDFAULT] = "hard fault",
+	[FAULT_RESET_ERROR]     = "errore",
+	[FAULT_RESET_LOWPOWER]  = "low power",
+};
+
+static const char *probes[PROF_PROBES] = TIMSYS_PROBE_NAMES;
+
+static FaultRecord_TypeDef record NOINIT;
+
+static struct {
+	FaultReset_TypeDef   cause;
+	uint8_t              captured;
+	FaultCapture_TypeDef capture;
+} last;
+
+// - Local functions ----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @fn void Capture(FaultReset_TypeDef)
+ * @brief completa la cattura con i registri di stato e lo stato dell'applicazione e riavvia la MCU
+ *
+ * @param type FAULT_RESET_HARDFAULT o FAULT_RESET_ERROR
+ */
+static void Capture(FaultReset_TypeDef type)
+{
+	FaultCapture_TypeDef *c = &record.capture;
+
+	c->cfsr    = SCB->CFSR;
+	c->hfsr    = SCB->HFSR;
+	c->bfar    = SCB->BFAR;
+	c->mmfar   = SCB->MMFAR;
+	c->tick    = HAL_GetTick();
+	c->gsm     = GSM_Status();
+	c->alarm   = AlarmSMStatus();
+	c->running = TimSys_Running();
+
+	for (uint8_t id = 0; id < PROF_PROBES; id++)
+	{
+		c->probe[id] = TimSys_Probe(id)->last;
+	}
+
+	record.pending = type;
+	record.magic   = FAULT_MAGIC;
+
+	Restart_Discard(); // il reset software non deve diventare un riavvio a caldo
+
+	HAL_NVIC_SystemReset();
+}
+
+// - Exported functions -------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @fn void Fault_Init(void)
+ * @brief classifica la causa del reset, aggiorna i contatori e recupera l'eventuale cattura.
+ *        Da chiamare prima di azzerare i flag di reset (RCC_CSR).
+ */
+void Fault_Init(void)
+{
+	FaultReset_TypeDef cause;
+
+	uint8_t valid = (record.magic == FAULT_MAGIC) && (record.pending < FAULT_RESET_CAUSES);
+
+	if (__HAL_RCC_GET_FLAG(RCC_FLAG_PORRST) || __HAL_RCC_GET_FLAG(RCC_FLAG_BORRST))
+	{
+		cause = FAULT_RESET_POWER;
+
+		valid = 0; // contenuto della RAM non affidabile
+	}
+	else
+	if (valid && __HAL_RCC_GET_FLAG(RCC_FLAG_SFTRST) && (record.pending == FAULT_RESET_HARDFAULT || record.pending == FAULT_RESET_ERROR))
+	{
+		cause = record.pending;
+	}
+	else
+	if (__HAL_RCC_GET_FLAG(RCC_FLAG_IWDGRST) || __HAL_RCC_GET_FLAG(RCC_FLAG_WWDGRST))
+	{
+		cause = FAULT_RESET_WATCHDOG;
+	}
+	else
+	if (__HAL_RCC_GET_FLAG(RCC_FLAG_SFTRST))
+	{
+		cause = FAULT_RESET_SOFTWARE;
+	}
+	else
+	if (__HAL_RCC_GET_FLAG(RCC_FLAG_LPWRRST))
+	{
+		cause = FAULT_RESET_LOWPOWER;
+	}
+	else
+	{
+		cause = FAULT_RESET_PIN; // PINRSTF è impostato da ogni reset: resta la sola causa esterna
+	}
+
+	if (!valid)
+	{
+		memset(&record, 0, sizeof(record));
+	}
+
+	last.cause    = cause;
+	last.captured = (cause == FAULT_RESET_HARDFAULT || cause == FAULT_RESET_ERROR);
+
+	if (last.captured)
+	{
+		last.capture = record.capture;
+	}
+
+	record.resets[cause]++;
+	record.pending = FAULT_RESET_POWER; // nessuna cattura
+	record.magic   = FAULT_MAGIC;
+}
+
+/**
+ * @fn void HardFault_Handler(void)
+ * @brief gestore dell'HardFault: passa a Fault_HardFault lo stack frame attivo (MSP o PSP, da EXC_RETURN) e il
+ *        valore di EXC_RETURN. Fault_HardFault non ritorna.
+ */
+__attribute__((naked)) void HardFault_Handler(void)
+{
+	__asm volatile (
+		" tst   lr, #4          \n" // EXC_RETURN bit 2: stack frame su MSP o PSP
+		" ite   eq              \n"
+		" mrseq r0, msp         \n"
+		" mrsne r0, psp         \n"
+		" mov   r1, lr          \n"
+		" b     Fault_HardFault \n" // non ritorna: cattura e reset
+	);
+}
+
+/**
+ * @fn void Fault_HardFault(uint32_t*, uint32_t)
+ * @brief cattura di un'eccezione, chiamata da HardFault_Handler con lo stack frame attivo al momento del fault
+ *
+ * @param frame      stack frame dell'eccezione: r0, r1, r2, r3, r12, lr, pc, xpsr
+ * @param exc_return valore di LR all'ingresso del gestore (EXC_RETURN)
+ */
+void Fault_HardFault(uint32_t *frame, uint32_t exc_return)
+{
+	FaultCapture_TypeDef *c = &record.capture;
+
+	memset(c, 0, sizeof(*c));
+
+	c->exc_return = exc_return;
+
+	if ((uint32_t) frame >= SRAM1_BASE && (uint32_t) (frame + 8) <= (uint32_t) &_estack) // frame nella RAM: lo stack non è esaurito
+	{
+		c->r0  = frame[0];
+		c->r1  = frame[1];
+		c->r2  = frame[2];
+		c->r3  = frame[3];
+		c->r12 = frame[4];
+		c->lr  = frame[5];
+		c->pc  = frame[6];
+		c->psr = frame[7];
+	}
+
+	Capture(FAULT_RESET_HARDFAULT);
+}
+
+/**
+ * @fn void Fault_Error(uint32_t)
+ * @brief cattura di un errore, chiamata da Error_Handler
+ *
+ * @param pc indirizzo di ritorno del chiamante di Error_Handler
+ */
+void Fault_Error(uint32_t pc)
+{
+	memset(&record.capture, 0, sizeof(record.capture));
+
+	record.capture.pc = pc;
+
+	Capture(FAULT_RESET_ERROR);
+}
+
+/**
+ * @fn FaultReset_TypeDef Fault_LastReset(void)
+ * @brief causa dell'ultimo reset
+ */
+FaultReset_TypeDef Fault_LastReset(void)
+{
+	return last.cause;
+}
+
+/**
+ * @fn const FaultCapture_TypeDef Fault_Captured*(void)
+ * @brief stato catturato prima dell'ultimo reset, NULL se il reset non è dovuto a un'eccezione o a un errore
+ */
+const FaultCapture_TypeDef *Fault_Captured(void)
+{
+	return last.captured ? &last.capture : NULL;
+}
+
+/**
+ * @fn uint32_t Fault_ResetCount(FaultReset_TypeDef)
+ * @brief numero di reset per causa dall'accensione
+ */
+uint32_t Fault_ResetCount(FaultReset_TypeDef cause)
+{
+	return (cause < FAULT_RESET_CAUSES) ? record.resets[cause] : 0;
+}
+
+/**
+ * @fn const char Fault_ResetName*(FaultReset_TypeDef)
+ * @brief nome della causa di reset
+ */
+const char *Fault_ResetName(FaultReset_TypeDef cause)
+{
+	return (cause < FAULT_RESET_CAUSES) ? names[cause] : "?";
+}
+
+/**
+ * @fn char Fault_Report*(char*, uint16_t)
+ * @brief rapporto dell'ultimo reset: causa, contatori e, se presente, lo stato catturato.
+ *        Il nome del task in esecuzione è risolto dallo scheduler: chiamare dopo la registrazione dei task.
+ *
+ * @param mess buffer di almeno FAULT_REPORT_LENGTH caratteri
+ * @param size dimensione del buffer
+ * @return mess
+ */
+char *Fault_Report(char *mess, uint16_t size)
+{
+	FmtSink_TypeDef out;
+
+	Fmt_SpanSink(&out, mess, size);
+
+	Fmt_Print(&out, "Reset: %s\r\nReset dall'accensione:", names[last.cause]);
+
+	for (uint8_t cause = FAULT_RESET_PIN; cause < FAULT_RESET_CAUSES; cause++)
+	{
+		Fmt_Print(&out, " %s %lu", names[cause], (unsigned long) record.resets[cause]);
+	}
+
+	Fmt_Print(&out, "\r\n");
+
+	if (last.captured)
+	{
+		const FaultCapture_TypeDef *c = &last.capture;
+
+		TimSys_Task_TypeDef *task = TimSys_Task(c->running);
+
+		Fmt_Print(&out, "PC %08lX LR %08lX PSR %08lX\r\n"
+						"CFSR %08lX HFSR %08lX BFAR %08lX MMFAR %08lX\r\n"
+						"R0 %08lX R1 %08lX R2 %08lX R3 %08lX R12 %08lX\r\n"
+						"t %lus, task %s, gsm %u, allarme %u\r\n",
+				(unsigned long) c->pc, (unsigned long) c->lr, (unsigned long) c->psr,
+				(unsigned long) c->cfsr, (unsigned long) c->hfsr, (unsigned long) c->bfar, (unsigned long) c->mmfar,
+				(unsigned long) c->r0, (unsigned long) c->r1, (unsigned long) c->r2, (unsigned long) c->r3, (unsigned long) c->r12,
+				(unsigned long) c->tick / 1000, task ? task->name : "-", c->gsm, c->alarm);
+
+		for (uint8_t id = 0; id < PROF_PROBES; id++)
+		{
+			Fmt_Print(&out, "%s %luns%s", probes[id], (unsigned long) c->probe[id], (id < PROF_PROBES - 1) ? ", " : "\r\n");
+		}
+	}
+
+	return mess;
+}
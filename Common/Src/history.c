@@ -0,0 +1,345 @@
+/**
+ * @file history.c - https://github.com/SC-Develop/tesysma
+ *
+ * @author Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/SC-Develop/
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ *
+ * Storia della temperatura in RAM:
+ *
+ * - ring di HISTORY_SIZE campioni compatti: temperatura in centesimi di grado (int16) e delta dal campione
+ *   precedente in unità di HISTORY_TICK_UNIT (uint16)
+ * - statistiche (min, max, media, varianza) sulle finestre mobili di 1 ora, 24 ore e 7 giorni. Ogni finestra è
+ *   divisa in intervalli (bucket) di durata fissa: il campione è accumulato con l'algoritmo di Welford nel bucket
+ *   corrente e nel totale della finestra, per cui l'aggiunta e la lettura delle statistiche sono O(1).
+ *   Alla chiusura di un bucket, il più vecchio esce dalla finestra e il totale viene ricalcolato unendo i bucket
+ *   rimasti (una volta per bucket, senza accumulo di errori di arrotondamento).
+ *   La finestra copre quindi la durata nominale più il bucket corrente, ancora parziale.
+ */
+
+#include "math.h"
+#include "libfmt.h"
+#include "history.h"
+
+/**
+ * @struct
+ * @brief accumulatore di Welford
+ *
+ */
+typedef struct {
+	uint32_t n;
+	float    mean;
+	float    m2;		// somma dei quadrati degli scarti dalla media
+	int16_t  min;		// [centesimi di grado]
+	int16_t  max;
+} HistoryAcc_TypeDef;
+
+/**
+ * @struct
+ * @brief finestra mobile suddivisa in bucket
+ *
+ */
+typedef struct {
+	HistoryAcc_TypeDef *bucket;		// bucket chiusi, gestiti a ring
+	uint16_t            size;		// numero di bucket della finestra
+	uint16_t            head;		// bucket più vecchio
+	uint16_t            used;		// bucket chiusi presenti
+	uint32_t            period;		// durata di un bucket [msec]
+	uint32_t            start;		// inizio del bucket corrente [msec]
+	HistoryAcc_TypeDef  current;	// bucket corrente
+	HistoryAcc_TypeDef  total;		// totale della finestra (bucket chiusi + corrente)
+} HistoryWindowAcc_TypeDef;
+
+/**
+ * @struct
+ * @brief campione compatto
+ *
+ */
+typedef struct {
+	int16_t  temp;		// [centesimi di grado]
+	uint16_t delta;		// tempo dal campione precedente [HISTORY_TICK_UNIT]
+} HistorySample_TypeDef;
+
+// Variables ------------------------------------------------------------------------------------------------------------------------------
+
+static HistoryAcc_TypeDef bucket_1h[60];	// 60 bucket di 1 minuto
+static HistoryAcc_TypeDef bucket_24h[96];	// 96 bucket di 15 minuti
+static HistoryAcc_TypeDef bucket_7d[168];	// 168 bucket di 1 ora
+
+static HistoryWindowAcc_TypeDef window[HW_MAX] = {
+	[HW_1H]  = { .bucket = bucket_1h,  .size = 60,  .period = 60000   },
+	[HW_24H] = { .bucket = bucket_24h, .size = 96,  .period = 900000  },
+	[HW_7D]  = { .bucket = bucket_7d,  .size = 168, .period = 3600000 },
+};
+
+static struct {
+	HistorySample_TypeDef sample[HISTORY_SIZE];
+	uint16_t              head;		// prossima posizione di scrittura
+	uint16_t              count;
+	uint32_t              last_tick;	// istante dell'ultimo campione
+} history;
+
+// - Local functions ----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @fn void Acc_Reset(HistoryAcc_TypeDef*)
+ * @brief azzera l'accumulatore
+ */
+static void Acc_Reset(HistoryAcc_TypeDef *acc)
+{
+	acc->n    = 0;
+	acc->mean = 0;
+	acc->m2   = 0;
+	acc->min  = INT16_MAX;
+	acc->max  = INT16_MIN;
+}
+
+/**
+ * @fn void Acc_Add(HistoryAcc_TypeDef*, int16_t)
+ * @brief aggiunge un campione all'accumulatore (Welford)
+ */
+static void Acc_Add(HistoryAcc_TypeDef *acc, int16_t x)
+{
+	if (acc->n == 0)
+	{
+		Acc_Reset(acc);
+	}
+
+	acc->n++;
+
+	float d = x - acc->mean;
+
+	acc->mean += d / acc->n;
+	acc->m2   += d * (x - acc->mean);
+
+	if (x < acc->min) acc->min = x;
+	if (x > acc->max) acc->max = x;
+}
+
+/**
+ * @fn void Acc_Merge(HistoryAcc_TypeDef*, const HistoryAcc_TypeDef*)
+ * @brief unisce l'accumulatore b nell'accumulatore a (Chan)
+ */
+static void Acc_Merge(HistoryAcc_TypeDef *a, const HistoryAcc_TypeDef *b)
+{
+	if (b->n == 0)
+	{
+		return;
+	}
+
+	if (a->n == 0)
+	{
+		*a = *b;
+		return;
+	}
+
+	uint32_t n = a->n + b->n;
+	float    d = b->mean - a->mean;
+
+	a->mean += d * b->n / n;
+	a->m2   += b->m2 + d * d * ((float) a->n * b->n / n);
+	a->n     = n;
+
+	if (b->min < a->min) a->min = b->min;
+	if (b->max > a->max) a->max = b->max;
+}
+
+/**
+ * @fn void Window_Roll(HistoryWindowAcc_TypeDef*, uint32_t)
+ * @brief chiude i bucket scaduti all'istante tick: i bucket più vecchi della finestra vengono scartati e il
+ *        totale ricalcolato
+ */
+static void Window_Roll(HistoryWindowAcc_TypeDef *w, uint32_t tick)
+{
+	uint32_t periods = (tick - w->start) / w->period;
+
+	if (periods == 0)
+	{
+		return;
+	}
+
+	for (uint32_t i = 0; i < periods && i <= w->size; i++) // oltre size bucket vuoti la finestra è comunque vuota
+	{
+		if (w->used == w->size)
+		{
+			w->head = (w->head + 1) % w->size;
+			w->used--;
+		}
+
+		w->bucket[(w->head + w->used) % w->size] = w->current;
+		w->used++;
+
+		Acc_Reset(&w->current);
+	}
+
+	w->start += periods * w->period;
+
+	Acc_Reset(&w->total);
+
+	for (uint16_t i = 0; i < w->used; i++)
+	{
+		Acc_Merge(&w->total, &w->bucket[(w->head + i) % w->size]);
+	}
+}
+
+/**
+ * @fn int16_t ToCentidegrees(float)
+ * @brief converte la temperatura in centesimi di grado, saturando al range di int16
+ */
+static int16_t ToCentidegrees(float temp)
+{
+	float c = roundf(temp * 100);
+
+	if (c > INT16_MAX) return INT16_MAX;
+	if (c < INT16_MIN) return INT16_MIN;
+
+	return (int16_t) c;
+}
+
+// - Exported functions -------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @fn void History_Add(float, uint32_t)
+ * @brief aggiunge una lettura alla storia e alle statistiche delle finestre
+ *
+ * @param temp  [°C]
+ * @param tick  istante della lettura [msec]
+ */
+void History_Add(float temp, uint32_t tick)
+{
+	int16_t  c     = ToCentidegrees(temp);
+	uint32_t delta = history.count ? (tick - history.last_tick) / HISTORY_TICK_UNIT : 0;
+
+	history.sample[history.head].temp  = c;
+	history.sample[history.head].delta = (delta > UINT16_MAX) ? UINT16_MAX : delta;
+
+	history.head = (history.head + 1) % HISTORY_SIZE;
+
+	if (history.count < HISTORY_SIZE)
+	{
+		history.count++;
+	}
+
+	for (uint8_t i = 0; i < HW_MAX; i++)
+	{
+		HistoryWindowAcc_TypeDef *w = window + i;
+
+		if (w->total.n == 0 && w->used == 0) // primo campione: la finestra inizia ora
+		{
+			w->start = tick;
+		}
+
+		Window_Roll(w, tick);
+
+		Acc_Add(&w->current, c);
+		Acc_Add(&w->total, c);
+	}
+
+	history.last_tick = tick;
+}
+
+/**
+ * @fn uint8_t History_Stats(HistoryWindow_TypeDef, HistoryStats_TypeDef*)
+ * @brief statistiche della finestra, O(1)
+ *
+ * @param w
+ * @param stats
+ * @return 0 se la finestra non contiene campioni
+ */
+uint8_t History_Stats(HistoryWindow_TypeDef w, HistoryStats_TypeDef *stats)
+{
+	const HistoryAcc_TypeDef *t = &window[w].total;
+
+	stats->count = t->n;
+
+	if (t->n == 0)
+	{
+		return 0;
+	}
+
+	stats->min      = t->min / 100.0f;
+	stats->max      = t->max / 100.0f;
+	stats->mean     = t->mean / 100.0f;
+	stats->variance = (t->n > 1) ? t->m2 / (t->n - 1) / 10000.0f : 0;
+
+	return 1;
+}
+
+/**
+ * @fn uint16_t History_Count(void)
+ * @brief numero di campioni presenti nel ring
+ */
+uint16_t History_Count(void)
+{
+	return history.count;
+}
+
+/**
+ * @fn uint8_t History_Get(uint16_t, float*, uint32_t*)
+ * @brief legge un campione dal ring
+ *
+ * @param age  0 = campione più recente
+ * @param temp [°C]
+ * @param tick istante del campione, ricostruito sommando i delta dei campioni più recenti [msec]
+ * @return 0 se il campione non esiste
+ */
+uint8_t History_Get(uint16_t age, float *temp, uint32_t *tick)
+{
+	if (age >= history.count)
+	{
+		return 0;
+	}
+
+	uint32_t t   = history.last_tick;
+	uint16_t idx = (history.head + HISTORY_SIZE - 1) % HISTORY_SIZE;
+
+	for (uint16_t i = 0; i < age; i++)
+	{
+		t  -= history.sample[idx].delta * HISTORY_TICK_UNIT;
+		idx = (idx + HISTORY_SIZE - 1) % HISTORY_SIZE;
+	}
+
+	*temp = history.sample[idx].temp / 100.0f;
+	*tick = t;
+
+	return 1;
+}
+
+/**
+ * @fn char History_Report*(char*, uint16_t)
+ * @brief compone il riepilogo min/media/max delle finestre, per l'SMS dei parametri e la console
+ *
+ * @param mess buffer di destinazione (96 caratteri per il riepilogo completo)
+ * @param size dimensione del buffer: il riepilogo è troncato a size - 1 caratteri
+ * @return mess
+ */
+char *History_Report(char *mess, uint16_t size)
+{
+	static const char *label[HW_MAX] = {
+		[HW_1H]  = "1h",
+		[HW_24H] = "24h",
+		[HW_7D]  = "7g",
+	};
+
+	FmtSink_TypeDef out;
+
+	Fmt_SpanSink(&out, mess, size);
+
+	Fmt_Print(&out, "Min/Med/Max:\r\n");
+
+	for (uint8_t i = 0; i < HW_MAX; i++)
+	{
+		HistoryStats_TypeDef s;
+
+		if (History_Stats(i, &s))
+		{
+			Fmt_Print(&out, "%s: %0.1f/%0.1f/%0.1f\r\n", label[i], s.min, s.mean, s.max);
+		}
+		else
+		{
+			Fmt_Print(&out, "%s: n/d\r\n", label[i]);
+		}
+	}
+
+	return mess;
+}
@@ -64,9 +64,51 @@ float ADC_Voltage(uint16_t adc_value, uint16_t adc_full_scale, float adc_vref)
  */
 float ADC_CalcCalibratedVDDA(uint32_t adc_vrefint)
 {
+   if (adc_vrefint == 0)
+   {
+	   return ADC_VDD;
+   }
+
    return ADC_VDD * ADC_VREFINT/adc_vrefint;
 }
 
+/**
+ * @brief Get the MCU internal temperature from the temperature sensor channel value, using the factory
+ *        calibration points TS_CAL1 (30 C°) and TS_CAL2 (110 C°).
+ * @param adc_ts  current temperature sensor ADC channel value
+ * @param vdda    current VDDA value (see ADC_CalcCalibratedVDDA)
+ *
+ * return the temperature in C°
+ */
+float ADC_CalcTempSensor(uint32_t adc_ts, float vdda)
+{
+   float ts = (float) adc_ts * vdda / ADC_VDD; // riporta il valore alle condizioni di calibrazione (VDDA = 3.3V)
+
+   return (ADC_TS_CAL2_TEMP - ADC_TS_CAL1_TEMP) * (ts - ADC_TS_CAL1) / (ADC_TS_CAL2 - ADC_TS_CAL1) + ADC_TS_CAL1_TEMP;
+}
+
+/**
+ * @brief Ratiometric correction: scale the ADC value acquired with reference vdda to the value that would be
+ *        acquired with reference vref (the supply voltage of the sensor).
+ * @param adc_value       ADC value
+ * @param vdda            current VDDA value (see ADC_CalcCalibratedVDDA)
+ * @param vref            sensor supply voltage
+ * @param adc_full_scale  ADC full scale value
+ *
+ * return the corrected value, saturated to adc_full_scale
+ */
+uint16_t ADC_Compensate(uint32_t adc_value, float vdda, float vref, uint16_t adc_full_scale)
+{
+   float value = (float) adc_value * vdda / vref;
+
+   if (value > adc_full_scale)
+   {
+	   return adc_full_scale;
+   }
+
+   return (uint16_t) (value + 0.5f);
+}
+
 /**
  * @brief restituisce il valore della resistenza variabile del partitore di tensione corrispondente al
  *         valore letto dall'adc
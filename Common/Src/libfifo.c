@@ -11,6 +11,23 @@
 #include "libfifo.h"
 #include "memory.h"
 
+/**
+ * @fn uint32_t fifo_lock(void)
+ * @brief the fifos are shared between interrupts and the main loop (e.g. tx fifo filled by the application and
+ *        emptied by the tx complete interrupt): items is updated by both sides, so every operation disables the
+ *        interrupts for a few instructions
+ *
+ * @return previous PRIMASK
+ */
+static inline uint32_t fifo_lock(void)
+{
+   uint32_t primask = __get_PRIMASK();
+
+   __disable_irq();
+
+   return primask;
+}
+
 /**
  * @fn void fifo_init(fifo_TypeDef*, char*)
  * @brief
@@ -39,8 +56,12 @@ void ch_fifo_init(Fifo_TypeDef *fifo, char *buffer, uint16_t buffersize)
  */
 uint8_t ch_fifo_push(Fifo_TypeDef *fifo, char ch)
 {
+  	uint32_t primask = fifo_lock();
+
   	if (fifo->items == fifo->size)
 	{
+	   __set_PRIMASK(primask);
+
 	   return 0; // coda piena
 	}
 
@@ -53,6 +74,8 @@ uint8_t ch_fifo_push(Fifo_TypeDef *fifo, char ch)
 
 	fifo->items++;
 
+	__set_PRIMASK(primask);
+
 	return 1;
 }
 
@@ -66,8 +89,12 @@ uint8_t ch_fifo_push(Fifo_TypeDef *fifo, char ch)
  */
 uint8_t ch_fifo_pop(Fifo_TypeDef *fifo, char *ch)
 {
+   uint32_t primask = fifo_lock();
+
    if (fifo->items==0)
    {
+      __set_PRIMASK(primask);
+
       return 0; // null char = empty fifo
    }
 
@@ -80,6 +107,8 @@ uint8_t ch_fifo_pop(Fifo_TypeDef *fifo, char *ch)
 
    fifo->items--;
 
+   __set_PRIMASK(primask);
+
    return 1;
 }
 
@@ -103,3 +132,50 @@ uint8_t ch_fifo_get(Fifo_TypeDef *fifo, char *ch)
    return 1;
 }
 
+/**
+ * @fn uint16_t ch_fifo_span(Fifo_TypeDef*, char**)
+ * @brief contiguous items from the head of the fifo, to be sent as a single block
+ *
+ * @param fifo
+ * @param data pointer to the head item
+ * @return number of contiguous items (up to the end of the circular buffer), 0 if the fifo is empty
+ */
+uint16_t ch_fifo_span(Fifo_TypeDef *fifo, char **data)
+{
+   uint32_t primask = fifo_lock();
+
+   uint16_t len = fifo->size - fifo->first;
+
+   *data = fifo->buffer + fifo->first;
+
+   if (len > fifo->items)
+   {
+      len = fifo->items;
+   }
+
+   __set_PRIMASK(primask);
+
+   return len;
+}
+
+/**
+ * @fn void ch_fifo_discard(Fifo_TypeDef*, uint16_t)
+ * @brief remove len items from the head of the fifo (e.g. after sending a ch_fifo_span block)
+ *
+ * @param fifo
+ * @param len
+ */
+void ch_fifo_discard(Fifo_TypeDef *fifo, uint16_t len)
+{
+   uint32_t primask = fifo_lock();
+
+   if (len > fifo->items)
+   {
+      len = fifo->items;
+   }
+
+   fifo->first = (fifo->first + len) % fifo->size;
+   fifo->items -= len;
+
+   __set_PRIMASK(primask);
+}
@@ -0,0 +1,543 @@
+/**
+ * @file libfmt.c - https://github.com/SC-Develop/tesysma
+ *
+ * @brief compact formatter, bounded and allocation free, replacing the newlib printf family
+ *
+ * @author Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/SC-Develop/
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ *
+ * Formattazione senza heap e senza il printf di newlib (e il suo supporto dei float): i caratteri sono scritti
+ * direttamente nel destinatario, un buffer lineare che non viene mai superato o una FIFO che, quando è piena, viene
+ * svuotata dalla funzione di flush. Nessuno stato statico: le funzioni sono rientranti.
+ *
+ * Conversioni: %d %i %u %x %X %c %s %f %%, con i flag '-' '0' '+', larghezza e precisione (anche '*') e i
+ * modificatori h, l, z. %f è in virgola fissa: il valore è convertito in float, arrotondato a FMT_FLOAT_PRECISION
+ * cifre decimali, o alla precisione indicata fino a FMT_FLOAT_MAX_PRECISION, e stampato come intero; "nan" e "ovf"
+ * se non rappresentabile. A differenza di printf il mezzo è arrotondato per eccesso e lo zero non ha segno. 'll'
+ * non è supportato. Una conversione sconosciuta è copiata così com'è.
+ */
+
+#include <string.h>
+#include "libfmt.h"
+
+// Defines ----------------------------------------------------------------------------------------------------------------------------------
+
+#define FLAG_LEFT		0x01	// '-': allineamento a sinistra
+#define FLAG_ZERO		0x02	// '0': riempimento con zeri
+#define FLAG_PLUS		0x04	// '+': segno anche per i positivi
+
+#define DIGITS_MAX		24		// cifre di un unsigned long in base 8 o superiore, e segno
+
+// Variables ------------------------------------------------------------------------------------------------------------------------------
+
+static const uint32_t scale[FMT_FLOAT_MAX_PRECISION + 1] = { 1, 10, 100, 1000 };
+
+// - Local functions ----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @fn void Put(FmtSink_TypeDef*, char)
+ * @brief scrive un carattere nel destinatario
+ */
+static void Put(FmtSink_TypeDef *sink, char ch)
+{
+	if (!sink->fifo)
+	{
+		if (sink->len + 1 < sink->size) // spazio per il terminatore
+		{
+			sink->buffer[sink->len++] = ch;
+
+			return;
+		}
+	}
+	else
+	{
+		uint8_t done = ch_fifo_push(sink->fifo, ch);
+
+		if (!done && sink->flush)
+		{
+			sink->flush(sink->arg); // coda piena: la svuota e riprova
+
+			done = ch_fifo_push(sink->fifo, ch);
+		}
+
+		if (done)
+		{
+			sink->len++;
+
+			return;
+		}
+	}
+
+	sink->lost++;
+}
+
+/**
+ * @fn void Write(FmtSink_TypeDef*, const char*, uint16_t)
+ * @brief scrive len caratteri nel destinatario: sul buffer lineare con una sola copia
+ */
+static void Write(FmtSink_TypeDef *sink, const char *s, uint16_t len)
+{
+	if (sink->fifo)
+	{
+		while (len--)
+		{
+			Put(sink, *s++);
+		}
+
+		return;
+	}
+
+	uint16_t room = (sink->size > sink->len) ? sink->size - sink->len - 1 : 0;
+
+	if (len > room)
+	{
+		sink->lost += len - room;
+
+		len = room;
+	}
+
+	memcpy(sink->buffer + sink->len, s, len);
+
+	sink->len += len;
+}
+
+/**
+ * @fn void Fill(FmtSink_TypeDef*, char, int16_t)
+ * @brief scrive n volte il carattere
+ */
+static void Fill(FmtSink_TypeDef *sink, char ch, int16_t n)
+{
+	while (n-- > 0)
+	{
+		Put(sink, ch);
+	}
+}
+
+/**
+ * @fn void Field(FmtSink_TypeDef*, char, int16_t, const char*, uint16_t, int16_t, uint8_t)
+ * @brief scrive un campo allineato: prefisso (segno), zeri della precisione e corpo, nella larghezza indicata
+ *
+ * @param prefix segno, 0 se assente
+ * @param zeros  zeri tra il prefisso e il corpo
+ * @param body   caratteri del campo
+ * @param len    lunghezza del corpo
+ * @param width  larghezza minima del campo
+ * @param flags
+ */
+static void Field(FmtSink_TypeDef *sink, char prefix, int16_t zeros, const char *body, uint16_t len, int16_t width, uint8_t flags)
+{
+	if (zeros < 0)
+	{
+		zeros = 0;
+	}
+
+	int16_t pad = width - (int16_t) len - (prefix ? 1 : 0) - zeros;
+
+	if (!(flags & FLAG_LEFT))
+	{
+		if (flags & FLAG_ZERO)
+		{
+			zeros += (pad > 0) ? pad : 0; // gli zeri seguono il segno
+		}
+		else
+		{
+			Fill(sink, ' ', pad);
+		}
+
+		pad = 0;
+	}
+
+	if (prefix)
+	{
+		Put(sink, prefix);
+	}
+
+	Fill(sink, '0', zeros);
+
+	Write(sink, body, len);
+
+	Fill(sink, ' ', pad);
+}
+
+/**
+ * @fn void Integer(FmtSink_TypeDef*, unsigned long, uint8_t, uint8_t, char, int16_t, int16_t, uint8_t)
+ * @brief scrive un intero nella base indicata
+ *
+ * @param value     valore assoluto
+ * @param base      10 o 16
+ * @param upper     cifre esadecimali maiuscole
+ * @param sign      segno, 0 se assente
+ * @param precision cifre minime, -1 se non indicata
+ */
+static void Integer(FmtSink_TypeDef *sink, unsigned long value, uint8_t base, uint8_t upper, char sign, int16_t precision, int16_t width, uint8_t flags)
+{
+	const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+
+	char     buf[DIGITS_MAX];
+	uint16_t n = DIGITS_MAX;
+
+	if (base == 16)
+	{
+		do {
+			buf[--n] = digits[value & 0x0F];
+			value  >>= 4;
+		} while (value);
+	}
+	else
+	{
+		do {
+			buf[--n] = '0' + value % 10;
+			value   /= 10;
+		} while (value);
+	}
+
+	if (precision >= 0)
+	{
+		flags &= ~FLAG_ZERO; // come printf: con la precisione il flag '0' è ignorato
+	}
+
+	if (precision == 0 && n == DIGITS_MAX - 1 && buf[n] == '0')
+	{
+		n = DIGITS_MAX; // come printf: lo zero con precisione nulla non ha cifre
+	}
+
+	Field(sink, sign, precision - (int16_t) (DIGITS_MAX - n), buf + n, DIGITS_MAX - n, width, flags);
+}
+
+/**
+ * @fn void Fixed(FmtSink_TypeDef*, float, int16_t, char, int16_t, uint8_t)
+ * @brief scrive un numero in virgola fissa con precision cifre decimali
+ *
+ * @param value
+ * @param precision cifre decimali, da 0 a FMT_FLOAT_MAX_PRECISION
+ * @param plus      segno per i positivi, 0 se assente
+ */
+static void Fixed(FmtSink_TypeDef *sink, float value, int16_t precision, char plus, int16_t width, uint8_t flags)
+{
+	char     buf[DIGITS_MAX];
+	uint16_t n = DIGITS_MAX;
+
+	char sign = plus;
+
+	if (value != value)
+	{
+		Field(sink, 0, 0, "nan", 3, width, flags & ~FLAG_ZERO);
+
+		return;
+	}
+
+	if (value < 0)
+	{
+		value = -value;
+		sign  = '-';
+	}
+
+	if (value >= 4000000000.0f / scale[precision]) // oltre uint32_t
+	{
+		Field(sink, sign, 0, "ovf", 3, width, flags & ~FLAG_ZERO);
+
+		return;
+	}
+
+	uint32_t fixed = (uint32_t) (value * scale[precision] + 0.5f);
+
+	if (fixed == 0 && sign == '-')
+	{
+		sign = plus; // niente "-0.0"
+	}
+
+	for (int16_t i = 0; i < precision; i++)
+	{
+		buf[--n] = '0' + fixed % 10;
+		fixed   /= 10;
+	}
+
+	if (precision)
+	{
+		buf[--n] = '.';
+	}
+
+	do {
+		buf[--n] = '0' + fixed % 10;
+		fixed   /= 10;
+	} while (fixed);
+
+	Field(sink, sign, 0, buf + n, DIGITS_MAX - n, width, flags);
+}
+
+// - Exported functions -------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @fn void Fmt_SpanSink(FmtSink_TypeDef*, char*, uint16_t)
+ * @brief destinatario su buffer lineare: la formattazione non supera size - 1 caratteri ed è sempre terminata
+ *
+ * @param sink
+ * @param buffer
+ * @param size   dimensione del buffer, terminatore compreso
+ */
+void Fmt_SpanSink(FmtSink_TypeDef *sink, char *buffer, uint16_t size)
+{
+	sink->buffer = buffer;
+	sink->size   = size;
+	sink->fifo   = NULL;
+	sink->flush  = NULL;
+	sink->arg    = NULL;
+	sink->len    = 0;
+	sink->lost   = 0;
+
+	if (size)
+	{
+		buffer[0] = '\0';
+	}
+}
+
+/**
+ * @fn void Fmt_FifoSink(FmtSink_TypeDef*, Fifo_TypeDef*, Fmt_Flush, void*)
+ * @brief destinatario su FIFO, senza terminatore
+ *
+ * @param sink
+ * @param fifo
+ * @param flush svuota la FIFO quando è piena, NULL se i caratteri in eccesso vanno scartati
+ * @param arg   argomento di flush
+ */
+void Fmt_FifoSink(FmtSink_TypeDef *sink, Fifo_TypeDef *fifo, Fmt_Flush flush, void *arg)
+{
+	sink->buffer = NULL;
+	sink->size   = 0;
+	sink->fifo   = fifo;
+	sink->flush  = flush;
+	sink->arg    = arg;
+	sink->len    = 0;
+	sink->lost   = 0;
+}
+
+/**
+ * @fn uint16_t Fmt_VPrint(FmtSink_TypeDef*, const char*, va_list)
+ * @brief formatta accodando al destinatario: chiamate successive sullo stesso destinatario concatenano il testo
+ *
+ * @param sink
+ * @param fmt
+ * @param ap
+ * @return caratteri scritti da questa chiamata, esclusi quelli scartati
+ */
+uint16_t Fmt_VPrint(FmtSink_TypeDef *sink, const char *fmt, va_list ap)
+{
+	uint16_t start = sink->len;
+
+	while (*fmt)
+	{
+		if (*fmt != '%')
+		{
+			const char *text = fmt;
+
+			while (*fmt && *fmt != '%')
+			{
+				fmt++;
+			}
+
+			Write(sink, text, fmt - text); // testo letterale fino alla prossima conversione
+
+			continue;
+		}
+
+		const char *spec = fmt++; // inizio della conversione, copiata se sconosciuta
+
+		uint8_t flags     = 0;
+		int16_t width     = 0;
+		int16_t precision = -1;
+		char    length    = 0;
+
+		for (;; fmt++)
+		{
+			if (*fmt == '-') flags |= FLAG_LEFT;
+			else
+			if (*fmt == '0') flags |= FLAG_ZERO;
+			else
+			if (*fmt == '+') flags |= FLAG_PLUS;
+			else
+			break;
+		}
+
+		if (*fmt == '*')
+		{
+			width = va_arg(ap, int);
+			fmt++;
+
+			if (width < 0)
+			{
+				flags |= FLAG_LEFT;
+				width  = -width;
+			}
+		}
+		else
+		{
+			while (*fmt >= '0' && *fmt <= '9')
+			{
+				width = width * 10 + (*fmt++ - '0');
+			}
+		}
+
+		if (*fmt == '.')
+		{
+			fmt++;
+			precision = 0;
+
+			if (*fmt == '*')
+			{
+				precision = va_arg(ap, int);
+				fmt++;
+			}
+			else
+			{
+				while (*fmt >= '0' && *fmt <= '9')
+				{
+					precision = precision * 10 + (*fmt++ - '0');
+				}
+			}
+		}
+
+		while (*fmt == 'h' || *fmt == 'l' || *fmt == 'z')
+		{
+			length = *fmt++;
+		}
+
+		char plus = (flags & FLAG_PLUS) ? '+' : 0;
+
+		switch (*fmt)
+		{
+			case 'd':
+			case 'i':
+			{
+				long value = (length == 'l') ? va_arg(ap, long) : (length == 'z') ? (long) va_arg(ap, size_t) : va_arg(ap, int);
+
+				unsigned long magnitude = (value < 0) ? 0UL - (unsigned long) value : (unsigned long) value;
+
+				Integer(sink, magnitude, 10, 0, (value < 0) ? '-' : plus, precision, width, flags);
+			}
+			break;
+
+			case 'u':
+			case 'x':
+			case 'X':
+			{
+				unsigned long value = (length == 'l') ? va_arg(ap, unsigned long) : (length == 'z') ? va_arg(ap, size_t) : va_arg(ap, unsigned int);
+
+				Integer(sink, value, (*fmt == 'u') ? 10 : 16, *fmt == 'X', 0, precision, width, flags);
+			}
+			break;
+
+			case 'c':
+			{
+				char ch = (char) va_arg(ap, int);
+
+				Field(sink, 0, 0, &ch, 1, width, flags & ~FLAG_ZERO);
+			}
+			break;
+
+			case 's':
+			{
+				const char *s = va_arg(ap, const char *);
+
+				if (!s)
+				{
+					s = "(null)";
+				}
+
+				uint16_t len = 0;
+
+				while (s[len] && (precision < 0 || len < precision))
+				{
+					len++;
+				}
+
+				Field(sink, 0, 0, s, len, width, flags & ~FLAG_ZERO);
+			}
+			break;
+
+			case 'f':
+			{
+				float value = (float) va_arg(ap, double);
+
+				if (precision < 0)
+				{
+					precision = FMT_FLOAT_PRECISION;
+				}
+				else
+				if (precision > FMT_FLOAT_MAX_PRECISION)
+				{
+					precision = FMT_FLOAT_MAX_PRECISION;
+				}
+
+				Fixed(sink, value, precision, plus, width, flags);
+			}
+			break;
+
+			case '%':
+				Write(sink, "%", 1);
+			break;
+
+			default: // conversione sconosciuta o formato troncato: copia la specifica
+			{
+				Write(sink, spec, fmt - spec);
+
+				continue;
+			}
+		}
+
+		fmt++;
+	}
+
+	if (!sink->fifo && sink->size)
+	{
+		sink->buffer[sink->len] = '\0';
+	}
+
+	return sink->len - start;
+}
+
+/**
+ * @fn uint16_t Fmt_Print(FmtSink_TypeDef*, const char*, ...)
+ * @brief vedi Fmt_VPrint
+ */
+uint16_t Fmt_Print(FmtSink_TypeDef *sink, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	uint16_t n = Fmt_VPrint(sink, fmt, ap);
+	va_end(ap);
+
+	return n;
+}
+
+/**
+ * @fn uint16_t Fmt_VSnprintf(char*, uint16_t, const char*, va_list)
+ * @brief formatta nel buffer, al più size - 1 caratteri più il terminatore
+ *
+ * @return caratteri scritti, a differenza di vsnprintf mai più di size - 1: il risultato può essere sommato
+ *         al puntatore del buffer senza controlli
+ */
+uint16_t Fmt_VSnprintf(char *buffer, uint16_t size, const char *fmt, va_list ap)
+{
+	FmtSink_TypeDef sink;
+
+	Fmt_SpanSink(&sink, buffer, size);
+
+	return Fmt_VPrint(&sink, fmt, ap);
+}
+
+/**
+ * @fn uint16_t Fmt_Snprintf(char*, uint16_t, const char*, ...)
+ * @brief vedi Fmt_VSnprintf
+ */
+uint16_t Fmt_Snprintf(char *buffer, uint16_t size, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	uint16_t n = Fmt_VSnprintf(buffer, size, fmt, ap);
+	va_end(ap);
+
+	return n;
+}
@@ -15,6 +15,7 @@
 #include <string.h>
 #include <libparser.h>
 #include <libfifo.h>
+#include "timsys.h"
 
 /**
  * Defines -------------------------------------------------------------------------------------------------- /
@@ -174,6 +175,11 @@ static ParserResult_TypeDef command_parsing(Parser_TypeDef *p, char ch)
 
 	uint8_t prefix_len = strlen(p->prefix);
 
+	if ((uint8_t) ch < SPACE && ch != BACKSPACE && ch != _CR && ch != LF) // control chars (terminal hotkeys) are not part of a command
+	{
+		return PR_IGNORED;
+	}
+
 	if (p->i < prefix_len)     				// check the prefix_len character: only prefix_len characters are allowed
 	{
 		if (ch == _CR)
@@ -205,23 +211,29 @@ static ParserResult_TypeDef command_parsing(Parser_TypeDef *p, char ch)
 		switch (ch)
 		{
 			case BACKSPACE:
+			case DEL:       // sent by most terminals for the backspace key
 
-			  if (p->rx_len>0) // override the previous character
+			  if (p->i > prefix_len) // remove the previous character, the prefix is kept
 			  {
-				p->rx_len--;
-				p->rx_idx--;
+				p->i--;
+
+				return PR_BACKSPACE;
 			  }
 
-            break;
+			  return PR_IGNORED;
 
-			case DEL:
-			case TAB:
-		  	  return PR_IGNORED;
-		  	break;
+            break;
 
 			case _CR:
 			case  LF: 	// return key pressed: end of command detected
 			{
+				if (p->i == prefix_len) // empty command: prompt on CR, LF of a CR LF pair ignored
+				{
+					p->i = 0;
+
+					return (ch == _CR) ? PR_PROMPT : PR_IGNORED;
+				}
+
 				p->cmd[p->i] = NULLCH;      	      // terminate the string command (without CR/LF)
 
 				p->i = 0;
@@ -236,14 +248,11 @@ static ParserResult_TypeDef command_parsing(Parser_TypeDef *p, char ch)
 
 					if (strncasecmp(cmd, cmds->prefix, prefix_len)==0) // compare command with current command prefix: check if command starts with command prefix
 					{
-						cmd += prefix_len; // skip to command args
+						cmd += prefix_len; // skip to command args (empty string if the command has none)
 
-						if (strlen(cmd))
+						if (cmds->execCallback)
 						{
-							if (cmds->execCallback)
-							{
-								return cmds->execCallback(cmd,n);
-							}
+							return cmds->execCallback(cmd,n);
 						}
 					}
 				}
@@ -358,8 +367,12 @@ static uint8_t message_analyze(ParserId_TypeDef id)
 
 	while (ch_fifo_pop(p->rxFifo, &ch)!=NULLCH)
 	{
+	   PROF_BEGIN(PROF_PARSER);
+
 	   uint8_t result = message_parsing(p,ch); 				// parse the current char and execute command if recognized
 
+	   PROF_END(PROF_PARSER);
+
 	   if (p->echo)
 	   {
 		  if (p->commands->echoCallback) 					// se la callback è impostata
@@ -0,0 +1,188 @@
+/**
+ * @file msgpool.c - https://github.com/SC-Develop/tesysma
+ *
+ * @author Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/SC-Develop/
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ *
+ * Pool di blocchi di dimensione fissa per i messaggi.
+ *
+ * I buffer dei messaggi (SMS in composizione, in coda e in trasmissione) non sono
+ * mai tutti in uso contemporaneamente: invece di riservarli staticamente sono presi da un pool di MSGPOOL_BLOCKS
+ * blocchi. Ogni blocco ha un proprietario; chi lo cede (ad esempio il compositore dell'SMS allo scheduler del modem
+ * e questo alla trasmissione) lo passa con MsgPool_Handoff e non lo usa più, l'ultimo proprietario lo rilascia.
+ * Allocazione e rilascio sono O(1) e possono essere chiamati da un interrupt.
+ */
+
+#include "libfmt.h"
+#include "msgpool.h"
+
+// Variables ------------------------------------------------------------------------------------------------------------------------------
+
+static uint32_t blocks[MSGPOOL_BLOCKS][MSGPOOL_BLOCK_SIZE / sizeof(uint32_t)]; // allineati a 32 bit
+
+static uint8_t block_owner[MSGPOOL_BLOCKS];
+
+static MsgPoolStats_TypeDef stats;
+
+static const char *names[MSG_OWNERS] = {
+	[MSG_FREE]       = "liberi",
+	[MSG_SMS_BUILD]  = "sms",
+	[MSG_SMS_QUEUED] = "in coda",
+	[MSG_SMS_TX]     = "tx",
+};
+
+// - Local functions ----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @fn int8_t Index(const void*)
+ * @brief indice del blocco, -1 se il puntatore non è l'inizio di un blocco del pool
+ */
+static int8_t Index(const void *block)
+{
+	for (uint8_t n = 0; n < MSGPOOL_BLOCKS; n++)
+	{
+		if (block == blocks[n])
+		{
+			return n;
+		}
+	}
+
+	return -1;
+}
+
+// - Exported functions -------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @fn void MsgPool_Alloc*(MsgOwner_TypeDef)
+ * @brief alloca un blocco di MSGPOOL_BLOCK_SIZE byte
+ *
+ * @param owner proprietario
+ * @return blocco, NULL se il pool è esaurito
+ */
+void *MsgPool_Alloc(MsgOwner_TypeDef owner)
+{
+	void *block = NULL;
+
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+
+	for (uint8_t n = 0; n < MSGPOOL_BLOCKS; n++)
+	{
+		if (block_owner[n] == MSG_FREE)
+		{
+			block_owner[n] = owner;
+
+			block = blocks[n];
+
+			stats.allocs++;
+
+			if (++stats.used > stats.high_water)
+			{
+				stats.high_water = stats.used;
+			}
+
+			break;
+		}
+	}
+
+	if (!block)
+	{
+		stats.failures++;
+	}
+
+	__set_PRIMASK(primask);
+
+	return block;
+}
+
+/**
+ * @fn void MsgPool_Handoff(void*, MsgOwner_TypeDef)
+ * @brief cede il blocco a un nuovo proprietario
+ */
+void MsgPool_Handoff(void *block, MsgOwner_TypeDef owner)
+{
+	int8_t n = Index(block);
+
+	if (n >= 0 && block_owner[n] != MSG_FREE && owner != MSG_FREE)
+	{
+		block_owner[n] = owner;
+	}
+}
+
+/**
+ * @fn void MsgPool_Free(void*)
+ * @brief rilascia il blocco; NULL e puntatori esterni al pool sono ignorati
+ */
+void MsgPool_Free(void *block)
+{
+	int8_t n = Index(block);
+
+	if (n < 0)
+	{
+		return;
+	}
+
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+
+	if (block_owner[n] != MSG_FREE)
+	{
+		block_owner[n] = MSG_FREE;
+
+		stats.used--;
+	}
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @fn void MsgPool_Stats(MsgPoolStats_TypeDef*)
+ * @brief statistiche correnti del pool
+ */
+void MsgPool_Stats(MsgPoolStats_TypeDef *s)
+{
+	*s = stats;
+
+	for (uint8_t i = 0; i < MSG_OWNERS; i++)
+	{
+		s->owners[i] = 0;
+	}
+
+	for (uint8_t n = 0; n < MSGPOOL_BLOCKS; n++)
+	{
+		s->owners[block_owner[n]]++;
+	}
+}
+
+/**
+ * @fn char MsgPool_Report*(char*, uint16_t)
+ * @brief riepilogo del pool per la console
+ *
+ * @param mess buffer di destinazione (128 caratteri per il riepilogo completo)
+ * @param size dimensione del buffer
+ * @return mess
+ */
+char *MsgPool_Report(char *mess, uint16_t size)
+{
+	MsgPoolStats_TypeDef s;
+
+	MsgPool_Stats(&s);
+
+	FmtSink_TypeDef out;
+
+	Fmt_SpanSink(&out, mess, size);
+
+	Fmt_Print(&out, "Messaggi: %u/%u blocchi da %u byte, massimo %u, esauriti %lu:", s.used, MSGPOOL_BLOCKS, MSGPOOL_BLOCK_SIZE, s.high_water, (unsigned long) s.failures);
+
+	for (uint8_t i = 0; i < MSG_OWNERS; i++)
+	{
+		Fmt_Print(&out, " %s %u", names[i], s.owners[i]);
+	}
+
+	Fmt_Print(&out, "\r\n");
+
+	return mess;
+}
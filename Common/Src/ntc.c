@@ -8,6 +8,7 @@
 
 #include "ntc.h"
 #include "math.h"
+#include "timsys.h"
 
 static struct NTC ntc[] = {
 	{ .A = NTC1_A, .B = NTC1_B, .D = NTC1_D, .Beta = NTC1_BETA, .Tref = T_REF, /*25, NTC1_REF, NTC1_VCC,*/ .vcc = 3.3, .Rc = NTC1_RC, .Rref = NTC1_REF, .betaEnabled = 1, .bitRes = 12, .resFullScale = 4095 },
@@ -19,11 +20,11 @@ static struct NTC ntc[] = {
  * @fn void NTC_Init(uint16_t*)
  * @brief init the ADc resolotion for each NTC in array.
  *
- * @param adc_resolution array of ADC resolution for each NTC. The number of item MUST be NTC_MAX-1, and be NULL terminated
+ * @param adc_resolution array of ADC resolution for each NTC. The number of item MUST be NTC_MAX
  */
 void NTC_Init(uint16_t *adc_resFullScale)
 {
-	for (uint8_t n=0; n<NTC_MAX-1; n++)
+	for (uint8_t n=0; n<NTC_MAX; n++)
 	{
 		ntc[n].resFullScale = *adc_resFullScale++;
 	}
@@ -103,11 +104,57 @@ float NTC_BTemp(struct NTC *ntc, uint32_t adc_value, uint16_t adc_fullscale)
  */
 float NTC_Temp(enum NTC_ID ntcid, uint32_t adc_value)
 {
+	float temp;
+
+	PROF_BEGIN(PROF_NTC);
+
 	if ((ntc + ntcid)->betaEnabled)
 	{
-		return NTC_BTemp(ntc + ntcid, adc_value, (ntc + ntcid)->resFullScale);
+		temp = NTC_BTemp(ntc + ntcid, adc_value, (ntc + ntcid)->resFullScale);
 	}
+	else
+	{
+		temp = NTC_ABDTemp(ntc + ntcid, adc_value, (ntc + ntcid)->resFullScale);
+	}
+
+	PROF_END(PROF_NTC);
 
-	return NTC_ABDTemp(ntc + ntcid, adc_value, (ntc + ntcid)->resFullScale);
+	return temp;
 }
 
+
+
+/**
+ * @fn uint32_t NTC_AdcValue(enum NTC_ID, float)
+ * @brief inverse of NTC_Temp: calcola il valore ADC corrispondente alla temperatura data, per bisezione
+ *        sul modello della sonda (la temperatura decresce al crescere del valore ADC)
+ *
+ * @param ntcid
+ * @param temp  temperatura in °C
+ * @return il minimo valore ADC la cui temperatura è minore o uguale a temp
+ */
+uint32_t NTC_AdcValue(enum NTC_ID ntcid, float temp)
+{
+	struct NTC n = ntc[ntcid]; // copia locale: le funzioni di calcolo aggiornano Rntc e temp
+
+	uint32_t lo = 1;
+	uint32_t hi = n.resFullScale - 1;
+
+	while (lo < hi)
+	{
+		uint32_t mid = (lo + hi) / 2;
+
+		float t = n.betaEnabled ? NTC_BTemp(&n, mid, n.resFullScale) : NTC_ABDTemp(&n, mid, n.resFullScale);
+
+		if (t > temp)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
@@ -75,9 +75,9 @@ static Commands_TypeDef gsm_reply[MID_MAX] = {
 
 static char * ser_prefix = "#";
 
-static char mess[1024] = "\0"; // stringa nulla: contiene solo il carattere terminatore
+static char mess[PARSER_DTMF_LENGTH] = "\0"; // stringa nulla: contiene solo il carattere terminatore
 
-static char line_msg[256] = "\0";
+static char line_msg[CMD_LEN] = "\0"; // una linea ricevuta dal parser, al più CMD_LEN caratteri
 
 // - Exported Functions -------------------------------------------------------------------------------------- /
 
@@ -309,7 +309,7 @@ static uint8_t gsm(char *arg, uint8_t cmd_index)
 
     		tok = strtok(NULL,",");
 
-    		vbat = atof(tok)/1000.0;
+    		vbat = atoi(tok)/1000.0f; // millivolt interi: atoi invece di atof (strtod)
 
     		SetBattCharge(charge);
 
@@ -386,6 +386,13 @@ static uint8_t gsm(char *arg, uint8_t cmd_index)
 
     	case MID_DTMF:
 
+    		if (len >= sizeof(mess) - 1) // sequenza troppo lunga: nessun comando valido
+    		{
+    			len = 0;
+
+    			ClearMessage();
+    		}
+
     		mess[len++] = arg[7]; // build message string
 
     		switch (mess[0])
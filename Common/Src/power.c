@@ -0,0 +1,330 @@
+/**
+ * @file power.c - https://github.com/SC-Develop/tesysma
+ *
+ * @author Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/SC-Develop/
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ *
+ * Idle a basso consumo, chiamato dal loop principale quando lo scheduler non ha task pronti.
+ *
+ * - Sleep tickless: il SysTick è riprogrammato per scadere alla prossima scadenza dei timer dello scheduler, la CPU
+ *   attende in WFI e viene risvegliata dal SysTick stesso o da qualsiasi interrupt (UART, ADC). Al risveglio il
+ *   tempo trascorso è letto dal contatore del SysTick e sommato al tick di sistema, per cui HAL_GetTick resta
+ *   corretto. Il SysTick è a 24 bit: il sonno è limitato a 0xFFFFFF cicli di clock (~670 ms a 25 MHz).
+ * - Stop mode (POWER_STOP_MODE): il risveglio è affidato al wakeup timer dell'RTC, clock LSI. In Stop i clock delle
+ *   periferiche sono fermi: l'UART non riceve e l'ADC non converte, per cui lo Stop è ammesso solo se il chiamante
+ *   lo consente (modem inattivo, nessuna trasmissione, ADC fermo) ed è disabilitato di default, perché i messaggi
+ *   non sollecitati del modem (RING, SMS) andrebbero persi. Il tempo trascorso è quello programmato nell'RTC, con la
+ *   precisione del LSI.
+ *
+ * Il watchdog indipendente continua a contare in entrambi i modi: il task periodico del supervisore limita il
+ * sonno a SUPERVISOR_PERIOD, POWER_MAX_SLEEP è un ulteriore limite entro il timeout dell'IWDG.
+ */
+
+#include "timsys.h"
+#include "clock.h"
+#include "power.h"
+
+// Variables ------------------------------------------------------------------------------------------------------------------------------
+
+static struct {
+	uint32_t start;		// tick di avvio delle statistiche
+	uint32_t mark;		// fine dell'ultimo sonno [msec]
+	uint64_t sleep_us;	// tempo in Sleep [usec]
+	uint64_t stop_us;	// tempo in Stop [usec]
+	uint64_t charge;	// carica consumata stimata [uA * msec]
+	uint32_t wakeups;
+} power;
+
+// - Local functions ----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @fn void SleepTickless(uint32_t)
+ * @brief sospende il tick periodico e dorme in WFI fino alla scadenza o al primo interrupt.
+ *        Deve essere chiamata con gli interrupt disabilitati (PRIMASK): il WFI si risveglia comunque
+ *        sull'interrupt pendente, che viene servito dopo la correzione del tick.
+ *
+ * @param ms  tempo di sonno [msec]
+ */
+static void SleepTickless(uint32_t ms)
+{
+	uint32_t tpm    = SysTick->LOAD + 1;		// cicli per tick (1 msec)
+	uint32_t max_ms = SysTick_LOAD_RELOAD_Msk / tpm;
+
+	if (ms > max_ms)
+	{
+		ms = max_ms;
+	}
+
+	SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+
+	uint32_t phase  = SysTick->VAL;			// cicli mancanti al prossimo tick
+	uint32_t reload = phase + (ms - 1) * tpm;	// il conteggio termina esattamente sul tick di scadenza
+
+	SysTick->LOAD  = reload;
+	SysTick->VAL   = 0;
+	SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+
+	__DSB();
+	__WFI();
+	__ISB();
+
+	uint32_t ctrl = SysTick->CTRL; // la lettura azzera COUNTFLAG: CTRL va letto una sola volta
+
+	SysTick->CTRL = ctrl & ~SysTick_CTRL_ENABLE_Msk;
+
+	uint32_t counted;
+	uint32_t elapsed_ms;
+	uint32_t remainder;
+
+	if (ctrl & SysTick_CTRL_COUNTFLAG_Msk) // risveglio dal SysTick: sonno completo
+	{
+		SCB->ICSR = SCB_ICSR_PENDSTCLR_Msk; // il tick è contato qui, non dall'interrupt
+
+		counted    = reload;
+		elapsed_ms = ms;
+		remainder  = tpm;
+	}
+	else // risveglio da un altro interrupt
+	{
+		counted = reload - SysTick->VAL;
+
+		if (counted < phase)
+		{
+			elapsed_ms = 0;
+			remainder  = phase - counted;
+		}
+		else
+		{
+			elapsed_ms = 1 + (counted - phase) / tpm;
+			remainder  = tpm - (counted - phase) % tpm;
+		}
+	}
+
+	uwTick += elapsed_ms;
+
+	// il primo periodo completa il tick in corso, i successivi tornano alla durata nominale
+
+	SysTick->LOAD  = remainder - 1;
+	SysTick->VAL   = 0;
+	SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+	SysTick->LOAD  = tpm - 1;
+
+	power.sleep_us += (uint64_t) counted * 1000 / tpm;
+	power.charge   += (uint64_t) counted * Clock_SleepCurrent() / tpm;
+
+	TimSys_MicrosAdvance((uint64_t) counted * 1000 / tpm); // il contatore di cicli è fermo in Sleep
+}
+
+#if POWER_STOP_MODE
+
+/**
+ * @fn void SleepStop(uint32_t)
+ * @brief Stop mode con risveglio dal wakeup timer dell'RTC (RTC/16, LSI)
+ *
+ * @param ms  tempo di sonno [msec]
+ */
+static void SleepStop(uint32_t ms)
+{
+	uint32_t counts = (uint64_t) ms * (POWER_LSI_FREQ / 16) / 1000;
+
+	if (counts == 0 || counts > 0x10000)
+	{
+		return;
+	}
+
+	RTC->WPR = 0xCA; // sblocca i registri dell'RTC
+	RTC->WPR = 0x53;
+
+	RTC->CR &= ~(RTC_CR_WUTE | RTC_CR_WUCKSEL); // WUCKSEL = 000: RTC/16
+
+	while (!(RTC->ISR & RTC_ISR_WUTWF));
+
+	RTC->WUTR = counts - 1;
+	RTC->ISR &= ~RTC_ISR_WUTF;
+	RTC->CR  |= RTC_CR_WUTE | RTC_CR_WUTIE;
+
+	RTC->WPR = 0xFF;
+
+	EXTI->PR = EXTI_PR_PR22;
+
+	HAL_SuspendTick();
+
+	HAL_PWR_EnterSTOPMode(PWR_LOWPOWERREGULATOR_ON, PWR_STOPENTRY_WFI);
+
+	Clock_Resume(); // all'uscita dallo Stop il clock di sistema è HSI
+
+	HAL_ResumeTick();
+
+	uint8_t expired = (RTC->ISR & RTC_ISR_WUTF) != 0;
+
+	RTC->WPR = 0xCA;
+	RTC->WPR = 0x53;
+
+	RTC->CR &= ~(RTC_CR_WUTE | RTC_CR_WUTIE);
+
+	RTC->WPR = 0xFF;
+
+	if (expired) // il solo risveglio previsto in Stop: il tempo trascorso è quello programmato
+	{
+		uwTick        += ms;
+		power.stop_us += (uint64_t) ms * 1000;
+
+		TimSys_MicrosAdvance(ms * 1000);
+		power.charge  += (uint64_t) ms * POWER_STOP_CURRENT;
+	}
+}
+
+#endif
+
+// - Exported functions -------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @fn void Power_Init(void)
+ * @brief avvia l'RTC con clock LSI (già attivo per il watchdog) e abilita l'interrupt di wakeup (EXTI 22)
+ */
+void Power_Init(void)
+{
+	power.start = HAL_GetTick();
+	power.mark  = power.start;
+
+  #if POWER_STOP_MODE
+
+	__HAL_RCC_PWR_CLK_ENABLE();
+
+	HAL_PWR_EnableBkUpAccess();
+
+	if (!(RCC->BDCR & RCC_BDCR_RTCEN))
+	{
+		__HAL_RCC_RTC_CONFIG(RCC_RTCCLKSOURCE_LSI);
+		__HAL_RCC_RTC_ENABLE();
+	}
+
+	EXTI->IMR  |= EXTI_IMR_MR22;
+	EXTI->RTSR |= EXTI_RTSR_TR22;
+
+	HAL_NVIC_SetPriority(RTC_WKUP_IRQn, 0, 0);
+	HAL_NVIC_EnableIRQ(RTC_WKUP_IRQn);
+
+  #endif
+}
+
+/**
+ * @fn void Power_Idle(uint8_t)
+ * @brief dorme fino alla prossima scadenza dei timer dello scheduler o al primo interrupt
+ *
+ * @param stop_allowed  1 se nessuna periferica richiede il clock (modem inattivo, UART e ADC fermi)
+ */
+void Power_Idle(uint8_t stop_allowed)
+{
+	__disable_irq(); // un task segnalato da una ISR da qui in poi risveglia il WFI
+
+	uint32_t ms = TimSys_NextDeadline();
+
+	if (ms == 0)
+	{
+		__enable_irq();
+
+		return;
+	}
+
+	if (ms > POWER_MAX_SLEEP)
+	{
+		ms = POWER_MAX_SLEEP;
+	}
+
+	power.charge += (uint64_t) (HAL_GetTick() - power.mark) * Clock_RunCurrent(); // tempo in run dall'ultimo sonno, con il profilo corrente
+
+	power.wakeups++;
+
+  #if POWER_STOP_MODE
+
+	if (stop_allowed && ms >= POWER_STOP_MIN_TIME)
+	{
+		SleepStop(ms);
+
+		power.mark = HAL_GetTick();
+
+		__enable_irq();
+
+		return;
+	}
+
+  #else
+
+	UNUSED(stop_allowed);
+
+  #endif
+
+	if (ms >= POWER_TICKLESS_MIN)
+	{
+		SleepTickless(ms);
+	}
+	else
+	{
+		uint32_t tpm   = SysTick->LOAD + 1;
+		uint32_t start = SysTick->VAL;
+
+		__WFI(); // il SysTick risveglia entro un tick
+
+		uint32_t end = SysTick->VAL;
+
+		uint32_t counted = (start >= end) ? start - end : start + tpm - end;
+
+		power.sleep_us += (uint64_t) counted * 1000 / tpm;
+		power.charge   += (uint64_t) counted * Clock_SleepCurrent() / tpm;
+
+		TimSys_MicrosAdvance((uint64_t) counted * 1000 / tpm);
+	}
+
+	power.mark = HAL_GetTick();
+
+	__enable_irq();
+}
+
+/**
+ * @fn void Power_Stats(PowerStats_TypeDef*)
+ * @brief statistiche di consumo: duty cycle e corrente media stimata dai tempi in run, Sleep e Stop, pesati con
+ *        le correnti del profilo di clock attivo in ciascun intervallo
+ *
+ * @param stats
+ */
+void Power_Stats(PowerStats_TypeDef *stats)
+{
+	stats->total   = HAL_GetTick() - power.start;
+	stats->sleep   = power.sleep_us / 1000;
+	stats->stop    = power.stop_us / 1000;
+	stats->wakeups = power.wakeups;
+
+	if (stats->total == 0)
+	{
+		stats->duty    = 100;
+		stats->current = Clock_RunCurrent() / 1000.0f;
+
+		return;
+	}
+
+	uint32_t idle = stats->sleep + stats->stop;
+	uint32_t run  = (idle < stats->total) ? stats->total - idle : 0;
+
+	stats->duty    = 100.0f * run / stats->total;
+	uint64_t charge = power.charge + (uint64_t) (HAL_GetTick() - power.mark) * Clock_RunCurrent(); // run in corso
+
+	stats->current = (float) charge / stats->total / 1000.0f;
+}
+
+/**
+ * @fn void Power_RtcWakeupIRQHandler(void)
+ * @brief interrupt del wakeup timer dell'RTC: pulisce i flag, il tempo è contato da SleepStop
+ */
+void Power_RtcWakeupIRQHandler(void)
+{
+	RTC->WPR = 0xCA;
+	RTC->WPR = 0x53;
+
+	RTC->ISR &= ~RTC_ISR_WUTF;
+
+	RTC->WPR = 0xFF;
+
+	EXTI->PR = EXTI_PR_PR22;
+}
@@ -0,0 +1,237 @@
+/**
+ * @file restart.c - https://github.com/SC-Develop/tesysma
+ *
+ * @author Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/SC-Develop/
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ *
+ * Riavvio a caldo.
+ *
+ * Lo stato essenziale del modem (configurazione completata, rubrica, IMEI, operatore) e dell'allarme (stato,
+ * notifica in corso, ultima lettura) è salvato ogni RESTART_SAVE_PERIOD in un record della RAM no-init, e subito
+ * prima di ogni reset software (Restart_SystemReset). Dopo un reset dell'IWDG o un reset software con un record
+ * valido (magic e checksum) l'avvio è a caldo: l'attesa di stabilizzazione dell'alimentazione e la
+ * reinizializzazione del modem sono saltate e il modem, ancora acceso e configurato, è verificato con un solo
+ * comando AT. Il modem non è considerato affidabile, ed è reinizializzato, se il reset è dovuto al modem stesso
+ * (PANIC_TIMEOUT o task gsm in ritardo per il supervisore).
+ *
+ * Accensione, brown-out e reset esterno (pulsante) sono sempre avvii a freddo, come RESTART_MAX_WARM riavvii a
+ * caldo consecutivi entro RESTART_STABLE_TIME: un reset ripetuto non è riprodotto all'infinito dallo stato salvato.
+ * Anche il reset dopo un'eccezione o Error_Handler (fault.c) è a freddo, perché lo stato salvato potrebbe essere la
+ * causa del guasto: la cattura del guasto scarta il record prima del reset e Restart_Init verifica comunque la causa
+ * classificata da Fault_Init.
+ */
+
+#include "stddef.h"
+#include "timsys.h"
+#include "supervisor.h"
+#include "fault.h"
+#include "restart.h"
+
+/**
+ * @struct
+ * @brief record conservato nella RAM no-init attraverso il reset
+ *
+ */
+typedef struct {
+	uint32_t               magic;
+	uint8_t                cause;		// Restart_Cause_TypeDef del reset richiesto, RESTART_SOFTWARE se nessuno
+	uint8_t                warm;		// riavvii a caldo consecutivi
+	GSMWarmState_TypeDef   gsm;
+	AlarmWarmState_TypeDef alarm;
+	uint32_t               checksum;
+} RestartRecord_TypeDef;
+
+// Variables ------------------------------------------------------------------------------------------------------------------------------
+
+static const char *names[RESTART_CAUSES] = {
+	[RESTART_COLD]     = "avvio a freddo",
+	[RESTART_WATCHDOG] = "watchdog",
+	[RESTART_PANIC]    = "modem occupato",
+	[RESTART_REMOTE]   = "DTMF #0#",
+	[RESTART_SOFTWARE] = "software",
+};
+
+static RestartRecord_TypeDef record NOINIT;
+
+static RestartRecord_TypeDef resume;	// stato letto all'avvio
+
+static struct {
+	Restart_Cause_TypeDef cause;
+	uint8_t               warm;			// avvio a caldo
+	uint8_t               modem;		// modem acceso e configurato: non va reinizializzato
+	uint8_t               count;		// riavvii a caldo consecutivi, compreso l'attuale
+} restart;
+
+static TimSys_Task_TypeDef restart_task;
+
+// - Local functions ----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @fn uint32_t Checksum(const RestartRecord_TypeDef*)
+ * @brief checksum del record, escluso il campo checksum
+ */
+static uint32_t Checksum(const RestartRecord_TypeDef *rec)
+{
+	const uint8_t *data = (const uint8_t *) rec;
+
+	uint32_t sum = 5381;
+
+	for (uint32_t n = 0; n < offsetof(RestartRecord_TypeDef, checksum); n++)
+	{
+		sum = (sum << 5) + sum + data[n];
+	}
+
+	return sum;
+}
+
+/**
+ * @fn void Commit(Restart_Cause_TypeDef)
+ * @brief salva lo stato corrente dei moduli nel record della RAM no-init
+ *
+ * @param cause causa del reset che potrebbe seguire
+ */
+static void Commit(Restart_Cause_TypeDef cause)
+{
+	record.magic = 0; // un reset durante l'aggiornamento lascia il record non valido
+
+	record.cause = cause;
+	record.warm  = restart.count;
+
+	SIM800L_SaveState(&record.gsm);
+	SM_Alarm_SaveState(&record.alarm);
+
+	record.checksum = Checksum(&record);
+	record.magic    = RESTART_MAGIC;
+}
+
+/**
+ * @fn void Restart_Task(void)
+ * @brief aggiorna periodicamente lo stato salvato
+ */
+static void Restart_Task(void)
+{
+	if (restart.count && HAL_GetTick() >= RESTART_STABLE_TIME) // il sistema è stabile
+	{
+		restart.count = 0;
+	}
+
+	Commit(RESTART_SOFTWARE);
+}
+
+// - Exported functions -------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @fn void Restart_Init(void)
+ * @brief legge lo stato salvato e stabilisce se l'avvio è a caldo. Da chiamare dopo Supervisor_Init, prima di
+ *        azzerare i flag di reset (RCC_CSR) e prima dell'inizializzazione di modem e allarme.
+ */
+void Restart_Init(void)
+{
+	uint8_t power = __HAL_RCC_GET_FLAG(RCC_FLAG_PORRST) || __HAL_RCC_GET_FLAG(RCC_FLAG_BORRST);
+	uint8_t iwdg  = __HAL_RCC_GET_FLAG(RCC_FLAG_IWDGRST);
+	uint8_t soft  = __HAL_RCC_GET_FLAG(RCC_FLAG_SFTRST);
+
+	uint8_t valid = (record.magic == RESTART_MAGIC) && (record.checksum == Checksum(&record)) && (record.cause < RESTART_CAUSES);
+
+	FaultReset_TypeDef fault = Fault_LastReset(); // Fault_Init è chiamata prima
+
+	if (fault == FAULT_RESET_HARDFAULT || fault == FAULT_RESET_ERROR)
+	{
+		valid = 0; // il reset segue un guasto: avvio a freddo
+	}
+
+	restart.cause = RESTART_COLD;
+	restart.warm  = 0;
+	restart.modem = 0;
+	restart.count = 0;
+
+	if (!power && (iwdg || soft) && valid && record.warm < RESTART_MAX_WARM)
+	{
+		resume = record;
+
+		restart.cause = iwdg ? RESTART_WATCHDOG : (Restart_Cause_TypeDef) resume.cause;
+		restart.warm  = 1;
+		restart.count = resume.warm + 1;
+
+		restart.modem = resume.gsm.configured && (restart.cause != RESTART_PANIC);
+
+		if (restart.cause == RESTART_WATCHDOG && Supervisor_LastReset()->id == SV_GSM)
+		{
+			restart.modem = 0; // il modem non rispondeva
+		}
+	}
+
+	record.magic = 0;
+
+	TimSys_TaskRegister(&restart_task, "restart", Restart_Task);
+	TimSys_TaskStart(&restart_task, RESTART_SAVE_PERIOD, RESTART_SAVE_PERIOD);
+}
+
+/**
+ * @fn uint8_t Restart_Warm(void)
+ * @brief 1 se l'avvio è a caldo
+ */
+uint8_t Restart_Warm(void)
+{
+	return restart.warm;
+}
+
+/**
+ * @fn void Restart_SystemReset(Restart_Cause_TypeDef)
+ * @brief salva lo stato con la causa e riavvia la MCU: al prossimo avvio il riavvio è a caldo
+ *
+ * @param cause
+ */
+void Restart_SystemReset(Restart_Cause_TypeDef cause)
+{
+	Commit(cause);
+
+	HAL_NVIC_SystemReset();
+}
+
+/**
+ * @fn void Restart_Discard(void)
+ * @brief scarta lo stato salvato, il prossimo avvio è a freddo. Chiamata dalla cattura dei guasti (fault.c) prima
+ *        del reset, anche nel contesto dell'HardFault: una sola scrittura nella RAM no-init.
+ */
+void Restart_Discard(void)
+{
+	record.magic = 0;
+}
+
+/**
+ * @fn Restart_Cause_TypeDef Restart_Cause(void)
+ * @brief causa dell'ultimo riavvio, RESTART_COLD se l'avvio è a freddo
+ */
+Restart_Cause_TypeDef Restart_Cause(void)
+{
+	return restart.cause;
+}
+
+/**
+ * @fn const char Restart_CauseName*(Restart_Cause_TypeDef)
+ * @brief descrizione della causa, per la console
+ */
+const char *Restart_CauseName(Restart_Cause_TypeDef cause)
+{
+	return (cause < RESTART_CAUSES) ? names[cause] : "?";
+}
+
+/**
+ * @fn const GSMWarmState_TypeDef Restart_Modem*(void)
+ * @brief stato salvato del modem, NULL se il modem va reinizializzato
+ */
+const GSMWarmState_TypeDef *Restart_Modem(void)
+{
+	return restart.modem ? &resume.gsm : NULL;
+}
+
+/**
+ * @fn const AlarmWarmState_TypeDef Restart_Alarm*(void)
+ * @brief stato salvato dell'allarme, NULL se l'avvio è a freddo
+ */
+const AlarmWarmState_TypeDef *Restart_Alarm(void)
+{
+	return restart.warm ? &resume.alarm : NULL;
+}
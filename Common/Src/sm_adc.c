@@ -9,12 +9,14 @@
 #include "main.h"
 #include "adc.h"
 #include "sm_adc.h"
+#include "supervisor.h"
+#include "telemetry.h"
 
 /**
  * Defines *************************************************************************************************** /
  */
 
-#define INTER_CHANNEL_DELAY     1   // time (ms) between subsequent channel acquisitions
+#define INTER_SCAN_DELAY        1   // time (ms) between subsequent scan sequences
 #define CIRCULAR_BUFFER_SIZE    (uint8_t) (1 << CIRCULAR_BUFFER_DIVISOR)
 #define ADC_WAIT_TIMEOUT        1000
 
@@ -35,7 +37,8 @@ typedef enum
 	ADC_SM_START_CONVERSION, /**< ADC_SM_START_CONVERSION */
 	ADC_SM_WAITING_FOR_COMPLETE,
 	ADC_SM_CONVERSION_COMPLETED,/**< ADC_SM_CONVERSION_COMPLETED */
-	ADC_SM_CHANNEL_DELAY, /**< ADC_SM_CHANNEL_DELAY */
+	ADC_SM_SCAN_DELAY, /**< ADC_SM_SCAN_DELAY */
+	ADC_SM_WATCH,      /**< ADC_SM_WATCH: continuous conversion of a single channel, guarded by the analog watchdog */
 } ADCSmStatus_TypeDef;
 
 /**
@@ -50,6 +53,7 @@ typedef struct
 	uint32_t SamplingTime;
 	uint32_t Buffer[CIRCULAR_BUFFER_SIZE];
 	uint8_t  BufferIndex;
+	uint8_t  Compensated;	// apply the ratiometric correction against the measured VDDA
 	ADC_ChannelStatus_TypeDef ChannelStatus;
 } ADC_Channel_TypeDef;
 
@@ -64,8 +68,12 @@ typedef struct
 	uint16_t              adc_full_scale;
 	ADC_HandleTypeDef     *hadc;
 	uint8_t               AvgSample;
-	ADC_ChannelId_TypeDef CurrentChannel;
+	__IO uint8_t          ScanIndex;					// rank of the next conversion of the scan sequence
+	__IO uint16_t         Scan[CHANNEL_COUNT];		// values of the last scan sequence, written by the conversion callback
+	__IO uint8_t          WatchTriggered;			// set by the analog watchdog interrupt
 	ADCSmStatus_TypeDef   Status;
+	TimSys_Task_TypeDef   Task;						// scheduler task running the state machine
+	TimSys_Task_TypeDef  *NotifyTask;				// task signaled at end of burst and on analog watchdog event
 } ADC_StateMachine;
 
 /**
@@ -79,22 +87,34 @@ static void smExec(void);
 static ADC_ChannelStatus_TypeDef smChannelStatus(ADC_ChannelId_TypeDef channel);
 static uint16_t smChannelValue(ADC_ChannelId_TypeDef channel);
 static uint16_t smChannelVin(ADC_ChannelId_TypeDef channel, float *Vin);
+static uint16_t smChannelCompensated(ADC_ChannelId_TypeDef channel);
+static float    smVdda(void);
 static uint8_t  smIsStopped(void);
+static uint8_t  smIsWatching(void);
+static uint8_t  smWatch(ADC_ChannelId_TypeDef channel, uint16_t low, uint16_t high);
+static uint8_t  smWatchTriggered(void);
+static void     smNotify(TimSys_Task_TypeDef *task);
 
 /**
  * Local Variables ********************************************************************************************* /
  */
 
 /*
- * ADC Channel Map
+ * ADC Channel Map: all channels are converted in a single scan sequence, in rank order.
+ *
+ * NTC dividers have a source impedance of some tens of kOhm, so they need a long sampling time;
+ * temperature sensor and VREFINT require a sampling time of at least 10 usec (480 cycles @ 6.25 MHz = 77 usec)
  */
 static ADC_Channel_TypeDef Channels[CHANNEL_COUNT] = {
 
-	[CHN_NTC_TEMP] = {.Channel = ADC_CHANNEL_1, .Rank = 1, .SamplingTime = ADC_SAMPLETIME_15CYCLES, .ChannelStatus = ADC_CHANNEL_BUSY, .BufferIndex = 0, .Buffer = {0}},
+	[CHN_NTC_TEMP]   = {.Channel = ADC_CHANNEL_1         , .Rank = 1, .SamplingTime = ADC_SAMPLETIME_144CYCLES, .Compensated = 1, .ChannelStatus = ADC_CHANNEL_BUSY, .BufferIndex = 0, .Buffer = {0}},
+	[CHN_NTC2_TEMP]  = {.Channel = ADC_CHANNEL_0         , .Rank = 2, .SamplingTime = ADC_SAMPLETIME_144CYCLES, .Compensated = 1, .ChannelStatus = ADC_CHANNEL_BUSY, .BufferIndex = 0, .Buffer = {0}},
+	[CHN_TEMPSENSOR] = {.Channel = ADC_CHANNEL_TEMPSENSOR, .Rank = 3, .SamplingTime = ADC_SAMPLETIME_480CYCLES, .Compensated = 0, .ChannelStatus = ADC_CHANNEL_BUSY, .BufferIndex = 0, .Buffer = {0}},
+	[CHN_VREFINT]    = {.Channel = ADC_CHANNEL_VREFINT   , .Rank = 4, .SamplingTime = ADC_SAMPLETIME_480CYCLES, .Compensated = 0, .ChannelStatus = ADC_CHANNEL_BUSY, .BufferIndex = 0, .Buffer = {0}},
 
 };
 
-static ADC_StateMachine StateMachine = {.CurrentChannel = 0, .Status = ADC_SM_IDLE};
+static ADC_StateMachine StateMachine = {.ScanIndex = 0, .Status = ADC_SM_IDLE};
 
 /*
  * ADC Interface
@@ -106,8 +126,14 @@ ADCSmInterface_TypeDef Interface = {
 	.ChannelStatus = smChannelStatus,
 	.ChannelValue  = smChannelValue,
 	.ChannelVin    = smChannelVin,
+	.ChannelCompensated = smChannelCompensated,
+	.Vdda          = smVdda,
 	.isStopped     = smIsStopped,
+	.isWatching    = smIsWatching,
 	.Init          = smInit,
+	.Watch         = smWatch,
+	.WatchTriggered = smWatchTriggered,
+	.Notify        = smNotify,
 };
 
 /**
@@ -115,13 +141,121 @@ ADCSmInterface_TypeDef Interface = {
  */
 static uint8_t smIsStopped(void)
 {
-	return (StateMachine.Status == ADC_SM_IDLE);
+	return (StateMachine.Status == ADC_SM_IDLE || StateMachine.Status == ADC_SM_STOP || StateMachine.Status == ADC_SM_WATCH);
+}
+
+/**
+ * @fn uint8_t smIsWatching(void)
+ * @brief the analog watchdog is guarding a channel: the ADC clock must stay on
+ */
+static uint8_t smIsWatching(void)
+{
+	return (StateMachine.Status == ADC_SM_WATCH);
+}
+
+/**
+ * @name SelectADCChannel
+ * @brief Configure a given ADC channel at its rank of the scan sequence
+ */
+static void SelectADCChannel(ADC_HandleTypeDef *hadc, ADC_Channel_TypeDef *channel)
+{
+	ADC_ChannelConfTypeDef sConfig = {0};
+
+	sConfig.Channel      = channel->Channel;
+	sConfig.SamplingTime = channel->SamplingTime;
+	sConfig.Rank         = channel->Rank;
+
+	if (HAL_ADC_ConfigChannel(hadc, &sConfig) != HAL_OK)
+	{
+	  	channel->ChannelStatus = ADC_CHANNEL_ERROR;
+	}
+	else
+	{
+		channel->ChannelStatus = ADC_CHANNEL_BUSY;
+	}
+}
+
+/**
+ * @fn void ConfigureScan(ADC_HandleTypeDef*)
+ * @brief configure the ADC for the scan of all channels listed in the channel map, with an interrupt at end
+ *        of each conversion (EOC), so that every rank value can be read by the conversion complete callback.
+ *        The analog watchdog is disabled.
+ *
+ * @param hadc
+ */
+static void ConfigureScan(ADC_HandleTypeDef *hadc)
+{
+	ADC_AnalogWDGConfTypeDef awd = {.WatchdogMode = ADC_ANALOGWATCHDOG_NONE, .ITMode = DISABLE};
+
+	hadc->Init.ScanConvMode       = ENABLE;
+	hadc->Init.ContinuousConvMode = DISABLE;
+	hadc->Init.NbrOfConversion    = CHANNEL_COUNT;
+	hadc->Init.EOCSelection       = ADC_EOC_SINGLE_CONV;
+
+	if (HAL_ADC_Init(hadc) != HAL_OK)
+	{
+		Error_Handler();
+	}
+
+	HAL_ADC_AnalogWDGConfig(hadc, &awd);
+
+	for (uint8_t i = 0; i < CHANNEL_COUNT; i++)
+	{
+		SelectADCChannel(hadc, Channels + i); // la configurazione di TEMPSENSOR e VREFINT abilita anche il bit TSVREFE
+	}
+}
+
+/**
+ * @fn uint8_t ConfigureWatch(ADC_HandleTypeDef*, ADC_Channel_TypeDef*, uint16_t, uint16_t)
+ * @brief configure the ADC for the continuous conversion of a single channel, with the analog watchdog guarding
+ *        the [low, high] window: no end of conversion interrupt is generated, only the watchdog interrupt.
+ *
+ * @param hadc
+ * @param channel  watched channel
+ * @param low      low threshold (raw ADC value)
+ * @param high     high threshold (raw ADC value)
+ * @return 1 on success
+ */
+static uint8_t ConfigureWatch(ADC_HandleTypeDef *hadc, ADC_Channel_TypeDef *channel, uint16_t low, uint16_t high)
+{
+	ADC_ChannelConfTypeDef   sConfig = {.Channel = channel->Channel, .Rank = 1, .SamplingTime = channel->SamplingTime};
+	ADC_AnalogWDGConfTypeDef awd     = {
+		.WatchdogMode  = ADC_ANALOGWATCHDOG_SINGLE_REG,
+		.HighThreshold = high,
+		.LowThreshold  = low,
+		.Channel       = channel->Channel,
+		.ITMode        = ENABLE,
+	};
+
+	hadc->Init.ScanConvMode       = DISABLE;
+	hadc->Init.ContinuousConvMode = ENABLE;
+	hadc->Init.NbrOfConversion    = 1;
+	hadc->Init.EOCSelection       = ADC_EOC_SEQ_CONV; // senza DMA e con EOC a fine sequenza non viene segnalato l'overrun
+
+	if (HAL_ADC_Init(hadc) != HAL_OK)
+	{
+		return 0;
+	}
+
+	if (HAL_ADC_ConfigChannel(hadc, &sConfig) != HAL_OK)
+	{
+		return 0;
+	}
+
+	if (HAL_ADC_AnalogWDGConfig(hadc, &awd) != HAL_OK)
+	{
+		return 0;
+	}
+
+	return (HAL_ADC_Start(hadc) == HAL_OK); // start senza interrupt di fine conversione: solo AWD
 }
 
 /**
  * @fn void smInit(void)
- * @brief
+ * @brief initialize the state machine and configure the ADC for the scan of all channels
  *
+ * @param hadc ADC handle (already initialized by MX_ADC1_Init)
+ * @param Vdd  sensors supply voltage: the reference of the ratiometric correction
  */
 static void smInit(ADC_HandleTypeDef *hadc, float Vdd)
 {
@@ -129,6 +263,80 @@ static void smInit(ADC_HandleTypeDef *hadc, float Vdd)
 	StateMachine.Vdd            = Vdd;
 	StateMachine.adc_full_scale = ADC_GetFullScale(StateMachine.hadc);
 	StateMachine.Status         = ADC_SM_IDLE;
+
+	ConfigureScan(hadc);
+
+	TimSys_TaskRegister(&StateMachine.Task, "adc", smExec);
+
+	Supervisor_Watch(SV_ADC, SUPERVISOR_ADC_DEADLINE, NULL);
+}
+
+/**
+ * @fn void smNotify(TimSys_Task_TypeDef*)
+ * @brief set the task to be signaled when a sampling burst is completed and when the analog watchdog fires
+ *
+ * @param task
+ */
+static void smNotify(TimSys_Task_TypeDef *task)
+{
+	StateMachine.NotifyTask = task;
+}
+
+/**
+ * @fn uint8_t smWatch(ADC_ChannelId_TypeDef, uint16_t, uint16_t)
+ * @brief put the ADC in watch mode between sampling bursts: the given channel is converted continuously by the
+ *        hardware and the analog watchdog interrupt fires as soon as its value leaves the [low, high] window
+ *        (raw ADC values). The watch mode is left by the next Start.
+ *        The ADC must be stopped (isStopped).
+ *
+ * @param channel
+ * @param low
+ * @param high
+ * @return 1 if watch mode started
+ */
+static uint8_t smWatch(ADC_ChannelId_TypeDef channel, uint16_t low, uint16_t high)
+{
+	if (!smIsStopped() || (uint32_t)channel >= CHANNEL_COUNT)
+	{
+		return 0;
+	}
+
+	HAL_ADC_Stop_IT(StateMachine.hadc);
+
+	StateMachine.WatchTriggered = 0;
+
+	if (!ConfigureWatch(StateMachine.hadc, Channels + channel, low, high))
+	{
+		HAL_ADC_Stop(StateMachine.hadc);
+
+		ConfigureScan(StateMachine.hadc);
+
+		StateMachine.Status = ADC_SM_IDLE;
+
+		return 0;
+	}
+
+	StateMachine.Status = ADC_SM_WATCH;
+
+	return 1;
+}
+
+/**
+ * @fn uint8_t smWatchTriggered(void)
+ * @brief return (and clear) the analog watchdog event flag
+ *
+ * @return 1 if the watched channel left the window since last call
+ */
+static uint8_t smWatchTriggered(void)
+{
+	if (StateMachine.WatchTriggered)
+	{
+		StateMachine.WatchTriggered = 0;
+
+		return 1;
+	}
+
+	return 0;
 }
 
 /**
@@ -139,7 +347,11 @@ static void smInit(ADC_HandleTypeDef *hadc, float Vdd)
  */
 static void smStart(void)
 {
+	Supervisor_Begin(SV_ADC); // il campionamento deve completarsi entro la scadenza, anche dopo ripetuti timeout
+
 	StateMachine.Status = ADC_SM_START;
+
+	TimSys_TaskSignal(&StateMachine.Task);
 }
 
 /**
@@ -149,6 +361,8 @@ static void smStart(void)
 static void smStop(void)
 {
 	StateMachine.Status = ADC_SM_STOP;
+
+	TimSys_TaskSignal(&StateMachine.Task);
 }
 
 /**
@@ -170,41 +384,17 @@ static void AddValueToChannel(ADC_Channel_TypeDef *channel, uint32_t value)
 	}
 }
 
-/**
- * @name SelectADCChannel
- * @brief Select or de-select a given ADC channel for next conversion
- *
- * if flag == SET, the selected ADC channel is selected for conversion, actual conversion
- * will happen on HAL_ADC_Start_IT.
- */
-static void SelectADCChannel(ADC_HandleTypeDef *hadc, ADC_Channel_TypeDef *channel)
-{
-	ADC_ChannelConfTypeDef sConfig = {0};
-
-	sConfig.Channel      = channel->Channel;
-	sConfig.SamplingTime = channel->SamplingTime;
-	sConfig.Rank         = channel->Rank;
-
-	if (HAL_ADC_ConfigChannel(hadc, &sConfig) != HAL_OK)
-	{
-	  	channel->ChannelStatus = ADC_CHANNEL_ERROR;
-	}
-	else
-	{
-		channel->ChannelStatus = ADC_CHANNEL_BUSY;
-	}
-}
-
 /**
  * @name RunHandler
  * @brief State machine run handler
  *
  * Actual ADC channel conversion happens here, provided that this handler gets called repeatedly.
- * Nothing happens until StateMachine.EnableChannelScan == SET (start handler invoked). When channel scan is
- * enabled, every channel listed in Channels array is prepared for conversion, according to the
- * specified parameters. ADC conversion is run in interrupt mode, so that the "conversion completed
- * callback" is called at end of conversion, and the analog value is stored in the selected channel
- * buffer. Then, conversion starts on the next analog line, after a period of INTER_CHANNEL_DELAY.
+ * Nothing happens until the start handler is invoked. Every channel listed in Channels array is configured
+ * at its rank of the regular scan sequence (see smInit), so that a single software start converts all
+ * channels one after the other, without extra conversion time per channel. ADC conversion is run in
+ * interrupt mode, so that the "conversion completed callback" is called at end of each conversion, and
+ * the analog value of the rank is stored in the scan array. At end of the sequence the scan values are
+ * moved into the channel buffers, then the next sequence starts after a period of INTER_SCAN_DELAY.
  * The analog interface handler does not deliver a value until the channel buffer (managed as a
  * ring buffer) is completely filled with analog data; when it gets filled, the analog value is the
  * mean value of the channel buffer, so that noise on analog lines is filtered away.
@@ -213,8 +403,6 @@ static void smExec(void)
 {
 	static uint32_t Timeout;
 
-	ADC_Channel_TypeDef *channel = Channels + StateMachine.CurrentChannel;
-
 	switch (StateMachine.Status)
 	{
 		case ADC_SM_IDLE:
@@ -229,11 +417,26 @@ static void smExec(void)
 
 		break;
 
+		case ADC_SM_WATCH:
+			// conversione continua in hardware: nulla da fare, l'uscita dalla finestra è segnalata dall'interrupt AWD
+		break;
+
 		case ADC_SM_START:
 
+			HAL_ADC_Stop_IT(StateMachine.hadc); // assicura che l'ADC sia fermo anche se non è passato dallo stato ADC_SM_STOP
+
+			if (StateMachine.hadc->Init.ContinuousConvMode == ENABLE) // lascia la modalità watch: ripristina la scansione
+			{
+				ConfigureScan(StateMachine.hadc);
+			}
+
 			for (uint8_t i = 0; i < CHANNEL_COUNT; i++)
 			{
-				Channels[i].ChannelStatus = ADC_CHANNEL_BUSY;
+				if (Channels[i].ChannelStatus != ADC_CHANNEL_ERROR)
+				{
+					Channels[i].ChannelStatus = ADC_CHANNEL_BUSY;
+				}
+
 				Channels[i].BufferIndex   = 0;
 
 				for (int j = 0; j < CIRCULAR_BUFFER_SIZE; j++)
@@ -242,8 +445,7 @@ static void smExec(void)
 				}
 			}
 
-			StateMachine.CurrentChannel = 0;
-			StateMachine.AvgSample     = 0;
+			StateMachine.AvgSample = 0;
 
 			StateMachine.Status = ADC_SM_START_CONVERSION;
 
@@ -251,13 +453,16 @@ static void smExec(void)
 
 		case ADC_SM_START_CONVERSION:
 
-			SelectADCChannel(StateMachine.hadc, channel);
+			StateMachine.ScanIndex = 0;
 
-			HAL_ADC_Start_IT(StateMachine.hadc);
+			StateMachine.Status = ADC_SM_WAITING_FOR_COMPLETE; // deve precedere lo start: la callback cambia lo stato
 
 			Timeout = HAL_GetTick() + ADC_WAIT_TIMEOUT;
 
-			StateMachine.Status = ADC_SM_WAITING_FOR_COMPLETE;
+			if (HAL_ADC_Start_IT(StateMachine.hadc) != HAL_OK)
+			{
+				smStop();
+			}
 
 		break;
 
@@ -271,32 +476,38 @@ static void smExec(void)
 		break;
 
 		case ADC_SM_CONVERSION_COMPLETED:
-		{
-			// SelectADCChannel(StateMachine.hadc, channel); // de-select channel rank
-
-			uint32_t value = HAL_ADC_GetValue(StateMachine.hadc); // read channel value
 
-			AddValueToChannel(channel, value);
+			for (uint8_t i = 0; i < CHANNEL_COUNT; i++)
+			{
+				AddValueToChannel(Channels + i, StateMachine.Scan[Channels[i].Rank - 1]);
+			}
 
-			if (++StateMachine.CurrentChannel == CHANNEL_COUNT)
+			if (++StateMachine.AvgSample == CIRCULAR_BUFFER_SIZE)
 			{
-				StateMachine.CurrentChannel = 0;
+				StateMachine.Status = ADC_SM_IDLE; // conversione e media di tutti i canali completata
+
+				Supervisor_Idle(SV_ADC);
+
+				for (uint8_t i = 0; i < CHANNEL_COUNT; i++) // burst completo: il buffer circolare è in ordine di conversione
+				{
+					Telemetry_Adc(i, Channels[i].Buffer, CIRCULAR_BUFFER_SIZE);
+				}
 
-				if (++StateMachine.AvgSample == 16)
+				if (StateMachine.NotifyTask)
 				{
-					StateMachine.Status = ADC_SM_IDLE; // conversione e media di tutti i canali completata
+					TimSys_TaskSignal(StateMachine.NotifyTask);
 				}
 			}
 			else
 			{
-				Timeout = HAL_GetTick() + INTER_CHANNEL_DELAY;
+				Timeout = HAL_GetTick() + INTER_SCAN_DELAY;
 
-				StateMachine.Status = ADC_SM_CHANNEL_DELAY;
+				StateMachine.Status = ADC_SM_SCAN_DELAY;
 			}
-		}
+
 		break;
 
-		case ADC_SM_CHANNEL_DELAY:
+		case ADC_SM_SCAN_DELAY:
 
 			if (HAL_GetTick() >= Timeout)
 			{
@@ -305,6 +516,27 @@ static void smExec(void)
 
 		break;
 	}
+
+	switch (StateMachine.Status) // prossima esecuzione del task
+	{
+		case ADC_SM_STOP:
+		case ADC_SM_START:
+		case ADC_SM_START_CONVERSION:
+		case ADC_SM_CONVERSION_COMPLETED:
+			TimSys_TaskSignal(&StateMachine.Task);
+		break;
+
+		case ADC_SM_WAITING_FOR_COMPLETE: // la callback di fine conversione segnala il task, il timer gestisce il timeout
+			TimSys_TaskStart(&StateMachine.Task, ADC_WAIT_TIMEOUT, 0);
+		break;
+
+		case ADC_SM_SCAN_DELAY:
+			TimSys_TaskStart(&StateMachine.Task, INTER_SCAN_DELAY, 0);
+		break;
+
+		default:
+		break;
+	}
 }
 
 /**
@@ -368,12 +600,52 @@ static uint16_t smChannelVin(ADC_ChannelId_TypeDef channel, float *Vin)
 
 	if (value != 0xFFFF)
 	{
-		*Vin = ADC_GET_VOLTAGE(value, StateMachine.adc_full_scale, StateMachine.Vdd);
+		*Vin = ADC_GET_VOLTAGE(value, StateMachine.adc_full_scale, smVdda());
 	}
 
 	return value;
 }
 
+/**
+ * @fn float smVdda(void)
+ * @brief return the VDDA computed from the VREFINT channel and the factory calibration value.
+ *        If the VREFINT channel is not ready, the nominal Vdd is returned.
+ *
+ * @return VDDA [V]
+ */
+static float smVdda(void)
+{
+	uint16_t vrefint = smChannelValue(CHN_VREFINT);
+
+	if (vrefint == 0xFFFF || vrefint == 0)
+	{
+		return StateMachine.Vdd;
+	}
+
+	return ADC_CalcCalibratedVDDA(vrefint);
+}
+
+/**
+ * @fn uint16_t smChannelCompensated(ADC_ChannelId_TypeDef)
+ * @brief return the channel value ratiometrically corrected against the measured VDDA, i.e. the value the ADC
+ *        would read if its reference were the sensors supply voltage (Vdd). Channels not flagged for
+ *        compensation return the plain mean value.
+ *
+ * @param channel
+ * @return the corrected value, or 0xFFFF if channel not ready
+ */
+static uint16_t smChannelCompensated(ADC_ChannelId_TypeDef channel)
+{
+	uint16_t value = smChannelValue(channel);
+
+	if (value == 0xFFFF || !Channels[channel].Compensated)
+	{
+		return value;
+	}
+
+	return ADC_Compensate(value, smVdda(), StateMachine.Vdd, StateMachine.adc_full_scale);
+}
+
 /**
  * Exported functions ******************************************************************************************** /
  */
@@ -391,13 +663,42 @@ ADCSmInterface_TypeDef * ADCInterface(void)
 
 /**
  * @name HAL_ADC_ConvCpltCallback
- * @brief ADC channel conversion complete callback
+ * @brief ADC channel conversion complete callback: called at end of each rank conversion of the scan sequence.
  *
+ * The data register must be read here, before the conversion of the next rank overwrites it.
  * This function must be visible from outside, it's an overload of a weak function
  */
 void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef *hadc)
 {
-	UNUSED(hadc);
+	if (StateMachine.ScanIndex < CHANNEL_COUNT)
+	{
+		StateMachine.Scan[StateMachine.ScanIndex++] = (uint16_t) HAL_ADC_GetValue(hadc);
+	}
+
+	if (StateMachine.ScanIndex == CHANNEL_COUNT)
+	{
+		StateMachine.Status = ADC_SM_CONVERSION_COMPLETED;
+
+		TimSys_TaskSignal(&StateMachine.Task);
+	}
+}
+
+/**
+ * @name HAL_ADC_LevelOutOfWindowCallback
+ * @brief ADC analog watchdog callback: the watched channel left the threshold window.
+ *
+ * The watchdog interrupt is disabled, otherwise it would fire at every conversion while the value stays out of
+ * the window: it is enabled again by the next smWatch.
+ * This function must be visible from outside, it's an overload of a weak function
+ */
+void HAL_ADC_LevelOutOfWindowCallback(ADC_HandleTypeDef *hadc)
+{
+	__HAL_ADC_DISABLE_IT(hadc, ADC_IT_AWD);
 
-	StateMachine.Status = ADC_SM_CONVERSION_COMPLETED;
+	StateMachine.WatchTriggered = 1;
+
+	if (StateMachine.NotifyTask)
+	{
+		TimSys_TaskSignal(StateMachine.NotifyTask);
+	}
 }
@@ -9,13 +9,23 @@
 #include "main.h"
 #include "adc.h"
 #include "stdbool.h"
+#include "math.h"
 #include "ntc.h"
 #include "timsys.h"
 #include "sm_alarm.h"
+#include "alarm_rules.h"
+#include "history.h"
+#include "datalog.h"
 #include "sm_adc.h"
 #include "SIM800L.h"
+#include "supervisor.h"
+#include "restart.h"
+#include "telemetry.h"
+#include "stm32_lib_usart.h"
+#include "ac_app.h"
 
 #define PANIC_TIMEOUT 300000 // 5 min.
+#define ALARM_TASK_PERIOD 100 // periodo del task di allarme [msec]
 
 /**
  * @struct
@@ -24,25 +34,67 @@
  */
 typedef struct {
 
-	float    temp_threshold;
-	float    temp;
+	AlarmRulesConfig_TypeDef rules;	// soglie, isteresi e orizzonte di previsione
+	float    temp;				// temperatura di allarme (NTC1)
+	float    ntc_temp[NTC_MAX];	// temperatura di tutte le sonde NTC
+	float    mcu_temp;			// temperatura interna del microcontrollore
+
+	float    prev_temp;			// temperatura del campione precedente, per la velocità di variazione
+	uint32_t prev_tick;			// istante del campione precedente (0 = nessun campione)
+
+	uint32_t sampling_min;		// limiti dell'intervallo di campionamento adattivo [msec]
+	uint32_t sampling_max;
+	uint32_t sampling_interval;	// intervallo fino al prossimo campionamento [msec]
+
+	uint32_t hour_tick;			// inizio della finestra oraria corrente
+	uint32_t hour_samples;		// campioni acquisiti nella finestra oraria corrente
+	uint32_t last_hour_samples;	// campioni acquisiti nell'ultima ora completa
+	uint8_t  hour_completed;
 
 	uint8_t  autoEnable;
+	uint8_t  wake;				// richiesta di campionamento immediato (analog watchdog o nuova soglia)
+
+	TempReading_TypeDef reading;	// ultima lettura pubblicata
+
+	uint32_t notify_tick;		// inizio della notifica in corso (attesa del modem o chiamate)
+	uint8_t  first_call;		// voce della rubrica da cui iniziano le chiamate della notifica
 
 	AlarmStatus_TypeDef  alarm;
 
 	AlarmSMStatus_TypeDef status;
 
+	SamplingSMStatus_TypeDef sampling;
+
+	TimSys_Task_TypeDef task;	// task dello scheduler
+
 } AlarmStateMachine_TypeDef;
 
 // Variables ------------------------------------------------------------------------------------------------------------------------------
 
+static const ADC_ChannelId_TypeDef ntc_channel[NTC_MAX] = {	// canale ADC di ciascuna sonda NTC
+	[NTC1] = CHN_NTC_TEMP,
+	[NTC2] = CHN_NTC2_TEMP,
+};
+
 static AlarmStateMachine_TypeDef alarm_sm = {
 	.alarm 			= ALARM_ON,
 	.autoEnable 	= 1,
 	.temp 			= 0,
-	.temp_threshold = 100,
+	.rules = {
+		.low          = 100,
+		.low_hyst     = TEMPERATURE_DELTA_THRESHOLD,
+		.high         = TEMPERATURE_HIGH_THRESHOLD,
+		.high_hyst    = TEMPERATURE_DELTA_THRESHOLD,
+		.high_enabled = 0,
+		.horizon      = PREDICTION_HORIZON,
+	},
 	.status 		= AS_IDLE,
+	.sampling 		= TS_WAITING,
+	.first_call     = PHONE_1,
+
+	.sampling_min      = SAMPLING_TIME_MIN,
+	.sampling_max      = SAMPLING_TIME_MAX,
+	.sampling_interval = 0, // primo campionamento immediato
 };
 
 // - Exported functions -------------------------------------------------------------------------------------------------------------------
@@ -55,6 +107,11 @@ static AlarmStateMachine_TypeDef alarm_sm = {
  */
 void EnableAlarm(AlarmStatus_TypeDef status)
 {
+	if (alarm_sm.alarm == ALARM_ON && status == ALARM_OFF)
+	{
+		DataLog_Event(DL_ACK, 0); // allarme disabilitato dall'utente
+	}
+
 	alarm_sm.alarm = status;
 }
 
@@ -80,6 +137,46 @@ uint8_t AlarmAutoEnable(void)
 	return alarm_sm.autoEnable;
 }
 
+/**
+ * @fn void SetSamplingBounds(uint32_t, uint32_t)
+ * @brief imposta i limiti dell'intervallo di campionamento adattivo
+ *
+ * @param min  intervallo minimo [msec] (vicino alla soglia)
+ * @param max  intervallo massimo [msec] (lontano dalla soglia)
+ */
+void SetSamplingBounds(uint32_t min, uint32_t max)
+{
+	if (min == 0 || max < min)
+	{
+		return;
+	}
+
+	alarm_sm.sampling_min = min;
+	alarm_sm.sampling_max = max;
+}
+
+/**
+ * @fn uint32_t SamplingInterval(void)
+ * @brief intervallo corrente fino al prossimo campionamento
+ *
+ * @return intervallo [msec]
+ */
+uint32_t SamplingInterval(void)
+{
+	return alarm_sm.sampling_interval;
+}
+
+/**
+ * @fn uint32_t SamplesPerHour(void)
+ * @brief numero di campioni acquisiti nell'ultima ora completa (nella prima ora, i campioni acquisiti finora)
+ *
+ * @return
+ */
+uint32_t SamplesPerHour(void)
+{
+	return alarm_sm.hour_completed ? alarm_sm.last_hour_samples : alarm_sm.hour_samples;
+}
+
 /**
  * @fn AlarmStatus_TypeDef AlarmStatus(void)
  * @brief
@@ -91,6 +188,17 @@ AlarmStatus_TypeDef AlarmStatus(void)
 	return alarm_sm.alarm;
 }
 
+/**
+ * @fn AlarmSMStatus_TypeDef AlarmSMStatus(void)
+ * @brief stato della notifica degli allarmi
+ *
+ * @return
+ */
+AlarmSMStatus_TypeDef AlarmSMStatus(void)
+{
+	return alarm_sm.status;
+}
+
 /**
  * @fn float GetTemp(void)
  * @brief
@@ -102,6 +210,40 @@ float GetTemp(void)
 	return alarm_sm.temp;
 }
 
+/**
+ * @fn TempReading_TypeDef GetReading(void)
+ * @brief ultima lettura pubblicata dall'acquisizione, con il suo istante
+ *
+ * @return
+ */
+TempReading_TypeDef GetReading(void)
+{
+	return alarm_sm.reading;
+}
+
+/**
+ * @fn float GetNtcTemp(enum NTC_ID)
+ * @brief get the last temperature read by the given NTC probe
+ *
+ * @param ntc
+ * @return
+ */
+float GetNtcTemp(enum NTC_ID ntc)
+{
+	return alarm_sm.ntc_temp[ntc];
+}
+
+/**
+ * @fn float GetMcuTemp(void)
+ * @brief get the last MCU internal temperature
+ *
+ * @return
+ */
+float GetMcuTemp(void)
+{
+	return alarm_sm.mcu_temp;
+}
+
 /**
  * @fn void SetTemp(float)
  * @brief
@@ -121,7 +263,8 @@ void SetTemp(float temp)
  */
 void SetTempThreshold(float temp)
 {
-	alarm_sm.temp_threshold = temp;
+	alarm_sm.rules.low      = temp;
+	alarm_sm.wake           = 1; // nuovo campionamento: riprogramma l'analog watchdog con la nuova soglia
 
 	union {
 		float    t;
@@ -164,7 +307,196 @@ void SetTempThreshold(float temp)
  */
 float GetTempThreshold(void)
 {
-	return alarm_sm.temp_threshold;
+	return alarm_sm.rules.low;
+}
+
+/**
+ * @fn void SetHighThreshold(float, uint8_t)
+ * @brief imposta la soglia alta di allarme
+ *
+ * @param temp
+ * @param enabled
+ */
+void SetHighThreshold(float temp, uint8_t enabled)
+{
+	alarm_sm.rules.high         = temp;
+	alarm_sm.rules.high_enabled = enabled;
+	alarm_sm.wake               = 1;
+}
+
+/**
+ * @fn float GetHighThreshold(void)
+ * @brief
+ *
+ * @return
+ */
+float GetHighThreshold(void)
+{
+	return alarm_sm.rules.high;
+}
+
+/**
+ * @fn uint8_t HighThresholdEnabled(void)
+ * @brief
+ *
+ * @return
+ */
+uint8_t HighThresholdEnabled(void)
+{
+	return alarm_sm.rules.high_enabled;
+}
+
+/**
+ * @fn void SetHysteresis(float, float)
+ * @brief imposta l'isteresi di rientro delle soglie bassa e alta
+ *
+ * @param low
+ * @param high
+ */
+void SetHysteresis(float low, float high)
+{
+	alarm_sm.rules.low_hyst  = low;
+	alarm_sm.rules.high_hyst = high;
+}
+
+/**
+ * @fn void SetPredictionHorizon(uint32_t)
+ * @brief imposta l'orizzonte dell'allarme predittivo
+ *
+ * @param seconds tempo di raggiungimento della soglia sotto il quale scatta l'allarme (0 = disabilitato)
+ */
+void SetPredictionHorizon(uint32_t seconds)
+{
+	alarm_sm.rules.horizon = seconds;
+}
+
+/**
+ * @fn uint32_t PredictionHorizon(void)
+ * @brief
+ *
+ * @return [s]
+ */
+uint32_t PredictionHorizon(void)
+{
+	return alarm_sm.rules.horizon;
+}
+
+/**
+ * @fn void CountSample(void)
+ * @brief aggiorna il contatore dei campioni acquisiti nell'ora
+ */
+static void CountSample(void)
+{
+	if (alarm_sm.hour_tick == 0 && alarm_sm.hour_samples == 0 && !alarm_sm.hour_completed)
+	{
+		alarm_sm.hour_tick = HAL_GetTick();
+	}
+
+	if (TimSys_TickTimeElapsed(&alarm_sm.hour_tick, SAMPLING_HOUR))
+	{
+		alarm_sm.last_hour_samples = alarm_sm.hour_samples;
+		alarm_sm.hour_samples      = 0;
+		alarm_sm.hour_completed    = 1;
+	}
+
+	alarm_sm.hour_samples++;
+}
+
+/**
+ * @fn uint32_t NextSamplingInterval(float)
+ * @brief calcola l'intervallo fino al prossimo campionamento in base alla distanza dalla soglia e alla velocità di
+ *        variazione della temperatura: campiona velocemente vicino alla soglia, o quando la temperatura vi si
+ *        avvicina rapidamente, e rallenta quando è lontana.
+ *
+ * @param temp ultima temperatura letta
+ * @return intervallo [msec], compreso tra sampling_min e sampling_max
+ */
+static uint32_t NextSamplingInterval(float temp)
+{
+	uint32_t now      = HAL_GetTick();
+	float    distance = temp - alarm_sm.rules.low;
+
+	if (alarm_sm.rules.high_enabled && fabsf(temp - alarm_sm.rules.high) < fabsf(distance)) // soglia più vicina
+	{
+		distance = temp - alarm_sm.rules.high;
+	}
+
+	float    interval = fabsf(distance) * SAMPLING_GAIN;
+
+	if (alarm_sm.prev_tick != 0)
+	{
+		uint32_t dt = TimSys_TimeElapsed(alarm_sm.prev_tick);
+
+		if (dt > 0)
+		{
+			float rate = (temp - alarm_sm.prev_temp) / dt; // [°C/msec]
+
+			if (distance * rate < 0) // la temperatura si avvicina alla soglia
+			{
+				float ttc = fabsf(distance / rate) / SAMPLING_TTC_DIVISOR; // frazione del tempo stimato di raggiungimento
+
+				if (ttc < interval)
+				{
+					interval = ttc;
+				}
+			}
+		}
+	}
+
+	alarm_sm.prev_temp = temp;
+	alarm_sm.prev_tick = now ? now : 1;
+
+	if (interval < alarm_sm.sampling_min)
+	{
+		return alarm_sm.sampling_min;
+	}
+
+	if (interval > alarm_sm.sampling_max)
+	{
+		return alarm_sm.sampling_max;
+	}
+
+	return (uint32_t) interval;
+}
+
+/**
+ * @fn uint16_t ThresholdCode(float)
+ * @brief converte la soglia di temperatura nel valore ADC tramite il modello NTC e lo riporta al valore grezzo
+ *        (non compensato con la VDDA misurata)
+ *
+ * @param temp
+ * @return il minimo valore ADC grezzo la cui temperatura è minore o uguale a temp
+ */
+static uint16_t ThresholdCode(float temp)
+{
+	uint16_t fs   = ADC_GetFullScale(&hadc1);
+	uint32_t code = NTC_AdcValue(NTC1, temp);							// valore compensato alla soglia
+
+	return ADC_Compensate(code, ADC_VDD, ADCInterface()->Vdda(), fs);	// valore grezzo letto dall'ADC
+}
+
+/**
+ * @fn void WatchThreshold(void)
+ * @brief programma l'analog watchdog dell'ADC sulla sonda di allarme, così l'interrupt AWD segnala il superamento
+ *        delle soglie tra un campionamento e l'altro. Il valore ADC cresce al diminuire della temperatura: la soglia
+ *        bassa di temperatura è la soglia alta dell'AWD e viceversa.
+ */
+static void WatchThreshold(void)
+{
+	uint16_t high = ThresholdCode(alarm_sm.rules.low);
+	uint16_t low  = 0;
+
+	if (high > 0)
+	{
+		high -= 1; // l'AWD interviene per valori strettamente maggiori della soglia alta
+	}
+
+	if (alarm_sm.rules.high_enabled)
+	{
+		low = ThresholdCode(alarm_sm.rules.high); // l'AWD interviene per valori strettamente minori della soglia bassa
+	}
+
+	ADCInterface()->Watch(ntc_channel[NTC1], low, high);
 }
 
 /**
@@ -179,17 +511,30 @@ float TemperatureSampling_Exec(void)
 	{
 		ADCInterface()->Start(); // fa partire l'ADC
 	}
-	else // ADC Started
+	else // ADC Started: la macchina a stati dell'ADC è eseguita dal proprio task
 	{
-		ADCInterface()->Exec();
+		if (ADCInterface()->ChannelStatus(CHN_VREFINT) == ADC_CHANNEL_READY)  // se l'acquisizione della sequenza è completata
+		{
+			for (uint8_t n = 0; n < NTC_MAX; n++)
+			{
+				uint16_t ntcTension = ADCInterface()->ChannelCompensated(ntc_channel[n]);
+
+				if (ntcTension != 0x0FFFF)
+				{
+					alarm_sm.ntc_temp[n] = NTC_Temp(n, ntcTension); // Calcola la temperatura di ciascuna sonda
+				}
+			}
 
-		float ntcTension = ADCInterface()->ChannelValue(CHN_NTC_TEMP);
+			uint16_t ts = ADCInterface()->ChannelValue(CHN_TEMPSENSOR);
 
-		if (ntcTension != 0x0FFFF) 					    // se l'acquisizione è completata
-		{
-			alarm_sm.temp = NTC_Temp(NTC1, ntcTension); // Calcola ed imposta la temperatura
+			if (ts != 0x0FFFF)
+			{
+				alarm_sm.mcu_temp = ADC_CalcTempSensor(ts, ADCInterface()->Vdda());
+			}
+
+			alarm_sm.temp = alarm_sm.ntc_temp[NTC1];         // Imposta la temperatura di allarme
 
-			ADCInterface()->Stop(); 				    // ferma l'ADC
+			ADCInterface()->Stop(); 				         // ferma l'ADC
 
 			return alarm_sm.temp;
 		}
@@ -199,114 +544,259 @@ float TemperatureSampling_Exec(void)
 }
 
 /**
- * @fn float ReadTemperature(void)
- * @brief Esegue la macchina a stati per la lettura della temperatura per un massimo di 2 sec.
+ * @fn void SM_Alarm_Init(const AlarmWarmState_TypeDef*)
+ * @brief
  *
- * @return la temperatura in °C oppure 0xFFFF in caso di timeout
+ * @param warm stato salvato prima del reset (riavvio a caldo), NULL all'avvio a freddo
  */
-float ReadTemperature(void)
+void SM_Alarm_Init(const AlarmWarmState_TypeDef *warm)
 {
-	uint32_t time = HAL_GetTick() + 2000;
+	ADCInterface()->Init(&hadc1,ADC_VDD);
 
-	float temp;
+	uint16_t fullscale[NTC_MAX];
+
+	for (uint8_t n = 0; n < NTC_MAX; n++)
+	{
+		fullscale[n] = ADC_GetFullScale(&hadc1);
+	}
 
-	while (HAL_GetTick() < time) // wait almost 1000 msec for temperature sampling
+	NTC_Init(fullscale);
+
+	TimSys_TaskRegister(&alarm_sm.task, "alarm", SM_Alarm_Exec);
+	TimSys_TaskStart(&alarm_sm.task, 0, ALARM_TASK_PERIOD);
+
+	Supervisor_Watch(SV_ALARM, SUPERVISOR_ALARM_DEADLINE, NULL);
+	Supervisor_CheckIn(SV_ALARM); // il primo campionamento è immediato
+
+	ADCInterface()->Notify(&alarm_sm.task); // fine campionamento e analog watchdog eseguono subito il task
+
+	if (warm)
 	{
-       temp = TemperatureSampling_Exec();
+		alarm_sm.alarm      = (warm->alarm == ALARM_OFF) ? ALARM_OFF : ALARM_ON; // un allarme già disabilitato dall'utente resta disabilitato
+		alarm_sm.autoEnable = warm->autoEnable;
 
-       if (temp != 0xFFFF)
-       {
-    	   break;
-       }
+		if (warm->valid)
+		{
+			alarm_sm.temp          = warm->temp;
+			alarm_sm.reading.temp  = warm->temp;
+			alarm_sm.reading.tick  = HAL_GetTick(); // prev_tick resta 0: la velocità di variazione riparte dal prossimo campione
+			alarm_sm.reading.valid = 1;
+		}
+
+		if (warm->status != AS_IDLE && alarm_sm.alarm == ALARM_ON) // notifica interrotta dal reset: riprende dalla chiamata in corso
+		{
+			alarm_sm.status      = AS_NOTIFY;
+			alarm_sm.notify_tick = HAL_GetTick();
+			alarm_sm.first_call  = warm->entry;
+		}
 	}
+}
 
-	return temp;
+/**
+ * @fn void SM_Alarm_SaveState(AlarmWarmState_TypeDef*)
+ * @brief stato dell'allarme da conservare per il riavvio a caldo
+ *
+ * @param state
+ */
+void SM_Alarm_SaveState(AlarmWarmState_TypeDef *state)
+{
+	state->alarm      = alarm_sm.alarm;
+	state->autoEnable = alarm_sm.autoEnable;
+	state->status     = alarm_sm.status;
+	state->entry      = (alarm_sm.status == AS_CALLING && GSM_Calling() >= PHONE_1) ? GSM_Calling() : alarm_sm.first_call;
+	state->valid      = alarm_sm.reading.valid;
+	state->temp       = alarm_sm.reading.temp;
 }
 
 /**
- * @fn void SM_Alarm_Init(void)
- * @brief
+ * @fn void Evaluate(float)
+ * @brief valuta le regole di allarme sulla nuova lettura: l'allarme viene solo segnalato alla macchina di
+ *        notifica, che attende il modem libero per effettuare le chiamate
  *
+ * @param temp
  */
-void SM_Alarm_Init(void)
+static void Evaluate(float temp)
 {
-	ADCInterface()->Init(&hadc1,ADC_VDD);
+	uint8_t rules = Rules_Exec(&alarm_sm.rules, temp, alarm_sm.reading.tick); // soglie e previsione sulla tendenza
+
+	if ( (alarm_sm.alarm == ALARM_ON ) && (rules != RULE_NONE) )
+	{
+		if (alarm_sm.status == AS_IDLE) // nessuna notifica già in corso
+		{
+			alarm_sm.status      = AS_NOTIFY;
+			alarm_sm.notify_tick = HAL_GetTick();
+
+			DataLog_Event(DL_ALARM, rules);
+		}
+
+		return;
+	}
+
+	if ((rules == RULE_NONE) && alarm_sm.autoEnable) // tutte le regole rientrate oltre l'isteresi
+	{
+		alarm_sm.alarm = ALARM_ON; // reset alarm
+	}
+
+	if (alarm_sm.alarm == ALARM_ON)
+	{
+		WatchThreshold(); // sorveglianza hardware della soglia fino al prossimo campionamento
+	}
 }
 
 /**
- * @fn void Alarm_SM_Exec(void)
- * @brief
+ * @fn void Progress(uint32_t)
+ * @brief la macchina a stati è avanzata: riarma la scadenza del supervisore con il tempo massimo fino al prossimo
+ *        avanzamento. L'esecuzione periodica del task non basta: un campionamento che non si completa deve far
+ *        intervenire il supervisore.
  *
+ * @param deadline [msec]
  */
-void SM_Alarm_Exec(void)
+static void Progress(uint32_t deadline)
+{
+	Supervisor_Watch(SV_ALARM, deadline, NULL);
+	Supervisor_CheckIn(SV_ALARM);
+}
+
+/**
+ * @fn void Sampling_Exec(void)
+ * @brief macchina a stati dell'acquisizione: campiona con l'intervallo adattivo, o subito su richiesta
+ *        dell'analog watchdog, e pubblica la lettura con il suo istante, indipendentemente dall'attività del modem
+ */
+static void Sampling_Exec(void)
 {
-	static uint32_t timeout = 0; // scadenza immediata
-	static uint32_t time    = 0; //
+	static uint32_t time = 0;
 
 	float temp;
 
-	switch(alarm_sm.status)
+	switch (alarm_sm.sampling)
 	{
-		case AS_IDLE:
+		case TS_WAITING:
 
-			if (TimSys_TickTimeElapsed(&time, timeout)) // controlla temperatura solo allo scadere del timeout solo se non c'è alcuna chiamata in uscita
+			if (ADCInterface()->WatchTriggered()) // la sonda ha superato la soglia: campiona senza attendere il timeout
 			{
-				if (GSM_Status() == GSM_IDLE)
-				{
-					alarm_sm.status = AS_CHECK_TEMPERATURE;
-				}
+				alarm_sm.wake = 1;
+			}
 
-				timeout = TEMPERATURE_SAMPLING_TIME;    // reimposta il timeout
+			if (TimSys_TickTimeElapsed(&time, alarm_sm.sampling_interval)) // campiona allo scadere dell'intervallo di campionamento
+			{
+				alarm_sm.wake = 1;
+			}
+
+			if (alarm_sm.wake)
+			{
+				alarm_sm.wake     = 0;
+				alarm_sm.sampling = TS_SAMPLING;
+
+				time = HAL_GetTick(); // l'intervallo decorre dal campionamento
+
+				Progress(SUPERVISOR_ALARM_DEADLINE); // la lettura deve essere pubblicata entro la scadenza
+
+				TimSys_TaskSignal(&alarm_sm.task); // avvia subito l'ADC
 			}
 
 		break;
 
-		case AS_CHECK_TEMPERATURE:
+		case TS_SAMPLING:
 
 			temp = TemperatureSampling_Exec();
 
 			if (temp != 0xFFFF)
 			{
-				if ( (alarm_sm.alarm == ALARM_ON ) && (alarm_sm.temp < alarm_sm.temp_threshold) )
+				alarm_sm.reading.temp  = temp; // pubblica la lettura
+				alarm_sm.reading.tick  = HAL_GetTick();
+				alarm_sm.reading.valid = 1;
+
+				History_Add(temp, alarm_sm.reading.tick);
+
+				DataLog_Reading(temp);
+
+				CountSample();
+
+				alarm_sm.sampling_interval = NextSamplingInterval(temp); // intervallo adattivo fino al prossimo campione
+
+				Telemetry_Temp(temp, alarm_sm.sampling_interval);
+
+				Evaluate(temp);
+
+				alarm_sm.sampling = TS_WAITING;
+
+				Progress(alarm_sm.sampling_interval + SUPERVISOR_ALARM_DEADLINE); // il prossimo campionamento deve iniziare entro l'intervallo
+			}
+
+		break;
+	}
+}
+
+/**
+ * @fn void Alarm_SM_Exec(void)
+ * @brief esegue l'acquisizione della temperatura e la notifica degli allarmi: solo la notifica attende che il
+ *        modem sia libero. La scadenza del supervisore è riarmata solo quando l'acquisizione avanza o la notifica
+ *        cambia stato; una notifica ferma in attesa del modem è interrotta dal reset dopo PANIC_TIMEOUT.
+ *
+ */
+void SM_Alarm_Exec(void)
+{
+	AlarmSMStatus_TypeDef status = alarm_sm.status;
+
+	Sampling_Exec();
+
+	switch(alarm_sm.status)
+	{
+		case AS_IDLE:
+			// nessun allarme da notificare
+		break;
+
+		case AS_NOTIFY:
+
+			if (App_BridgeStop()) // il modem è collegato alla console: l'allarme ha la precedenza
+			{
+				USART_Printf(USART_2, "\r\nBridge modem terminato: allarme da notificare\r\n");
+			}
+
+			if (TimSys_TickTimeElapsed(&alarm_sm.notify_tick, PANIC_TIMEOUT)) // il modem non si libera: reset
+			{
+				Restart_SystemReset(RESTART_PANIC); // la notifica riprende dopo la reinizializzazione del modem
+			}
+
+			if (GSM_Status() == GSM_IDLE) // solo se non c'è alcuna chiamata in uscita
+			{
+				if (alarm_sm.alarm == ALARM_ON)
 				{
-					SIM800L_Schedule_Call_Phonebook_Entries(); // Schedula la chiamata di allarme a tutti i numeri
+					SIM800L_Schedule_Call_Phonebook_From(alarm_sm.first_call); // Schedula la chiamata di allarme a tutti i numeri
 
-					alarm_sm.status = AS_CALLING;              // Cambia lo stato della macchina
+					alarm_sm.first_call = PHONE_1;
 
-					time = HAL_GetTick();
+					DataLog_Event(DL_CALL, 0);
 
-					return;
+					alarm_sm.status = AS_CALLING;              // Cambia lo stato della macchina
 				}
-				else
+				else // allarme disabilitato nel frattempo
 				{
-					if (alarm_sm.temp > (alarm_sm.temp_threshold + TEMPERATURE_DELTA_THRESHOLD) && alarm_sm.autoEnable)
-					{
-						alarm_sm.alarm = ALARM_ON; // reset alarm
-					}
+					alarm_sm.status = AS_IDLE;
 				}
 
-				alarm_sm.status = AS_IDLE;
+				alarm_sm.notify_tick = HAL_GetTick();
 			}
 
 		break;
 
 		case AS_CALLING: // waiting for terminating alarm calling
 
-			if (TimSys_TickTimeElapsed(&time, PANIC_TIMEOUT))
+			if (TimSys_TickTimeElapsed(&alarm_sm.notify_tick, PANIC_TIMEOUT))
 			{
-				HAL_NVIC_SystemReset();
+				Restart_SystemReset(RESTART_PANIC);
 			}
 
 			if ( (GSM_Calling() >= PHONE_3) && (GSM_Status() == GSM_IDLE) ) // when the last call was hang up
 			{
-				time = HAL_GetTick();
-
 				alarm_sm.status = AS_IDLE;
 			}
 
 		break;
 	}
-}
-
-
 
+	if (alarm_sm.status != status) // la notifica è avanzata
+	{
+		Supervisor_CheckIn(SV_ALARM);
+	}
+}
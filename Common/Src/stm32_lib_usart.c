@@ -5,21 +5,49 @@
  */
 
 #include "stm32_lib_usart.h"
+#include "libfmt.h"
 
 // - Defines ------------------------------------------------------------------------------------------------- /
 
-#define BUFFER_SIZE 256
+#define USARTS_NUM    USART_COUNT                         // one table entry per USART_Id_TypeDef: do not change
+#define USART_ID_MAX  (USARTS_NUM - 1)                    // do not change
 
-#define USARTS_NUM    ((USART_MAX == 0) ? 1 : USART_MAX) // do not change:
-#define USART_ID_MAX  USARTS_NUM - 1                      // do not change
+// The USART/UART instances are 1 KB apart on the APB buses: bits 10..14 of the base address give a distinct slot
+// for USART1..3, UART4..5, USART6 and UART7..8, so the instance of a HAL callback maps to its port in constant time
+
+#define USART_SLOTS          32
+#define USART_SLOT(instance) ((((uintptr_t) (instance)) >> 10) & (USART_SLOTS - 1))
+
+_Static_assert(USART_SLOT(USART1_BASE) != USART_SLOT(USART2_BASE) && USART_SLOT(USART1_BASE) != USART_SLOT(USART6_BASE) &&
+               USART_SLOT(USART2_BASE) != USART_SLOT(USART6_BASE), "USART instances share a dispatch slot");
+
+// - Types definition ---------------------------------------------------------------------------------------- /
+
+/**
+ * @struct
+ * @brief one direction of the DMA bridge. The rx DMA fills the circular buffer and raises an event at each half, at
+ *        the end and on line idle; the tx DMA of the other port sends the received chars straight from the buffer
+ *        (no copy) while the rx DMA fills the other half.
+ */
+typedef struct {
+	USART_Id_TypeDef  rx;								// source port
+	USART_Id_TypeDef  tx;								// destination port
+	volatile uint16_t head;								// next char to send
+	volatile uint16_t tail;								// next char to be written by the rx DMA, at the last rx event
+	volatile uint16_t busy;								// chars in flight on the tx DMA, 0 if idle
+	char              buffer[USART_BRIDGE_BUFFER_SIZE];
+} Bridge_TypeDef;
 
 // - Private variables --------------------------------------------------------------------------------------- /
 
 static UART_HandleTypeDef *husart[USARTS_NUM];			// Managed USART handle
 
-static char rx_char[USARTS_NUM];						// USART rx char
+static const USART_Callbacks_TypeDef *callbacks[USARTS_NUM];	// Port callbacks, NULL if none
+
+static uint8_t slotId[USART_SLOTS];						// USART id + 1 of the instance slot, 0 if the instance is not managed
 
-static char printfBuffer[BUFFER_SIZE];    				// USART2 internal printf buffer
+static char rx_char[USARTS_NUM];						// USART rx char
+static char rx_last[USARTS_NUM];						// USART last received char, kept when the rx fifo is full
 
 static char rxBuffer[USARTS_NUM][FIFO_RX_BUFFER_SIZE];	// USART rx buffers managed by rx fifo
 static char txBuffer[USARTS_NUM][FIFO_TX_BUFFER_SIZE];	// USART tx buffers managed by tx fifo
@@ -27,6 +55,197 @@ static char txBuffer[USARTS_NUM][FIFO_TX_BUFFER_SIZE];	// USART tx buffers manag
 static Fifo_TypeDef rxFifo[USARTS_NUM];					// USART rx fifo
 static Fifo_TypeDef txFifo[USARTS_NUM]; 				// USART tx fifo
 
+static volatile uint16_t txBusy[USARTS_NUM];			// USART tx chars in flight (interrupt transfer from the tx fifo), 0 if idle
+
+static USART_Stats_TypeDef stats[USARTS_NUM];			// USART link statistics, updated by the interrupts
+
+static volatile uint8_t rxHeld[USARTS_NUM];			// RTS flow control: reception stopped above the rx fifo high watermark
+
+static Bridge_TypeDef   bridge[2];						// DMA bridge directions: bridge[0] a -> b, bridge[1] b -> a
+static volatile uint8_t bridged[USARTS_NUM];			// port owned by the DMA bridge: the fifos are not served
+
+// - Private functions --------------------------------------------------------------------------------------- /
+
+/**
+ * @fn int8_t Lookup(UART_HandleTypeDef*)
+ * @brief USART id of the HAL handle, in constant time
+ *
+ * @return id, -1 if the handle is not managed
+ */
+static inline int8_t Lookup(UART_HandleTypeDef *huart)
+{
+	int8_t id = (int8_t) slotId[USART_SLOT(huart->Instance)] - 1;
+
+	return (id >= 0 && husart[id] == huart) ? id : -1;
+}
+
+/**
+ * @fn const USART_Callbacks_TypeDef Callbacks*(UART_HandleTypeDef*)
+ * @brief callbacks of the port of the HAL handle, NULL if none
+ */
+static inline const USART_Callbacks_TypeDef *Callbacks(UART_HandleTypeDef *huart)
+{
+	int8_t id = Lookup(huart);
+
+	return (id < 0) ? NULL : callbacks[id];
+}
+
+/**
+ * @fn uint8_t RxFlow(USART_Id_TypeDef)
+ * @brief the USART has hardware RTS flow control: with no pending receive request the received char stays in the
+ *        data register and RTS stays deasserted, so the sender is stopped without losing chars
+ */
+static inline uint8_t RxFlow(USART_Id_TypeDef id)
+{
+	return (husart[id]->Init.HwFlowCtl & UART_HWCONTROL_RTS) != 0;
+}
+
+/**
+ * @fn uint8_t CanWait(USART_Id_TypeDef)
+ * @brief the caller may wait for the tx fifo to empty: the USART handle is set and the caller is neither an
+ *        interrupt nor running with interrupts disabled
+ */
+static uint8_t CanWait(USART_Id_TypeDef id)
+{
+	return husart[id] && !bridged[id] && !__get_IPSR() && !__get_PRIMASK();
+}
+
+/**
+ * @fn void TxStart(USART_Id_TypeDef)
+ * @brief if the USART is idle, start the interrupt transfer of the contiguous block at the head of the tx fifo.
+ *        The block is discarded from the fifo by the tx complete callback, which starts the next one.
+ *
+ * @param id
+ */
+static void TxStart(USART_Id_TypeDef id)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+
+	char    *data;
+	uint16_t len;
+
+	if (!txBusy[id] && husart[id] && !bridged[id] && (len = ch_fifo_span(txFifo + id, &data)))
+	{
+		if (HAL_UART_Transmit_IT(husart[id], (unsigned char *) data, len) == HAL_OK)
+		{
+			txBusy[id] = len;
+		}
+	}
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @fn void TxHighWater(USART_Id_TypeDef)
+ * @brief update the tx fifo high-water mark
+ */
+static inline void TxHighWater(USART_Id_TypeDef id)
+{
+	if (txFifo[id].items > stats[id].tx_high)
+	{
+		stats[id].tx_high = txFifo[id].items;
+	}
+}
+
+/**
+ * @fn void TxFifoWait(void*)
+ * @brief flush callback of the printf sink: wait for room in the full tx fifo (dropped chars from an interrupt)
+ *
+ * @param arg tx fifo
+ */
+static void TxFifoWait(void *arg)
+{
+	Fifo_TypeDef    *fifo = arg;
+	USART_Id_TypeDef id   = fifo - txFifo;
+
+	TxStart(id);
+
+	while (CanWait(id) && fifo->items == fifo->size)
+	{
+		TxStart(id);
+	}
+}
+
+/**
+ * @fn Bridge_TypeDef Bridge*(USART_Id_TypeDef, uint8_t)
+ * @brief bridge direction with port id as source (tx = 0) or destination (tx = 1)
+ */
+static inline Bridge_TypeDef *Bridge(USART_Id_TypeDef id, uint8_t tx)
+{
+	return (tx ? bridge[0].tx : bridge[0].rx) == id ? bridge : bridge + 1;
+}
+
+/**
+ * @fn void BridgeKick(Bridge_TypeDef*)
+ * @brief if the destination is idle, send the contiguous received chars not sent yet (interrupts or PRIMASK only)
+ */
+static void BridgeKick(Bridge_TypeDef *b)
+{
+	if (b->busy || b->head == b->tail)
+	{
+		return;
+	}
+
+	uint16_t len = ((b->tail > b->head) ? b->tail : USART_BRIDGE_BUFFER_SIZE) - b->head;
+
+	if (HAL_UART_Transmit_DMA(husart[b->tx], (uint8_t *) b->buffer + b->head, len) == HAL_OK)
+	{
+		b->busy = len;
+	}
+}
+
+/**
+ * @fn void BridgeRxEvent(Bridge_TypeDef*, uint16_t)
+ * @brief rx DMA event (half, end, idle): the chars up to pos are forwarded to the destination
+ *
+ * @param pos position of the rx DMA in the buffer
+ */
+static void BridgeRxEvent(Bridge_TypeDef *b, uint16_t pos)
+{
+	pos %= USART_BRIDGE_BUFFER_SIZE;
+
+	uint16_t from     = b->tail;
+	uint16_t received = (pos + USART_BRIDGE_BUFFER_SIZE - from) % USART_BRIDGE_BUFFER_SIZE;
+	uint16_t pending  = (from + USART_BRIDGE_BUFFER_SIZE - b->head) % USART_BRIDGE_BUFFER_SIZE;
+
+	if (pending + received >= USART_BRIDGE_BUFFER_SIZE)
+	{
+		stats[b->rx].rx_overflows += pending + received - USART_BRIDGE_BUFFER_SIZE + 1; // destination too slow: unsent chars overwritten
+	}
+
+	stats[b->rx].rx_bytes += received;
+
+	b->tail = pos;
+
+	if (received && callbacks[b->rx] && callbacks[b->rx]->BridgeRx)
+	{
+		if (pos > from)
+		{
+			callbacks[b->rx]->BridgeRx(b->buffer + from, received);
+		}
+		else
+		{
+			callbacks[b->rx]->BridgeRx(b->buffer + from, USART_BRIDGE_BUFFER_SIZE - from);
+			callbacks[b->rx]->BridgeRx(b->buffer, pos);
+		}
+	}
+
+	BridgeKick(b);
+}
+
+/**
+ * @fn void BridgeRxStart(Bridge_TypeDef*)
+ * @brief start the circular rx DMA of the direction from the beginning of the buffer
+ */
+static void BridgeRxStart(Bridge_TypeDef *b)
+{
+	b->head = b->tail = 0;
+
+	HAL_UARTEx_ReceiveToIdle_DMA(husart[b->rx], (uint8_t *) b->buffer, USART_BRIDGE_BUFFER_SIZE);
+}
+
 // - Exported Functions -------------------------------------------------------------------------------------- /
 
 /**
@@ -38,12 +257,20 @@ static Fifo_TypeDef txFifo[USARTS_NUM]; 				// USART tx fifo
 uint8_t USART_Init(void)
 {
 	memset(husart,0,sizeof(husart));
+	memset(callbacks,0,sizeof(callbacks));
+	memset(slotId,0,sizeof(slotId));
+	memset(stats,0,sizeof(stats));
 
 	uint8_t n = USARTS_NUM;
 
 	while (n--)
 	{
 	    ch_fifo_init(txFifo + n, &txBuffer[n][0], FIFO_TX_BUFFER_SIZE);
+
+	    txBusy[n]  = 0;
+	    rxHeld[n]  = 0;
+	    bridged[n] = 0;
+
 		ch_fifo_init(rxFifo + n, rxBuffer[n], FIFO_RX_BUFFER_SIZE);
 	}
 
@@ -51,20 +278,42 @@ uint8_t USART_Init(void)
 }
 
 /**
- * @fn void USART_SetHandle(USART_TypeDef, UART_HandleTypeDef*)
- * @brief associate the USART handle with the specified USART Id, for using with USART_ library.
+ * @fn uint8_t USART_SetHandle(USART_Id_TypeDef, UART_HandleTypeDef*, const USART_Callbacks_TypeDef*)
+ * @brief associate the USART handle and the port callbacks with the specified USART Id, for using with USART_ library.
  *
  * @param id
  * @param husart
+ * @param cb     port callbacks called by the HAL interrupt callbacks (NULL members are skipped), NULL if none
+ * @return 0 if id is out of range or the instance is already managed by another id
  */
-uint8_t USART_SetHandle(USART_Id_TypeDef id, UART_HandleTypeDef *huart)
+uint8_t USART_SetHandle(USART_Id_TypeDef id, UART_HandleTypeDef *huart, const USART_Callbacks_TypeDef *cb)
 {
 	if (id > USART_ID_MAX)
 	{
 		return 0;
 	}
 
-	husart[id] = huart;
+	uint8_t slot = USART_SLOT(huart->Instance);
+
+	if (slotId[slot] && slotId[slot] != id + 1)
+	{
+		return 0;
+	}
+
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq(); // the callbacks may already be running
+
+	if (husart[id])
+	{
+		slotId[USART_SLOT(husart[id]->Instance)] = 0; // handle replaced
+	}
+
+	husart[id]    = huart;
+	callbacks[id] = cb;
+	slotId[slot]  = id + 1;
+
+	__set_PRIMASK(primask);
 
 	return 1;
 }
@@ -84,6 +333,57 @@ HAL_StatusTypeDef USART_Start(USART_Id_TypeDef id)
    return USART_Read(id, rx_char + id, 1, 0);    // read next char from usart
 }
 
+/**
+ * @fn HAL_StatusTypeDef USART_SetBaudRate(USART_Id_TypeDef, uint32_t)
+ * @brief change the baud rate of USART id on the fly: waits until the tx fifo has been sent, stops the transfers,
+ *        reprograms the USART and restarts the reception. The rx fifo is cleared: the chars received across the
+ *        change are garbage.
+ *
+ * @param baud
+ * @return HAL_OK, HAL_ERROR if id is not managed or the USART cannot be reprogrammed
+ */
+HAL_StatusTypeDef USART_SetBaudRate(USART_Id_TypeDef id, uint32_t baud)
+{
+   if (id > USART_ID_MAX || !husart[id])
+   {
+	   return HAL_ERROR;
+   }
+
+   if (bridged[id])
+   {
+	   return HAL_BUSY;
+   }
+
+   USART_TxFifoSend(id);
+
+   HAL_UART_Abort(husart[id]);
+
+   txBusy[id] = 0;
+   rxHeld[id] = 0;
+
+   husart[id]->Init.BaudRate = baud;
+
+   HAL_StatusTypeDef status = HAL_UART_Init(husart[id]);
+
+   ch_fifo_discard(rxFifo + id, rxFifo[id].items);
+
+   if (status == HAL_OK)
+   {
+	   status = USART_Start(id);
+   }
+
+   return status;
+}
+
+/**
+ * @fn uint32_t USART_BaudRate(USART_Id_TypeDef)
+ * @brief current baud rate of USART id, 0 if not managed
+ */
+uint32_t USART_BaudRate(USART_Id_TypeDef id)
+{
+   return (id > USART_ID_MAX || !husart[id]) ? 0 : husart[id]->Init.BaudRate;
+}
+
 /**
  * @fn Fifo_TypeDef USART2_RxFifo*(void)
  * @brief
@@ -102,68 +402,183 @@ Fifo_TypeDef *USART_RxFifo(USART_Id_TypeDef id)
  */
 void USART_ReadChar(USART_Id_TypeDef id)
 {
-   ch_fifo_push(rxFifo + id, *(rx_char + id));  // push last readed char into fifo
+   stats[id].rx_bytes++;
+
+   rx_last[id] = rx_char[id];                      // rx_char is reused by the next reception
+
+   if (ch_fifo_push(rxFifo + id, rx_last[id]))     // push last readed char into fifo
+   {
+	  if (rxFifo[id].items > stats[id].rx_high)
+	  {
+		 stats[id].rx_high = rxFifo[id].items;
+	  }
+   }
+   else
+   {
+	  stats[id].rx_overflows++; // fifo full: char lost
+   }
 
    /*if (strstr(rxFifo[id].buffer,"MO RING\r\n"))
    {
 	  USART_Write(USART_2, "\r\nFound\r\n", 0);
    }*/
 
+   if (RxFlow(id) && rxFifo[id].items >= USART_RX_FLOW_HIGH)
+   {
+	  rxHeld[id] = 1; // fifo almost full: no new request, RTS stops the sender until USART_RxFlowUpdate
+
+	  stats[id].rx_holds++;
+
+	  return;
+   }
+
    USART_Read(id, rx_char + id, 1, 0);    		// read next char from usart
 }
 
 /**
- * @fn void USART2_WriteTxQueue(void)
- * @brief send tx fifo content to USART id
+ * @fn char USART_RxChar(USART_Id_TypeDef)
+ * @brief char received by the last rx complete interrupt, also when the rx fifo was full and the char was lost:
+ *        RxCplt callbacks dispatch on this char, not on the tail of the fifo
+ *
+ * @param id
+ * @return
+ */
+char USART_RxChar(USART_Id_TypeDef id)
+{
+   return (id > USART_ID_MAX) ? 0 : rx_last[id];
+}
+
+/**
+ * @fn void USART_RxFlowUpdate(USART_Id_TypeDef)
+ * @brief RTS flow control: restart the reception stopped by USART_ReadChar once the consumer has emptied the rx fifo
+ *        below the low watermark. To be called by the rx fifo consumer after reading it.
+ *
+ */
+void USART_RxFlowUpdate(USART_Id_TypeDef id)
+{
+   if (rxHeld[id] && !bridged[id] && rxFifo[id].items <= USART_RX_FLOW_LOW)
+   {
+	  uint32_t primask = __get_PRIMASK();
+
+	  __disable_irq(); // the HAL handle lock would make a tx interrupt fail to start the next tx block
+
+	  rxHeld[id] = 0;
+
+	  USART_Read(id, rx_char + id, 1, 0); // the char waiting in the data register is received at once
+
+	  __set_PRIMASK(primask);
+   }
+}
+
+/**
+ * @fn uint16_t USART_TxFree(USART_Id_TypeDef)
+ * @brief room left in the tx fifo: a writer that must not wait pushes a block only if it fits
+ *
+ */
+uint16_t USART_TxFree(USART_Id_TypeDef id)
+{
+   return txFifo[id].size - txFifo[id].items;
+}
+
+/**
+ * @fn void USART_TxFifoSend(USART_Id_TypeDef)
+ * @brief wait until the tx fifo content has been sent to USART id (from an interrupt only starts the transfer)
  *
  */
 void USART_TxFifoSend(USART_Id_TypeDef id)
 {
-   char ch;
+   TxStart(id);
 
-   while (ch_fifo_pop(txFifo + id, &ch))
+   while (CanWait(id) && (txFifo[id].items || txBusy[id]))
    {
-	  USART_WriteChar(id, ch);
+	  TxStart(id);
    }
 }
 
 /**
- * @fn void USART2_QueueWrite(char*)
- * @brief push a string into USART2 tx queue
+ * @fn uint16_t USART_TxFifoPushBuffer(USART_Id_TypeDef, const char*, uint16_t)
+ * @brief push a char buffer into the tx fifo and start sending it. From the main loop waits for room when the
+ *        fifo is full, from an interrupt the chars exceeding the free room are dropped.
  *
- * @param null terminated string, if string lenght exceeds teh FIO_TX_BUFFER_LENGHT, the string will be truncated
+ * @param buff
+ * @param len
+ * @return pushed chars
  */
-void USART_TxFifoPushString(USART_Id_TypeDef id, char *string)
+uint16_t USART_TxFifoPushBuffer(USART_Id_TypeDef id, const char *buff, uint16_t len)
 {
-   while (*string && ch_fifo_push(txFifo + id, *string++));
+   uint16_t pushed = 0;
+
+   while (pushed < len)
+   {
+	  while (pushed < len && ch_fifo_push(txFifo + id, buff[pushed]))
+	  {
+		 pushed++;
+	  }
+
+	  TxHighWater(id);
+
+	  TxStart(id);
+
+	  if (pushed < len && !CanWait(id))
+	  {
+		 stats[id].tx_overflows += len - pushed; // fifo full
+		 break;
+	  }
+   }
+
+   return pushed;
 }
 
 /**
- * @fn void USART2_TxFifoPushChars(char*, uint16_t)
- * @brief push a char buffer into USART2 tx queue
+ * @fn uint16_t USART_TxFifoPushString(USART_Id_TypeDef, const char*)
+ * @brief push a null terminated string into the tx fifo, see USART_TxFifoPushBuffer
  *
  * @param string
- * @param len
+ * @return pushed chars
  */
-void USART_TxFifoPushBuffer(USART_Id_TypeDef id, char *buff, uint16_t len)
+uint16_t USART_TxFifoPushString(USART_Id_TypeDef id, const char *string)
 {
-   while (len-- && ch_fifo_push(txFifo + id, *buff++));
+   return USART_TxFifoPushBuffer(id, string, strlen(string));
 }
 
 /**
- * @brief write mess to usart 2
+ * @fn uint16_t USART_TxFifoPushUInt(USART_Id_TypeDef, uint32_t)
+ * @brief push the decimal digits of value into the tx fifo, see USART_TxFifoPushBuffer
+ *
+ * @param value
+ * @return pushed chars
+ */
+uint16_t USART_TxFifoPushUInt(USART_Id_TypeDef id, uint32_t value)
+{
+   char     digits[10];
+   uint8_t  n = sizeof(digits);
+
+   do {
+	  digits[--n] = '0' + value % 10;
+	  value /= 10;
+   } while (value);
+
+   return USART_TxFifoPushBuffer(id, digits + n, sizeof(digits) - n);
+}
+
+/**
+ * @brief write mess to usart: the message is copied into the tx fifo, so the caller's buffer can be reused at once
  * @param mess
- * @param blocking
- * @return operation code
+ * @param blocking wait until the message has been sent
+ * @return HAL_OK, HAL_BUSY if the message was truncated (from an interrupt with the fifo full)
  */
 HAL_StatusTypeDef USART_Write(USART_Id_TypeDef id, char *mess, unsigned char blocking)
 {
+	uint16_t len = strlen(mess);
+
+	HAL_StatusTypeDef status = (USART_TxFifoPushBuffer(id, mess, len) == len) ? HAL_OK : HAL_BUSY;
+
 	if (blocking)
 	{
-		return HAL_UART_Transmit(*(husart + id),(unsigned char *) mess ,strlen(mess),HAL_MAX_DELAY);
+		USART_TxFifoSend(id);
 	}
 
-	return HAL_UART_Transmit_IT(*(husart + id),(unsigned char *) mess, strlen(mess));
+	return status;
  }
 
 /**
@@ -190,21 +605,28 @@ HAL_StatusTypeDef USART_Read(USART_Id_TypeDef id, char *mess, unsigned int len,
  */
 HAL_StatusTypeDef USART_WriteChar(USART_Id_TypeDef id, char c)
 {
-	char cc[2] = {c, 0};
-	return USART_Write(id, cc, 1);
+	return USART_TxFifoPushBuffer(id, &c, 1) ? HAL_OK : HAL_BUSY;
 }
 
 /**
- * @brief VSPrintf for usart 2
+ * @brief VSPrintf for usart 2: formats straight into the tx fifo (libfmt), waiting for room whenever it is full.
+ *        The output length is not limited by the fifo size.
  * @param fmt
  * @param argptr
  * @return void
  */
 void USART_VSPrintf(USART_Id_TypeDef id, const char *fmt, va_list *argptr)
 {
-    vsprintf((char *) printfBuffer, (const char *) fmt, *argptr);
-    printfBuffer[BUFFER_SIZE-1] = 0;
-    USART_Write(id, printfBuffer, 1);
+    FmtSink_TypeDef sink;
+
+    Fmt_FifoSink(&sink, txFifo + id, TxFifoWait, txFifo + id);
+    Fmt_VPrint(&sink, fmt, *argptr);
+
+    TxHighWater(id);
+
+    stats[id].tx_overflows += sink.lost;
+
+    TxStart(id);
 }
 
 /**
@@ -221,53 +643,191 @@ void USART_Printf(USART_Id_TypeDef id, const char *fmt,...)
 	va_end(argptr);
 }
 
-//-- Interrupt callback weak functions ------------------------------------------------------------
+/**
+ * @fn uint8_t USART_BridgeStart(USART_Id_TypeDef, USART_Id_TypeDef)
+ * @brief transparent DMA bridge between ports a and b: what one receives is sent by the other through DMA, with no
+ *        per char work of the CPU. The tx fifos are sent first; while bridged the rx fifos are not fed (their content
+ *        and the parser state are kept) and the chars pushed into the tx fifos are held, or dropped when full, until
+ *        USART_BridgeStop. Both handles need the rx DMA (circular) and the tx DMA (normal) linked.
+ *
+ * @return 1 if the bridge has been started
+ */
+uint8_t USART_BridgeStart(USART_Id_TypeDef a, USART_Id_TypeDef b)
+{
+	if (a > USART_ID_MAX || b > USART_ID_MAX || a == b || !husart[a] || !husart[b] || bridged[a] || bridged[b])
+	{
+		return 0;
+	}
+
+	if (!husart[a]->hdmarx || !husart[a]->hdmatx || !husart[b]->hdmarx || !husart[b]->hdmatx)
+	{
+		return 0;
+	}
+
+	USART_TxFifoSend(a);
+	USART_TxFifoSend(b);
 
-__weak void USART1_RxCpltCallback(UART_HandleTypeDef *huart){};
-__weak void USART1_ErrorCallback(UART_HandleTypeDef *huart){};
-__weak void USART1_AbortCpltCallback (UART_HandleTypeDef *huart){};
-__weak void USART1_AbortTransmitCpltCallback (UART_HandleTypeDef *huart){};
-__weak void USART1_AbortReceiveCpltCallback (UART_HandleTypeDef *huart){};
-__weak void USART1_TxCpltCallback(UART_HandleTypeDef *huart){};
-__weak void USART1_TxHalfCpltCallback(UART_HandleTypeDef *huart){};
-__weak void USART1_RxHalfCpltCallback(UART_HandleTypeDef *huart){};
-__weak void USART2_RxCpltCallback(UART_HandleTypeDef *huart){};
-__weak void USART2_ErrorCallback(UART_HandleTypeDef *huart){};
-__weak void USART2_AbortCpltCallback (UART_HandleTypeDef *huart){};
-__weak void USART2_AbortTransmitCpltCallback (UART_HandleTypeDef *huart){};
-__weak void USART2_AbortReceiveCpltCallback (UART_HandleTypeDef *huart){};
-__weak void USART2_TxCpltCallback(UART_HandleTypeDef *huart){};
-__weak void USART2_TxHalfCpltCallback(UART_HandleTypeDef *huart){};
-__weak void USART2_RxHalfCpltCallback(UART_HandleTypeDef *huart){};
+	uint32_t primask = __get_PRIMASK();
 
-//-------------------------------------------------------------------------------------------------
+	__disable_irq();
+
+	HAL_UART_AbortReceive(husart[a]); // stop the interrupt reception: the char being received is the first of the bridge
+	HAL_UART_AbortReceive(husart[b]);
+
+	bridge[0].rx = bridge[1].tx = a;
+	bridge[0].tx = bridge[1].rx = b;
+
+	bridge[0].busy = bridge[1].busy = 0;
+
+	bridged[a] = bridged[b] = 1;
+	rxHeld[a]  = rxHeld[b]  = 0;
+
+	BridgeRxStart(bridge);
+	BridgeRxStart(bridge + 1);
+
+	__set_PRIMASK(primask);
+
+	return 1;
+}
 
 /**
- * @brief HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
+ * @fn void USART_BridgeStop(void)
+ * @brief stop the DMA bridge: the chars already received are sent (up to USART_BRIDGE_STOP_TIMEOUT), then both ports
+ *        return to the interrupt reception into the rx fifos and the tx fifos content held meanwhile is sent
+ *
  */
-void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
+void USART_BridgeStop(void)
 {
-	uint8_t n = USARTS_NUM;
+	USART_Id_TypeDef a = bridge[0].rx, b = bridge[0].tx;
+
+	if (!bridged[a])
+	{
+		return;
+	}
+
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
 
-	while(n--)
+	for (uint8_t n = 0; n < 2; n++)
 	{
-		if (husart[n] == huart)
+		BridgeRxEvent(bridge + n, USART_BRIDGE_BUFFER_SIZE - __HAL_DMA_GET_COUNTER(husart[bridge[n].rx]->hdmarx)); // chars since the last event
+
+		HAL_UART_AbortReceive(husart[bridge[n].rx]);
+	}
+
+	__set_PRIMASK(primask);
+
+	uint32_t start = HAL_GetTick();
+
+	while ((bridge[0].busy || bridge[1].busy) && HAL_GetTick() - start < USART_BRIDGE_STOP_TIMEOUT)
+	{
+		// the tx complete callbacks send the rest
+	}
+
+	for (uint8_t n = 0; n < 2; n++)
+	{
+		if (bridge[n].busy) // destination stuck (e.g. CTS): the rest is dropped
 		{
-			USART_ReadChar(n);
-
-			if (huart->Instance==USART1)
-			{
-				USART1_RxCpltCallback(huart);
-			}
-			else
-			if (huart->Instance==USART2)
-			{
-				USART2_RxCpltCallback(huart);
-			}
-
-			break;
+			HAL_UART_AbortTransmit(husart[bridge[n].tx]);
+
+			bridge[n].busy = 0;
 		}
 	}
+
+	bridged[a] = bridged[b] = 0;
+
+	USART_Start(a);
+	USART_Start(b);
+
+	TxStart(a);
+	TxStart(b);
+}
+
+/**
+ * @fn uint8_t USART_Bridged(USART_Id_TypeDef)
+ * @brief the port is in the DMA bridge
+ */
+uint8_t USART_Bridged(USART_Id_TypeDef id)
+{
+	return id <= USART_ID_MAX && bridged[id];
+}
+
+/**
+ * @fn void USART_Stats(USART_Id_TypeDef, USART_Stats_TypeDef*)
+ * @brief consistent copy of the link statistics of USART id
+ *
+ * @param dest destination
+ */
+void USART_Stats(USART_Id_TypeDef id, USART_Stats_TypeDef *dest)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+
+	*dest = stats[id];
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @fn void USART_StatsReset(USART_Id_TypeDef)
+ * @brief reset the link statistics of USART id (counters and high-water marks)
+ *
+ */
+void USART_StatsReset(USART_Id_TypeDef id)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+
+	memset(stats + id, 0, sizeof(stats[id]));
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @fn char USART_StatsReport*(USART_Id_TypeDef, char*, uint16_t)
+ * @brief one line summary of the link statistics of USART id
+ *
+ * @param mess destination buffer (160 chars for the full line)
+ * @param size buffer size
+ * @return mess
+ */
+char *USART_StatsReport(USART_Id_TypeDef id, char *mess, uint16_t size)
+{
+	USART_Stats_TypeDef s;
+
+	USART_Stats(id, &s);
+
+	Fmt_Snprintf(mess, size, "USART%u %lu: rx %lu tx %lu, ore %lu fe %lu ne %lu pe %lu riarmi %lu rts %lu, persi rx %lu tx %lu, max rx %u/%u tx %u/%u\r\n",
+	             id + 1, (unsigned long) USART_BaudRate(id), (unsigned long) s.rx_bytes, (unsigned long) s.tx_bytes, (unsigned long) s.overruns, (unsigned long) s.framing,
+	             (unsigned long) s.noise, (unsigned long) s.parity, (unsigned long) s.rearms, (unsigned long) s.rx_holds, (unsigned long) s.rx_overflows,
+	             (unsigned long) s.tx_overflows, s.rx_high, FIFO_RX_BUFFER_SIZE, s.tx_high, FIFO_TX_BUFFER_SIZE);
+
+	return mess;
+}
+
+//-- HAL interrupt callbacks: O(1) dispatch to the port callbacks ----------------------------------
+
+/**
+ * @brief HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
+ */
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
+{
+	int8_t id = Lookup(huart);
+
+	if (id < 0)
+	{
+		return;
+	}
+
+	USART_ReadChar(id);
+
+	if (callbacks[id] && callbacks[id]->RxCplt)
+	{
+		callbacks[id]->RxCplt(huart);
+	}
 }
 
 /**
@@ -277,14 +837,51 @@ void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
   */
 void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
 {
-	if (huart->Instance==USART1)
+	int8_t id = Lookup(huart);
+
+	if (id < 0)
 	{
-		USART1_ErrorCallback(huart);
+		return;
 	}
-	else
-	if (huart->Instance==USART2)
+
+	uint32_t error = huart->ErrorCode;
+
+	stats[id].overruns += (error & HAL_UART_ERROR_ORE) != 0;
+	stats[id].framing  += (error & HAL_UART_ERROR_FE) != 0;
+	stats[id].noise    += (error & HAL_UART_ERROR_NE) != 0;
+	stats[id].parity   += (error & HAL_UART_ERROR_PE) != 0;
+
+	if (callbacks[id] && callbacks[id]->Error)
 	{
-		USART2_ErrorCallback(huart);
+		callbacks[id]->Error(huart);
+	}
+
+	if (bridged[id])
+	{
+		if (huart->RxState == HAL_UART_STATE_READY) // rx DMA stopped by the error: the chars in flight are lost
+		{
+			Bridge_TypeDef *b = Bridge(id, 0);
+
+			HAL_UART_AbortTransmit(husart[b->tx]);
+
+			b->busy = 0;
+
+			stats[id].rearms++;
+
+			BridgeRxStart(b);
+		}
+
+		return;
+	}
+
+	// an overrun (or a DMA error) ends the interrupt reception: without a new request the port would stay deaf.
+	// Framing, noise and parity errors leave the reception running (the char is received anyway).
+
+	if (huart->RxState == HAL_UART_STATE_READY && !rxHeld[id])
+	{
+		stats[id].rearms++;
+
+		USART_Read(id, rx_char + id, 1, 0);
 	}
 }
 
@@ -295,14 +892,41 @@ void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
   */
 void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
 {
-	if (huart->Instance==USART1)
+	int8_t id = Lookup(huart);
+
+	if (id < 0)
+	{
+		return;
+	}
+
+	if (bridged[id])
 	{
-		USART1_TxCpltCallback(huart);
+		Bridge_TypeDef *b = Bridge(id, 1);
+
+		stats[id].tx_bytes += b->busy;
+
+		b->head = (b->head + b->busy) % USART_BRIDGE_BUFFER_SIZE;
+		b->busy = 0;
+
+		BridgeKick(b);
+
+		return;
 	}
-	else
-	if (huart->Instance==USART2)
+
+	if (txBusy[id])
+	{
+		stats[id].tx_bytes += txBusy[id];
+
+		ch_fifo_discard(txFifo + id, txBusy[id]); // block sent: next block of the tx fifo
+
+		txBusy[id] = 0;
+
+		TxStart(id);
+	}
+
+	if (callbacks[id] && callbacks[id]->TxCplt)
 	{
-		USART2_TxCpltCallback(huart);
+		callbacks[id]->TxCplt(huart);
 	}
 }
 
@@ -313,14 +937,11 @@ void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
   */
 void HAL_UART_TxHalfCpltCallback(UART_HandleTypeDef *huart)
 {
-	if (huart->Instance==USART1)
-	{
-		USART1_TxHalfCpltCallback(huart);
-	}
-	else
-	if (huart->Instance==USART2)
+	const USART_Callbacks_TypeDef *cb = Callbacks(huart);
+
+	if (cb && cb->TxHalfCplt)
 	{
-		USART2_TxHalfCpltCallback(huart);
+		cb->TxHalfCplt(huart);
 	}
 }
 
@@ -331,14 +952,11 @@ void HAL_UART_TxHalfCpltCallback(UART_HandleTypeDef *huart)
   */
 void HAL_UART_RxHalfCpltCallback(UART_HandleTypeDef *huart)
 {
-	if (huart->Instance==USART1)
-	{
-		USART1_RxHalfCpltCallback(huart);
-	}
-	else
-	if (huart->Instance==USART2)
+	const USART_Callbacks_TypeDef *cb = Callbacks(huart);
+
+	if (cb && cb->RxHalfCplt)
 	{
-		USART2_RxHalfCpltCallback(huart);
+		cb->RxHalfCplt(huart);
 	}
 }
 
@@ -349,32 +967,26 @@ void HAL_UART_RxHalfCpltCallback(UART_HandleTypeDef *huart)
   */
 void HAL_UART_AbortCpltCallback (UART_HandleTypeDef *huart)
 {
-	if (huart->Instance==USART1)
-	{
-		USART1_AbortCpltCallback(huart);
-	}
-	else
-	if (huart->Instance==USART2)
+	const USART_Callbacks_TypeDef *cb = Callbacks(huart);
+
+	if (cb && cb->AbortCplt)
 	{
-		USART2_AbortCpltCallback(huart);
+		cb->AbortCplt(huart);
 	}
 }
 
 /**
-  * @brief  UART Abort Complete callback.
+  * @brief  UART Abort Transmit Complete callback.
   * @param  huart UART handle.
   * @retval None
   */
 void HAL_UART_AbortTransmitCpltCallback (UART_HandleTypeDef *huart)
 {
-	if (huart->Instance==USART1)
-	{
-		USART1_AbortTransmitCpltCallback(huart);
-	}
-	else
-	if (huart->Instance==USART2)
+	const USART_Callbacks_TypeDef *cb = Callbacks(huart);
+
+	if (cb && cb->AbortTransmitCplt)
 	{
-		USART2_AbortTransmitCpltCallback(huart);
+		cb->AbortTransmitCplt(huart);
 	}
 }
 
@@ -385,12 +997,26 @@ void HAL_UART_AbortTransmitCpltCallback (UART_HandleTypeDef *huart)
   */
 void HAL_UART_AbortReceiveCpltCallback (UART_HandleTypeDef *huart)
 {
-	if (huart->Instance==USART1)
+	const USART_Callbacks_TypeDef *cb = Callbacks(huart);
+
+	if (cb && cb->AbortReceiveCplt)
 	{
-		USART1_AbortReceiveCpltCallback(huart);
+		cb->AbortReceiveCplt(huart);
 	}
-	else if (huart->Instance==USART2)
+}
+
+/**
+  * @brief  Reception event callback (rx DMA of the bridge: half, end of the buffer or line idle).
+  * @param  huart UART handle.
+  * @param  Size  position of the rx DMA in the buffer.
+  * @retval None
+  */
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
+{
+	int8_t id = Lookup(huart);
+
+	if (id >= 0 && bridged[id])
 	{
-		USART2_AbortReceiveCpltCallback(huart);
+		BridgeRxEvent(Bridge(id, 0), Size);
 	}
 }
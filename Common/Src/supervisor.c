@@ -0,0 +1,244 @@
+/**
+ * @file supervisor.c - https://github.com/SC-Develop/tesysma
+ *
+ * @author Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/SC-Develop/
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ *
+ * Supervisore del watchdog indipendente (IWDG).
+ *
+ * Ogni task supervisionato segnala la propria attività (check-in) entro una scadenza propria. Il supervisore è un
+ * task dello scheduler: ogni SUPERVISOR_PERIOD controlla le scadenze e ricarica l'IWDG solo se tutti i task sono
+ * in regola. Un task può essere a riposo (Supervisor_Idle), ad esempio l'ADC tra un campionamento e l'altro: non è
+ * controllato fino al successivo check-in.
+ *
+ * Un task oltre la scadenza con una procedura di recupero (il modem) viene recuperato senza riavviare la MCU, fino
+ * a SUPERVISOR_MAX_RECOVERY volte consecutive. Altrimenti il supervisore smette di ricaricare l'IWDG, che riavvia
+ * la MCU entro il suo timeout; il task in ritardo è salvato nella RAM no-init (sezione .noinit dei linker script)
+ * e, insieme al task dello scheduler in esecuzione al momento del reset, è disponibile al successivo avvio.
+ * Se il loop principale resta bloccato il supervisore non viene eseguito: il reset è attribuito al task in
+ * esecuzione.
+ */
+
+#include "iwdg.h"
+#include "timsys.h"
+#include "supervisor.h"
+
+/**
+ * @struct
+ * @brief stato di un task supervisionato
+ *
+ */
+typedef struct {
+	uint8_t            active;		// controllato: ha fatto check-in e non è a riposo
+	uint32_t           deadline;	// [msec]
+	uint32_t           checkin;		// ultimo check-in [msec]
+	Supervisor_Recover recover;		// procedura di recupero, NULL se il task non è recuperabile
+	uint8_t            attempts;	// recuperi consecutivi senza check-in
+	uint32_t           recoveries;	// recuperi totali
+} SupervisedTask_TypeDef;
+
+/**
+ * @struct
+ * @brief record conservato nella RAM no-init attraverso il reset
+ *
+ */
+typedef struct {
+	uint32_t magic;
+	uint8_t  starved;	// Supervisor_Id_TypeDef, SV_TASKS se nessuno
+	uint32_t tick;
+} SupervisorRecord_TypeDef;
+
+// Variables ------------------------------------------------------------------------------------------------------------------------------
+
+static const char *names[SV_TASKS] = {
+	[SV_ALARM] = "alarm",
+	[SV_ADC]   = "adc",
+	[SV_GSM]   = "gsm",
+};
+
+static SupervisedTask_TypeDef supervised[SV_TASKS];
+
+static SupervisorRecord_TypeDef record NOINIT;
+
+static struct {
+	uint8_t                 starved;		// task in ritardo rilevato all'ultimo reset
+	uint8_t                 running;		// id del task dello scheduler in esecuzione all'ultimo reset
+	uint32_t                tick;
+	uint8_t                 valid;
+	SupervisorReset_TypeDef info;
+} last;
+
+static TimSys_Task_TypeDef supervisor_task;
+
+static uint8_t starving = 0; // un task non recuperabile è in ritardo: l'IWDG non è più ricaricato
+
+// - Local functions ----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @fn void Supervisor_Task(void)
+ * @brief controlla le scadenze dei task e ricarica l'IWDG se sono tutti in regola
+ */
+static void Supervisor_Task(void)
+{
+	uint32_t now = HAL_GetTick();
+
+	for (uint8_t id = 0; id < SV_TASKS && !starving; id++)
+	{
+		SupervisedTask_TypeDef *t = supervised + id;
+
+		if (!t->active || (now - t->checkin) <= t->deadline)
+		{
+			continue;
+		}
+
+		if (t->recover && t->attempts < SUPERVISOR_MAX_RECOVERY)
+		{
+			t->attempts++;
+			t->recoveries++;
+			t->checkin = now; // nuova scadenza per il recupero
+
+			t->recover();
+
+			continue;
+		}
+
+		starving = 1; // l'IWDG riavvierà la MCU
+
+		record.magic   = SUPERVISOR_MAGIC;
+		record.starved = id;
+		record.tick    = now;
+	}
+
+	if (!starving)
+	{
+		Supervisor_Kick();
+	}
+}
+
+// - Exported functions -------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @fn void Supervisor_Init(void)
+ * @brief legge la causa dell'ultimo reset dalla RAM no-init e avvia il task del supervisore.
+ *        Da chiamare prima di azzerare i flag di reset (RCC_CSR) e prima che lo scheduler esegua un task.
+ */
+void Supervisor_Init(void)
+{
+	last.valid   = __HAL_RCC_GET_FLAG(RCC_FLAG_IWDGRST) ? 1 : 0;
+	last.starved = (last.valid && record.magic == SUPERVISOR_MAGIC && record.starved < SV_TASKS) ? record.starved : SV_TASKS;
+	last.tick    = (last.starved < SV_TASKS) ? record.tick : 0;
+	last.running = TimSys_Running();
+
+	record.magic   = 0;
+	record.starved = SV_TASKS;
+
+	TimSys_TaskRegister(&supervisor_task, "supervisor", Supervisor_Task);
+	TimSys_TaskStart(&supervisor_task, SUPERVISOR_PERIOD, SUPERVISOR_PERIOD);
+}
+
+/**
+ * @fn void Supervisor_Watch(Supervisor_Id_TypeDef, uint32_t, Supervisor_Recover)
+ * @brief imposta la scadenza del task; il controllo inizia al primo check-in
+ *
+ * @param id
+ * @param deadline tempo massimo tra due check-in [msec]
+ * @param recover  procedura di recupero senza reset, NULL se il ritardo del task deve riavviare la MCU
+ */
+void Supervisor_Watch(Supervisor_Id_TypeDef id, uint32_t deadline, Supervisor_Recover recover)
+{
+	if (id < SV_TASKS)
+	{
+		supervised[id].deadline = deadline;
+		supervised[id].recover  = recover;
+	}
+}
+
+/**
+ * @fn void Supervisor_CheckIn(Supervisor_Id_TypeDef)
+ * @brief il task è attivo e sta avanzando: riarma la scadenza
+ */
+void Supervisor_CheckIn(Supervisor_Id_TypeDef id)
+{
+	if (id < SV_TASKS)
+	{
+		supervised[id].checkin  = HAL_GetTick();
+		supervised[id].active   = 1;
+		supervised[id].attempts = 0;
+	}
+}
+
+/**
+ * @fn void Supervisor_Begin(Supervisor_Id_TypeDef)
+ * @brief inizio di un'operazione: arma la scadenza solo se il task era a riposo, per cui i tentativi ripetuti di
+ *        un'operazione che non si completa non la prorogano
+ */
+void Supervisor_Begin(Supervisor_Id_TypeDef id)
+{
+	if (id < SV_TASKS && !supervised[id].active)
+	{
+		Supervisor_CheckIn(id);
+	}
+}
+
+/**
+ * @fn void Supervisor_Idle(Supervisor_Id_TypeDef)
+ * @brief il task è a riposo: non è controllato fino al prossimo check-in
+ */
+void Supervisor_Idle(Supervisor_Id_TypeDef id)
+{
+	if (id < SV_TASKS)
+	{
+		supervised[id].active   = 0;
+		supervised[id].attempts = 0;
+	}
+}
+
+/**
+ * @fn void Supervisor_Kick(void)
+ * @brief ricarica l'IWDG. Fuori dal supervisore solo durante l'avvio, prima che lo scheduler sia in esecuzione.
+ */
+void Supervisor_Kick(void)
+{
+  #ifdef WATCHDOG
+
+	HAL_IWDG_Refresh(&hiwdg);
+
+  #endif
+}
+
+/**
+ * @fn uint32_t Supervisor_Recoveries(Supervisor_Id_TypeDef)
+ * @brief numero di recuperi del task dall'avvio
+ */
+uint32_t Supervisor_Recoveries(Supervisor_Id_TypeDef id)
+{
+	return (id < SV_TASKS) ? supervised[id].recoveries : 0;
+}
+
+/**
+ * @fn const char Supervisor_Name*(Supervisor_Id_TypeDef)
+ * @brief nome del task supervisionato
+ */
+const char *Supervisor_Name(Supervisor_Id_TypeDef id)
+{
+	return (id < SV_TASKS) ? names[id] : NULL;
+}
+
+/**
+ * @fn const SupervisorReset_TypeDef Supervisor_LastReset*(void)
+ * @brief causa dell'ultimo reset dell'IWDG. Il nome del task in esecuzione è risolto dallo scheduler: chiamare dopo
+ *        la registrazione dei task.
+ */
+const SupervisorReset_TypeDef *Supervisor_LastReset(void)
+{
+	TimSys_Task_TypeDef *running = last.valid ? TimSys_Task(last.running) : NULL;
+
+	last.info.valid   = last.valid;
+	last.info.id      = last.starved;
+	last.info.starved = Supervisor_Name(last.starved);
+	last.info.running = running ? running->name : NULL;
+	last.info.tick    = last.tick;
+
+	return &last.info;
+}
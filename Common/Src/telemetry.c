@@ -0,0 +1,405 @@
+/**
+ * @file   telemetry.c - https://github.com/SC-Develop/tesysma
+ *
+ * @author Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/SC-Develop/
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ *
+ * Telemetria binaria su USART2: record a formato fisso (telemetry.def.h) con CRC, in trame COBS, senza formattazione
+ * di stringhe. I record sono composti dai task che producono i dati e accodati nella fifo di trasmissione solo se la
+ * trama entra per intero: con la coda piena il record è scartato e contato, il produttore non attende mai. Il
+ * decodificatore su host è in Tools/telemetry.
+ */
+
+#include <string.h>
+#include "telemetry.h"
+#include "stm32_lib_usart.h"
+#include "timsys.h"
+#include "libfmt.h"
+
+// Types definition ---------------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @struct
+ * @brief record in composizione, prima del CRC e della codifica COBS
+ *
+ */
+typedef struct {
+	uint8_t data[TM_RECORD_MAX];
+	uint8_t len;
+} Record_TypeDef;
+
+// - Local variables ----------------------------------------------------------------------------------------- /
+
+static const uint16_t crc_table[16] = { // CRC-16/CCITT, 4 bit alla volta
+	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+	0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+};
+
+static TimSys_Task_TypeDef profile_task; // record TM_PROFILE ogni TELEMETRY_PROFILE_PERIOD
+
+static struct {
+	uint8_t  mask;			// tipi trasmessi, TM_MASK(type)
+	uint16_t seq;			// sequenza del prossimo record
+	uint32_t frames;		// trame accodate
+	uint32_t dropped;		// record scartati con la coda di trasmissione piena
+} telemetry = { .mask = TELEMETRY_MASK_DEFAULT };
+
+// - Local Functions ----------------------------------------------------------------------------------------- /
+
+static inline void Put8(Record_TypeDef *r, uint8_t value)
+{
+	r->data[r->len++] = value;
+}
+
+static inline void Put16(Record_TypeDef *r, uint16_t value)
+{
+	Put8(r, value);
+	Put8(r, value >> 8);
+}
+
+static inline void Put32(Record_TypeDef *r, uint32_t value)
+{
+	Put16(r, value);
+	Put16(r, value >> 16);
+}
+
+static inline void Put64(Record_TypeDef *r, uint64_t value)
+{
+	Put32(r, value);
+	Put32(r, value >> 32);
+}
+
+static inline void PutFloat(Record_TypeDef *r, float value)
+{
+	uint32_t bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+
+	Put32(r, bits);
+}
+
+/**
+ * @fn uint16_t Crc16(const uint8_t*, uint8_t)
+ * @brief CRC-16/CCITT-FALSE
+ *
+ */
+static uint16_t Crc16(const uint8_t *data, uint8_t len)
+{
+	uint16_t crc = 0xFFFF;
+
+	while (len--)
+	{
+		uint8_t b = *data++;
+
+		crc = (crc << 4) ^ crc_table[(crc >> 12) ^ (b >> 4)];
+		crc = (crc << 4) ^ crc_table[(crc >> 12) ^ (b & 0x0F)];
+	}
+
+	return crc;
+}
+
+/**
+ * @fn uint8_t Cobs(const uint8_t*, uint8_t, uint8_t*)
+ * @brief codifica COBS: nessuno zero nei dati codificati, lo zero è il delimitatore delle trame
+ *
+ * @param src
+ * @param len
+ * @param dst almeno len + 1 byte
+ * @return lunghezza codificata
+ */
+static uint8_t Cobs(const uint8_t *src, uint8_t len, uint8_t *dst)
+{
+	uint8_t code_idx = 0; // posizione del codice del blocco corrente
+	uint8_t code     = 1; // distanza dal prossimo zero
+	uint8_t out      = 1;
+
+	for (uint8_t i = 0; i < len; i++)
+	{
+		if (src[i])
+		{
+			dst[out++] = src[i];
+
+			if (++code < 0xFF)
+			{
+				continue;
+			}
+		}
+
+		dst[code_idx] = code; // zero nei dati o blocco di 254 byte: chiude il blocco
+		code_idx      = out++;
+		code          = 1;
+	}
+
+	dst[code_idx] = code;
+
+	return out;
+}
+
+/**
+ * @fn void Begin(Record_TypeDef*, TelemetryType_TypeDef)
+ * @brief intestazione del record: la sequenza avanza anche se il record sarà scartato
+ *
+ */
+static void Begin(Record_TypeDef *r, TelemetryType_TypeDef type)
+{
+	r->len = 0;
+
+	Put8(r, TM_VERSION);
+	Put8(r, type);
+	Put16(r, telemetry.seq++);
+	Put32(r, TimSys_Micros());
+}
+
+/**
+ * @fn void Send(Record_TypeDef*)
+ * @brief aggiunge il CRC, codifica la trama e la accoda se entra per intero nella fifo di trasmissione
+ *
+ */
+static void Send(Record_TypeDef *r)
+{
+	uint8_t frame[TM_FRAME_MAX];
+
+	Put16(r, Crc16(r->data, r->len));
+
+	uint8_t len = Cobs(r->data, r->len, frame + 1) + 2;
+
+	frame[0]       = 0;
+	frame[len - 1] = 0;
+
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq(); // l'eco dei caratteri del modem (USART1_RxCplt) non deve entrare nella trama
+
+	if (!USART_Bridged(USART_2) && USART_TxFree(USART_2) >= len)
+	{
+		USART_TxFifoPushBuffer(USART_2, (const char *) frame, len);
+
+		telemetry.frames++;
+	}
+	else
+	{
+		telemetry.dropped++;
+	}
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @fn void Profile_Exec(void)
+ * @brief task dei record TM_PROFILE: un record per sonda
+ *
+ */
+static void Profile_Exec(void)
+{
+	if (!Telemetry_Enabled(TM_PROFILE))
+	{
+		return;
+	}
+
+	for (uint8_t id = 0; id < PROF_PROBES; id++)
+	{
+		TimSys_Probe_TypeDef p;
+
+		uint32_t primask = __get_PRIMASK();
+
+		__disable_irq();
+
+		p = *TimSys_Probe(id); // copia coerente, le sonde delle ISR possono aggiornarsi
+
+		__set_PRIMASK(primask);
+
+		Record_TypeDef r;
+
+		Begin(&r, TM_PROFILE);
+
+		Put8(&r, id);
+		Put32(&r, p.count);
+		Put32(&r, p.min);
+		Put32(&r, p.max);
+		Put32(&r, p.last);
+		Put64(&r, p.sum);
+
+		Send(&r);
+	}
+}
+
+// - Exported Functions -------------------------------------------------------------------------------------- /
+
+/**
+ * @fn void Telemetry_Init(void)
+ * @brief registra il task dei record di profiling
+ *
+ */
+void Telemetry_Init(void)
+{
+	TimSys_TaskRegister(&profile_task, "telemetry", Profile_Exec);
+
+	Telemetry_SetMask(telemetry.mask);
+}
+
+/**
+ * @fn void Telemetry_SetMask(uint8_t)
+ * @brief imposta i tipi di record trasmessi, 0 spegne la telemetria
+ *
+ * @param mask TM_MASK dei tipi
+ */
+void Telemetry_SetMask(uint8_t mask)
+{
+	telemetry.mask = mask & TM_MASK_ALL;
+
+	if (Telemetry_Enabled(TM_PROFILE))
+	{
+		TimSys_TaskStart(&profile_task, TELEMETRY_PROFILE_PERIOD, TELEMETRY_PROFILE_PERIOD);
+	}
+	else
+	{
+		TimSys_TaskStop(&profile_task);
+	}
+}
+
+/**
+ * @fn uint8_t Telemetry_Mask(void)
+ * @brief
+ *
+ * @return tipi di record trasmessi
+ */
+uint8_t Telemetry_Mask(void)
+{
+	return telemetry.mask;
+}
+
+/**
+ * @fn uint8_t Telemetry_Enabled(TelemetryType_TypeDef)
+ * @brief i produttori possono evitare di raccogliere i dati di un tipo non trasmesso
+ *
+ */
+uint8_t Telemetry_Enabled(TelemetryType_TypeDef type)
+{
+	return (telemetry.mask & TM_MASK(type)) != 0;
+}
+
+/**
+ * @fn void Telemetry_Adc(uint8_t, const uint32_t*, uint8_t)
+ * @brief record TM_ADC: conversioni grezze di un canale al termine di un burst
+ *
+ * @param channel ADC_ChannelId_TypeDef
+ * @param values
+ * @param count al più (TM_PAYLOAD_MAX - 2) / 2
+ */
+void Telemetry_Adc(uint8_t channel, const uint32_t *values, uint8_t count)
+{
+	if (!Telemetry_Enabled(TM_ADC))
+	{
+		return;
+	}
+
+	if (count > (TM_PAYLOAD_MAX - 2) / 2)
+	{
+		count = (TM_PAYLOAD_MAX - 2) / 2;
+	}
+
+	Record_TypeDef r;
+
+	Begin(&r, TM_ADC);
+
+	Put8(&r, channel);
+	Put8(&r, count);
+
+	for (uint8_t i = 0; i < count; i++)
+	{
+		Put16(&r, values[i]);
+	}
+
+	Send(&r);
+}
+
+/**
+ * @fn void Telemetry_Temp(float, uint32_t)
+ * @brief record TM_TEMP: campione di temperatura dell'allarme
+ *
+ * @param temp [°C]
+ * @param interval prossimo intervallo di campionamento [msec]
+ */
+void Telemetry_Temp(float temp, uint32_t interval)
+{
+	if (!Telemetry_Enabled(TM_TEMP))
+	{
+		return;
+	}
+
+	Record_TypeDef r;
+
+	Begin(&r, TM_TEMP);
+
+	PutFloat(&r, temp);
+	Put32(&r, interval);
+
+	Send(&r);
+}
+
+/**
+ * @fn void Telemetry_Gsm(uint8_t, uint8_t, uint8_t)
+ * @brief record TM_GSM: transizione di stato del modem
+ *
+ * @param from GSMStatus_TypeDef
+ * @param to GSMStatus_TypeDef
+ * @param command ultimo comando AT inviato
+ */
+void Telemetry_Gsm(uint8_t from, uint8_t to, uint8_t command)
+{
+	if (!Telemetry_Enabled(TM_GSM))
+	{
+		return;
+	}
+
+	Record_TypeDef r;
+
+	Begin(&r, TM_GSM);
+
+	Put8(&r, from);
+	Put8(&r, to);
+	Put8(&r, command);
+
+	Send(&r);
+}
+
+/**
+ * @fn void Telemetry_Parser(uint8_t, uint8_t)
+ * @brief record TM_PARSER: risposta del modem riconosciuta dal parser
+ *
+ * @param reply ATCommand_Reply_TypeDef
+ * @param status GSMStatus_TypeDef alla ricezione
+ */
+void Telemetry_Parser(uint8_t reply, uint8_t status)
+{
+	if (!Telemetry_Enabled(TM_PARSER))
+	{
+		return;
+	}
+
+	Record_TypeDef r;
+
+	Begin(&r, TM_PARSER);
+
+	Put8(&r, reply);
+	Put8(&r, status);
+
+	Send(&r);
+}
+
+/**
+ * @fn char Telemetry_Report*(char*, uint16_t)
+ * @brief riepilogo della telemetria per la console
+ *
+ * @param mess buffer di destinazione (64 caratteri per il riepilogo completo)
+ * @param size dimensione del buffer
+ * @return mess
+ */
+char *Telemetry_Report(char *mess, uint16_t size)
+{
+	Fmt_Snprintf(mess, size, "Telemetria: tipi 0x%02X, trame %lu, scartate %lu\r\n", telemetry.mask,
+	             (unsigned long) telemetry.frames, (unsigned long) telemetry.dropped);
+
+	return mess;
+}
@@ -6,7 +6,7 @@
  * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
  */
 
-#include "limits.h"
+#include "libfmt.h"
 #include "timsys.h"
 
 /******************************************************************************
@@ -28,12 +28,7 @@ uint32_t TimSys_TimeElapsed(uint32_t start)
 {
 	uint32_t t = HAL_GetTick(); // get current sys time and freeze the value
 
-	if (start > t) // timer has been reset
-	{
-	   return UINT_MAX - start + t;
-	}
-
-	return (t-start);
+	return t - start; // modular arithmetic: correct across the counter wrap
 }
 
 //* Tick time elapsed function ------------------------------------------------------------------------
@@ -88,14 +83,7 @@ uint32_t TimSys_TickTimeElapsed(uint32_t *start, uint32_t timeout)
     uint32_t time_elapsed;
 	uint32_t t = HAL_GetTick(); // get current sys time and freeze the value
 
-	if (*start > t) // timer has been reset
-	{
-	   time_elapsed = UINT_MAX - (*start) + t;
-	}
-	else
-	{
-	   time_elapsed = t - (*start);
-	}
+	time_elapsed = t - (*start); // modular arithmetic: correct across the counter wrap
 
 	if (time_elapsed >= timeout)
 	{
@@ -124,3 +112,687 @@ uint32_t TimSys_TickTimeElapsedEx(uint32_t *start, uint32_t timeout, uint8_t *st
 
 	return TimSys_TickTimeElapsed(start, timeout);
 }
+
+/******************************************************************************
+ * MICROSECOND TIMEBASE
+ *
+ * Il tempo in microsecondi è ricavato dal contatore di cicli del core (DWT CYCCNT): il numero di cicli trascorsi
+ * dall'ultimo riallineamento è convertito con il fattore usec/ciclo in virgola fissa Q32, per cui la conversione è
+ * esatta anche per clock non multipli di 1 MHz (6.25 MHz). Il riallineamento avviene ad ogni cambio di clock
+ * (TimSys_MicrosSync) e quando i cicli trascorsi superano 2^30, per cui TimSys_Micros deve essere chiamata almeno
+ * una volta ogni 2^32 cicli (il loop principale la chiama ad ogni task).
+ * Il contatore di cicli è fermo con il core in Sleep e in Stop: power.c riporta il tempo trascorso con
+ * TimSys_MicrosAdvance.
+ ******************************************************************************/
+
+static struct {
+	uint32_t cycles;    // contatore di cicli all'ultimo riallineamento
+	uint32_t micros;    // tempo all'ultimo riallineamento [usec]
+	uint32_t us_q32;    // usec per ciclo, Q32
+	uint32_t ns_q16;    // nsec per ciclo, Q16
+} timebase = { .us_q32 = 0xFFFFFFFF, .ns_q16 = 1000 << 16 }; // 1 MHz finché TimSys_Init non legge il clock
+
+/**
+ * @brief enable the cycle counter and load the clock conversion factors
+ */
+void TimSys_Init(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+
+	DWT->CYCCNT = 0;
+	DWT->CTRL  |= DWT_CTRL_CYCCNTENA_Msk;
+
+	timebase.cycles = 0;
+
+	TimSys_MicrosSync();
+}
+
+/**
+ * @brief core cycles elapsed from start, wrap safe
+ */
+uint32_t TimSys_CyclesElapsed(uint32_t start)
+{
+	return TimSys_Cycles() - start;
+}
+
+/**
+ * @brief free running microsecond counter, wrap every ~71 minutes. Can be called from ISR.
+ */
+uint32_t TimSys_Micros(void)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+
+	uint32_t elapsed = TimSys_Cycles() - timebase.cycles;
+	uint32_t us      = ((uint64_t) elapsed * timebase.us_q32) >> 32;
+
+	if (elapsed >= (1UL << 30)) // riallinea prima del giro del contatore di cicli
+	{
+		timebase.cycles += elapsed;
+		timebase.micros += us;
+		us = 0;
+	}
+
+	us += timebase.micros;
+
+	__set_PRIMASK(primask);
+
+	return us;
+}
+
+/**
+ * @brief microseconds elapsed from start, wrap safe
+ */
+uint32_t TimSys_MicrosElapsed(uint32_t start)
+{
+	return TimSys_Micros() - start;
+}
+
+/**
+ * @brief fold the elapsed cycles with the current conversion factor and reload it from SystemCoreClock.
+ *        Call before and after every change of the core clock.
+ */
+void TimSys_MicrosSync(void)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+
+	uint32_t now = TimSys_Cycles();
+
+	timebase.micros += ((uint64_t) (now - timebase.cycles) * timebase.us_q32) >> 32;
+	timebase.cycles  = now;
+	timebase.us_q32  = ((uint64_t) 1000000 << 32) / SystemCoreClock;
+	timebase.ns_q16  = ((uint64_t) 1000000000 << 16) / SystemCoreClock;
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief add the time the cycle counter was halted (core in Sleep or Stop)
+ */
+void TimSys_MicrosAdvance(uint32_t us)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+
+	timebase.micros += us;
+
+	__set_PRIMASK(primask);
+}
+
+/******************************************************************************
+ * PROFILING
+ *
+ * Ogni sonda accumula numero di esecuzioni, minimo, massimo, media e un istogramma logaritmico delle durate misurate
+ * tra PROF_BEGIN(id) e PROF_END(id). PROF_BEGIN dichiara una variabile locale: le due macro devono stare nello
+ * stesso blocco. Una sonda deve essere usata da un solo contesto (main loop o una ISR).
+ ******************************************************************************/
+
+static TimSys_Probe_TypeDef probes[PROF_PROBES];
+
+static const char *probe_names[PROF_PROBES] = TIMSYS_PROBE_NAMES;
+
+/**
+ * @brief logarithmic histogram bucket of a duration: 0 = below 1 usec, i = [2^(i-1), 2^i) usec
+ */
+static uint8_t Log2Bucket(uint32_t us, uint8_t buckets)
+{
+	uint8_t bucket = us ? 32 - __builtin_clz(us) : 0;
+
+	return (bucket < buckets) ? bucket : buckets - 1;
+}
+
+/**
+ * @brief record a duration measured by PROF_END
+ *
+ * @param id     probe
+ * @param cycles core cycles
+ */
+void TimSys_ProfRecord(TimSys_ProbeId_TypeDef id, uint32_t cycles)
+{
+	if (id >= PROF_PROBES)
+	{
+		return;
+	}
+
+	TimSys_Probe_TypeDef *p = probes + id;
+
+	uint64_t ns64 = ((uint64_t) cycles * timebase.ns_q16) >> 16;
+	uint32_t ns   = (ns64 > UINT32_MAX) ? UINT32_MAX : (uint32_t) ns64;
+	uint8_t  bucket = Log2Bucket(ns / 1000, TIMSYS_PROF_BUCKETS);
+
+	if (p->count == 0 || ns < p->min)
+	{
+		p->min = ns;
+	}
+
+	if (ns > p->max)
+	{
+		p->max = ns;
+	}
+
+	p->last = ns;
+	p->sum += ns;
+	p->count++;
+	p->hist[bucket]++;
+}
+
+/**
+ * @brief clear the statistics of all probes
+ */
+void TimSys_ProfReset(void)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+
+	for (uint8_t i = 0; i < PROF_PROBES; i++)
+	{
+		probes[i] = (TimSys_Probe_TypeDef) {0};
+	}
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief probe statistics
+ */
+const TimSys_Probe_TypeDef *TimSys_Probe(TimSys_ProbeId_TypeDef id)
+{
+	return (id < PROF_PROBES) ? probes + id : NULL;
+}
+
+/**
+ * @brief compose the report line of the probe: count, min/mean/max [usec] and the histogram counts
+ *
+ * @param id
+ * @param mess destination buffer (160 chars for the whole line)
+ * @param size buffer size, the line is truncated to size - 1 chars
+ * @return mess
+ */
+char *TimSys_ProfReport(TimSys_ProbeId_TypeDef id, char *mess, uint16_t size)
+{
+	TimSys_Probe_TypeDef p;
+
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+
+	p = probes[id]; // copia coerente, le sonde delle ISR possono aggiornarsi durante la stampa
+
+	__set_PRIMASK(primask);
+
+	uint32_t mean = p.count ? p.sum / p.count : 0;
+
+	FmtSink_TypeDef out;
+
+	Fmt_SpanSink(&out, mess, size);
+
+	Fmt_Print(&out, "%-10s n=%lu min/med/max=%lu.%02lu/%lu.%02lu/%lu.%02lu us |", probe_names[id], (unsigned long) p.count,
+				 (unsigned long) (p.min / 1000), (unsigned long) (p.min % 1000 / 10),
+				 (unsigned long) (mean / 1000),  (unsigned long) (mean % 1000 / 10),
+				 (unsigned long) (p.max / 1000), (unsigned long) (p.max % 1000 / 10));
+
+	for (uint8_t i = 0; i < TIMSYS_PROF_BUCKETS; i++)
+	{
+		Fmt_Print(&out, " %lu", (unsigned long) p.hist[i]);
+	}
+
+	Fmt_Print(&out, "\r\n");
+
+	return mess;
+}
+
+/******************************************************************************
+ * LOOP MONITOR
+ *
+ * Sempre attivo: ogni esecuzione di un task da parte di TimSys_Run è un'iterazione del loop principale. Ne sono
+ * registrati durata (istogramma, media, massimo), ritardo dal momento in cui il task è diventato pronto (jitter) e le
+ * iterazioni peggiori con la sorgente: il nome del task, o il tag impostato dal task con TimSys_LoopTag prima di
+ * una chiamata bloccante. Le iterazioni oltre TIMSYS_LOOP_BUDGET incrementano il contatore di avvisi.
+ ******************************************************************************/
+
+static TimSys_LoopStats_TypeDef loop;
+
+static const char *loop_tag; // tag dell'iterazione in corso
+
+static volatile uint8_t running NOINIT; // task in esecuzione, conservato attraverso il reset per il supervisore
+
+/**
+ * @brief record a main loop iteration
+ *
+ * @param tag     source
+ * @param time    duration [usec]
+ * @param latency delay from ready to run [usec]
+ */
+static void LoopRecord(const char *tag, uint32_t time, uint32_t latency)
+{
+	loop.iterations++;
+	loop.sum += time;
+	loop.latency_sum += latency;
+	loop.hist[Log2Bucket(time, TIMSYS_LOOP_BUCKETS)]++;
+
+	if (time > loop.max)         loop.max = time;
+	if (latency > loop.latency_max) loop.latency_max = latency;
+
+	if (time > TIMSYS_LOOP_BUDGET * 1000)
+	{
+		loop.over_budget++;
+	}
+
+	// iterazioni peggiori: una voce per sorgente, ordinate per durata decrescente
+
+	TimSys_LoopWorst_TypeDef *w = loop.worst;
+
+	uint8_t i;
+
+	for (i = 0; i < TIMSYS_LOOP_WORST - 1; i++) // voce della stessa sorgente, o l'ultima
+	{
+		if (w[i].tag == tag || w[i].tag == NULL)
+		{
+			break;
+		}
+	}
+
+	if (w[i].tag != NULL && time <= w[i].time)
+	{
+		return; // non peggiore della voce esistente (o dell'ultima registrata)
+	}
+
+	for (; i > 0 && w[i - 1].time < time; i--) // risale fino alla posizione in ordine
+	{
+		w[i] = w[i - 1];
+	}
+
+	w[i].tag  = tag;
+	w[i].time = time;
+	w[i].tick = HAL_GetTick();
+}
+
+/**
+ * @brief set the source tag of the current main loop iteration, before a blocking call (main loop only)
+ */
+void TimSys_LoopTag(const char *tag)
+{
+	loop_tag = tag;
+}
+
+/**
+ * @brief clear the main loop statistics
+ */
+void TimSys_LoopReset(void)
+{
+	loop = (TimSys_LoopStats_TypeDef) {0};
+}
+
+/**
+ * @brief main loop statistics
+ */
+const TimSys_LoopStats_TypeDef *TimSys_LoopStats(void)
+{
+	return &loop;
+}
+
+/**
+ * @brief compose the one line summary of the main loop, for the console and the parameters SMS
+ *
+ * @param mess destination buffer (64 chars for the whole line)
+ * @param size buffer size
+ * @return mess
+ */
+char *TimSys_LoopReport(char *mess, uint16_t size)
+{
+	Fmt_Snprintf(mess, size, "Loop >%ums: %lu, max %lums (%s)\r\n", TIMSYS_LOOP_BUDGET, (unsigned long) loop.over_budget,
+			(unsigned long) (loop.max / 1000), loop.worst[0].tag ? loop.worst[0].tag : "-");
+
+	return mess;
+}
+
+/******************************************************************************
+ * COOPERATIVE SCHEDULER
+ *
+ * Scheduler run-to-completion: i task registrati sono eseguiti da TimSys_Run, nel loop principale, solo quando
+ * sono pronti. Un task diventa pronto allo scadere del suo timer o quando viene segnalato (TimSys_TaskSignal,
+ * utilizzabile anche dalle ISR).
+ *
+ * I timer sono gestiti con una ruota hashed di TIMSYS_WHEEL_SIZE slot da 1 tick: il timer con scadenza 'expire'
+ * è inserito nello slot expire % TIMSYS_WHEEL_SIZE, per cui ad ogni tick si esamina un solo slot. I timer con
+ * scadenza oltre un giro della ruota restano nello slot finché il confronto con il tick corrente non li fa scadere.
+ * I task pronti sono i bit di una maschera, aggiornata con gli interrupt disabilitati.
+ ******************************************************************************/
+
+static struct {
+	TimSys_Task_TypeDef *task[TIMSYS_MAX_TASKS];
+	TimSys_Task_TypeDef *wheel[TIMSYS_WHEEL_SIZE];
+	uint8_t              count;
+	uint32_t             tick;    // ultimo tick elaborato dalla ruota
+	volatile uint32_t    ready;   // maschera dei task pronti
+} sched;
+
+/**
+ * @brief set the ready bit of the task (ISR safe)
+ */
+static void SetReady(uint8_t id)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+
+	if (!(sched.ready & (1UL << id)))
+	{
+		sched.task[id]->ready_time = TimSys_Micros(); // per il ritardo di esecuzione
+	}
+
+	sched.ready |= (1UL << id);
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief insert the task timer in the wheel slot of its expire tick
+ */
+static void WheelInsert(TimSys_Task_TypeDef *task)
+{
+	TimSys_Task_TypeDef **slot = &sched.wheel[task->expire & (TIMSYS_WHEEL_SIZE - 1)];
+
+	task->next  = *slot;
+	*slot       = task;
+	task->armed = 1;
+}
+
+/**
+ * @brief remove the task timer from the wheel
+ */
+static void WheelRemove(TimSys_Task_TypeDef *task)
+{
+	if (!task->armed)
+	{
+		return;
+	}
+
+	TimSys_Task_TypeDef **p = &sched.wheel[task->expire & (TIMSYS_WHEEL_SIZE - 1)];
+
+	while (*p)
+	{
+		if (*p == task)
+		{
+			*p = task->next;
+			break;
+		}
+
+		p = &(*p)->next;
+	}
+
+	task->next  = NULL;
+	task->armed = 0;
+}
+
+/**
+ * @brief advance the wheel to the current tick: expired timers make their task ready, periodic timers are
+ *        inserted again at the next period
+ */
+static void WheelAdvance(void)
+{
+	uint32_t now   = HAL_GetTick();
+	uint32_t ticks = now - sched.tick;
+
+	if (ticks == 0)
+	{
+		return;
+	}
+
+	if (ticks > TIMSYS_WHEEL_SIZE)
+	{
+		ticks = TIMSYS_WHEEL_SIZE; // un giro completo esamina tutti gli slot
+	}
+
+	for (uint32_t t = 1; t <= ticks; t++)
+	{
+		TimSys_Task_TypeDef **p = &sched.wheel[(sched.tick + t) & (TIMSYS_WHEEL_SIZE - 1)];
+
+		while (*p)
+		{
+			TimSys_Task_TypeDef *task = *p;
+
+			if ((int32_t) (task->expire - now) > 0) // scade in un giro successivo della ruota
+			{
+				p = &task->next;
+				continue;
+			}
+
+			*p          = task->next; // rimuove il timer scaduto
+			task->next  = NULL;
+			task->armed = 0;
+
+			SetReady(task->id);
+
+			if (task->period)
+			{
+				task->expire += task->period;
+
+				if ((int32_t) (task->expire - now) <= 0) // periodi persi: riallinea al tick corrente
+				{
+					task->expire = now + task->period;
+				}
+
+				WheelInsert(task);
+			}
+		}
+	}
+
+	sched.tick = now;
+}
+
+/**
+ * @brief register a task in the scheduler. The task is idle until started or signaled.
+ *
+ * @param task
+ * @param name
+ * @param func  task function, run to completion
+ * @return 0 if the task table is full
+ */
+uint8_t TimSys_TaskRegister(TimSys_Task_TypeDef *task, const char *name, TimSys_TaskFunc func)
+{
+	if (sched.count >= TIMSYS_MAX_TASKS)
+	{
+		return 0;
+	}
+
+	if (sched.count == 0)
+	{
+		sched.tick = HAL_GetTick();
+	}
+
+	task->name     = name;
+	task->func     = func;
+	task->id       = sched.count;
+	task->armed    = 0;
+	task->next     = NULL;
+	task->runs     = 0;
+	task->run_time = 0;
+	task->max_time = 0;
+	task->ready_time = 0;
+
+	sched.task[sched.count++] = task;
+
+	return 1;
+}
+
+/**
+ * @brief start the task timer
+ *
+ * @param task
+ * @param delay  first expire from now [msec] (0 = ready now)
+ * @param period timer period [msec], 0 for a one-shot timer
+ */
+void TimSys_TaskStart(TimSys_Task_TypeDef *task, uint32_t delay, uint32_t period)
+{
+	WheelRemove(task);
+
+	task->period = period;
+	task->expire = HAL_GetTick() + delay;
+
+	if (delay == 0)
+	{
+		SetReady(task->id);
+
+		if (period == 0)
+		{
+			return;
+		}
+
+		task->expire += period;
+	}
+
+	WheelInsert(task);
+}
+
+/**
+ * @brief stop the task timer, a pending ready state is cleared
+ */
+void TimSys_TaskStop(TimSys_Task_TypeDef *task)
+{
+	WheelRemove(task);
+
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+
+	sched.ready &= ~(1UL << task->id);
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief make the task ready: the task runs at the next scheduler cycle. Can be called from ISR.
+ */
+void TimSys_TaskSignal(TimSys_Task_TypeDef *task)
+{
+	if (task->func) // task registrato
+	{
+		SetReady(task->id);
+	}
+}
+
+/**
+ * @brief scheduler cycle: advance the timer wheel and run the highest priority ready task, to completion
+ *
+ * @return 1 if a task was run, 0 if nothing was due (the caller can idle)
+ */
+uint8_t TimSys_Run(void)
+{
+	WheelAdvance();
+
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+
+	uint32_t ready = sched.ready;
+
+	if (ready == 0)
+	{
+		__set_PRIMASK(primask);
+
+		return 0;
+	}
+
+	uint8_t id = __builtin_ctz(ready); // task pronto a priorità maggiore
+
+	sched.ready &= ~(1UL << id);
+
+	__set_PRIMASK(primask);
+
+	TimSys_Task_TypeDef *task = sched.task[id];
+
+	uint32_t start = TimSys_Micros();
+
+	loop_tag = task->name;
+	running  = id;
+
+	task->func();
+
+	running  = 0xFF;
+
+	uint32_t elapsed = TimSys_MicrosElapsed(start);
+
+	LoopRecord(loop_tag, elapsed, start - task->ready_time);
+
+	task->runs++;
+	task->run_time += elapsed;
+
+	if (elapsed > task->max_time)
+	{
+		task->max_time = elapsed;
+	}
+
+	return 1;
+}
+
+/**
+ * @brief time to the first timer expire, for the idle sleep. Call with interrupts disabled, so that a task
+ *        signaled by an ISR after the check wakes up the sleep.
+ *
+ * @return 0 if a task is ready, UINT32_MAX if no timer is armed [msec]
+ */
+uint32_t TimSys_NextDeadline(void)
+{
+	if (sched.ready)
+	{
+		return 0;
+	}
+
+	uint32_t now  = HAL_GetTick();
+	uint32_t next = UINT32_MAX;
+
+	for (uint8_t i = 0; i < sched.count; i++)
+	{
+		TimSys_Task_TypeDef *task = sched.task[i];
+
+		if (!task->armed)
+		{
+			continue;
+		}
+
+		int32_t left = (int32_t) (task->expire - now);
+
+		if (left <= 0)
+		{
+			return 0;
+		}
+
+		if ((uint32_t) left < next)
+		{
+			next = left;
+		}
+	}
+
+	return next;
+}
+
+/**
+ * @brief number of registered tasks
+ */
+uint8_t TimSys_TaskCount(void)
+{
+	return sched.count;
+}
+
+/**
+ * @brief id of the task being run, 0xFF if none. Before the first scheduler cycle it is the task that was
+ *        running at the last reset (no-init RAM).
+ */
+uint8_t TimSys_Running(void)
+{
+	return running;
+}
+
+/**
+ * @brief registered task, for the run-time statistics
+ */
+TimSys_Task_TypeDef *TimSys_Task(uint8_t id)
+{
+	return (id < sched.count) ? sched.task[id] : NULL;
+}
@@ -6,38 +6,81 @@
  * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
  */
 
-#include "stm32_lib_usart.h"
+#include "usart_callback.h"
+#include "SIM800L.h"
+#include "ac_app.h"
+#include "console.h"
+
+#define PROFILE_DUMP_KEY 0x10 // CTRL+P dal terminale: elenca le statistiche di profiling
+#define BRIDGE_KEY       0x02 // CTRL+B dal terminale: attiva/disattiva il bridge DMA console <-> modem
 
 /**
- * @fn void USART1_RxCpltCallback(UART_HandleTypeDef*)
- * @brief  RECEIVING CHARACTER FROM SIM800L GSM MODULE
+ * @fn void USART1_RxCplt(UART_HandleTypeDef*)
+ * @brief  RECEIVING CHARACTER FROM SIM800L GSM MODULE: il carattere resta nella fifo per il parser del modem, l'eco
+ *         sul terminale è attiva solo con MODEM MONITOR ON, per non mescolare il traffico del modem con la console e
+ *         con la telemetria.
  *
  * @param huart
  */
-void USART1_RxCpltCallback(UART_HandleTypeDef *huart)
+static void USART1_RxCplt(UART_HandleTypeDef *huart)
 {
-	char ch;
+	if (Console_ModemMonitor())
+	{
+		USART_WriteChar(USART_2, USART_RxChar(USART_1));
+	}
 
-	Fifo_TypeDef *rxfifo = USART_RxFifo(USART_1);
+	TimSys_TaskSignal(SIM800L_Task()); // dati dal modem: esegue subito la macchina a stati
+};
 
-	ch_fifo_get(rxfifo, &ch);
+/**
+ * @fn void USART2_RxCplt(UART_HandleTypeDef*)
+ * @brief RECEIVING CHARACTER FROM SERIAL TERMINAL: il carattere resta nella fifo per il parser della console, i tasti
+ *        di controllo sono gestiti subito (il parser li ignora). Il tasto è il carattere appena ricevuto, non l'ultimo
+ *        della fifo: con la fifo piena sarebbe un carattere precedente.
+ *
+ * @param huart
+ */
+static void USART2_RxCplt(UART_HandleTypeDef *huart)
+{
+	char ch = USART_RxChar(USART_2);
+
+	if (ch == PROFILE_DUMP_KEY)
+	{
+		Console_ProfileDump();
+		return;
+	}
+
+	if (ch == BRIDGE_KEY)
+	{
+		App_Bridge();
+		return;
+	}
 
-	USART_WriteChar(USART_2, ch);
+	TimSys_TaskSignal(Console_Task()); // comando della console
 };
 
 /**
- * @fn void USART2_RxCpltCallback(UART_HandleTypeDef*)
- * @brief RECEIVING CHARACTER FROM SERIAL TERMINAL
+ * @fn void USART2_BridgeRx(const char*, uint16_t)
+ * @brief blocco ricevuto dal terminale durante il bridge DMA, già inoltrato al modem: cerca solo il tasto di uscita
  *
- * @param huart
+ * @param data
+ * @param len
  */
-void USART2_RxCpltCallback(UART_HandleTypeDef *huart)
+static void USART2_BridgeRx(const char *data, uint16_t len)
 {
-	char ch;
+	if (memchr(data, BRIDGE_KEY, len))
+	{
+		App_Bridge();
+	}
+}
 
-	Fifo_TypeDef *rxfifo = USART_RxFifo(USART_2);
+// Callbacks delle porte, registrate con USART_SetHandle: i membri NULL non sono chiamati ------------------------------------
 
-	ch_fifo_pop(rxfifo, &ch);
+const USART_Callbacks_TypeDef USART1_Callbacks = {
+	.RxCplt = USART1_RxCplt,
+};
 
-	USART_WriteChar(USART_1, ch); // send char to gsm module
+const USART_Callbacks_TypeDef USART2_Callbacks = {
+	.RxCplt   = USART2_RxCplt,
+	.BridgeRx = USART2_BridgeRx,
 };
@@ -14,5 +14,14 @@
 #define CALL_INACTIVITY_TIMEOUT 25000
 #define HANGUP_TIMEOUT			5000
 #define MAX_NUM_LENGTH          32
+#define MAX_SMS_LENGTH          512     // lunghezza massima di un SMS
+#define AT_DELAY                200     // [msec] attesa dopo il completamento di un comando AT
+#define GSM_RESET_PULSE         200     // [msec] impulso di reset del modulo (minimo 105 msec)
+
+#define GSM_BAUD_NEGOTIATE      1       // 1: all'avvio porta il collegamento col modulo a GSM_BAUD_TARGET (AT+IPR)
+#define GSM_BAUD_TARGET         115200  // velocità negoziata, memorizzata nel modulo (AT&W)
+#define GSM_BAUD_DEFAULT        9600    // velocità di fabbrica del modulo (autobaud) e di ripiego
+#define GSM_BAUD_SYNC_TRIES     3       // AT senza risposta prima di provare la velocità successiva
+#define GSM_LINK_TIMEOUT        1000    // [msec] attesa della risposta ad AT e AT+IPR durante la negoziazione
 
 #endif /* INC_SIM800L_DEF_H_ */
@@ -11,9 +11,10 @@
 #define SRC_SIM800L_H_
 
 #include "SIM800L.def.h"
+#include "timsys.h"
 
 #define MAX_AT_LENGTH           64  // lunghezza massima di un comando AT
-#define MAX_SMS_LENGTH          512 // lunghezza massima di un SMS
+#define GSM_TASK_PERIOD         5   // periodo del task del modem [msec]
 
 typedef enum {
 
@@ -61,8 +62,28 @@ typedef struct {
 
 } SMS_TypeDef;
 
-void SIM800L_Init(void);
+/**
+ * @struct
+ * @brief stato del modem conservato per il riavvio a caldo (restart.h)
+ *
+ */
+typedef struct {
+
+	uint8_t configured;	// coda di inizializzazione completata
+	uint8_t status;		// GSMStatus_TypeDef al salvataggio
+	uint8_t signal;
+	uint32_t baud;		// velocità del collegamento col modulo, 0 se non nota
+	char    imei[16];
+	char    operator[64];
+
+	PhonebookEntry_TypeDef phonebook[PHONE_MAX - 1];
+
+} GSMWarmState_TypeDef;
+
+void SIM800L_Init(const GSMWarmState_TypeDef *warm);
+void SIM800L_Recover(void);
 void SIM800L_HangUp(void);
+void SIM800L_Suspend(uint8_t suspend);
 void SIM800L_SM_Exec(void);
 void SIM800L_SetClipNumber(char *number);
 char *SIM800L_GetClipNumber(void);
@@ -71,8 +92,10 @@ void SIMM800L_SMS2PhoneNumber(char *num, char *mess);
 uint8_t SIMM800L_Schedule_AddPhonebookEntry(char * num, PhonebookIdEntry_TypeDef entry);
 uint8_t SIMM800L_Schedule_DelPhonebookEntry(PhonebookIdEntry_TypeDef entry);
 void SIM800L_Schedule_Call_Phonebook_Entries(void);
+void SIM800L_Schedule_Call_Phonebook_From(PhonebookIdEntry_TypeDef first);
 void SIMM800L_Schedule_SMS(SMS_TypeDef *sms);
 void SIMM800L_Schedule_SMS_Get_Params(SMS_TypeDef *sms);
+void SIMM800L_Schedule_SMS_Report(SMS_TypeDef *sms);
 PhonebookEntry_TypeDef *GetPhonebook(void);
 uint8_t SetPhonebookEntry(char *num, PhonebookIdEntry_TypeDef entry);
 uint8_t SIMM800L_CallPhonebookEntry(PhonebookIdEntry_TypeDef entry);
@@ -81,5 +104,8 @@ void SetBattCharge(uint8_t perc);
 void SetVBatt(float volt);
 uint8_t GSM_Calling(void);
 GSMStatus_TypeDef GSM_Status(void);
+void SIM800L_SaveState(GSMWarmState_TypeDef *state);
+TimSys_Task_TypeDef *SIM800L_Task(void);
+char *SIM800L_StatusReport(char *mess, uint16_t size);
 
 #endif /* SRC_SIM800L_H_ */
@@ -10,10 +10,14 @@
 #ifndef AC_APP_H_
 #define AC_APP_H_
 
-void WatchdogRefresh(void);
+#include "main.h"
 
 void App_Start(void);
 
+void App_Bridge(void);
+
+uint8_t App_BridgeStop(void);
+
 char* App_Version(void);
 
 char *App_BuildDate(void);
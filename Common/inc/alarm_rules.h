@@ -0,0 +1,57 @@
+/*
+ * alarm_rules.h
+ *
+ *  Created on:
+ *      Author: Ing. Salvatore Cerami
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ */
+
+#ifndef INC_ALARM_RULES_H_
+#define INC_ALARM_RULES_H_
+
+#include "main.h"
+
+// Defines ----------------------------------------------------------------------
+
+#define RULES_HISTORY_SIZE		16			// campioni nella finestra di regressione (storia breve)
+#define RULES_MIN_SAMPLES		4			// campioni minimi per stimare la pendenza
+
+// Types definition ---------------------------------------------------------------
+
+/**
+ * @enum
+ * @brief regole attive (maschera di bit)
+ *
+ */
+typedef enum {
+	RULE_NONE		  = 0x00,	/**< nessuna regola attiva */
+	RULE_LOW		  = 0x01,	/**< temperatura sotto la soglia bassa */
+	RULE_HIGH		  = 0x02,	/**< temperatura sopra la soglia alta */
+	RULE_PREDICT_LOW  = 0x04,	/**< soglia bassa raggiunta entro l'orizzonte di previsione */
+	RULE_PREDICT_HIGH = 0x08,	/**< soglia alta raggiunta entro l'orizzonte di previsione */
+} AlarmRule_TypeDef;
+
+/**
+ * @struct
+ * @brief configurazione delle regole di allarme
+ *
+ */
+typedef struct {
+	float    low;			// soglia bassa [°C]
+	float    low_hyst;		// isteresi di rientro della soglia bassa [°C]
+	float    high;			// soglia alta [°C]
+	float    high_hyst;		// isteresi di rientro della soglia alta [°C]
+	uint8_t  high_enabled;	// abilita la soglia alta
+	uint32_t horizon;		// orizzonte di previsione [s] (0 = allarme predittivo disabilitato)
+} AlarmRulesConfig_TypeDef;
+
+// exported functions prototype ---------------------------------------------------
+
+uint8_t  Rules_Exec(const AlarmRulesConfig_TypeDef *cfg, float temp, uint32_t tick);
+uint8_t  Rules_Active(void);
+float    Rules_Slope(void);
+uint32_t Rules_CrossingTime(void);
+void     Rules_Reset(void);
+
+#endif /* INC_ALARM_RULES_H_ */
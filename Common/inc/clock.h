@@ -0,0 +1,44 @@
+/*
+ * clock.h
+ *
+ *  Created on:
+ *      Author: Ing. Salvatore Cerami
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ */
+
+#ifndef INC_CLOCK_H_
+#define INC_CLOCK_H_
+
+#include "main.h"
+
+// Defines ----------------------------------------------------------------------
+
+#define CLOCK_HSE_FREQ			25000000	// quarzo HSE [Hz]
+#define CLOCK_ADC_FREQ			6250000		// clock massimo dell'ADC, tempi di campionamento di sm_adc [Hz]
+#define CLOCK_IDLE_TIME			5000		// inattività prima di passare al profilo a basso consumo [msec]
+
+// Types definition ---------------------------------------------------------------
+
+/**
+ * @enum
+ * @brief profili di clock
+ *
+ */
+typedef enum {
+	CLOCK_PERFORMANCE = 0,	/**< PLL a 100 MHz, 3 wait state, prefetch e cache */
+	CLOCK_DEFAULT     = 1,	/**< HSE a 25 MHz, senza PLL (configurazione di SystemClock_Config) */
+	CLOCK_LOW_POWER   = 2,	/**< HSE / 4 = 6.25 MHz, per l'idle */
+	CLOCK_PROFILES
+} ClockProfile_TypeDef;
+
+// exported functions prototype ---------------------------------------------------
+
+uint8_t              Clock_SetProfile(ClockProfile_TypeDef profile);
+ClockProfile_TypeDef Clock_Profile(void);
+void                 Clock_Resume(void);
+const char          *Clock_ProfileName(ClockProfile_TypeDef profile);
+uint32_t             Clock_RunCurrent(void);
+uint32_t             Clock_SleepCurrent(void);
+
+#endif /* INC_CLOCK_H_ */
@@ -0,0 +1,32 @@
+/*
+ * console.h
+ *
+ *  Created on:
+ *      Author: Ing. Salvatore Cerami
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ */
+
+#ifndef INC_CONSOLE_H_
+#define INC_CONSOLE_H_
+
+#include "main.h"
+#include "timsys.h"
+
+// Defines ----------------------------------------------------------------------
+
+#define CONSOLE_PROMPT			"> "
+#define CONSOLE_LINE_LENGTH		160			// riga più lunga di un elenco (USART_StatsReport)
+#define CONSOLE_DUMP_DELAY		5			// [msec] attesa di spazio nella coda di trasmissione durante un elenco
+#define CONSOLE_HISTORY_MAX		100			// campioni elencati al massimo da HISTORY n
+
+// exported functions prototype ---------------------------------------------------
+
+void Console_Init(void);
+void Console_ProfileDump(void);
+
+uint8_t Console_ModemMonitor(void);
+
+TimSys_Task_TypeDef *Console_Task(void);
+
+#endif /* INC_CONSOLE_H_ */
@@ -0,0 +1,66 @@
+/*
+ * datalog.h
+ *
+ *  Created on:
+ *      Author: Ing. Salvatore Cerami
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ */
+
+#ifndef INC_DATALOG_H_
+#define INC_DATALOG_H_
+
+#include "main.h"
+
+// Defines ----------------------------------------------------------------------
+
+#define DATALOG_SECTORS				2				// settori di flash del log, gestiti a ring
+#define DATALOG_SECTOR_SIZE			0x20000			// 128 KB
+#define DATALOG_ADDRESS				0x08040000		// settore 6, dopo DATA_CFG_ADDRESS (settore 5)
+#define DATALOG_FIRST_SECTOR		FLASH_SECTOR_6
+#define DATALOG_INDEX_STEP			2048			// distanza tra due punti dell'indice temporale [byte]
+#define DATALOG_ERASE_WATERMARK		(DATALOG_SECTOR_SIZE * 3 / 4) // oltre questo riempimento il settore successivo viene cancellato in anticipo
+#define DATALOG_READING_TIME		60000			// intervallo minimo di registrazione delle letture [msec]
+
+// Types definition ---------------------------------------------------------------
+
+/**
+ * @enum
+ * @brief tipo di record
+ *
+ */
+typedef enum {
+	DL_READING       = 1,	/**< lettura della temperatura, arg = centesimi di grado */
+	DL_ALARM         = 2,	/**< allarme attivato, arg = regole attive */
+	DL_CALL          = 3,	/**< chiamate di allarme avviate */
+	DL_ACK           = 4,	/**< allarme disabilitato dall'utente */
+	DL_WATCHDOG      = 5,	/**< avvio dopo un reset del watchdog, arg = task in ritardo + 1 (supervisor.h), 0 = loop bloccato */
+	DL_BOOT          = 6,	/**< avvio, arg = flag di reset RCC_CSR */
+	DL_FAULT         = 7,	/**< avvio dopo un'eccezione o Error_Handler, arg = PC catturato (fault.h) */
+} DataLogType_TypeDef;
+
+/**
+ * @struct
+ * @brief record decodificato
+ *
+ */
+typedef struct {
+	DataLogType_TypeDef type;
+	uint32_t            time;	// tempo del log [s]
+	int32_t             arg;
+} DataLogRecord_TypeDef;
+
+typedef void (*DataLog_Callback)(const DataLogRecord_TypeDef *record);
+
+// exported functions prototype ---------------------------------------------------
+
+void     DataLog_Init(void);
+void     DataLog_Exec(uint8_t idle);
+uint8_t  DataLog_Reading(float temp);
+uint8_t  DataLog_Event(DataLogType_TypeDef type, int32_t arg);
+uint32_t DataLog_Read(uint32_t from, uint32_t to, DataLog_Callback callback);
+uint32_t DataLog_Time(void);
+uint32_t DataLog_Used(void);
+uint32_t DataLog_Dropped(void);
+
+#endif /* INC_DATALOG_H_ */
@@ -0,0 +1,74 @@
+/*
+ * fault.h
+ *
+ *  Created on:
+ *      Author: Ing. Salvatore Cerami
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ */
+
+#ifndef INC_FAULT_H_
+#define INC_FAULT_H_
+
+#include "main.h"
+#include "timsys.def.h"
+
+// Defines ----------------------------------------------------------------------
+
+#define FAULT_MAGIC				0x464C5452	// "FLTR": record della RAM no-init valido
+#define FAULT_REPORT_SMS		1			// 1: il rapporto di un reset anomalo è inviato anche via SMS al primo numero della rubrica
+#define FAULT_REPORT_LENGTH		480			// lunghezza massima del rapporto (entro MAX_SMS_LENGTH)
+
+// Types definition ---------------------------------------------------------------
+
+/**
+ * @enum
+ * @brief causa del reset, dai flag di RCC_CSR e dal record della RAM no-init
+ *
+ */
+typedef enum {
+	FAULT_RESET_POWER = 0,	/**< accensione o brown-out: i contatori ripartono da zero */
+	FAULT_RESET_PIN,		/**< reset esterno (NRST) */
+	FAULT_RESET_WATCHDOG,	/**< IWDG o WWDG */
+	FAULT_RESET_SOFTWARE,	/**< reset software richiesto (Restart_SystemReset) */
+	FAULT_RESET_HARDFAULT,	/**< eccezione della CPU catturata da Fault_HardFault */
+	FAULT_RESET_ERROR,		/**< Error_Handler */
+	FAULT_RESET_LOWPOWER,	/**< ingresso illegale in Standby/Stop */
+	FAULT_RESET_CAUSES
+} FaultReset_TypeDef;
+
+/**
+ * @struct
+ * @brief stato catturato al momento dell'eccezione o dell'errore
+ *
+ */
+typedef struct {
+	uint32_t r0, r1, r2, r3, r12;
+	uint32_t lr;							// registri salvati sullo stack dall'eccezione
+	uint32_t pc;							// istruzione che ha generato l'eccezione, chiamante di Error_Handler
+	uint32_t psr;
+	uint32_t exc_return;
+	uint32_t cfsr;							// Configurable Fault Status Register (MMFSR | BFSR | UFSR)
+	uint32_t hfsr;							// HardFault Status Register
+	uint32_t bfar;							// indirizzo del bus fault, valido se CFSR.BFARVALID
+	uint32_t mmfar;							// indirizzo del memory fault, valido se CFSR.MMARVALID
+	uint32_t tick;							// [msec] dall'avvio
+	uint8_t  gsm;							// GSMStatus_TypeDef
+	uint8_t  alarm;							// AlarmSMStatus_TypeDef
+	uint8_t  running;						// id del task dello scheduler in esecuzione
+	uint32_t probe[PROF_PROBES];			// ultime durate delle sonde di profiling [nsec]
+} FaultCapture_TypeDef;
+
+// exported functions prototype ---------------------------------------------------
+
+void        Fault_Init(void);
+void        Fault_HardFault(uint32_t *frame, uint32_t exc_return);
+void        Fault_Error(uint32_t pc);
+
+FaultReset_TypeDef          Fault_LastReset(void);
+const FaultCapture_TypeDef *Fault_Captured(void);
+uint32_t                    Fault_ResetCount(FaultReset_TypeDef cause);
+const char                 *Fault_ResetName(FaultReset_TypeDef cause);
+char                       *Fault_Report(char *mess, uint16_t size);
+
+#endif /* INC_FAULT_H_ */
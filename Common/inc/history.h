@@ -0,0 +1,56 @@
+/*
+ * history.h
+ *
+ *  Created on:
+ *      Author: Ing. Salvatore Cerami
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ */
+
+#ifndef INC_HISTORY_H_
+#define INC_HISTORY_H_
+
+#include "main.h"
+
+// Defines ----------------------------------------------------------------------
+
+#define HISTORY_SIZE			1024		// campioni nel ring della storia (4 byte per campione)
+#define HISTORY_TICK_UNIT		100			// risoluzione del delta tra due campioni [msec]
+#define HISTORY_REPORT_TIME		3600000		// intervallo del report periodico sulla console [msec]
+
+// Types definition ---------------------------------------------------------------
+
+/**
+ * @enum
+ * @brief finestre mobili delle statistiche
+ *
+ */
+typedef enum {
+	HW_1H  = 0,		/**< ultima ora */
+	HW_24H = 1,		/**< ultime 24 ore */
+	HW_7D  = 2,		/**< ultimi 7 giorni */
+	HW_MAX,
+} HistoryWindow_TypeDef;
+
+/**
+ * @struct
+ * @brief statistiche di una finestra
+ *
+ */
+typedef struct {
+	uint32_t count;		// campioni nella finestra
+	float    min;		// [°C]
+	float    max;		// [°C]
+	float    mean;		// [°C]
+	float    variance;	// [°C^2]
+} HistoryStats_TypeDef;
+
+// exported functions prototype ---------------------------------------------------
+
+void     History_Add(float temp, uint32_t tick);
+uint8_t  History_Stats(HistoryWindow_TypeDef window, HistoryStats_TypeDef *stats);
+uint16_t History_Count(void);
+uint8_t  History_Get(uint16_t age, float *temp, uint32_t *tick);
+char    *History_Report(char *mess, uint16_t size);
+
+#endif /* INC_HISTORY_H_ */
@@ -12,11 +12,14 @@
 
 #include "main.h"
 
-// _STM32F072 valore di riferimento interno di calibrazione della tensione
-#define ADC_VREFINT ( *(uint16_t*)((uint32_t)0x1FFFF7BA) ) // Internal Reference Voltage for VDDA Calibration (VREFINT_CAL)
+// STM32F411 valori di calibrazione di fabbrica (system memory), acquisiti con VDDA = 3.3V
 
-// STM32F446 valore di riferimento della tensione
-// #define VREFINT ( (uint16_t*)((uint32_t)0x1FFF7A2A) )
+#define ADC_VREFINT  ( *(uint16_t*)((uint32_t)0x1FFF7A2A) ) // Internal Reference Voltage for VDDA Calibration (VREFINT_CAL)
+#define ADC_TS_CAL1  ( *(uint16_t*)((uint32_t)0x1FFF7A2C) ) // Temperature sensor value acquired at 30 C° (TS_CAL1)
+#define ADC_TS_CAL2  ( *(uint16_t*)((uint32_t)0x1FFF7A2E) ) // Temperature sensor value acquired at 110 C° (TS_CAL2)
+
+#define ADC_TS_CAL1_TEMP 30.0f
+#define ADC_TS_CAL2_TEMP 110.0f
 
 #define ADC_VDD 3.3
 #define ADC_NORMALIZE(adc_value,adc_full_scale) ( ( (float)(adc_value) )/(adc_full_scale) )
@@ -25,6 +28,8 @@
 uint16_t ADC_GetFullScale(ADC_HandleTypeDef *hadc);
 float   ADC_Normalize(uint16_t adc_value, uint16_t adc_full_scale);
 float   ADC_CalcCalibratedVDDA(uint32_t adc_vrefint);
+float   ADC_CalcTempSensor(uint32_t adc_ts, float vdda);
+uint16_t ADC_Compensate(uint32_t adc_value, float vdda, float vref, uint16_t adc_full_scale);
 float   ADC_Rntc_Val(uint32_t adc_value, uint16_t Rc, uint16_t adc_fullscale);
 
 #endif /* ADC_LIB_H_ */
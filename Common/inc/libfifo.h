@@ -24,5 +24,7 @@ void    ch_fifo_init(Fifo_TypeDef *fifo, char *buffer, uint16_t buffersize);
 uint8_t ch_fifo_push(Fifo_TypeDef *fifo, char ch);
 uint8_t ch_fifo_pop(Fifo_TypeDef *fifo, char *ch);
 uint8_t ch_fifo_get(Fifo_TypeDef *fifo, char *ch);
+uint16_t ch_fifo_span(Fifo_TypeDef *fifo, char **data);
+void    ch_fifo_discard(Fifo_TypeDef *fifo, uint16_t len);
 
 #endif /* SRC_LIBFIFO_H_ */
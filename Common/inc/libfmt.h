@@ -0,0 +1,51 @@
+/*
+ * libfmt.h
+ *
+ *  Created on:
+ *      Author: Ing. Salvatore Cerami
+ *
+ *  @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ */
+
+#ifndef INC_LIBFMT_H_
+#define INC_LIBFMT_H_
+
+#include <stdarg.h>
+#include "libfifo.h"
+
+// Defines ----------------------------------------------------------------------
+
+#define FMT_FLOAT_PRECISION		1			// cifre decimali di %f senza precisione esplicita
+#define FMT_FLOAT_MAX_PRECISION	3			// massimo delle cifre decimali di %f
+
+// Types definition ---------------------------------------------------------------
+
+typedef void (*Fmt_Flush)(void *arg);
+
+/**
+ * @struct
+ * @brief destinatario della formattazione: un buffer lineare (span) o una FIFO
+ *
+ */
+typedef struct {
+	char         *buffer;		// span: buffer lineare
+	uint16_t      size;			// span: dimensione del buffer, terminatore compreso
+	Fifo_TypeDef *fifo;			// FIFO: coda dei caratteri, NULL se il destinatario è un buffer lineare
+	Fmt_Flush     flush;		// FIFO: svuota la coda piena, NULL se i caratteri in eccesso vanno scartati
+	void         *arg;			// FIFO: argomento di flush
+	uint16_t      len;			// caratteri scritti
+	uint16_t      lost;			// caratteri scartati per mancanza di spazio
+} FmtSink_TypeDef;
+
+// exported functions prototype ---------------------------------------------------
+
+void     Fmt_SpanSink(FmtSink_TypeDef *sink, char *buffer, uint16_t size);
+void     Fmt_FifoSink(FmtSink_TypeDef *sink, Fifo_TypeDef *fifo, Fmt_Flush flush, void *arg);
+
+uint16_t Fmt_VPrint(FmtSink_TypeDef *sink, const char *fmt, va_list ap);
+uint16_t Fmt_Print(FmtSink_TypeDef *sink, const char *fmt, ...);
+
+uint16_t Fmt_VSnprintf(char *buffer, uint16_t size, const char *fmt, va_list ap);
+uint16_t Fmt_Snprintf(char *buffer, uint16_t size, const char *fmt, ...);
+
+#endif /* INC_LIBFMT_H_ */
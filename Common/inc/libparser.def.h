@@ -17,7 +17,7 @@ typedef enum {
   PARSER_4 = 3,
 } ParserId_TypeDef;
 
-#define MAXPARSER 1
+#define MAXPARSER 2
 
 #define CMD_LEN  128
 #define BUF_LEN  128
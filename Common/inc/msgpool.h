@@ -0,0 +1,57 @@
+/*
+ * msgpool.h
+ *
+ *  Created on:
+ *      Author: Ing. Salvatore Cerami
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ */
+
+#ifndef INC_MSGPOOL_H_
+#define INC_MSGPOOL_H_
+
+#include "main.h"
+
+// Defines ----------------------------------------------------------------------
+
+#define MSGPOOL_BLOCKS			3		// blocchi del pool: un SMS in trasmissione, fino a due in composizione o in coda
+#define MSGPOOL_BLOCK_SIZE		544		// dimensione di un blocco [byte]: contiene un SMS_TypeDef (numero + testo)
+
+// Types definition ---------------------------------------------------------------
+
+/**
+ * @enum
+ * @brief proprietario di un blocco: il blocco passa da un proprietario all'altro con MsgPool_Handoff e viene
+ *        rilasciato dall'ultimo
+ *
+ */
+typedef enum {
+	MSG_FREE = 0,		/**< blocco libero */
+	MSG_SMS_BUILD,		/**< SMS in composizione */
+	MSG_SMS_QUEUED,		/**< SMS in coda nello scheduler del modem */
+	MSG_SMS_TX,			/**< SMS in trasmissione al modem */
+	MSG_OWNERS
+} MsgOwner_TypeDef;
+
+/**
+ * @struct
+ * @brief statistiche del pool
+ *
+ */
+typedef struct {
+	uint8_t  used;						// blocchi in uso
+	uint8_t  high_water;				// massimo dei blocchi in uso dall'avvio
+	uint32_t allocs;
+	uint32_t failures;					// richieste non soddisfatte: pool esaurito
+	uint8_t  owners[MSG_OWNERS];		// blocchi in uso per proprietario
+} MsgPoolStats_TypeDef;
+
+// exported functions prototype ---------------------------------------------------
+
+void *MsgPool_Alloc(MsgOwner_TypeDef owner);
+void  MsgPool_Handoff(void *block, MsgOwner_TypeDef owner);
+void  MsgPool_Free(void *block);
+void  MsgPool_Stats(MsgPoolStats_TypeDef *stats);
+char *MsgPool_Report(char *mess, uint16_t size);
+
+#endif /* INC_MSGPOOL_H_ */
@@ -69,6 +69,7 @@ void NTC_Init(uint16_t *adc_resFullScale);
 float NTC_ABDTemp(struct NTC *ntc, uint32_t adc_value, uint16_t adc_fullscale);
 float NTC_BTemp(struct NTC *ntc, uint32_t adc_value, uint16_t adc_fullscale);
 float NTC_Temp(enum NTC_ID ntc, uint32_t adc_value);
+uint32_t NTC_AdcValue(enum NTC_ID ntc, float temp);
 
 struct NTC NTC_Get(enum NTC_ID ntc);
 void NTC_Set(enum NTC_ID ntc,struct NTC *ntcparam);
@@ -13,6 +13,8 @@
     #include "main.h"
     #include "libparser.h"
 
+    #define PARSER_DTMF_LENGTH 64 // sequenza DTMF più lunga: *X*Num** con un numero di MAX_NUM_LENGTH cifre
+
 	typedef enum {
 		ATR_NONE = PR_MAX,  // do not overlap PR_XXX value
 		ATR_OK,
@@ -0,0 +1,48 @@
+/*
+ * power.h
+ *
+ *  Created on:
+ *      Author: Ing. Salvatore Cerami
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ */
+
+#ifndef INC_POWER_H_
+#define INC_POWER_H_
+
+#include "main.h"
+
+// Defines ----------------------------------------------------------------------
+
+#define POWER_STOP_MODE			0			// 1 = abilita lo Stop mode (vedi power.c: la ricezione UART non risveglia la CPU)
+#define POWER_MAX_SLEEP			20000		// sonno massimo [msec], entro il budget del watchdog (~32 s)
+#define POWER_STOP_MIN_TIME		50			// sonno minimo per entrare in Stop mode [msec]
+#define POWER_TICKLESS_MIN		2			// sonno minimo per sospendere il tick di sistema [msec]
+#define POWER_LSI_FREQ			32000		// frequenza nominale LSI, clock dell'RTC [Hz]
+
+#define POWER_STOP_CURRENT		120			// corrente stimata in Stop [uA], run e Sleep dipendono dal profilo di clock (clock.c)
+
+// Types definition ---------------------------------------------------------------
+
+/**
+ * @struct
+ * @brief statistiche di consumo dall'avvio
+ *
+ */
+typedef struct {
+	uint32_t total;		// tempo dall'avvio [msec]
+	uint32_t sleep;		// tempo in Sleep (WFI) [msec]
+	uint32_t stop;		// tempo in Stop [msec]
+	uint32_t wakeups;	// risvegli
+	float    duty;		// frazione di tempo in run [%]
+	float    current;	// corrente media stimata [mA]
+} PowerStats_TypeDef;
+
+// exported functions prototype ---------------------------------------------------
+
+void Power_Init(void);
+void Power_Idle(uint8_t stop_allowed);
+void Power_Stats(PowerStats_TypeDef *stats);
+void Power_RtcWakeupIRQHandler(void);
+
+#endif /* INC_POWER_H_ */
@@ -0,0 +1,52 @@
+/*
+ * restart.h
+ *
+ *  Created on:
+ *      Author: Ing. Salvatore Cerami
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ */
+
+#ifndef INC_RESTART_H_
+#define INC_RESTART_H_
+
+#include "main.h"
+#include "SIM800L.h"
+#include "sm_alarm.h"
+
+// Defines ----------------------------------------------------------------------
+
+#define RESTART_MAGIC				0x57524D53	// "WRMS": record della RAM no-init valido
+#define RESTART_SAVE_PERIOD			1000		// periodo di aggiornamento dello stato salvato [msec]
+#define RESTART_MAX_WARM			3			// riavvii a caldo consecutivi prima di forzare un avvio a freddo
+#define RESTART_STABLE_TIME			600000		// funzionamento senza reset che azzera il conteggio dei riavvii a caldo [msec]
+
+// Types definition ---------------------------------------------------------------
+
+/**
+ * @enum
+ * @brief causa del riavvio
+ *
+ */
+typedef enum {
+	RESTART_COLD = 0,	/**< accensione, brown-out o reset esterno: stato non disponibile */
+	RESTART_WATCHDOG,	/**< reset dell'IWDG */
+	RESTART_PANIC,		/**< il modem non si è liberato per la notifica dell'allarme (PANIC_TIMEOUT) */
+	RESTART_REMOTE,		/**< reset richiesto con il tono DTMF #0# */
+	RESTART_SOFTWARE,	/**< altro reset software */
+	RESTART_CAUSES
+} Restart_Cause_TypeDef;
+
+// exported functions prototype ---------------------------------------------------
+
+void    Restart_Init(void);
+uint8_t Restart_Warm(void);
+void    Restart_SystemReset(Restart_Cause_TypeDef cause);
+void    Restart_Discard(void);
+
+Restart_Cause_TypeDef         Restart_Cause(void);
+const char                   *Restart_CauseName(Restart_Cause_TypeDef cause);
+const GSMWarmState_TypeDef   *Restart_Modem(void);
+const AlarmWarmState_TypeDef *Restart_Alarm(void);
+
+#endif /* INC_RESTART_H_ */
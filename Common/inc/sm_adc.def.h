@@ -10,12 +10,17 @@
 #ifndef INC_ADC_DEF_H_
 #define INC_ADC_DEF_H_
 
+/*
+ * Regular scan sequence: the channel id is also the rank-1 of the channel in the sequence
+ */
 typedef enum {
-	CHN_NTC_TEMP    = 0,
-	// CHN_TEMPSENSOR  = 1,
+	CHN_NTC_TEMP    = 0,	// NTC1 - PA1 (ADC1_IN1)
+	CHN_NTC2_TEMP   = 1,	// NTC2 - PA0 (ADC1_IN0)
+	CHN_TEMPSENSOR  = 2,	// MCU internal temperature sensor
+	CHN_VREFINT     = 3,	// internal reference voltage, used for VDDA measurement
 } ADC_ChannelId_TypeDef;
 
-#define CHANNEL_COUNT           1
+#define CHANNEL_COUNT           4
 #define CIRCULAR_BUFFER_DIVISOR 4   // 2^7 = 128 byte buffer size => power of 2, establishes the circular buffer size
 
 #endif /* INC_ADC_DEF_H_ */
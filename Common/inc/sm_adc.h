@@ -10,6 +10,7 @@
 #define INC_SM_ANALOG_H_
 
 #include "libadc.h"
+#include "timsys.h"
 #include "sm_adc.def.h"
 
 typedef enum {
@@ -25,6 +26,12 @@ typedef enum {
  * - call "Stop" method to stopp collecting analog data
  * - query channel for valid data via "GetChannelStatus", data available if it returns VCC_CHANNEL_READY
  * - get channel value (actually a sliding mean) via "GetChannelValue"; returns 0xFFFF if channel not ready
+ * - get the ratiometric corrected channel value (referred to the Vdd given to "Init") via "ChannelCompensated"
+ * - get the VDDA measured through the VREFINT channel via "Vdda"
+ * - between samplings, call "Watch" to let the hardware analog watchdog guard a channel, and poll
+ *   "WatchTriggered" to know as soon as the channel left the threshold window; "Start" leaves the watch mode
+ * - the state machine runs as a scheduler task, registered by "Init"; the task given to "Notify" is signaled
+ *   when a sampling burst is completed and when the analog watchdog fires
  */
 typedef struct {
     void (*Start)(void);
@@ -32,8 +39,14 @@ typedef struct {
     void (*Exec) (void);
     uint16_t (*ChannelValue)(ADC_ChannelId_TypeDef channel);
     uint16_t (*ChannelVin)  (ADC_ChannelId_TypeDef channel, float *Vin);
+    uint16_t (*ChannelCompensated)(ADC_ChannelId_TypeDef channel);
+    float    (*Vdda)        (void);
     uint8_t  (*isStopped)   (void);
+    uint8_t  (*isWatching)  (void);
     void     (*Init)        (ADC_HandleTypeDef *hadc, float Vdd);
+    uint8_t  (*Watch)       (ADC_ChannelId_TypeDef channel, uint16_t low, uint16_t high);
+    uint8_t  (*WatchTriggered)(void);
+    void     (*Notify)      (TimSys_Task_TypeDef *task);
     ADC_ChannelStatus_TypeDef (*ChannelStatus)(ADC_ChannelId_TypeDef channel);
 } ADCSmInterface_TypeDef;
 
@@ -10,11 +10,21 @@
 #ifndef INC_SM_ALARM_H_
 #define INC_SM_ALARM_H_
 
+#include "ntc.h"
+
 // Defines ----------------------------------------------------------------------
 
 #define DATA_CFG_ADDRESS          	0X08020000  // 0x0803FC00
 #define TEMPERATURE_SAMPLING_TIME 	60000
 #define TEMPERATURE_DELTA_THRESHOLD 1.0
+#define TEMPERATURE_HIGH_THRESHOLD	-15.0		// soglia alta di default (disabilitata all'avvio)
+#define PREDICTION_HORIZON			900			// orizzonte di default dell'allarme predittivo [s] (15 min.)
+
+#define SAMPLING_TIME_MIN			1000		// intervallo minimo di campionamento adattivo [msec]
+#define SAMPLING_TIME_MAX			300000		// intervallo massimo di campionamento adattivo [msec] (5 min.)
+#define SAMPLING_GAIN				10000		// intervallo per grado di distanza dalla soglia [msec/°C]
+#define SAMPLING_TTC_DIVISOR		4			// campioni almeno 4 volte prima del tempo stimato di raggiungimento della soglia
+#define SAMPLING_HOUR				3600000		// finestra del contatore di campioni [msec]
 
 // Types definition ---------------------------------------------------------------
 
@@ -36,27 +46,82 @@ typedef enum {
 typedef enum {
 
 	AS_IDLE,             /**< AS_IDLE */
-	AS_CHECK_TEMPERATURE,/**< AS_CHECK_TEMPERATURE */
+	AS_NOTIFY,           /**< AS_NOTIFY: allarme da notificare, in attesa che il modem sia libero */
 	AS_CALLING,          /**< AS_CALLING */
 
 } AlarmSMStatus_TypeDef;
 
+/**
+ * @enum
+ * @brief stato dell'acquisizione della temperatura, indipendente dal modem
+ *
+ */
+typedef enum {
+
+	TS_WAITING,          /**< TS_WAITING: attesa del prossimo campionamento */
+	TS_SAMPLING,         /**< TS_SAMPLING: campionamento in corso */
+
+} SamplingSMStatus_TypeDef;
+
+/**
+ * @struct
+ * @brief ultima lettura pubblicata dall'acquisizione
+ *
+ */
+typedef struct {
+
+	float    temp;       // temperatura di allarme [°C]
+	uint32_t tick;       // istante della lettura [msec]
+	uint8_t  valid;      // 0 finché non è disponibile la prima lettura
+
+} TempReading_TypeDef;
+
+/**
+ * @struct
+ * @brief stato dell'allarme conservato per il riavvio a caldo (restart.h)
+ *
+ */
+typedef struct {
+
+	uint8_t  alarm;      // AlarmStatus_TypeDef
+	uint8_t  autoEnable;
+	uint8_t  status;     // AlarmSMStatus_TypeDef: notifica in corso
+	uint8_t  entry;      // voce della rubrica da cui riprendere le chiamate
+	uint8_t  valid;      // ultima lettura disponibile
+	float    temp;       // ultima lettura [°C]
+
+} AlarmWarmState_TypeDef;
+
 // exported functions prototype ---------------------------------------------------
 
 float GetTemp(void);
+TempReading_TypeDef GetReading(void);
+float GetNtcTemp(enum NTC_ID ntc);
+float GetMcuTemp(void);
 void  SetTemp(float temp);
 void  SetTempThreshold(float temp);
 float GetTempThreshold(void);
-void  EnableAlarm(uint8_t val);
+void  SetHighThreshold(float temp, uint8_t enabled);
+float GetHighThreshold(void);
+void  SetHysteresis(float low, float high);
+void  SetPredictionHorizon(uint32_t seconds);
+
+uint8_t  HighThresholdEnabled(void);
+uint32_t PredictionHorizon(void);
+void  EnableAlarm(AlarmStatus_TypeDef status);
 void  SetAlarmAutoEnable(uint8_t enabled);
 
 uint8_t AlarmAutoEnable(void);
 
-float ReadTemperature(void);
+void     SetSamplingBounds(uint32_t min, uint32_t max);
+uint32_t SamplingInterval(void);
+uint32_t SamplesPerHour(void);
 
 void SM_Alarm_Exec(void);
-void SM_Alarm_Init(void);
+void SM_Alarm_Init(const AlarmWarmState_TypeDef *warm);
+void SM_Alarm_SaveState(AlarmWarmState_TypeDef *state);
 
 AlarmStatus_TypeDef AlarmStatus(void);
+AlarmSMStatus_TypeDef AlarmSMStatus(void);
 
 #endif /* INC_SM_ALARM_H_ */
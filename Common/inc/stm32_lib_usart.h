@@ -12,7 +12,6 @@
 
 #include "main.h"
 
-#include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
 #include "libfifo.h"
@@ -25,20 +24,66 @@ typedef enum  {
 	USART_4,
 	USART_5,
 	USART_6,
+	USART_COUNT,	// number of port ids: sizes the port tables of the library, keep last
 } USART_Id_TypeDef;
 
+/**
+ * @struct
+ * @brief callbacks of a port, called by the HAL interrupt callbacks of its USART instance. NULL members are skipped.
+ *        RxCplt is called after the received char (USART_RxChar) has been pushed into the rx fifo, TxCplt after the
+ *        next block of the tx fifo has been started.
+ */
+typedef struct {
+	void (*RxCplt)(UART_HandleTypeDef *huart);
+	void (*TxCplt)(UART_HandleTypeDef *huart);
+	void (*Error)(UART_HandleTypeDef *huart);
+	void (*RxHalfCplt)(UART_HandleTypeDef *huart);
+	void (*TxHalfCplt)(UART_HandleTypeDef *huart);
+	void (*AbortCplt)(UART_HandleTypeDef *huart);
+	void (*AbortTransmitCplt)(UART_HandleTypeDef *huart);
+	void (*AbortReceiveCplt)(UART_HandleTypeDef *huart);
+	void (*BridgeRx)(const char *data, uint16_t len);	// block received while the port is in the DMA bridge
+} USART_Callbacks_TypeDef;
+
+/**
+ * @struct
+ * @brief link statistics of a port, for sizing the fifos and choosing the baud rate
+ */
+typedef struct {
+	uint32_t rx_bytes;			// received chars
+	uint32_t tx_bytes;			// sent chars
+	uint32_t overruns;			// overrun errors (char lost by the USART, reception restarted)
+	uint32_t framing;			// framing errors
+	uint32_t noise;				// noise errors
+	uint32_t parity;			// parity errors
+	uint32_t rearms;			// reception restarted after an error
+	uint32_t rx_holds;			// sender stopped by RTS at the rx fifo high watermark
+	uint32_t rx_overflows;		// received chars dropped with the rx fifo full
+	uint32_t tx_overflows;		// chars dropped with the tx fifo full (from an interrupt)
+	uint16_t rx_high;			// rx fifo high-water mark
+	uint16_t tx_high;			// tx fifo high-water mark
+} USART_Stats_TypeDef;
+
 uint8_t USART_Init(void);
 
-uint8_t USART_SetHandle(USART_Id_TypeDef id, UART_HandleTypeDef *husart);
+uint8_t USART_SetHandle(USART_Id_TypeDef id, UART_HandleTypeDef *husart, const USART_Callbacks_TypeDef *cb);
 
 HAL_StatusTypeDef USART_Start(USART_Id_TypeDef id);
 
+HAL_StatusTypeDef USART_SetBaudRate(USART_Id_TypeDef id, uint32_t baud);
+uint32_t          USART_BaudRate(USART_Id_TypeDef id);
+
 Fifo_TypeDef *USART_RxFifo(USART_Id_TypeDef id);
 
-void USART_TxFifoPushBuffer(USART_Id_TypeDef id, char *buff, uint16_t len);
-void USART_TxFifoPushString(USART_Id_TypeDef id, char *string);
+uint16_t USART_TxFifoPushBuffer(USART_Id_TypeDef id, const char *buff, uint16_t len);
+uint16_t USART_TxFifoPushString(USART_Id_TypeDef id, const char *string);
+uint16_t USART_TxFifoPushUInt(USART_Id_TypeDef id, uint32_t value);
+void     USART_TxFifoSend(USART_Id_TypeDef id);
+uint16_t USART_TxFree(USART_Id_TypeDef id);
 
 void USART_ReadChar(USART_Id_TypeDef id);
+char USART_RxChar(USART_Id_TypeDef id);
+void USART_RxFlowUpdate(USART_Id_TypeDef id);
 
 HAL_StatusTypeDef USART_Write(USART_Id_TypeDef id, char *mess, unsigned char blocking);
 HAL_StatusTypeDef USART_Read(USART_Id_TypeDef id, char *mess, unsigned int len, unsigned char blocking);
@@ -47,4 +92,12 @@ HAL_StatusTypeDef USART_WriteChar(USART_Id_TypeDef id, char);
 void USART_VSPrintf(USART_Id_TypeDef id, const char *fmt, va_list *argptr);
 void USART_Printf(USART_Id_TypeDef id, const char *fmt,...);
 
+uint8_t USART_BridgeStart(USART_Id_TypeDef a, USART_Id_TypeDef b);
+void    USART_BridgeStop(void);
+uint8_t USART_Bridged(USART_Id_TypeDef id);
+
+void  USART_Stats(USART_Id_TypeDef id, USART_Stats_TypeDef *stats);
+void  USART_StatsReset(USART_Id_TypeDef id);
+char *USART_StatsReport(USART_Id_TypeDef id, char *mess, uint16_t size);
+
 #endif /* STM32LIBUSART_H_ */
@@ -0,0 +1,66 @@
+/*
+ * supervisor.h
+ *
+ *  Created on:
+ *      Author: Ing. Salvatore Cerami
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ */
+
+#ifndef INC_SUPERVISOR_H_
+#define INC_SUPERVISOR_H_
+
+#include "main.h"
+
+// Defines ----------------------------------------------------------------------
+
+#define SUPERVISOR_PERIOD			1000		// periodo di controllo e di ricarica dell'IWDG [msec]
+#define SUPERVISOR_MAX_RECOVERY		3			// recuperi consecutivi di un task prima di lasciar intervenire l'IWDG
+#define SUPERVISOR_MAGIC			0x53555056	// "SUPV": record della RAM no-init valido
+
+#define SUPERVISOR_ALARM_DEADLINE	20000		// [msec] oltre l'intervallo di campionamento: copre le attese bloccanti degli altri task
+#define SUPERVISOR_ADC_DEADLINE		10000		// [msec] durata massima di un campionamento
+#define SUPERVISOR_GSM_DEADLINE		25000		// [msec] risposta del modem, entro il timeout dell'IWDG (~32 s)
+
+// Types definition ---------------------------------------------------------------
+
+/**
+ * @enum
+ * @brief task supervisionati
+ *
+ */
+typedef enum {
+	SV_ALARM = 0,
+	SV_ADC,
+	SV_GSM,
+	SV_TASKS
+} Supervisor_Id_TypeDef;
+
+typedef void (*Supervisor_Recover)(void);
+
+/**
+ * @struct
+ * @brief causa dell'ultimo reset del watchdog, dalla RAM no-init
+ *
+ */
+typedef struct {
+	uint8_t     valid;		// 1 se l'avvio segue un reset dell'IWDG
+	uint8_t     id;			// Supervisor_Id_TypeDef del task in ritardo, SV_TASKS se nessuno
+	const char *starved;	// task supervisionato oltre la scadenza, NULL se il loop era bloccato
+	const char *running;	// task dello scheduler in esecuzione al reset, NULL se nessuno
+	uint32_t    tick;		// istante della mancata ricarica [msec]
+} SupervisorReset_TypeDef;
+
+// exported functions prototype ---------------------------------------------------
+
+void     Supervisor_Init(void);
+void     Supervisor_Watch(Supervisor_Id_TypeDef id, uint32_t deadline, Supervisor_Recover recover);
+void     Supervisor_CheckIn(Supervisor_Id_TypeDef id);
+void     Supervisor_Begin(Supervisor_Id_TypeDef id);
+void     Supervisor_Idle(Supervisor_Id_TypeDef id);
+void     Supervisor_Kick(void);
+uint32_t Supervisor_Recoveries(Supervisor_Id_TypeDef id);
+const char *Supervisor_Name(Supervisor_Id_TypeDef id);
+const SupervisorReset_TypeDef *Supervisor_LastReset(void);
+
+#endif /* INC_SUPERVISOR_H_ */
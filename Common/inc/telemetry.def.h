@@ -0,0 +1,56 @@
+/*
+ * telemetry.def.h
+ *
+ *  Created on:
+ *      Author: Ing. Salvatore Cerami
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ *
+ * Formato dei record della telemetria binaria su USART2, condiviso dal firmware e dal decodificatore su host
+ * (Tools/telemetry): solo tipi standard, nessuna dipendenza dalla HAL.
+ *
+ * Trama sulla linea: 0x00, COBS(record), 0x00. Lo zero iniziale separa la trama dal testo della console eventualmente
+ * trasmesso prima. Record, campi little endian:
+ *
+ *   uint8  versione (TM_VERSION)
+ *   uint8  tipo (TelemetryType_TypeDef)
+ *   uint16 sequenza: incrementata per ogni record generato, anche se scartato con la coda di trasmissione piena
+ *   uint32 tempo [usec] (TimSys_Micros)
+ *   ...    dati del tipo
+ *   uint16 CRC-16/CCITT-FALSE (poli 0x1021, iniziale 0xFFFF) di tutti i campi precedenti
+ *
+ * Dati dei tipi, versione 1:
+ *
+ *   TM_ADC      uint8 canale, uint8 n, n x uint16 conversioni grezze del burst, nell'ordine del buffer circolare
+ *   TM_TEMP     float temperatura [°C], uint32 prossimo intervallo di campionamento [msec]
+ *   TM_GSM      uint8 stato precedente, uint8 stato (GSMStatus_TypeDef), uint8 ultimo comando AT (ATCommand_ID_TypeDef)
+ *   TM_PARSER   uint8 risposta del modem (ATCommand_Reply_TypeDef), uint8 stato del modem
+ *   TM_PROFILE  uint8 sonda (TimSys_ProbeId_TypeDef), uint32 count, uint32 min, uint32 max, uint32 last [nsec],
+ *               uint64 sum [nsec]
+ *
+ * Un cambio del formato di un tipo esistente richiede una nuova versione; i tipi nuovi si aggiungono in coda.
+ */
+
+#ifndef INC_TELEMETRY_DEF_H_
+#define INC_TELEMETRY_DEF_H_
+
+#define TM_VERSION				1
+#define TM_HEADER_SIZE			8			// versione, tipo, sequenza, tempo
+#define TM_CRC_SIZE				2
+#define TM_PAYLOAD_MAX			40			// TM_ADC con 16 conversioni (CIRCULAR_BUFFER_SIZE)
+#define TM_RECORD_MAX			(TM_HEADER_SIZE + TM_PAYLOAD_MAX + TM_CRC_SIZE)
+#define TM_FRAME_MAX			(TM_RECORD_MAX + 1 + 2)		// COBS: un byte di overhead fino a 254 byte, due delimitatori
+
+#define TM_MASK(type)			(1U << (type))
+#define TM_MASK_ALL				(TM_MASK(TM_TYPES) - 1)
+
+typedef enum {
+	TM_ADC     = 0,		/**< blocco di conversioni grezze di un canale ADC */
+	TM_TEMP    = 1,		/**< campione di temperatura */
+	TM_GSM     = 2,		/**< transizione di stato del modem */
+	TM_PARSER  = 3,		/**< risposta del modem riconosciuta dal parser */
+	TM_PROFILE = 4,		/**< contatori di una sonda di profiling */
+	TM_TYPES
+} TelemetryType_TypeDef;
+
+#endif /* INC_TELEMETRY_DEF_H_ */
@@ -0,0 +1,35 @@
+/*
+ * telemetry.h
+ *
+ *  Created on:
+ *      Author: Ing. Salvatore Cerami
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ */
+
+#ifndef INC_TELEMETRY_H_
+#define INC_TELEMETRY_H_
+
+#include "main.h"
+#include "telemetry.def.h"
+
+// Defines ----------------------------------------------------------------------
+
+#define TELEMETRY_MASK_DEFAULT		0			// tipi trasmessi all'avvio: telemetria spenta, si attiva dalla console
+#define TELEMETRY_PROFILE_PERIOD	1000		// [msec] intervallo dei record TM_PROFILE
+
+// exported functions prototype ---------------------------------------------------
+
+void     Telemetry_Init(void);
+void     Telemetry_SetMask(uint8_t mask);
+uint8_t  Telemetry_Mask(void);
+uint8_t  Telemetry_Enabled(TelemetryType_TypeDef type);
+
+void     Telemetry_Adc(uint8_t channel, const uint32_t *values, uint8_t count);
+void     Telemetry_Temp(float temp, uint32_t interval);
+void     Telemetry_Gsm(uint8_t from, uint8_t to, uint8_t command);
+void     Telemetry_Parser(uint8_t reply, uint8_t status);
+
+char    *Telemetry_Report(char *mess, uint16_t size);
+
+#endif /* INC_TELEMETRY_H_ */
@@ -0,0 +1,37 @@
+/*
+ * timsys.def.h
+ *
+ *  Created on:
+ *      Author: Ing. Salvatore Cerami
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ */
+
+#ifndef INC_TIMSYS_DEF_H_
+#define INC_TIMSYS_DEF_H_
+
+#define TIMSYS_PROFILING			// abilita le sonde PROF_BEGIN/PROF_END
+
+#define TIMSYS_PROF_BUCKETS  12     // istogramma: bucket i = durate in [2^(i-1), 2^i) usec, l'ultimo raccoglie le maggiori
+
+#define TIMSYS_LOOP_BUDGET   100    // durata massima di un'iterazione del loop principale [msec]: oltre, il parser UART rischia l'overflow
+#define TIMSYS_LOOP_BUCKETS  24     // istogramma delle iterazioni, come TIMSYS_PROF_BUCKETS (l'ultimo bucket >= 4.2 s)
+#define TIMSYS_LOOP_WORST    4      // iterazioni peggiori registrate, una per sorgente
+
+/**
+ * @enum
+ * @brief sonde di profiling
+ *
+ */
+typedef enum {
+	PROF_PARSER = 0,		/**< parsing di un carattere ricevuto dal modem */
+	PROF_NTC,				/**< conversione ADC -> temperatura */
+	PROF_GSM_SM,			/**< SIM800L_SM_Exec */
+	PROF_USART1_ISR,		/**< interrupt USART1 (modem) */
+	PROF_USART2_ISR,		/**< interrupt USART2 (console) */
+	PROF_PROBES
+} TimSys_ProbeId_TypeDef;
+
+#define TIMSYS_PROBE_NAMES { "parser", "ntc", "gsm sm", "usart1 isr", "usart2 isr" }
+
+#endif /* INC_TIMSYS_DEF_H_ */
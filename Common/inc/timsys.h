@@ -13,12 +13,129 @@
 // Includes ***************************************************************************************
 
 #include "main.h"
+#include "timsys.def.h"
+
+// Defines ****************************************************************************************
+
+#define TIMSYS_WHEEL_SIZE   64      // slot della ruota dei timer (potenza di 2), 1 slot = 1 tick
+#define TIMSYS_MAX_TASKS    16      // task registrabili
+
+#ifdef TIMSYS_PROFILING
+
+#define PROF_BEGIN(id)  uint32_t prof_start_##id = TimSys_Cycles()
+#define PROF_END(id)    TimSys_ProfRecord((id), TimSys_Cycles() - prof_start_##id)
+
+#else
+
+#define PROF_BEGIN(id)
+#define PROF_END(id)
+
+#endif
+
+// Types ******************************************************************************************
+
+typedef void (*TimSys_TaskFunc)(void);
+
+/**
+ * @struct
+ * @brief task run-to-completion del scheduler cooperativo
+ *
+ * Il task è eseguito quando il suo timer scade (one-shot o periodico) o quando viene segnalato, anche da una ISR.
+ * L'ordine di registrazione è la priorità: a parità di stato pronto viene eseguito il task registrato per primo.
+ */
+typedef struct TimSys_Task {
+	const char          *name;
+	TimSys_TaskFunc      func;
+	uint8_t              id;        // bit nella maschera dei task pronti
+	uint8_t              armed;     // timer inserito nella ruota
+	uint32_t             period;    // 0 = one-shot [msec]
+	uint32_t             expire;    // tick di scadenza del timer
+	struct TimSys_Task  *next;      // catena dello slot della ruota
+	uint32_t             runs;      // numero di esecuzioni
+	uint32_t             run_time;  // tempo di esecuzione totale [usec]
+	uint32_t             max_time;  // tempo di esecuzione massimo [usec]
+	uint32_t             ready_time;// istante in cui è diventato pronto [usec]
+} TimSys_Task_TypeDef;
+
+/**
+ * @struct
+ * @brief iterazione peggiore del loop principale
+ */
+typedef struct {
+	const char *tag;                        // sorgente: nome del task o tag impostato con TimSys_LoopTag
+	uint32_t    time;                       // durata [usec]
+	uint32_t    tick;                       // istante [msec]
+} TimSys_LoopWorst_TypeDef;
+
+/**
+ * @struct
+ * @brief statistiche del loop principale: un'iterazione è l'esecuzione di un task
+ */
+typedef struct {
+	uint32_t iterations;
+	uint32_t over_budget;                   // iterazioni oltre TIMSYS_LOOP_BUDGET
+	uint32_t max;                           // [usec]
+	uint64_t sum;                           // per la media [usec]
+	uint32_t latency_max;                   // ritardo massimo tra task pronto ed esecuzione [usec]
+	uint64_t latency_sum;
+	uint32_t hist[TIMSYS_LOOP_BUCKETS];     // durate, bucket logaritmici in usec
+	TimSys_LoopWorst_TypeDef worst[TIMSYS_LOOP_WORST]; // ordinate per durata decrescente
+} TimSys_LoopStats_TypeDef;
+
+/**
+ * @struct
+ * @brief statistiche di una sonda di profiling, tempi in nanosecondi
+ */
+typedef struct {
+	uint32_t count;
+	uint32_t min;                           // [nsec]
+	uint32_t max;                           // [nsec]
+	uint32_t last;                          // ultima durata misurata [nsec]
+	uint64_t sum;                           // per la media [nsec]
+	uint32_t hist[TIMSYS_PROF_BUCKETS];     // bucket logaritmici in usec (vedi TIMSYS_PROF_BUCKETS)
+} TimSys_Probe_TypeDef;
 
 // Functions prototype ****************************************************************************
 
+/**
+ * @brief cycle counter (DWT), wrap every 2^32 core cycles (~43 s at 100 MHz)
+ */
+static inline uint32_t TimSys_Cycles(void)
+{
+	return DWT->CYCCNT;
+}
+
+void     TimSys_Init(void);
+uint32_t TimSys_CyclesElapsed(uint32_t start);
+uint32_t TimSys_Micros(void);
+uint32_t TimSys_MicrosElapsed(uint32_t start);
+void     TimSys_MicrosSync(void);
+void     TimSys_MicrosAdvance(uint32_t us);
+
+
 uint32_t TimSys_Time(void);
 uint32_t TimSys_TimeElapsed(uint32_t start);
 uint32_t TimSys_TickTimeElapsed(uint32_t *start, uint32_t timeout);
 uint32_t TimSys_TickTimeElapsedEx(uint32_t *start, uint32_t timeout, uint8_t *start_from_now);
 
+uint8_t  TimSys_TaskRegister(TimSys_Task_TypeDef *task, const char *name, TimSys_TaskFunc func);
+void     TimSys_TaskStart(TimSys_Task_TypeDef *task, uint32_t delay, uint32_t period);
+void     TimSys_TaskStop(TimSys_Task_TypeDef *task);
+void     TimSys_TaskSignal(TimSys_Task_TypeDef *task);
+uint8_t  TimSys_Run(void);
+uint32_t TimSys_NextDeadline(void);
+uint8_t  TimSys_TaskCount(void);
+uint8_t  TimSys_Running(void);
+TimSys_Task_TypeDef *TimSys_Task(uint8_t id);
+
+void     TimSys_ProfRecord(TimSys_ProbeId_TypeDef id, uint32_t cycles);
+void     TimSys_ProfReset(void);
+const TimSys_Probe_TypeDef *TimSys_Probe(TimSys_ProbeId_TypeDef id);
+char    *TimSys_ProfReport(TimSys_ProbeId_TypeDef id, char *mess, uint16_t size);
+
+void     TimSys_LoopTag(const char *tag);
+void     TimSys_LoopReset(void);
+const TimSys_LoopStats_TypeDef *TimSys_LoopStats(void);
+char    *TimSys_LoopReport(char *mess, uint16_t size);
+
 #endif /* TIMER_GEN_H_ */
@@ -10,10 +10,16 @@
 #ifndef SRC_USART_DEF_H_
 #define SRC_USART_DEF_H_
 
-#define USART_MAX 2             	 // Max number of USART Managed
-
 #define FIFO_RX_BUFFER_SIZE 256
 #define FIFO_TX_BUFFER_SIZE 256
 
+#define USART1_RTS_CTS      0                            // 1: RTS/CTS hardware flow control on USART1 (PA12 RTS, PA11 CTS wired to the modem)
+
+#define USART_RX_FLOW_HIGH  (FIFO_RX_BUFFER_SIZE - 64)   // RTS flow control: rx fifo items that stop the sender (room for the chars in flight)
+#define USART_RX_FLOW_LOW   (FIFO_RX_BUFFER_SIZE / 4)    // RTS flow control: rx fifo items that restart the sender
+
+#define USART_BRIDGE_BUFFER_SIZE  256                    // DMA bridge: circular rx buffer of each direction, sent by halves
+#define USART_BRIDGE_STOP_TIMEOUT 1000                   // [msec] DMA bridge: wait for the chars in flight when stopping
+
 
 #endif /* SRC_USART_DEF_H_ */
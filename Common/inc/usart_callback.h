@@ -0,0 +1,20 @@
+/*
+ * usart_callback.h
+ *
+ *  Created on:
+ *      Author: Ing. Salvatore Cerami
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ */
+
+#ifndef INC_USART_CALLBACK_H_
+#define INC_USART_CALLBACK_H_
+
+#include "stm32_lib_usart.h"
+
+// exported variables ---------------------------------------------------------------
+
+extern const USART_Callbacks_TypeDef USART1_Callbacks; // modem SIM800L
+extern const USART_Callbacks_TypeDef USART2_Callbacks; // terminale seriale
+
+#endif /* INC_USART_CALLBACK_H_ */
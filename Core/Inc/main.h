@@ -47,6 +47,7 @@ extern "C" {
 
 /* Exported macro ------------------------------------------------------------*/
 /* USER CODE BEGIN EM */
+#define NOINIT __attribute__((section(".noinit"))) // variabile non inizializzata all'avvio: conservata attraverso il reset
 
 /* USER CODE END EM */
 
@@ -21,7 +21,36 @@
 #include "usart.h"
 
 /* USER CODE BEGIN 0 */
+#include "usart.def.h"
 
+DMA_HandleTypeDef hdma_usart1_rx;	// DMA bridge console <-> modem (USART_BridgeStart)
+DMA_HandleTypeDef hdma_usart1_tx;
+DMA_HandleTypeDef hdma_usart2_rx;
+DMA_HandleTypeDef hdma_usart2_tx;
+
+/**
+ * @brief configura uno stream DMA (canale 4) per la UART: circolare in ricezione, normale in trasmissione
+ */
+static void UART_DMA_Init(DMA_HandleTypeDef *hdma, DMA_Stream_TypeDef *stream, uint32_t direction, IRQn_Type irq)
+{
+  hdma->Instance = stream;
+  hdma->Init.Channel = DMA_CHANNEL_4;
+  hdma->Init.Direction = direction;
+  hdma->Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma->Init.MemInc = DMA_MINC_ENABLE;
+  hdma->Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hdma->Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+  hdma->Init.Mode = (direction == DMA_PERIPH_TO_MEMORY) ? DMA_CIRCULAR : DMA_NORMAL;
+  hdma->Init.Priority = DMA_PRIORITY_LOW;
+  hdma->Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+  if (HAL_DMA_Init(hdma) != HAL_OK)
+  {
+    Error_Handler();
+  }
+
+  HAL_NVIC_SetPriority(irq, 0, 0);
+  HAL_NVIC_EnableIRQ(irq);
+}
 /* USER CODE END 0 */
 
 UART_HandleTypeDef huart1;
@@ -52,7 +81,13 @@ void MX_USART1_UART_Init(void)
     Error_Handler();
   }
   /* USER CODE BEGIN USART1_Init 2 */
-
+#if USART1_RTS_CTS
+  huart1.Init.HwFlowCtl = UART_HWCONTROL_RTS_CTS; // RTS/CTS col modem: PA12 RTS, PA11 CTS
+  if (HAL_UART_Init(&huart1) != HAL_OK)
+  {
+    Error_Handler();
+  }
+#endif
   /* USER CODE END USART1_Init 2 */
 
 }
@@ -114,7 +149,25 @@ void HAL_UART_MspInit(UART_HandleTypeDef* uartHandle)
     HAL_NVIC_SetPriority(USART1_IRQn, 0, 0);
     HAL_NVIC_EnableIRQ(USART1_IRQn);
   /* USER CODE BEGIN USART1_MspInit 1 */
-
+#if USART1_RTS_CTS
+    __HAL_RCC_GPIOA_CLK_ENABLE();
+    /**USART1 GPIO Configuration
+    PA11     ------> USART1_CTS
+    PA12     ------> USART1_RTS
+    */
+    GPIO_InitStruct.Pin = GPIO_PIN_11|GPIO_PIN_12;
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+    GPIO_InitStruct.Alternate = GPIO_AF7_USART1;
+    HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+#endif
+    /* USART1 DMA Init: DMA2 Stream2 RX, Stream7 TX */
+    __HAL_RCC_DMA2_CLK_ENABLE();
+    UART_DMA_Init(&hdma_usart1_rx, DMA2_Stream2, DMA_PERIPH_TO_MEMORY, DMA2_Stream2_IRQn);
+    __HAL_LINKDMA(uartHandle,hdmarx,hdma_usart1_rx);
+    UART_DMA_Init(&hdma_usart1_tx, DMA2_Stream7, DMA_MEMORY_TO_PERIPH, DMA2_Stream7_IRQn);
+    __HAL_LINKDMA(uartHandle,hdmatx,hdma_usart1_tx);
   /* USER CODE END USART1_MspInit 1 */
   }
   else if(uartHandle->Instance==USART2)
@@ -141,7 +194,12 @@ void HAL_UART_MspInit(UART_HandleTypeDef* uartHandle)
     HAL_NVIC_SetPriority(USART2_IRQn, 0, 0);
     HAL_NVIC_EnableIRQ(USART2_IRQn);
   /* USER CODE BEGIN USART2_MspInit 1 */
-
+    /* USART2 DMA Init: DMA1 Stream5 RX, Stream6 TX */
+    __HAL_RCC_DMA1_CLK_ENABLE();
+    UART_DMA_Init(&hdma_usart2_rx, DMA1_Stream5, DMA_PERIPH_TO_MEMORY, DMA1_Stream5_IRQn);
+    __HAL_LINKDMA(uartHandle,hdmarx,hdma_usart2_rx);
+    UART_DMA_Init(&hdma_usart2_tx, DMA1_Stream6, DMA_MEMORY_TO_PERIPH, DMA1_Stream6_IRQn);
+    __HAL_LINKDMA(uartHandle,hdmatx,hdma_usart2_tx);
   /* USER CODE END USART2_MspInit 1 */
   }
 }
@@ -166,7 +224,11 @@ void HAL_UART_MspDeInit(UART_HandleTypeDef* uartHandle)
     /* USART1 interrupt Deinit */
     HAL_NVIC_DisableIRQ(USART1_IRQn);
   /* USER CODE BEGIN USART1_MspDeInit 1 */
-
+#if USART1_RTS_CTS
+    HAL_GPIO_DeInit(GPIOA, GPIO_PIN_11|GPIO_PIN_12);
+#endif
+    HAL_DMA_DeInit(uartHandle->hdmarx);
+    HAL_DMA_DeInit(uartHandle->hdmatx);
   /* USER CODE END USART1_MspDeInit 1 */
   }
   else if(uartHandle->Instance==USART2)
@@ -186,7 +248,8 @@ void HAL_UART_MspDeInit(UART_HandleTypeDef* uartHandle)
     /* USART2 interrupt Deinit */
     HAL_NVIC_DisableIRQ(USART2_IRQn);
   /* USER CODE BEGIN USART2_MspDeInit 1 */
-
+    HAL_DMA_DeInit(uartHandle->hdmarx);
+    HAL_DMA_DeInit(uartHandle->hdmatx);
   /* USER CODE END USART2_MspDeInit 1 */
   }
 }
@@ -0,0 +1,214 @@
+/**
+ * @file fmt_bench.c - https://github.com/SC-Develop/tesysma
+ *
+ * @author Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/SC-Develop/
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ *
+ * Benchmark su host di libfmt rispetto a snprintf della libc, sui formati usati dal firmware.
+ *
+ * Per ogni formato confronta il testo prodotto e misura i cicli (TSC su x86, altrimenti nanosecondi) per chiamata,
+ * come mediana di FMT_BENCH_ROUNDS serie di FMT_BENCH_CALLS chiamate. I cicli dell'host non sono quelli del
+ * Cortex-M4: il benchmark confronta le due implementazioni, non misura il tempo sul target.
+ *
+ * Compilazione ed esecuzione, dalla radice del repository:
+ *
+ *   gcc -O2 -ITools/fmtbench -ICommon/inc Tools/fmtbench/fmt_bench.c Common/Src/libfmt.c Common/Src/libfifo.c -o fmt_bench
+ *   ./fmt_bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "libfmt.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define UNIT "cicli"
+static inline uint64_t Now(void) { return __rdtsc(); }
+#else
+#define UNIT "ns"
+static inline uint64_t Now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec * 1000000000u + t.tv_nsec;
+}
+#endif
+
+// Defines ----------------------------------------------------------------------------------------------------------------------------------
+
+#define FMT_BENCH_CALLS		2000
+#define FMT_BENCH_ROUNDS	21
+#define FMT_BENCH_BUFFER	600
+
+// Types definition ---------------------------------------------------------------------------------------------------------------------------
+
+typedef int      (*LibcFormat)(char *buffer, size_t size);
+typedef uint16_t (*FmtFormat)(char *buffer, uint16_t size);
+
+typedef struct {
+	const char *name;
+	LibcFormat  libc;
+	FmtFormat   fmt;
+} Case_TypeDef;
+
+// Variables ------------------------------------------------------------------------------------------------------------------------------
+
+static volatile float    temp = 21.35f, threshold = 30.0f, slope = -0.134f, vbatt = 4.087f;	// volatile: niente valori costanti
+static volatile int      signal_q = 18, charge = 87;
+static volatile uint32_t reg = 0x20001F3Cu, count = 123456u;
+
+static volatile uint32_t sink_guard;
+
+// - Local functions ----------------------------------------------------------------------------------------------------------------------
+
+#define PARAMS_FMT "Segnale: %d%%\r\nBatteria: %d%%, %0.1fV\r\nTemperatura: %0.1f gradi\r\nSoglia: %0.1f gradi\r\nTendenza: %0.2f gradi/min\r\n"
+#define PARAMS_ARGS signal_q, charge, vbatt, temp, threshold, slope
+
+static int      LibcParams(char *b, size_t n)   { return snprintf(b, n, PARAMS_FMT, PARAMS_ARGS); }
+static uint16_t FmtParams(char *b, uint16_t n)  { return Fmt_Snprintf(b, n, PARAMS_FMT, PARAMS_ARGS); }
+
+#define HISTORY_FMT "%s: %0.1f/%0.1f/%0.1f\r\n"
+#define HISTORY_ARGS "24h", temp - 3.0f, temp, temp + 2.5f
+
+static int      LibcHistory(char *b, size_t n)  { return snprintf(b, n, HISTORY_FMT, HISTORY_ARGS); }
+static uint16_t FmtHistory(char *b, uint16_t n) { return Fmt_Snprintf(b, n, HISTORY_FMT, HISTORY_ARGS); }
+
+#define FAULT_FMT "PC %08lX LR %08lX PSR %08lX\r\nt %lus, task %s, gsm %u, allarme %u\r\n"
+#define FAULT_ARGS (unsigned long) reg, (unsigned long) reg + 0x40, 0x21000000ul, (unsigned long) count, "gsm", 4u, 1u
+
+static int      LibcFault(char *b, size_t n)    { return snprintf(b, n, FAULT_FMT, FAULT_ARGS); }
+static uint16_t FmtFault(char *b, uint16_t n)   { return Fmt_Snprintf(b, n, FAULT_FMT, FAULT_ARGS); }
+
+#define PROF_FMT "%-10s n=%lu min/med/max=%lu.%02lu/%lu.%02lu/%lu.%02lu us |"
+#define PROF_ARGS "adc_isr", (unsigned long) count, 1ul, 5ul, 2ul, 40ul, 13ul, 7ul
+
+static int      LibcProf(char *b, size_t n)     { return snprintf(b, n, PROF_FMT, PROF_ARGS); }
+static uint16_t FmtProf(char *b, uint16_t n)    { return Fmt_Snprintf(b, n, PROF_FMT, PROF_ARGS); }
+
+static const Case_TypeDef cases[] = {
+	{ "parametri (float)", LibcParams,  FmtParams  },
+	{ "storia (float)",    LibcHistory, FmtHistory },
+	{ "fault (hex)",       LibcFault,   FmtFault   },
+	{ "profiling (int)",   LibcProf,    FmtProf    },
+};
+
+static int Compare(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+static uint64_t Median(uint64_t *v)
+{
+	qsort(v, FMT_BENCH_ROUNDS, sizeof(*v), Compare);
+
+	return v[FMT_BENCH_ROUNDS / 2];
+}
+
+/**
+ * @fn void FifoDrain(void*)
+ * @brief flush del destinatario FIFO: scarta il contenuto, come una trasmissione istantanea
+ */
+static void FifoDrain(void *arg)
+{
+	Fifo_TypeDef *fifo = arg;
+	char         *data;
+
+	sink_guard += ch_fifo_span(fifo, &data);
+
+	ch_fifo_discard(fifo, fifo->items);
+}
+
+// - Main -------------------------------------------------------------------------------------------------------------------------------------
+
+int main(void)
+{
+	static char a[FMT_BENCH_BUFFER], b[FMT_BENCH_BUFFER];
+
+	uint64_t libc[FMT_BENCH_ROUNDS], fmt[FMT_BENCH_ROUNDS];
+
+	int errors = 0;
+
+	printf("%-20s %10s %10s %8s\n", "formato", "snprintf", "libfmt", "rapporto");
+
+	for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+	{
+		cases[c].libc(a, sizeof(a));
+		cases[c].fmt(b, sizeof(b));
+
+		if (strcmp(a, b))
+		{
+			printf("%s: testo diverso\n  snprintf: %s\n  libfmt:   %s\n", cases[c].name, a, b);
+			errors++;
+		}
+
+		for (int r = 0; r < FMT_BENCH_ROUNDS; r++)
+		{
+			uint64_t t0 = Now();
+
+			for (int i = 0; i < FMT_BENCH_CALLS; i++)
+			{
+				cases[c].libc(a, sizeof(a));
+			}
+
+			uint64_t t1 = Now();
+
+			for (int i = 0; i < FMT_BENCH_CALLS; i++)
+			{
+				cases[c].fmt(b, sizeof(b));
+			}
+
+			uint64_t t2 = Now();
+
+			libc[r] = (t1 - t0) / FMT_BENCH_CALLS;
+			fmt[r]  = (t2 - t1) / FMT_BENCH_CALLS;
+		}
+
+		uint64_t ml = Median(libc), mf = Median(fmt);
+
+		printf("%-20s %10llu %10llu %7.2fx   [" UNIT "/chiamata]\n", cases[c].name, (unsigned long long) ml, (unsigned long long) mf, mf ? (double) ml / mf : 0.0);
+	}
+
+	// destinatario FIFO: la stessa formattazione dei parametri attraverso una coda di 64 caratteri svuotata quando è piena
+
+	char         queue[64];
+	Fifo_TypeDef fifo;
+
+	ch_fifo_init(&fifo, queue, sizeof(queue));
+
+	for (int r = 0; r < FMT_BENCH_ROUNDS; r++)
+	{
+		FmtSink_TypeDef sink;
+
+		uint64_t t0 = Now();
+
+		for (int i = 0; i < FMT_BENCH_CALLS; i++)
+		{
+			Fmt_FifoSink(&sink, &fifo, FifoDrain, &fifo);
+			Fmt_Print(&sink, PARAMS_FMT, PARAMS_ARGS);
+			FifoDrain(&fifo);
+		}
+
+		fmt[r] = (Now() - t0) / FMT_BENCH_CALLS;
+	}
+
+	printf("%-20s %10s %10llu            [" UNIT "/chiamata]\n", "parametri (FIFO)", "-", (unsigned long long) Median(fmt));
+
+	// troncamento: il buffer non viene mai superato ed è sempre terminato
+
+	memset(b, 'x', sizeof(b));
+
+	uint16_t n = Fmt_Snprintf(b, 8, PARAMS_FMT, PARAMS_ARGS);
+
+	if (n != 7 || b[7] != '\0' || b[8] != 'x')
+	{
+		printf("troncamento errato: %u caratteri\n", n);
+		errors++;
+	}
+
+	return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
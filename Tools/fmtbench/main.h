@@ -0,0 +1,23 @@
+/*
+ * main.h
+ *
+ *  Created on:
+ *      Author: Ing. Salvatore Cerami
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ *
+ * Sostituto di Core/Inc/main.h per la compilazione su host di libfmt e libfifo: solo i tipi standard e le
+ * funzioni CMSIS delle sezioni critiche, senza HAL.
+ */
+
+#ifndef __MAIN_H
+#define __MAIN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+static inline uint32_t __get_PRIMASK(void)          { return 0; }
+static inline void     __set_PRIMASK(uint32_t mask) { (void) mask; }
+static inline void     __disable_irq(void)          { }
+
+#endif /* __MAIN_H */
@@ -0,0 +1,231 @@
+/**
+ * @file link_bench.c - https://github.com/SC-Develop/tesysma
+ *
+ * @author Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/SC-Develop/
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ *
+ * Tempi del collegamento seriale col SIM800L alle diverse velocità, calcolati con un modello analitico del modulo:
+ * non emula la macchina a stati del firmware né il collegamento, somma i tempi dei caratteri e delle attese.
+ *
+ * Il modello conta l'eco dei caratteri inviati (ATE0 non è usato) e risposte ai comandi di lunghezza realistica dopo
+ * una latenza fissa di elaborazione. Il tempo di un carattere è di 10 bit (8N1). Per ogni velocità calcola:
+ *
+ *   - la sequenza di inizializzazione di Startup (SIM800L.c): tempo sul filo e tempo totale con l'attesa AT_DELAY
+ *     dopo ogni risposta;
+ *   - l'invio di un SMS di MAX_SMS_LENGTH caratteri: AT+CMGS, una linea per ogni prompt "> ", CTRL-Z e la conferma
+ *     del modulo, senza il tempo della rete GSM.
+ *
+ * AT_DELAY, MAX_SMS_LENGTH e le velocità sono quelli del firmware (SIM800L.def.h); i comandi sono copiati da
+ * SIM800L.c e vanno aggiornati se cambia la sequenza di inizializzazione.
+ * Gli echi del modulo sono inoltrati alla console (USART2 a 115200): oltre quella velocità la console perde
+ * caratteri, il conteggio degli scarti è nelle statistiche della porta (USART_StatsReport).
+ *
+ * Compilazione ed esecuzione, dalla radice del repository:
+ *
+ *   gcc -O2 -ICommon/inc Tools/linkbench/link_bench.c -o link_bench
+ *   ./link_bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "SIM800L.def.h"
+
+// Defines ----------------------------------------------------------------------------------------------------------------------------------
+
+#define MODEM_LATENCY		10		// [msec] elaborazione di un comando nel modulo (stima)
+#define SMS_LINE_LENGTH		32		// linea tipica dell'SMS dei parametri, CRLF compreso
+#define CTRLZ				0x1A
+
+// Types definition ---------------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @struct
+ * @brief risposta del modulo al comando che inizia con prefix
+ */
+typedef struct {
+	const char *prefix;
+	const char *reply;
+} Reply_TypeDef;
+
+/**
+ * @struct
+ * @brief linea seriale tra firmware e modulo: tempo corrente e caratteri trasferiti
+ */
+typedef struct {
+	uint32_t baud;
+	double   now;			// [msec]
+	double   wire;			// [msec] tempo in cui la linea trasferisce caratteri
+	uint32_t commands;
+} Link_TypeDef;
+
+// Variables ------------------------------------------------------------------------------------------------------------------------------
+
+static const uint32_t rates[] = { GSM_BAUD_DEFAULT, 19200, 38400, 57600, GSM_BAUD_TARGET, 230400, 460800 };
+
+static const char *init[] = { // Startup (SIM800L.c): comandi inviati al modulo
+	"AT+CLIP=1\n", "AT+CMGF=1\n", "AT+DDET=1\n", "AT+VTD=10\n", "AT+MORING=0\n", "AT+CALM=1\n", "AT+CRSL=0\n",
+	"AT+CLVL=0\n", "AT+CMIC=0,0\n", "AT+CMIC=1,0\n", "AT+CMIC=2,0\n", "AT+CMIC=3,0\n", "AT+CBC\n", "AT+CPBR=1,3\n",
+	"AT+CGSN\n", "AT+COPS?\n", "AT+CGATT=0\n", "AT+CSQ\n", "AT+CMGD=1,4\n",
+};
+
+static const Reply_TypeDef replies[] = { // risposte del modulo, la prima con il prefisso del comando
+	{ "AT+CPBR", "\r\n+CPBR: 1,\"+393331234567\",145,\"\"\r\n+CPBR: 2,\"+393337654321\",145,\"\"\r\n+CPBR: 3,\"+393339876543\",145,\"\"\r\n\r\nOK\r\n" },
+	{ "AT+CGSN", "\r\n867856030123456\r\n\r\nOK\r\n" },
+	{ "AT+COPS", "\r\n+COPS: 0,0,\"I TIM\"\r\n\r\nOK\r\n" },
+	{ "AT+CSQ",  "\r\n+CSQ: 18,0\r\n\r\nOK\r\n" },
+	{ "AT+CBC",  "\r\n+CBC: 0,87,4087\r\n\r\nOK\r\n" },
+	{ "AT+CMGS", "\r\n> " },
+	{ "",        "\r\nOK\r\n" },
+};
+
+// - Local functions ----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @fn double CharTime(const Link_TypeDef*)
+ * @brief durata di un carattere 8N1 [msec]
+ */
+static double CharTime(const Link_TypeDef *link)
+{
+	return 10000.0 / link->baud;
+}
+
+/**
+ * @fn const char Reply*(const char*)
+ * @brief risposta del modulo al comando
+ */
+static const char *Reply(const char *command)
+{
+	const Reply_TypeDef *r = replies;
+
+	while (strncmp(command, r->prefix, strlen(r->prefix)))
+	{
+		r++;
+	}
+
+	return r->reply;
+}
+
+/**
+ * @fn void Exchange(Link_TypeDef*, size_t, const char*, double)
+ * @brief il firmware invia len caratteri, il modulo li rimanda in eco mentre li riceve e, dopo latency, invia
+ *        reply. Il firmware reagisce all'ultimo carattere della risposta (il task gsm è segnalato dalla ricezione).
+ */
+static void Exchange(Link_TypeDef *link, size_t len, const char *reply, double latency)
+{
+	double tc   = CharTime(link);
+	double sent = len * tc;							// trasmissione: l'eco termina un carattere dopo
+	double ans  = strlen(reply) * tc;
+
+	link->now  += sent + tc + latency + ans;
+	link->wire += sent + tc + ans;
+}
+
+/**
+ * @fn void Command(Link_TypeDef*, const char*)
+ * @brief comando AT completo: scambio, risposta e attesa AT_DELAY del firmware
+ */
+static void Command(Link_TypeDef *link, const char *command)
+{
+	Exchange(link, strlen(command), Reply(command), MODEM_LATENCY);
+
+	link->now += AT_DELAY;
+	link->commands++;
+}
+
+/**
+ * @fn void Sms(Link_TypeDef*, const char*)
+ * @brief invio di un SMS come nello stato GSM_WAITING_FOR_REPLY: una linea per ogni prompt, l'ultima con CTRL-Z
+ */
+static void Sms(Link_TypeDef *link, const char *mess)
+{
+	const char *command = "AT+CMGS=\"+393331234567\"\r\n";
+
+	Exchange(link, strlen(command), Reply(command), MODEM_LATENCY);
+
+	const char *line = mess;
+	const char *next;
+
+	while ((next = strstr(line, "\r\n")))
+	{
+		next += 2;
+
+		Exchange(link, next - line, "\r\n> ", 0);
+
+		line = next;
+	}
+
+	Exchange(link, strlen(line), "\r\n+CMGS: 12\r\n\r\nOK\r\n", MODEM_LATENCY); // ultima linea con CTRL-Z
+
+	link->now += AT_DELAY;
+	link->commands++;
+}
+
+/**
+ * @fn void SmsBody(char*)
+ * @brief SMS di prova di MAX_SMS_LENGTH - 1 caratteri (CTRL-Z compreso), in linee come l'SMS dei parametri
+ */
+static void SmsBody(char *mess)
+{
+	size_t len = 0;
+
+	for (int n = 0; len + SMS_LINE_LENGTH < MAX_SMS_LENGTH - 2; n++)
+	{
+		len += snprintf(mess + len, MAX_SMS_LENGTH - len, "Riga %02d: %-*s\r\n", n, SMS_LINE_LENGTH - 11, "parametro");
+	}
+
+	while (len < MAX_SMS_LENGTH - 2)
+	{
+		mess[len++] = '.';
+	}
+
+	mess[len++] = CTRLZ;
+	mess[len]   = '\0';
+}
+
+// - Main -------------------------------------------------------------------------------------------------------------------------------------
+
+int main(void)
+{
+	char mess[MAX_SMS_LENGTH];
+
+	SmsBody(mess);
+
+	char title[32];
+
+	snprintf(title, sizeof(title), "SMS %d caratteri [ms]", MAX_SMS_LENGTH);
+
+	printf("%8s | %-26s | %-26s | %s\n", "baud", "inizializzazione [ms]", title, "guadagno SMS");
+	printf("%8s | %8s %8s %8s | %8s %8s %8s |\n", "", "filo", "totale", "AT_DELAY", "filo", "totale", "AT_DELAY");
+
+	double base = 0;
+
+	for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+	{
+		Link_TypeDef boot = { .baud = rates[r] };
+		Link_TypeDef sms  = { .baud = rates[r] };
+
+		for (size_t c = 0; c < sizeof(init) / sizeof(init[0]); c++)
+		{
+			Command(&boot, init[c]);
+		}
+
+		Sms(&sms, mess);
+
+		double tsms = sms.now;
+
+		if (!base)
+		{
+			base = tsms;
+		}
+
+		printf("%8lu | %8.1f %8.1f %8u | %8.1f %8.1f %8u | %5.2fx\n", (unsigned long) rates[r], boot.wire, boot.now, AT_DELAY * boot.commands,
+		       sms.wire, tsms, AT_DELAY * sms.commands, base / tsms);
+	}
+
+	printf("\nlatenza del modulo %u ms per comando, rete GSM esclusa\n", MODEM_LATENCY);
+
+	return EXIT_SUCCESS;
+}
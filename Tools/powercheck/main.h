@@ -0,0 +1,75 @@
+/*
+ * main.h
+ *
+ *  Created on:
+ *      Author: Ing. Salvatore Cerami
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ *
+ * Sostituto di Core/Inc/main.h per la compilazione su host di power.c: i registri del SysTick, dello SCB, del DWT,
+ * dell'RTC e dell'EXTI sono simulati da power_check.c, ogni accesso al SysTick passa da SysTick_Access.
+ */
+
+#ifndef __MAIN_H
+#define __MAIN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define UNUSED(X) (void) X
+
+typedef struct {
+	volatile uint32_t CTRL;
+	volatile uint32_t LOAD;
+	volatile uint32_t VAL;
+	volatile uint32_t CALIB;
+} SysTick_Type;
+
+typedef struct {
+	volatile uint32_t ICSR;
+} SCB_Type;
+
+typedef struct {
+	volatile uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct {
+	volatile uint32_t ISR;
+	volatile uint32_t WPR;
+} RTC_Type;
+
+typedef struct {
+	volatile uint32_t PR;
+} EXTI_Type;
+
+#define SysTick_CTRL_ENABLE_Msk		(1UL << 0)
+#define SysTick_CTRL_COUNTFLAG_Msk	(1UL << 16)
+#define SysTick_LOAD_RELOAD_Msk		0xFFFFFFUL
+#define SCB_ICSR_PENDSTCLR_Msk		(1UL << 25)
+#define RTC_ISR_WUTF				(1UL << 10)
+#define EXTI_PR_PR22				(1UL << 22)
+
+SysTick_Type *SysTick_Access(void);
+void          Wfi(void);
+
+extern SCB_Type          scb;
+extern DWT_Type          dwt;
+extern RTC_Type          rtc;
+extern EXTI_Type         exti;
+extern volatile uint32_t uwTick;
+
+#define SysTick		(SysTick_Access())
+#define SCB			(&scb)
+#define DWT			(&dwt)
+#define RTC			(&rtc)
+#define EXTI		(&exti)
+
+static inline void __disable_irq(void) { }
+static inline void __enable_irq(void)  { }
+static inline void __DSB(void)         { }
+static inline void __ISB(void)         { }
+static inline void __WFI(void)         { Wfi(); }
+
+uint32_t HAL_GetTick(void);
+
+#endif /* __MAIN_H */
@@ -0,0 +1,198 @@
+/**
+ * @file power_check.c - https://github.com/SC-Develop/tesysma
+ *
+ * @author Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/SC-Develop/
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ *
+ * Verifica su host della correzione del tick di sistema dopo lo sleep tickless (SleepTickless, power.c).
+ *
+ * Il SysTick è simulato: Power_Idle lo riprogramma, il WFI termina dopo un numero di cicli scelto a caso oppure alla
+ * scadenza del conteggio (COUNTFLAG). Come sul Cortex-M4 il COUNTFLAG si azzera con la prima lettura di CTRL dopo il
+ * risveglio, per cui una seconda lettura non lo vede più. Per entrambi i risvegli verifica:
+ *
+ *   - i tick sommati a uwTick: i confini di tick attraversati durante il sonno, tutti e ms per il sonno completo;
+ *   - la durata del primo periodo dopo il risveglio: il resto del tick in corso, che mantiene la fase;
+ *   - il tempo passato a TimSys_MicrosAdvance.
+ *
+ * Compilazione ed esecuzione, dalla radice del repository:
+ *
+ *   gcc -O2 -ITools/powercheck -ICommon/inc Tools/powercheck/power_check.c Common/Src/power.c -o power_check
+ *   ./power_check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "power.h"
+
+// Defines ----------------------------------------------------------------------------------------------------------------------------------
+
+#define CHECK_CASES			100000		// sonni simulati per ciascun clock
+#define CHECK_SEED			1
+
+// Types definition ---------------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @struct
+ * @brief risultato dei casi di un tipo di risveglio
+ */
+typedef struct {
+	const char *name;
+	uint32_t    cases;
+	uint32_t    errors;
+} Result_TypeDef;
+
+// Variables ------------------------------------------------------------------------------------------------------------------------------
+
+SCB_Type          scb;
+DWT_Type          dwt;
+RTC_Type          rtc;
+EXTI_Type         exti;
+volatile uint32_t uwTick;
+
+static SysTick_Type systick;
+static uint8_t      countflag_read;		// COUNTFLAG visto da un accesso: il successivo lo trova azzerato
+static uint32_t     load_seen;			// LOAD all'inizio dell'ultimo accesso
+static uint32_t     wake_cycles;		// cicli di sonno prima dell'interrupt, oltre il reload risveglia il SysTick
+static uint32_t     next_deadline;
+static uint64_t     micros;
+
+static const uint32_t clocks[] = { 25000000, 6250000 }; // profili CLOCK_DEFAULT e CLOCK_LOW_POWER (clock.h)
+
+// - Firmware stubs -----------------------------------------------------------------------------------------------------------------------
+
+SysTick_Type *SysTick_Access(void)
+{
+	if (countflag_read)
+	{
+		systick.CTRL  &= ~SysTick_CTRL_COUNTFLAG_Msk;
+		countflag_read = 0;
+	}
+
+	countflag_read = (systick.CTRL & SysTick_CTRL_COUNTFLAG_Msk) != 0;
+	load_seen      = systick.LOAD;
+
+	return &systick;
+}
+
+void Wfi(void)
+{
+	uint32_t reload = systick.LOAD; // VAL azzerato da SleepTickless: il conteggio parte da LOAD
+
+	if (wake_cycles >= reload)
+	{
+		systick.VAL   = reload;
+		systick.CTRL |= SysTick_CTRL_COUNTFLAG_Msk;
+	}
+	else
+	{
+		systick.VAL = reload - wake_cycles;
+	}
+}
+
+uint32_t HAL_GetTick(void)            { return uwTick; }
+uint32_t TimSys_NextDeadline(void)    { return next_deadline; }
+void     TimSys_MicrosAdvance(uint64_t us) { micros += us; }
+uint32_t Clock_RunCurrent(void)       { return 0; }
+uint32_t Clock_SleepCurrent(void)     { return 0; }
+
+// - Local functions ----------------------------------------------------------------------------------------------------------------------
+
+static uint32_t Random(uint32_t n)
+{
+	return (((uint32_t) rand() << 16) ^ (uint32_t) rand()) % n;
+}
+
+/**
+ * @fn uint8_t Sleep(uint32_t, uint32_t, uint32_t, uint8_t)
+ * @brief un sonno simulato confrontato con il modello dei confini di tick
+ *
+ * @param tpm    cicli per tick
+ * @param phase  cicli mancanti al prossimo tick all'ingresso
+ * @param ms     sonno richiesto
+ * @param full   1 risveglio dal SysTick, 0 da un altro interrupt
+ * @return 1 se corretto
+ */
+static uint8_t Sleep(uint32_t tpm, uint32_t phase, uint32_t ms, uint8_t full)
+{
+	uint32_t reload = phase + (ms - 1) * tpm;
+
+	systick.LOAD   = tpm - 1;
+	systick.VAL    = phase;
+	systick.CTRL   = SysTick_CTRL_ENABLE_Msk;
+	countflag_read = 0;
+
+	wake_cycles   = full ? reload : Random(reload);
+	next_deadline = ms;
+	micros        = 0;
+
+	uint32_t tick = uwTick;
+
+	Power_Idle(0);
+
+	uint32_t counted   = full ? reload : wake_cycles;
+	uint32_t ticks     = (counted < phase) ? 0 : 1 + (counted - phase) / tpm;	// confini a phase, phase + tpm, ...
+	uint32_t remainder = phase + ticks * tpm - counted;						// cicli al prossimo confine, in (0, tpm]
+
+	uint8_t ok = uwTick - tick == ticks
+	          && load_seen + 1 == remainder
+	          && systick.LOAD == tpm - 1
+	          && micros == (uint64_t) counted * 1000 / tpm;
+
+	if (full && uwTick - tick != ms)
+	{
+		ok = 0;
+	}
+
+	if (!ok)
+	{
+		printf("  errore: tpm %u, fase %u, ms %u, cicli %u: tick %u (atteso %u), primo periodo %u (atteso %u)\n",
+		       tpm, phase, ms, counted, uwTick - tick, ticks, load_seen + 1, remainder);
+	}
+
+	return ok;
+}
+
+// - Main -------------------------------------------------------------------------------------------------------------------------------------
+
+int main(void)
+{
+	Result_TypeDef results[2] = { { .name = "interrupt" }, { .name = "SysTick" } };
+
+	srand(CHECK_SEED);
+
+	uwTick = 0xFFFFFF00; // attraversa il wrap di HAL_GetTick
+
+	for (uint32_t c = 0; c < sizeof(clocks) / sizeof(clocks[0]); c++)
+	{
+		uint32_t tpm    = clocks[c] / 1000;
+		uint32_t max_ms = SysTick_LOAD_RELOAD_Msk / tpm;
+
+		for (uint32_t i = 0; i < CHECK_CASES; i++)
+		{
+			uint8_t  full  = i & 1;
+			uint32_t phase = 1 + Random(tpm - 1);
+			uint32_t ms    = POWER_TICKLESS_MIN + Random(max_ms - POWER_TICKLESS_MIN); // entro il limite di SleepTickless
+
+			Result_TypeDef *r = &results[full];
+
+			r->cases++;
+
+			if (!Sleep(tpm, phase, ms, full) && ++r->errors > 5)
+			{
+				break;
+			}
+		}
+	}
+
+	uint32_t errors = 0;
+
+	for (uint8_t i = 0; i < 2; i++)
+	{
+		printf("risveglio da %-9s  casi %7u  errori %u\n", results[i].name, results[i].cases, results[i].errors);
+
+		errors += results[i].errors;
+	}
+
+	return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,18 @@
+/*
+ * main.h
+ *
+ *  Created on:
+ *      Author: Ing. Salvatore Cerami
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ *
+ * Sostituto di Core/Inc/main.h per la compilazione su host di alarm_rules.c: solo i tipi standard, senza HAL.
+ */
+
+#ifndef __MAIN_H
+#define __MAIN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#endif /* __MAIN_H */
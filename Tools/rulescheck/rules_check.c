@@ -0,0 +1,143 @@
+/**
+ * @file rules_check.c - https://github.com/SC-Develop/tesysma
+ *
+ * @author Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/SC-Develop/
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ *
+ * Verifica su host della pendenza stimata dalle regole di allarme (Rules_Slope, alarm_rules.c).
+ *
+ * Simula per CHECK_HOURS ore una rampa di temperatura con un piccolo rumore di misura, per ciascun passo di
+ * campionamento e partendo da un tick vicino al wrap di HAL_GetTick. A ogni campione confronta la pendenza del
+ * firmware con la regressione calcolata in double sugli stessi campioni della finestra.
+ *
+ * Compilazione ed esecuzione, dalla radice del repository:
+ *
+ *   gcc -O2 -ITools/rulescheck -ICommon/inc Tools/rulescheck/rules_check.c Common/Src/alarm_rules.c -o rules_check
+ *   ./rules_check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "alarm_rules.h"
+
+// Defines ----------------------------------------------------------------------------------------------------------------------------------
+
+#define CHECK_HOURS			8
+#define CHECK_RAMP			0.06		// pendenza della rampa [°C/min]
+#define CHECK_NOISE			0.02		// ampiezza del rumore di misura [°C]
+#define CHECK_TOLERANCE		0.005		// scarto massimo dalla regressione in double [°C/min]
+#define CHECK_SEED			1
+
+// Variables ------------------------------------------------------------------------------------------------------------------------------
+
+static const uint32_t steps[] = { 1000, 10000, 300000 }; // passo di campionamento [msec], da SAMPLING_TIME_MIN
+
+static const AlarmRulesConfig_TypeDef config = {
+	.low      = -100,
+	.low_hyst = 1,
+	.horizon  = 0,
+};
+
+static double   x_hist[RULES_HISTORY_SIZE]; // finestra di riferimento
+static double   y_hist[RULES_HISTORY_SIZE];
+static uint32_t n_hist;
+
+// - Local functions ----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @fn double Reference(double, double)
+ * @brief aggiunge il campione alla finestra di riferimento e calcola la regressione in double
+ *
+ * @return [°C/min]
+ */
+static double Reference(double x, double y)
+{
+	x_hist[n_hist % RULES_HISTORY_SIZE] = x;
+	y_hist[n_hist % RULES_HISTORY_SIZE] = y;
+	n_hist++;
+
+	uint32_t n  = (n_hist < RULES_HISTORY_SIZE) ? n_hist : RULES_HISTORY_SIZE;
+	double   mx = 0, my = 0, sxx = 0, sxy = 0;
+
+	if (n < RULES_MIN_SAMPLES)
+	{
+		return 0;
+	}
+
+	for (uint32_t i = 0; i < n; i++)
+	{
+		mx += x_hist[i];
+		my += y_hist[i];
+	}
+
+	mx /= n;
+	my /= n;
+
+	for (uint32_t i = 0; i < n; i++)
+	{
+		sxx += (x_hist[i] - mx) * (x_hist[i] - mx);
+		sxy += (x_hist[i] - mx) * (y_hist[i] - my);
+	}
+
+	return sxy / sxx * 60;
+}
+
+/**
+ * @fn uint32_t Ramp(uint32_t)
+ * @brief una rampa campionata con il passo indicato
+ *
+ * @return numero di campioni fuori tolleranza
+ */
+static uint32_t Ramp(uint32_t step)
+{
+	uint32_t samples = CHECK_HOURS * 3600000u / step;
+	uint32_t tick    = 0xFFFFFFFFu - samples / 2 * step; // attraversa il wrap di HAL_GetTick a metà prova
+	uint32_t errors  = 0;
+	double   worst   = 0;
+
+	Rules_Reset();
+	n_hist = 0;
+
+	for (uint32_t i = 0; i < samples; i++, tick += step)
+	{
+		double x    = (double) i * step / 1000;
+		float  temp = (float) (20 + CHECK_RAMP * x / 60 + CHECK_NOISE * (2.0 * rand() / RAND_MAX - 1));
+
+		Rules_Exec(&config, temp, tick);
+
+		double ref  = Reference(x, temp);
+		double diff = fabs(Rules_Slope() - ref);
+
+		if (diff > worst)
+		{
+			worst = diff;
+		}
+
+		if (diff > CHECK_TOLERANCE && ++errors <= 5)
+		{
+			printf("  errore: passo %u ms, campione %u: pendenza %.4f, attesa %.4f °C/min\n", step, i, Rules_Slope(), ref);
+		}
+	}
+
+	printf("passo %6u ms  campioni %6u  scarto massimo %.6f °C/min  errori %u\n", step, samples, worst, errors);
+
+	return errors;
+}
+
+// - Main -------------------------------------------------------------------------------------------------------------------------------------
+
+int main(void)
+{
+	uint32_t errors = 0;
+
+	srand(CHECK_SEED);
+
+	for (uint32_t s = 0; s < sizeof(steps) / sizeof(steps[0]); s++)
+	{
+		errors += Ramp(steps[s]);
+	}
+
+	return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
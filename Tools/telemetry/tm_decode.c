@@ -0,0 +1,440 @@
+/**
+ * @file tm_decode.c - https://github.com/SC-Develop/tesysma
+ *
+ * @author Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/SC-Develop/
+ *
+ * @copyright (c) 2023 (MIT) Ing. Salvatore Cerami - dev.salvatore.cerami@gmail.com - https://github.com/sc-develop/
+ *
+ * Decodificatore su host della telemetria binaria di USART2 (telemetry.def.h): legge il flusso catturato dalla
+ * seriale, separa le trame COBS, verifica CRC e versione e scrive un record per riga in CSV o in JSON (una riga JSON
+ * per record).
+ *
+ * Il testo della console trasmesso tra le trame è scartato e contato, anche quando è racchiuso tra due delimitatori:
+ * una trama con CRC errato è contata come tale solo se l'intestazione è plausibile (versione, tipo, lunghezza) e i
+ * suoi byte non sono testo. I record persi (coda di trasmissione piena sul firmware o trame corrotte) sono rilevati
+ * dai salti della sequenza. Un riavvio del firmware, che riparte dalla sequenza 0 e dal tempo 0, è contato a parte e
+ * non come record persi. Il riepilogo è scritto su stderr.
+ *
+ * Colonne CSV: seq, tempo_us, tipo, poi i campi del tipo:
+ *
+ *   adc       canale, n, n conversioni
+ *   temp      temperatura, intervallo_ms
+ *   gsm       da, a, comando
+ *   parser    risposta, stato
+ *   profile   sonda, count, min_ns, max_ns, last_ns, sum_ns
+ *
+ * Compilazione ed esecuzione, dalla radice del repository:
+ *
+ *   gcc -O2 -ICommon/inc Tools/telemetry/tm_decode.c -o tm_decode
+ *   stty -F /dev/ttyUSB0 115200 raw && ./tm_decode < /dev/ttyUSB0
+ *   ./tm_decode -j cattura.bin > cattura.json
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "telemetry.def.h"
+#include "timsys.def.h"
+
+// Types definition ---------------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @struct
+ * @brief contatori del flusso decodificato
+ */
+typedef struct {
+	uint32_t records;		// record validi
+	uint32_t crc;			// trame con intestazione plausibile e CRC errato
+	uint32_t invalid;		// CRC corretto ma versione o tipo sconosciuti, lunghezza errata
+	uint32_t lost;			// record mancanti nella sequenza
+	uint32_t restarts;		// riavvii del firmware: sequenza ripartita da 0 o tempo all'indietro
+	uint32_t text;			// byte che non formano una trama (testo della console)
+} Counters_TypeDef;
+
+/**
+ * @struct
+ * @brief lettura dei campi little endian di un record
+ */
+typedef struct {
+	const uint8_t *data;
+	size_t         len;
+	size_t         pos;
+} Reader_TypeDef;
+
+// Variables ------------------------------------------------------------------------------------------------------------------------------
+
+static const char *types[TM_TYPES] = { "adc", "temp", "gsm", "parser", "profile" };
+
+static const char *probes[PROF_PROBES] = TIMSYS_PROBE_NAMES;
+
+static const char *gsm_states[] = { // GSMStatus_TypeDef (SIM800L.h): va aggiornato se cambia l'enumerazione
+	"WAITING_FOR_READY", "WAITING_FOR_IDLE", "IDLE", "SEND_AT_COMMAND", "WAITING_FOR_REPLY", "CALL_IN_PROGRESS",
+	"CALL_ANSWERED", "ERROR",
+};
+
+#define GSM_STATES (sizeof(gsm_states) / sizeof(gsm_states[0]))
+
+static Counters_TypeDef counters;
+
+static int json;
+
+// - Local functions ----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @fn uint16_t Crc16(const uint8_t*, size_t)
+ * @brief CRC-16/CCITT-FALSE, come telemetry.c
+ */
+static uint16_t Crc16(const uint8_t *data, size_t len)
+{
+	uint16_t crc = 0xFFFF;
+
+	while (len--)
+	{
+		crc ^= (uint16_t) *data++ << 8;
+
+		for (int i = 0; i < 8; i++)
+		{
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+		}
+	}
+
+	return crc;
+}
+
+/**
+ * @fn size_t Cobs(const uint8_t*, size_t, uint8_t*)
+ * @brief decodifica COBS di una trama senza delimitatori
+ * @return lunghezza decodificata, 0 se la codifica non è valida
+ */
+static size_t Cobs(const uint8_t *src, size_t len, uint8_t *dst)
+{
+	size_t out = 0;
+
+	for (size_t i = 0; i < len; )
+	{
+		uint8_t code = src[i++];
+
+		if (code == 0 || i + code - 1 > len)
+		{
+			return 0;
+		}
+
+		for (uint8_t k = 1; k < code; k++)
+		{
+			dst[out++] = src[i++];
+		}
+
+		if (code < 0xFF && i < len)
+		{
+			dst[out++] = 0;
+		}
+	}
+
+	return out;
+}
+
+static uint32_t Get(Reader_TypeDef *r, int bytes)
+{
+	uint32_t value = 0;
+
+	for (int i = 0; i < bytes; i++)
+	{
+		value |= (uint32_t) r->data[r->pos++] << (8 * i);
+	}
+
+	return value;
+}
+
+static uint64_t Get64(Reader_TypeDef *r)
+{
+	uint64_t low = Get(r, 4);
+
+	return low | ((uint64_t) Get(r, 4) << 32);
+}
+
+static float GetFloat(Reader_TypeDef *r)
+{
+	uint32_t bits = Get(r, 4);
+	float    value;
+
+	memcpy(&value, &bits, sizeof(value));
+
+	return value;
+}
+
+static const char *GsmState(uint32_t state)
+{
+	return (state < GSM_STATES) ? gsm_states[state] : "?";
+}
+
+/**
+ * @fn size_t PayloadSize(uint8_t, const uint8_t*, size_t)
+ * @brief lunghezza attesa dei dati del tipo, 0 se il tipo è sconosciuto
+ */
+static size_t PayloadSize(uint8_t type, const uint8_t *payload, size_t len)
+{
+	switch (type)
+	{
+		case TM_ADC:     return (len >= 2) ? 2 + 2 * (size_t) payload[1] : 2;
+		case TM_TEMP:    return 8;
+		case TM_GSM:     return 3;
+		case TM_PARSER:  return 2;
+		case TM_PROFILE: return 25;
+	}
+
+	return 0;
+}
+
+/**
+ * @fn void Print(const uint8_t*, size_t)
+ * @brief scrive un record valido in CSV o JSON
+ */
+static void Print(const uint8_t *record, size_t len)
+{
+	Reader_TypeDef r = { .data = record, .len = len, .pos = 1 };
+
+	uint8_t  type = Get(&r, 1);
+	uint32_t seq  = Get(&r, 2);
+	uint32_t time = Get(&r, 4);
+
+	if (json)
+	{
+		printf("{\"seq\":%u,\"tempo_us\":%u,\"tipo\":\"%s\"", seq, time, types[type]);
+	}
+	else
+	{
+		printf("%u,%u,%s", seq, time, types[type]);
+	}
+
+	switch (type)
+	{
+		case TM_ADC:
+		{
+			uint32_t channel = Get(&r, 1);
+			uint32_t n       = Get(&r, 1);
+
+			json ? printf(",\"canale\":%u,\"conversioni\":[", channel) : printf(",%u,%u", channel, n);
+
+			for (uint32_t i = 0; i < n; i++)
+			{
+				json ? printf("%s%u", i ? "," : "", Get(&r, 2)) : printf(",%u", Get(&r, 2));
+			}
+
+			if (json)
+			{
+				printf("]");
+			}
+		}
+		break;
+
+		case TM_TEMP:
+		{
+			float    temp     = GetFloat(&r);
+			uint32_t interval = Get(&r, 4);
+
+			json ? printf(",\"temperatura\":%.2f,\"intervallo_ms\":%u", temp, interval) : printf(",%.2f,%u", temp, interval);
+		}
+		break;
+
+		case TM_GSM:
+		{
+			uint32_t from    = Get(&r, 1);
+			uint32_t to      = Get(&r, 1);
+			uint32_t command = Get(&r, 1);
+
+			json ? printf(",\"da\":\"%s\",\"a\":\"%s\",\"comando\":%u", GsmState(from), GsmState(to), command)
+			     : printf(",%s,%s,%u", GsmState(from), GsmState(to), command);
+		}
+		break;
+
+		case TM_PARSER:
+		{
+			uint32_t reply  = Get(&r, 1);
+			uint32_t status = Get(&r, 1);
+
+			json ? printf(",\"risposta\":%u,\"stato\":\"%s\"", reply, GsmState(status)) : printf(",%u,%s", reply, GsmState(status));
+		}
+		break;
+
+		case TM_PROFILE:
+		{
+			uint32_t id    = Get(&r, 1);
+			uint32_t count = Get(&r, 4);
+			uint32_t min   = Get(&r, 4);
+			uint32_t max   = Get(&r, 4);
+			uint32_t last  = Get(&r, 4);
+			uint64_t sum   = Get64(&r);
+
+			const char *name = (id < PROF_PROBES) ? probes[id] : "?";
+
+			json ? printf(",\"sonda\":\"%s\",\"count\":%u,\"min_ns\":%u,\"max_ns\":%u,\"last_ns\":%u,\"sum_ns\":%llu", name, count, min, max, last, (unsigned long long) sum)
+			     : printf(",%s,%u,%u,%u,%u,%llu", name, count, min, max, last, (unsigned long long) sum);
+		}
+		break;
+	}
+
+	printf(json ? "}\n" : "\n");
+}
+
+/**
+ * @fn int Text(const uint8_t*, size_t)
+ * @brief 1 se i byte sono testo della console: caratteri stampabili, CR, LF, TAB o UTF-8. Una trama COBS contiene
+ *        quasi sempre codici di blocco minori di 0x20.
+ */
+static int Text(const uint8_t *data, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+	{
+		if (data[i] < 0x20 && data[i] != '\r' && data[i] != '\n' && data[i] != '\t')
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * @fn void Frame(const uint8_t*, size_t)
+ * @brief trama completa, senza delimitatori: decodifica, verifica e stampa
+ */
+static void Frame(const uint8_t *frame, size_t len)
+{
+	static int      first = 1;
+	static uint16_t next;
+	static uint32_t last_time;
+
+	uint8_t record[TM_FRAME_MAX];
+
+	size_t n = Cobs(frame, len, record);
+
+	if (n < TM_HEADER_SIZE + TM_CRC_SIZE) // non COBS o troppo corta: testo della console
+	{
+		counters.text += len;
+		return;
+	}
+
+	n -= TM_CRC_SIZE;
+
+	uint8_t  type = record[1];
+	uint16_t seq  = record[2] | record[3] << 8;
+	uint32_t time = record[4] | record[5] << 8 | record[6] << 16 | (uint32_t) record[7] << 24;
+
+	int header = record[0] == TM_VERSION && type < TM_TYPES
+	          && PayloadSize(type, record + TM_HEADER_SIZE, n - TM_HEADER_SIZE) == n - TM_HEADER_SIZE;
+
+	if (Crc16(record, n) != (uint16_t) (record[n] | record[n + 1] << 8))
+	{
+		if (header && !Text(frame, len))
+		{
+			counters.crc++; // trama corrotta
+		}
+		else
+		{
+			counters.text += len; // testo tra due delimitatori che si decodifica come COBS
+		}
+
+		return;
+	}
+
+	if (!header)
+	{
+		counters.invalid++;
+		return;
+	}
+
+	if (!first)
+	{
+		if ((seq == 0 && next != 0) || (int32_t) (time - last_time) < 0) // il wrap del tempo non è un salto all'indietro
+		{
+			counters.restarts++; // la sequenza riparte: nessun record perso
+		}
+		else
+		{
+			counters.lost += (uint16_t) (seq - next);
+		}
+	}
+
+	first     = 0;
+	next      = seq + 1;
+	last_time = time;
+
+	counters.records++;
+
+	Print(record, n);
+}
+
+// - Main -------------------------------------------------------------------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+	FILE *in   = stdin;
+	int   args = 1;
+
+	if (args < argc && strcmp(argv[args], "-j") == 0)
+	{
+		json = 1;
+		args++;
+	}
+
+	if (args < argc)
+	{
+		in = fopen(argv[args], "rb");
+
+		if (!in)
+		{
+			perror(argv[args]);
+
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!json)
+	{
+		printf("seq,tempo_us,tipo,campi\n");
+	}
+
+	uint8_t buffer[TM_FRAME_MAX];
+	size_t  len  = 0;
+	int     skip = 0; // più lungo di una trama: testo, scartato fino al prossimo zero
+	int     ch;
+
+	while ((ch = fgetc(in)) != EOF)
+	{
+		if (ch == 0)
+		{
+			if (len && !skip)
+			{
+				Frame(buffer, len);
+			}
+
+			len  = 0;
+			skip = 0;
+
+			continue;
+		}
+
+		if (skip || len == sizeof(buffer))
+		{
+			counters.text += skip ? 1 : len + 1;
+			skip = 1;
+
+			continue;
+		}
+
+		buffer[len++] = ch;
+	}
+
+	if (len && !skip) // coda del flusso senza delimitatore: testo della console
+	{
+		counters.text += len;
+	}
+
+	fflush(stdout);
+
+	fprintf(stderr, "record %u, errori CRC %u, trame non valide %u, record persi %u, riavvii %u, byte di testo %u\n",
+	        counters.records, counters.crc, counters.invalid, counters.lost, counters.restarts, counters.text);
+
+	return EXIT_SUCCESS;
+}